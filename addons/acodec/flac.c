@@ -46,6 +46,12 @@ typedef struct FLACFILE {
 
    ALLEGRO_FILE *fh;
    uint64_t loop_start, loop_end; /* in samples */
+
+   /* While the stream is being fed from the cache, the decoder is left
+    * where it was until the cache runs out.
+    */
+   _AL_ACODEC_CACHE *cache;
+   bool decoder_behind;
 } FLACFILE;
 
 
@@ -360,6 +366,8 @@ static double flac_stream_get_position(ALLEGRO_AUDIO_STREAM *stream)
 }
 
 
+static bool real_seek(ALLEGRO_AUDIO_STREAM *stream, uint64_t sample);
+
 /*
  *  Updates 'stream' with the next chunk of data.
  *  Returns the actual number of bytes written.
@@ -385,6 +393,18 @@ static size_t flac_stream_update(ALLEGRO_AUDIO_STREAM *stream, void *data,
    }
 
    while (wanted_samples > 0) {
+      if (ff->decoder_behind) {
+         read_samples = _al_acodec_cache_read(ff->cache, ff->streamed_samples,
+            (uint8_t *)data + written_bytes, wanted_samples);
+         if (read_samples > 0) {
+            ff->streamed_samples += read_samples;
+            wanted_samples -= read_samples;
+            written_bytes += read_samples * bytes_per_sample;
+            continue;
+         }
+         real_seek(stream, ff->streamed_samples);
+      }
+
       read_samples = ff->decoded_samples - ff->streamed_samples;
 
       /* If the buffer size is small, we shouldn't read a new frame or our
@@ -401,11 +421,13 @@ static size_t flac_stream_update(ALLEGRO_AUDIO_STREAM *stream, void *data,
 
       if (read_samples > wanted_samples)
          read_samples = wanted_samples;
-      ff->streamed_samples += read_samples;
-      wanted_samples -= read_samples;
       read_bytes = read_samples * bytes_per_sample;
       /* Copy data from the FLAC file buffer to the stream buffer. */
       memcpy((uint8_t *)data + written_bytes, ff->buffer, read_bytes);
+      _al_acodec_cache_store(ff->cache, ff->streamed_samples,
+         (uint8_t *)data + written_bytes, read_samples);
+      ff->streamed_samples += read_samples;
+      wanted_samples -= read_samples;
       /* Make room in the FLACFILE buffer. */
       memmove(ff->buffer, ff->buffer + read_bytes,
          ff->buffer_pos - read_bytes);
@@ -424,6 +446,7 @@ static void flac_stream_close(ALLEGRO_AUDIO_STREAM *stream)
 
    al_fclose(ff->fh);
    al_free(ff->buffer);
+   _al_acodec_destroy_cache(ff->cache);
    flac_close(ff);
 }
 
@@ -442,6 +465,22 @@ static bool real_seek(ALLEGRO_AUDIO_STREAM *stream, uint64_t sample)
    ff->buffer_pos = 0;
    ff->streamed_samples = sample;
    ff->decoded_samples = sample;
+   ff->decoder_behind = false;
+   return true;
+}
+
+/* Seeks without touching the decoder if the cache has the sample. */
+static bool cached_seek(ALLEGRO_AUDIO_STREAM *stream, uint64_t sample)
+{
+   FLACFILE *ff = stream->extra;
+
+   if (!_al_acodec_cache_seek(ff->cache, sample))
+      return real_seek(stream, sample);
+
+   ff->buffer_pos = 0;
+   ff->streamed_samples = sample;
+   ff->decoded_samples = sample;
+   ff->decoder_behind = true;
    return true;
 }
 
@@ -449,13 +488,13 @@ static bool flac_stream_seek(ALLEGRO_AUDIO_STREAM *stream, double time)
 {
    FLACFILE *ff = stream->extra;
    uint64_t sample = time * ff->sample_rate;
-   return real_seek(stream, sample);
+   return cached_seek(stream, sample);
 }
 
 static bool flac_stream_rewind(ALLEGRO_AUDIO_STREAM *stream)
 {
    FLACFILE *ff = stream->extra;
-   return real_seek(stream, ff->loop_start);
+   return cached_seek(stream, ff->loop_start);
 }
 
 static double flac_stream_get_length(ALLEGRO_AUDIO_STREAM *stream)
@@ -621,6 +660,8 @@ ALLEGRO_AUDIO_STREAM *_al_load_flac_audio_stream_f(ALLEGRO_FILE* f,
       stream->extra = ff;
       ff->loop_start = 0;
       ff->loop_end = ff->total_samples;
+      ff->cache = _al_acodec_create_cache(ff->sample_size * ff->channels);
+      _al_acodec_cache_seek(ff->cache, 0);
       stream->feeder = flac_stream_update;
       stream->unload_feeder = flac_stream_close;
       stream->rewind_feeder = flac_stream_rewind;
@@ -3,34 +3,308 @@
 #include "allegro5/internal/aintern.h"
 #include "allegro5/internal/aintern_audio.h"
 #include "allegro5/internal/aintern_system.h"
+#include "allegro5/internal/aintern_vector.h"
 #include "helper.h"
 
+/* Default for the [audio] stream_cache_kbytes config option. */
+#define DEFAULT_CACHE_KBYTES  0
+/* Seeking to many different places mostly leaves empty blocks behind. */
+#define MAX_CACHE_BLOCKS      16
+
+/* A run of decoded frames starting at some position in the stream. */
+typedef struct CACHE_BLOCK {
+   uint64_t start;
+   size_t frames;
+   size_t capacity;
+   unsigned int last_used;
+   char *data;
+} CACHE_BLOCK;
+
+/* Decoded audio around the places a stream seeks to, such as its loop
+ * start, so that seeking there again doesn't need the decoder to seek and
+ * decode the same frames over again. Every seek starts recording what's
+ * decoded from there on into a block, up to half the cache size. When the
+ * cache is full, the least recently used blocks go first.
+ *
+ * A stream's feeder and seek functions are never called at the same time,
+ * so there's no locking.
+ */
+struct _AL_ACODEC_CACHE {
+   size_t frame_size;
+   size_t max_bytes;
+   size_t max_block_frames;
+   size_t used_bytes;
+   _AL_VECTOR blocks;
+   CACHE_BLOCK *recording;
+   unsigned int clock;
+};
+
 void _al_acodec_start_feed_thread(ALLEGRO_AUDIO_STREAM *stream)
 {
-   stream->feed_thread = al_create_thread(_al_kcm_feed_stream, stream);
-   stream->feed_thread_started_cond = al_create_cond();
-   stream->feed_thread_started_mutex = al_create_mutex();
-   al_start_thread(stream->feed_thread);
+   _al_kcm_start_stream_feeder(stream);
 }
 
 void _al_acodec_stop_feed_thread(ALLEGRO_AUDIO_STREAM *stream)
 {
-   ALLEGRO_EVENT quit_event;
+   _al_kcm_stop_stream_feeder(stream);
+}
+
+
+/* _al_acodec_create_cache:
+ *  Creates a cache for a stream with frames of the given size, or returns
+ *  NULL if caching is disabled. All the cache functions accept NULL.
+ */
+_AL_ACODEC_CACHE *_al_acodec_create_cache(size_t frame_size)
+{
+   const char *value = al_get_config_value(al_get_system_config(), "audio",
+      "stream_cache_kbytes");
+   long kbytes = DEFAULT_CACHE_KBYTES;
+   _AL_ACODEC_CACHE *cache;
+
+   if (value && value[0] != '\0')
+      kbytes = strtol(value, NULL, 10);
+   if (kbytes <= 0 || frame_size == 0)
+      return NULL;
+
+   cache = al_calloc(1, sizeof(*cache));
+   if (!cache)
+      return NULL;
+
+   cache->frame_size = frame_size;
+   cache->max_bytes = (size_t)kbytes * 1024;
+   cache->max_block_frames = cache->max_bytes / 2 / frame_size;
+   _al_vector_init(&cache->blocks, sizeof(CACHE_BLOCK));
+   return cache;
+}
+
+
+/* _al_acodec_destroy_cache:
+ */
+void _al_acodec_destroy_cache(_AL_ACODEC_CACHE *cache)
+{
+   unsigned int i;
+
+   if (!cache)
+      return;
+
+   for (i = 0; i < _al_vector_size(&cache->blocks); i++) {
+      CACHE_BLOCK *block = _al_vector_ref(&cache->blocks, i);
+      al_free(block->data);
+   }
+   _al_vector_free(&cache->blocks);
+   al_free(cache);
+}
+
+
+static CACHE_BLOCK *find_block(_AL_ACODEC_CACHE *cache, uint64_t frame)
+{
+   unsigned int i;
+
+   for (i = 0; i < _al_vector_size(&cache->blocks); i++) {
+      CACHE_BLOCK *block = _al_vector_ref(&cache->blocks, i);
+      if (frame >= block->start && frame < block->start + block->frames)
+         return block;
+   }
+
+   return NULL;
+}
+
+
+/* Returns the start of the first block after `frame', or UINT64_MAX. */
+static uint64_t next_block_start(_AL_ACODEC_CACHE *cache, uint64_t frame)
+{
+   uint64_t next = UINT64_MAX;
+   unsigned int i;
+
+   for (i = 0; i < _al_vector_size(&cache->blocks); i++) {
+      CACHE_BLOCK *block = _al_vector_ref(&cache->blocks, i);
+      if (block->start > frame && block->start < next)
+         next = block->start;
+   }
+
+   return next;
+}
+
+
+/* Frees the least recently used block other than the one being recorded.
+ * Returns false if there's none.
+ */
+static bool evict_block(_AL_ACODEC_CACHE *cache)
+{
+   CACHE_BLOCK *victim = NULL;
+   unsigned int i;
+
+   for (i = 0; i < _al_vector_size(&cache->blocks); i++) {
+      CACHE_BLOCK *block = _al_vector_ref(&cache->blocks, i);
+      if (block != cache->recording &&
+            (!victim || block->last_used < victim->last_used)) {
+         victim = block;
+      }
+   }
+
+   if (!victim)
+      return false;
+
+   cache->used_bytes -= victim->capacity * cache->frame_size;
+   al_free(victim->data);
+
+   /* Deleting moves the blocks after it down by one. */
+   if (cache->recording > victim)
+      cache->recording--;
+   _al_vector_delete_at(&cache->blocks,
+      victim - (CACHE_BLOCK *)_al_vector_ref(&cache->blocks, 0));
+   return true;
+}
+
+
+/* _al_acodec_cache_seek:
+ *  To be called when the stream seeks to `frame'. Returns true if that frame
+ *  is cached, in which case the decoder needn't seek until the frames which
+ *  _al_acodec_cache_read returns run out. Otherwise the frames decoded from
+ *  there on are going to be passed to _al_acodec_cache_store.
+ */
+bool _al_acodec_cache_seek(_AL_ACODEC_CACHE *cache, uint64_t frame)
+{
+   CACHE_BLOCK *block;
+   unsigned int i;
+
+   if (!cache)
+      return false;
+
+   block = find_block(cache, frame);
+   if (block) {
+      block->last_used = ++cache->clock;
+      cache->recording = block;
+      return true;
+   }
+
+   /* Carry on with a block that ends where we're going. */
+   for (i = 0; i < _al_vector_size(&cache->blocks); i++) {
+      block = _al_vector_ref(&cache->blocks, i);
+      if (block->start + block->frames == frame) {
+         block->last_used = ++cache->clock;
+         cache->recording = block;
+         return false;
+      }
+   }
+
+   cache->recording = NULL;
+   if (_al_vector_size(&cache->blocks) >= MAX_CACHE_BLOCKS &&
+         !evict_block(cache)) {
+      return false;
+   }
+
+   block = _al_vector_alloc_back(&cache->blocks);
+   if (!block)
+      return false;
+   memset(block, 0, sizeof(*block));
+   block->start = frame;
+   block->last_used = ++cache->clock;
+   cache->recording = block;
+   return false;
+}
+
+
+/* _al_acodec_cache_read:
+ *  Copies up to `frames' cached frames from `frame' on into `buf'. Returns
+ *  the number copied, which is 0 if `frame' isn't cached.
+ */
+size_t _al_acodec_cache_read(_AL_ACODEC_CACHE *cache, uint64_t frame,
+   void *buf, size_t frames)
+{
+   CACHE_BLOCK *block;
+   size_t offset;
+
+   if (!cache)
+      return 0;
+
+   block = find_block(cache, frame);
+   if (!block)
+      return 0;
+
+   offset = (size_t)(frame - block->start);
+   if (frames > block->frames - offset)
+      frames = block->frames - offset;
+
+   memcpy(buf, block->data + offset * cache->frame_size,
+      frames * cache->frame_size);
+   block->last_used = ++cache->clock;
+
+   /* If the decoder takes over at the end, keep adding to this block. */
+   cache->recording = block;
+   return frames;
+}
+
+
+/* _al_acodec_cache_store:
+ *  Passes frames decoded from `frame' on to the cache, which keeps them if
+ *  they continue the block it's recording.
+ */
+void _al_acodec_cache_store(_AL_ACODEC_CACHE *cache, uint64_t frame,
+   const void *buf, size_t frames)
+{
+   CACHE_BLOCK *block;
+   size_t room;
+   uint64_t next;
+   bool full = false;
+
+   if (!cache || !cache->recording)
+      return;
+
+   block = cache->recording;
+   if (frame != block->start + block->frames) {
+      cache->recording = NULL;
+      return;
+   }
+
+   /* Stop at the block size limit or where the next block starts. */
+   room = cache->max_block_frames - block->frames;
+   next = next_block_start(cache, block->start);
+   if (next - frame < room)
+      room = (size_t)(next - frame);
+   if (frames >= room) {
+      frames = room;
+      full = true;
+   }
+   if (frames == 0) {
+      cache->recording = NULL;
+      return;
+   }
+
+   if (block->frames + frames > block->capacity) {
+      size_t capacity = block->capacity ? block->capacity * 2 : frames;
+      size_t grow;
+      char *data;
+
+      if (capacity < block->frames + frames)
+         capacity = block->frames + frames;
+      if (capacity > cache->max_block_frames)
+         capacity = cache->max_block_frames;
+      grow = (capacity - block->capacity) * cache->frame_size;
+
+      while (cache->used_bytes + grow > cache->max_bytes) {
+         if (!evict_block(cache)) {
+            cache->recording = NULL;
+            return;
+         }
+      }
+      /* Evicting may have moved it. */
+      block = cache->recording;
 
-   /* Need to wait for the thread to start, otherwise the quit event may be
-    * sent before the event source is registered with the queue. */
-   al_lock_mutex(stream->feed_thread_started_mutex);
-   while (!stream->feed_thread_started) {
-      al_wait_cond(stream->feed_thread_started_cond, stream->feed_thread_started_mutex);
+      data = al_realloc(block->data, capacity * cache->frame_size);
+      if (!data) {
+         cache->recording = NULL;
+         return;
+      }
+      block->data = data;
+      block->capacity = capacity;
+      cache->used_bytes += grow;
    }
-   al_unlock_mutex(stream->feed_thread_started_mutex);
 
-   quit_event.type = _KCM_STREAM_FEEDER_QUIT_EVENT_TYPE;
-   al_emit_user_event(al_get_audio_stream_event_source(stream), &quit_event, NULL);
-   al_join_thread(stream->feed_thread, NULL);
-   al_destroy_thread(stream->feed_thread);
-   al_destroy_cond(stream->feed_thread_started_cond);
-   al_destroy_mutex(stream->feed_thread_started_mutex);
+   memcpy(block->data + block->frames * cache->frame_size, buf,
+      frames * cache->frame_size);
+   block->frames += frames;
 
-   stream->feed_thread = NULL;
+   if (full)
+      cache->recording = NULL;
 }
@@ -1,7 +1,17 @@
 #ifndef __al_included_acodec_helper_h
 #define __al_included_acodec_helper_h
 
+typedef struct _AL_ACODEC_CACHE _AL_ACODEC_CACHE;
+
 void _al_acodec_start_feed_thread(ALLEGRO_AUDIO_STREAM *stream);
 void _al_acodec_stop_feed_thread(ALLEGRO_AUDIO_STREAM *stream);
 
+_AL_ACODEC_CACHE *_al_acodec_create_cache(size_t frame_size);
+void _al_acodec_destroy_cache(_AL_ACODEC_CACHE *cache);
+bool _al_acodec_cache_seek(_AL_ACODEC_CACHE *cache, uint64_t frame);
+size_t _al_acodec_cache_read(_AL_ACODEC_CACHE *cache, uint64_t frame,
+   void *buf, size_t frames);
+void _al_acodec_cache_store(_AL_ACODEC_CACHE *cache, uint64_t frame,
+   const void *buf, size_t frames);
+
 #endif
@@ -37,6 +37,12 @@ struct AL_OV_DATA {
    int bitstream;
    double loop_start;
    double loop_end;
+   _AL_ACODEC_CACHE *cache;
+   /* Position of the stream, and of the decoder, which lags behind while
+    * the stream is being fed from the cache. In samples.
+    */
+   uint64_t pos;
+   uint64_t decoder_pos;
 };
 
 
@@ -51,17 +57,15 @@ static struct
    int (*ov_clear)(OggVorbis_File *);
    ogg_int64_t (*ov_pcm_total)(OggVorbis_File *, int);
    vorbis_info *(*ov_info)(OggVorbis_File *, int);
+   int (*ov_pcm_seek)(OggVorbis_File *, ogg_int64_t);
 #ifndef TREMOR
    int (*ov_open_callbacks)(void *, OggVorbis_File *, const char *, long, ov_callbacks);
    double (*ov_time_total)(OggVorbis_File *, int);
-   int (*ov_time_seek_lap)(OggVorbis_File *, double);
-   double (*ov_time_tell)(OggVorbis_File *);
+   int (*ov_pcm_seek_lap)(OggVorbis_File *, ogg_int64_t);
    long (*ov_read)(OggVorbis_File *, char *, int, int, int, int, int *);
 #else
    int (*ov_open_callbacks)(void *, OggVorbis_File *, const char *, long, ov_callbacks);
    ogg_int64_t (*ov_time_total)(OggVorbis_File *, int);
-   int (*ov_time_seek)(OggVorbis_File *, ogg_int64_t);
-   ogg_int64_t (*ov_time_tell)(OggVorbis_File *);
    long (*ov_read)(OggVorbis_File *, char *, int, int *);
 #endif
 } lib;
@@ -119,15 +123,13 @@ static bool init_dynlib(void)
    INITSYM(ov_open_callbacks);
    INITSYM(ov_pcm_total);
    INITSYM(ov_info);
+   INITSYM(ov_pcm_seek);
 #ifndef TREMOR
    INITSYM(ov_time_total);
-   INITSYM(ov_time_seek_lap);
-   INITSYM(ov_time_tell);
+   INITSYM(ov_pcm_seek_lap);
    INITSYM(ov_read);
 #else
    INITSYM(ov_time_total);
-   INITSYM(ov_time_seek);
-   INITSYM(ov_time_tell);
    INITSYM(ov_read);
 #endif
 
@@ -306,16 +308,43 @@ ALLEGRO_SAMPLE *_al_load_ogg_vorbis_f(ALLEGRO_FILE *file)
 }
 
 
+/* Seeks the decoder. A lapping seek crossfades from what was decoded before
+ * to hide the jump, which is only wanted when the stream really jumps, not
+ * when the decoder catches up with audio that was played from the cache.
+ */
+static bool decoder_seek(AL_OV_DATA *extra, uint64_t pos, bool lap)
+{
+#ifndef TREMOR
+   int ret = lap ? lib.ov_pcm_seek_lap(extra->vf, pos) :
+      lib.ov_pcm_seek(extra->vf, pos);
+#else
+   int ret = lib.ov_pcm_seek(extra->vf, pos);
+   (void)lap;
+#endif
+
+   if (ret != 0)
+      return false;
+   extra->decoder_pos = pos;
+   return true;
+}
+
+
 static bool ogg_stream_seek(ALLEGRO_AUDIO_STREAM *stream, double time)
 {
    AL_OV_DATA *extra = (AL_OV_DATA *) stream->extra;
+   uint64_t pos = time * extra->vi->rate;
+
    if (time >= extra->loop_end)
       return false;
-#ifndef TREMOR
-   return (lib.ov_time_seek_lap(extra->vf, time) != -1);
-#else
-   return lib.ov_time_seek(extra->vf, time*1000) != -1;
-#endif
+
+   /* If it's cached, the decoder can catch up when the cache runs out. */
+   if (!_al_acodec_cache_seek(extra->cache, pos) &&
+         !decoder_seek(extra, pos, true)) {
+      return false;
+   }
+
+   extra->pos = pos;
+   return true;
 }
 
 
@@ -329,11 +358,7 @@ static bool ogg_stream_rewind(ALLEGRO_AUDIO_STREAM *stream)
 static double ogg_stream_get_position(ALLEGRO_AUDIO_STREAM *stream)
 {
    AL_OV_DATA *extra = (AL_OV_DATA *) stream->extra;
-#ifndef TREMOR
-   return lib.ov_time_tell(extra->vf);
-#else
-   return lib.ov_time_tell(extra->vf)/1000.0;
-#endif
+   return extra->pos / (double)extra->vi->rate;
 }
 
 
@@ -370,6 +395,7 @@ static void ogg_stream_close(ALLEGRO_AUDIO_STREAM *stream)
    al_fclose(extra->file);
 
    lib.ov_clear(extra->vf);
+   _al_acodec_destroy_cache(extra->cache);
    al_free(extra->vf);
    al_free(extra);
    stream->extra = NULL;
@@ -389,20 +415,16 @@ static size_t ogg_stream_update(ALLEGRO_AUDIO_STREAM *stream, void *data,
    const int word_size = 2;   /* 1 = 8bit, 2 = 16-bit. nothing else */
    const int signedness = 1;  /* 0 for unsigned, 1 for signed */
 
+   const int frame_size = word_size * extra->vi->channels;
    unsigned long pos = 0;
    int read_length = buf_size;
-#ifndef TREMOR
-   double ctime = lib.ov_time_tell(extra->vf);
-#else
-   double ctime = lib.ov_time_tell(extra->vf)/1000.0;
-#endif
    double rate = extra->vi->rate;
+   double ctime = extra->pos / rate;
    double btime = ((double)buf_size / ((double)word_size * (double)extra->vi->channels)) / rate;
-   unsigned long read;
+   long read;
    
    if (stream->spl.loop == _ALLEGRO_PLAYMODE_STREAM_ONEDIR) {
       if (ctime + btime > extra->loop_end) {
-         const int frame_size = word_size * extra->vi->channels;
          read_length = (extra->loop_end - ctime) * rate * (double)word_size * (double)extra->vi->channels;
          if (read_length < 0)
             return 0;
@@ -412,6 +434,18 @@ static size_t ogg_stream_update(ALLEGRO_AUDIO_STREAM *stream, void *data,
       }
    }
    while (pos < (unsigned long)read_length) {
+      if (extra->decoder_pos != extra->pos) {
+         size_t frames = _al_acodec_cache_read(extra->cache, extra->pos,
+            (char *)data + pos, (read_length - pos) / frame_size);
+         if (frames > 0) {
+            pos += frames * frame_size;
+            extra->pos += frames;
+            continue;
+         }
+         if (!decoder_seek(extra, extra->pos, false))
+            return pos;
+      }
+
 #ifndef TREMOR
       read = lib.ov_read(extra->vf, (char *)data + pos,
          read_length - pos, endian, word_size, signedness, &extra->bitstream);
@@ -421,12 +455,18 @@ static size_t ogg_stream_update(ALLEGRO_AUDIO_STREAM *stream, void *data,
       read = lib.ov_read(extra->vf, (char *)data + pos,
          read_length - pos, &extra->bitstream);
 #endif
-      pos += read;
-	   
-      if (read == 0) {
+      if (read == OV_HOLE)
+         continue;
+      if (read <= 0) {
          /* Return the number of useful bytes written. */
          return pos;
       }
+
+      _al_acodec_cache_store(extra->cache, extra->pos, (char *)data + pos,
+         read / frame_size);
+      pos += read;
+      extra->pos += read / frame_size;
+      extra->decoder_pos = extra->pos;
    }
 
    return pos;
@@ -519,6 +559,10 @@ ALLEGRO_AUDIO_STREAM *_al_load_ogg_vorbis_audio_stream_f(ALLEGRO_FILE *file,
 
    extra->loop_start = 0.0;
    extra->loop_end = ogg_stream_get_length(stream);
+   extra->pos = 0;
+   extra->decoder_pos = 0;
+   extra->cache = _al_acodec_create_cache(word_size * channels);
+   _al_acodec_cache_seek(extra->cache, 0);
    stream->quit_feed_thread = false;
    stream->feeder = ogg_stream_update;
    stream->rewind_feeder = ogg_stream_rewind;
@@ -31,6 +31,12 @@ struct AL_OP_DATA {
    int bitstream;
    double loop_start;
    double loop_end;
+   _AL_ACODEC_CACHE *cache;
+   /* Position of the stream, and of the decoder, which lags behind while
+    * the stream is being fed from the cache. In samples.
+    */
+   uint64_t pos;
+   uint64_t decoder_pos;
 };
 
 /* dynamic loading support (Windows only currently) */
@@ -267,14 +273,31 @@ ALLEGRO_SAMPLE *_al_load_ogg_opus_f(ALLEGRO_FILE *file)
 }
 
 
+static bool decoder_seek(AL_OP_DATA *extra, uint64_t pos)
+{
+   if (lib.op_pcm_seek(extra->of, pos) != 0)
+      return false;
+   extra->decoder_pos = pos;
+   return true;
+}
+
+
 static bool ogg_stream_seek(ALLEGRO_AUDIO_STREAM *stream, double time)
 {
    AL_OP_DATA *extra = (AL_OP_DATA *) stream->extra;
+   uint64_t pos = time * 48000;
 
    if (time >= extra->loop_end)
       return false;
 
-   return !lib.op_pcm_seek(extra->of, time * 48000);;
+   /* If it's cached, the decoder can catch up when the cache runs out. */
+   if (!_al_acodec_cache_seek(extra->cache, pos) &&
+         !decoder_seek(extra, pos)) {
+      return false;
+   }
+
+   extra->pos = pos;
+   return true;
 }
 
 
@@ -290,7 +313,7 @@ static double ogg_stream_get_position(ALLEGRO_AUDIO_STREAM *stream)
 {
    AL_OP_DATA *extra = (AL_OP_DATA *) stream->extra;
 
-   return lib.op_pcm_tell(extra->of)/48000.0;
+   return extra->pos/48000.0;
 }
 
 
@@ -323,6 +346,7 @@ static void ogg_stream_close(ALLEGRO_AUDIO_STREAM *stream)
    al_fclose(extra->file);
 
    lib.op_free(extra->of);
+   _al_acodec_destroy_cache(extra->cache);
    al_free(extra);
    stream->extra = NULL;
 }
@@ -341,7 +365,7 @@ static size_t ogg_stream_update(ALLEGRO_AUDIO_STREAM *stream, void *data,
    long rate = 48000;
    int channels = extra->channels;
 
-   double ctime = lib.op_pcm_tell(extra->of)/(double)rate;
+   double ctime = extra->pos/(double)rate;
 
    double btime = ((double)buf_size / (word_size * channels)) / rate;
    long read;
@@ -357,17 +381,36 @@ static size_t ogg_stream_update(ALLEGRO_AUDIO_STREAM *stream, void *data,
 
    buf_in_word= read_length/word_size;
 
-   while (pos < (unsigned long) read_length) {
+   while (pos + channels <= (unsigned long) buf_in_word) {
+      if (extra->decoder_pos != extra->pos) {
+         size_t frames = _al_acodec_cache_read(extra->cache, extra->pos,
+            (opus_int16 *)data + pos, (buf_in_word - pos) / channels);
+         if (frames > 0) {
+            pos += frames * channels;
+            extra->pos += frames;
+            continue;
+         }
+         if (!decoder_seek(extra, extra->pos))
+            return pos*word_size;
+      }
+
       read = lib.op_read(extra->of, (opus_int16 *)data + pos, buf_in_word - pos, NULL);
-      pos += read * channels;
 
-      if (read == 0) {
+      if (read == OP_HOLE)
+         continue;
+      if (read <= 0) {
          /* Return the number of useful bytes written. */
          return pos*word_size;
       }
+
+      _al_acodec_cache_store(extra->cache, extra->pos,
+         (opus_int16 *)data + pos, read);
+      pos += read * channels;
+      extra->pos += read;
+      extra->decoder_pos = extra->pos;
    }
 
-   return pos;
+   return pos*word_size;
 }
 
 
@@ -455,6 +498,10 @@ ALLEGRO_AUDIO_STREAM *_al_load_ogg_opus_audio_stream_f(ALLEGRO_FILE *file,
 
    extra->loop_start = 0.0;
    extra->loop_end = ogg_stream_get_length(stream);
+   extra->pos = 0;
+   extra->decoder_pos = 0;
+   extra->cache = _al_acodec_create_cache(word_size * channels);
+   _al_acodec_cache_seek(extra->cache, 0);
    stream->quit_feed_thread = false;
    stream->feeder = ogg_stream_update;
    stream->rewind_feeder = ogg_stream_rewind;
@@ -6,10 +6,18 @@
 #include <stdio.h>
 
 #include "allegro5/allegro_audio.h"
+#include "allegro5/internal/aintern.h"
 #include "allegro5/internal/aintern_audio.h"
+#include "allegro5/internal/aintern_file.h"
 #include "acodec.h"
 #include "helper.h"
 
+#ifdef ALLEGRO_HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 ALLEGRO_DEBUG_CHANNEL("wav")
 
 
@@ -295,6 +303,113 @@ static void wav_stream_close(ALLEGRO_AUDIO_STREAM *stream)
 }
 
 
+#ifdef ALLEGRO_HAVE_MMAP
+
+typedef struct WAV_MAPPING
+{
+   void *base;
+   size_t size;
+} WAV_MAPPING;
+
+
+static void wav_unmap_sample(ALLEGRO_SAMPLE *spl)
+{
+   WAV_MAPPING *mapping = spl->free_buf_data;
+
+   munmap(mapping->base, mapping->size);
+   al_free(mapping);
+}
+
+
+/* wav_map_sample:
+ *  If the wav_mmap option in the [audio] section of the system config is
+ *  set, maps the data chunk of the file into memory and creates a sample
+ *  using it as is, so that it's only read from the file as it's played.
+ *  Returns NULL if that's not possible, in which case the data has to be
+ *  read in instead.
+ */
+static ALLEGRO_SAMPLE *wav_map_sample(WAVFILE *wavfile)
+{
+   const char *value = al_get_config_value(al_get_system_config(), "audio",
+      "wav_mmap");
+   const size_t n = wavfile->sample_size * (size_t)wavfile->samples;
+   const int align = wavfile->bits / 8;
+   WAV_MAPPING *mapping;
+   ALLEGRO_SAMPLE *spl;
+   struct stat st;
+   size_t skip;
+   void *base;
+   int fd;
+
+   if (!value || _al_stricmp(value, "true"))
+      return NULL;
+
+#ifdef ALLEGRO_BIG_ENDIAN
+   /* The 16-bit data would need swapping. */
+   if (wavfile->bits == 16)
+      return NULL;
+#endif
+
+   if (n == 0 || wavfile->dpos % align != 0)
+      return NULL;
+
+   /* Only files opened with the stdio file interface can be mapped. */
+   fd = _al_get_file_fd(wavfile->f);
+   if (fd < 0) {
+      ALLEGRO_DEBUG("Not a stdio file, reading the data instead.\n");
+      return NULL;
+   }
+
+   /* Pages beyond the end of the file can't be read from the mapping. */
+   if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+         (uint64_t)st.st_size < wavfile->dpos + (uint64_t)n) {
+      ALLEGRO_DEBUG("Data chunk isn't all there, reading it instead.\n");
+      return NULL;
+   }
+
+   skip = wavfile->dpos % sysconf(_SC_PAGESIZE);
+   base = mmap(NULL, skip + n, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd,
+      wavfile->dpos - skip);
+   if (base == MAP_FAILED) {
+      ALLEGRO_WARN("Failed to map the data chunk, reading it instead.\n");
+      return NULL;
+   }
+
+   mapping = al_malloc(sizeof(WAV_MAPPING));
+   if (!mapping) {
+      munmap(base, skip + n);
+      return NULL;
+   }
+   mapping->base = base;
+   mapping->size = skip + n;
+
+   spl = al_create_sample((char *)base + skip, wavfile->samples, wavfile->freq,
+      _al_word_size_to_depth_conf(wavfile->bits / 8),
+      _al_count_to_channel_conf(wavfile->channels), true);
+   if (!spl) {
+      munmap(base, skip + n);
+      al_free(mapping);
+      return NULL;
+   }
+
+   spl->free_buf_proc = wav_unmap_sample;
+   spl->free_buf_data = mapping;
+
+   ALLEGRO_DEBUG("Mapped %lu bytes of sample data.\n", (unsigned long)n);
+   return spl;
+}
+
+#else
+
+static ALLEGRO_SAMPLE *wav_map_sample(WAVFILE *wavfile)
+{
+   (void)wavfile;
+   return NULL;
+}
+
+#endif
+
+
 /* _al_load_wav:
  *  Reads a RIFF WAV format sample ALLEGRO_FILE, returning an ALLEGRO_SAMPLE
  *  structure, or NULL on error.
@@ -325,8 +440,15 @@ ALLEGRO_SAMPLE *_al_load_wav_f(ALLEGRO_FILE *fp)
 
    if (wavfile) {
       size_t n = (wavfile->bits / 8) * wavfile->channels * wavfile->samples;
-      char *data = al_malloc(n);
+      char *data;
+
+      spl = wav_map_sample(wavfile);
+      if (spl) {
+         wav_close(wavfile);
+         return spl;
+      }
 
+      data = al_malloc(n);
       if (data) {
          spl = al_create_sample(data, wavfile->samples, wavfile->freq,
             _al_word_size_to_depth_conf(wavfile->bits / 8),
@@ -49,6 +49,7 @@ enum ALLEGRO_AUDIO_EVENT_TYPE
    ALLEGRO_EVENT_AUDIO_STREAM_FINISHED   = 514,
 #if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_KCM_AUDIO_SRC)
    ALLEGRO_EVENT_AUDIO_RECORDER_FRAGMENT = 515,
+   ALLEGRO_EVENT_AUDIO_STATS             = 516,
 #endif
 };
 
@@ -131,7 +132,10 @@ enum ALLEGRO_MIXER_QUALITY
 {
    ALLEGRO_MIXER_QUALITY_POINT   = 0x110,
    ALLEGRO_MIXER_QUALITY_LINEAR  = 0x111,
-   ALLEGRO_MIXER_QUALITY_CUBIC   = 0x112
+   ALLEGRO_MIXER_QUALITY_CUBIC   = 0x112,
+#if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_KCM_AUDIO_SRC)
+   ALLEGRO_MIXER_QUALITY_SINC    = 0x113,
+#endif
 };
 
 
@@ -181,11 +185,58 @@ typedef struct ALLEGRO_AUDIO_RECORDER ALLEGRO_AUDIO_RECORDER;
 #endif
 
 
+#if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_KCM_AUDIO_SRC)
+/* Enum: ALLEGRO_SAMPLE_STEAL_MODE
+ */
+enum ALLEGRO_SAMPLE_STEAL_MODE
+{
+   ALLEGRO_SAMPLE_STEAL_NONE     = 0,
+   ALLEGRO_SAMPLE_STEAL_OLDEST   = 1,
+   ALLEGRO_SAMPLE_STEAL_QUIETEST = 2
+};
+
+
+/* Type: ALLEGRO_SAMPLE_POOL_STATS
+ */
+typedef struct ALLEGRO_SAMPLE_POOL_STATS ALLEGRO_SAMPLE_POOL_STATS;
+
+struct ALLEGRO_SAMPLE_POOL_STATS {
+   int reserved;
+   int virtual_reserved;
+   int playing;
+   int virtual_playing;
+   unsigned int started;
+   unsigned int stolen;
+   unsigned int resumed;
+   unsigned int dropped;
+};
+
+
+/* Type: ALLEGRO_AUDIO_STATS
+ */
+typedef struct ALLEGRO_AUDIO_STATS ALLEGRO_AUDIO_STATS;
+
+struct ALLEGRO_AUDIO_STATS {
+   unsigned int buffers;
+   double min_mix_time;
+   double avg_mix_time;
+   double max_mix_time;
+   unsigned int underruns;
+   unsigned int late_fragments;
+   unsigned int queued_fragments;
+   double latency;
+};
+#endif
+
+
 #ifndef __cplusplus
 typedef enum ALLEGRO_AUDIO_DEPTH ALLEGRO_AUDIO_DEPTH;
 typedef enum ALLEGRO_CHANNEL_CONF ALLEGRO_CHANNEL_CONF;
 typedef enum ALLEGRO_PLAYMODE ALLEGRO_PLAYMODE;
 typedef enum ALLEGRO_MIXER_QUALITY ALLEGRO_MIXER_QUALITY;
+#if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_KCM_AUDIO_SRC)
+typedef enum ALLEGRO_SAMPLE_STEAL_MODE ALLEGRO_SAMPLE_STEAL_MODE;
+#endif
 #endif
 
 
@@ -196,6 +247,11 @@ ALLEGRO_KCM_AUDIO_FUNC(ALLEGRO_SAMPLE *, al_create_sample, (void *buf,
       ALLEGRO_CHANNEL_CONF chan_conf, bool free_buf));
 ALLEGRO_KCM_AUDIO_FUNC(void, al_destroy_sample, (ALLEGRO_SAMPLE *spl));
 
+#if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_KCM_AUDIO_SRC)
+ALLEGRO_KCM_AUDIO_FUNC(ALLEGRO_SAMPLE *, al_resample_sample, (const ALLEGRO_SAMPLE *spl,
+      unsigned int freq));
+#endif
+
 
 /* Sample instance functions */
 ALLEGRO_KCM_AUDIO_FUNC(ALLEGRO_SAMPLE_INSTANCE*, al_create_sample_instance, (
@@ -292,6 +348,7 @@ ALLEGRO_KCM_AUDIO_FUNC(ALLEGRO_EVENT_SOURCE *, al_get_audio_stream_event_source,
 
 #if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_KCM_AUDIO_SRC)
 ALLEGRO_KCM_AUDIO_FUNC(bool, al_set_audio_stream_channel_matrix, (ALLEGRO_AUDIO_STREAM *stream, const float *matrix));
+ALLEGRO_KCM_AUDIO_FUNC(unsigned int, al_get_audio_stream_near_underruns, (const ALLEGRO_AUDIO_STREAM *stream));
 #endif
 
 /* Mixer functions */
@@ -322,6 +379,11 @@ ALLEGRO_KCM_AUDIO_FUNC(bool, al_set_mixer_gain, (ALLEGRO_MIXER *mixer, float gai
 ALLEGRO_KCM_AUDIO_FUNC(bool, al_set_mixer_playing, (ALLEGRO_MIXER *mixer, bool val));
 ALLEGRO_KCM_AUDIO_FUNC(bool, al_detach_mixer, (ALLEGRO_MIXER *mixer));
 
+#if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_KCM_AUDIO_SRC)
+ALLEGRO_KCM_AUDIO_FUNC(bool, al_get_mixer_parallel, (const ALLEGRO_MIXER *mixer));
+ALLEGRO_KCM_AUDIO_FUNC(bool, al_set_mixer_parallel, (ALLEGRO_MIXER *mixer, bool val));
+#endif
+
 /* Voice functions */
 ALLEGRO_KCM_AUDIO_FUNC(ALLEGRO_VOICE*, al_create_voice, (unsigned int freq,
       ALLEGRO_AUDIO_DEPTH depth,
@@ -343,6 +405,10 @@ ALLEGRO_KCM_AUDIO_FUNC(bool, al_get_voice_playing, (const ALLEGRO_VOICE *voice))
 ALLEGRO_KCM_AUDIO_FUNC(bool, al_set_voice_position, (ALLEGRO_VOICE *voice, unsigned int val));
 ALLEGRO_KCM_AUDIO_FUNC(bool, al_set_voice_playing, (ALLEGRO_VOICE *voice, bool val));
 
+#if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_KCM_AUDIO_SRC)
+ALLEGRO_KCM_AUDIO_FUNC(bool, al_render_voice, (ALLEGRO_VOICE *voice, void *buffer, unsigned int samples));
+#endif
+
 /* Misc. audio functions */
 ALLEGRO_KCM_AUDIO_FUNC(bool, al_install_audio, (void));
 ALLEGRO_KCM_AUDIO_FUNC(void, al_uninstall_audio, (void));
@@ -370,6 +436,13 @@ ALLEGRO_KCM_AUDIO_FUNC(void, al_set_default_voice, (ALLEGRO_VOICE *voice));
 #if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_KCM_AUDIO_SRC)
 ALLEGRO_KCM_AUDIO_FUNC(ALLEGRO_SAMPLE_INSTANCE*, al_lock_sample_id, (ALLEGRO_SAMPLE_ID *spl_id));
 ALLEGRO_KCM_AUDIO_FUNC(void, al_unlock_sample_id, (ALLEGRO_SAMPLE_ID *spl_id));
+ALLEGRO_KCM_AUDIO_FUNC(bool, al_play_sample_with_priority, (ALLEGRO_SAMPLE *data,
+      float gain, float pan, float speed, ALLEGRO_PLAYMODE loop, int priority,
+      ALLEGRO_SAMPLE_ID *ret_id));
+ALLEGRO_KCM_AUDIO_FUNC(bool, al_reserve_virtual_samples, (int reserve_samples));
+ALLEGRO_KCM_AUDIO_FUNC(void, al_set_sample_steal_mode, (ALLEGRO_SAMPLE_STEAL_MODE mode));
+ALLEGRO_KCM_AUDIO_FUNC(ALLEGRO_SAMPLE_STEAL_MODE, al_get_sample_steal_mode, (void));
+ALLEGRO_KCM_AUDIO_FUNC(void, al_get_sample_pool_stats, (ALLEGRO_SAMPLE_POOL_STATS *stats));
 #endif
 
 /* File type handlers */
@@ -415,6 +488,17 @@ ALLEGRO_KCM_AUDIO_FUNC(ALLEGRO_EVENT_SOURCE *, al_get_audio_recorder_event_sourc
 ALLEGRO_KCM_AUDIO_FUNC(ALLEGRO_AUDIO_RECORDER_EVENT *, al_get_audio_recorder_event, (ALLEGRO_EVENT *event));
 ALLEGRO_KCM_AUDIO_FUNC(void, al_destroy_audio_recorder, (ALLEGRO_AUDIO_RECORDER *r));
 
+/* Statistics functions */
+ALLEGRO_KCM_AUDIO_FUNC(bool, al_get_voice_stats, (ALLEGRO_VOICE *voice,
+   ALLEGRO_AUDIO_STATS *stats));
+ALLEGRO_KCM_AUDIO_FUNC(bool, al_get_mixer_stats, (ALLEGRO_MIXER *mixer,
+   ALLEGRO_AUDIO_STATS *stats));
+ALLEGRO_KCM_AUDIO_FUNC(bool, al_get_audio_stream_stats, (ALLEGRO_AUDIO_STREAM *stream,
+   ALLEGRO_AUDIO_STATS *stats));
+ALLEGRO_KCM_AUDIO_FUNC(void, al_reset_audio_stats, (void));
+ALLEGRO_KCM_AUDIO_FUNC(void, al_set_audio_stats_interval, (double seconds));
+ALLEGRO_KCM_AUDIO_FUNC(ALLEGRO_EVENT_SOURCE *, al_get_audio_stats_event_source, (void));
+
 #endif
    
 #ifdef __cplusplus
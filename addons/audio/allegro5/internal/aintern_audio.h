@@ -6,7 +6,8 @@
 #define AINTERN_AUDIO_H
 
 #include "allegro5/allegro.h"
-#include "allegro5/internal/aintern_list.h"
+#include "allegro5/internal/aintern_atomicops.h"
+#include "allegro5/internal/aintern_dtor.h"
 #include "allegro5/internal/aintern_vector.h"
 #include "../allegro_audio.h"
 
@@ -57,7 +58,8 @@ typedef enum ALLEGRO_AUDIO_DRIVER_ENUM
    ALLEGRO_AUDIO_DRIVER_AQUEUE     = 0x20005,
    ALLEGRO_AUDIO_DRIVER_PULSEAUDIO = 0x20006,
    ALLEGRO_AUDIO_DRIVER_OPENSL     = 0x20007,
-   ALLEGRO_AUDIO_DRIVER_SDL        = 0x20008
+   ALLEGRO_AUDIO_DRIVER_SDL        = 0x20008,
+   ALLEGRO_AUDIO_DRIVER_NULL       = 0x20009
 } ALLEGRO_AUDIO_DRIVER_ENUM;
 
 typedef struct ALLEGRO_AUDIO_DRIVER ALLEGRO_AUDIO_DRIVER;
@@ -93,6 +95,26 @@ const void *_al_voice_update(ALLEGRO_VOICE *voice, ALLEGRO_MUTEX *mutex,
 bool _al_kcm_set_voice_playing(ALLEGRO_VOICE *voice, ALLEGRO_MUTEX *mutex,
    bool val);
 
+/* Running counters behind ALLEGRO_AUDIO_STATS, see kcm_stats.c.  They are
+ * written by the audio thread while holding the object's mutex.
+ */
+typedef struct _AL_KCM_STATS _AL_KCM_STATS;
+struct _AL_KCM_STATS {
+   unsigned int         buffers;
+   double               total_time;
+   double               min_time;
+   double               max_time;
+   unsigned int         underruns;
+   unsigned int         late_fragments;
+};
+
+void _al_kcm_init_stats(void);
+void _al_kcm_shutdown_stats(void);
+void _al_kcm_record_mix_time(_AL_KCM_STATS *stats, double seconds);
+void _al_kcm_emit_voice_stats(ALLEGRO_VOICE *voice);
+ALLEGRO_KCM_AUDIO_FUNC(void, _al_kcm_voice_underrun, (ALLEGRO_VOICE *voice));
+ALLEGRO_KCM_AUDIO_FUNC(void, _al_kcm_set_voice_latency, (ALLEGRO_VOICE *voice, double seconds));
+
 /* A voice structure that you'd attach a mixer or sample to. Ideally there
  * would be one ALLEGRO_VOICE per system/hardware voice.
  */
@@ -117,13 +139,20 @@ struct ALLEGRO_VOICE {
    ALLEGRO_MUTEX        *mutex;
    ALLEGRO_COND         *cond;
 
-   _AL_LIST_ITEM        *dtor_item;
+   _AL_DTOR_ITEM        *dtor_item;
 
    ALLEGRO_AUDIO_DRIVER *driver;
                         /* XXX shouldn't there only be one audio driver active
                          * at a time?
                          */
 
+   _AL_KCM_STATS        stats;
+   double               latency;
+                        /* Last output latency reported by the driver in
+                         * seconds, or -1 if it doesn't report one.
+                         */
+   double               last_stats_event;
+
    void                 *extra;
                         /* Extra data for use by the driver. */
 };
@@ -150,7 +179,13 @@ struct ALLEGRO_SAMPLE {
                         /* Whether `buffer' needs to be freed when the sample
                          * is destroyed, or when `buffer' changes.
                          */
-   _AL_LIST_ITEM        *dtor_item;
+   void                 (*free_buf_proc)(ALLEGRO_SAMPLE *spl);
+                        /* Frees `buffer' instead of al_free, for buffers
+                         * which weren't allocated with al_malloc.
+                         */
+   void                 *free_buf_data;
+                        /* For use by free_buf_proc. */
+   _AL_DTOR_ITEM        *dtor_item;
 };
 
 /* Read some samples into a mixer buffer.
@@ -221,6 +256,12 @@ struct ALLEGRO_SAMPLE_INSTANCE {
                          * The gain is premultiplied in.
                          */
 
+   const float          *sinc_table;
+                        /* Filter table for ALLEGRO_MIXER_QUALITY_SINC,
+                         * shared with other sample instances.  Otherwise
+                         * is NULL.
+                         */
+
    bool                 is_mixer;
    stream_reader_t      spl_read;
                         /* Reads sample data into the provided buffer, using
@@ -236,7 +277,7 @@ struct ALLEGRO_SAMPLE_INSTANCE {
    sample_parent_t      parent;
                         /* The object that this sample is attached to, if any.
                          */
-   _AL_LIST_ITEM        *dtor_item;
+   _AL_DTOR_ITEM        *dtor_item;
 };
 
 void _al_kcm_destroy_sample(ALLEGRO_SAMPLE_INSTANCE *sample, bool unregister);
@@ -252,6 +293,25 @@ typedef double (*get_feeder_position_t)(ALLEGRO_AUDIO_STREAM *);
 typedef double (*get_feeder_length_t)(ALLEGRO_AUDIO_STREAM *);
 typedef bool (*set_feeder_loop_t)(ALLEGRO_AUDIO_STREAM *, double, double);
 
+/* Single-producer, single-consumer ring of fragment pointers.  Only the
+ * consumer writes 'head' and only the producer writes 'tail'.  Both count
+ * modulo twice the size so that a full ring can be told from an empty one.
+ */
+typedef struct _AL_FRAGMENT_RING _AL_FRAGMENT_RING;
+struct _AL_FRAGMENT_RING {
+   void                 **slots;
+   unsigned int         size;
+   volatile _AL_ATOMIC  head;
+   volatile _AL_ATOMIC  tail;
+};
+
+void _al_kcm_init_fragment_ring(_AL_FRAGMENT_RING *ring, void **slots,
+   unsigned int size);
+unsigned int _al_kcm_fragment_ring_count(const _AL_FRAGMENT_RING *ring);
+bool _al_kcm_fragment_ring_push(_AL_FRAGMENT_RING *ring, void *fragment);
+void *_al_kcm_fragment_ring_peek(const _AL_FRAGMENT_RING *ring);
+void *_al_kcm_fragment_ring_pop(_AL_FRAGMENT_RING *ring);
+
 struct ALLEGRO_AUDIO_STREAM {
    ALLEGRO_SAMPLE_INSTANCE spl;
                         /* ALLEGRO_AUDIO_STREAM is derived from
@@ -269,18 +329,26 @@ struct ALLEGRO_AUDIO_STREAM {
                          * at the start for linear/cubic interpolation.
                          */
 
-   void                 **pending_bufs;
-   void                 **used_bufs;
-                        /* Arrays of offsets into the main_buffer.
-                         * The arrays are each 'buf_count' long.
+   _AL_FRAGMENT_RING    pending_bufs;
+   _AL_FRAGMENT_RING    used_bufs;
+                        /* Rings of pointers into the main_buffer.
+                         * The rings each hold up to 'buf_count' fragments.
                          *
                          * 'pending_bufs' holds pointers to fragments supplied
                          * by the user which are yet to be handed off to the
-                         * audio driver.
+                         * audio driver.  The one at the front is the one
+                         * being played, if any.
                          *
                          * 'used_bufs' holds pointers to fragments which
                          * have been sent to the audio driver and so are
                          * ready to receive new data.
+                         *
+                         * The user (or feeder thread) only pushes to
+                         * 'pending_bufs' and pops from 'used_bufs'; the
+                         * mixer does the opposite while holding the stream
+                         * mutex.  So al_get_audio_stream_fragment and
+                         * al_set_audio_stream_fragment needn't take the
+                         * mutex and can't hold up the mixer.
                          */
 
    volatile bool         is_draining;
@@ -295,11 +363,30 @@ struct ALLEGRO_AUDIO_STREAM {
                           * the stream was started.
                           */
 
+   ALLEGRO_MUTEX         *feed_mutex;
+                         /* Serialises calls to the feeder callbacks below.
+                          * Not the same as spl.mutex, which the mixer takes
+                          * while mixing, so that slow decoding never holds
+                          * up the mixer.
+                          */
    ALLEGRO_THREAD        *feed_thread;
    ALLEGRO_MUTEX         *feed_thread_started_mutex;
    ALLEGRO_COND          *feed_thread_started_cond;
    bool                  feed_thread_started;
    volatile bool         quit_feed_thread;
+   bool                  feed_pooled;
+                         /* Fed by the shared feeder threads rather than
+                          * by feed_thread, see kcm_feeder.c.
+                          */
+   bool                  feed_pending;
+   bool                  feeding;
+                         /* Pool state, protected by the pool's mutex. */
+   bool                  finished_event_sent;
+   unsigned int          near_underruns;
+                         /* Number of fragments the feeder started filling
+                          * with less than half a fragment left to play.
+                          */
+   _AL_KCM_STATS         stats;
    unload_feeder_t       unload_feeder;
    rewind_feeder_t       rewind_feeder;
    seek_feeder_t         seek_feeder;
@@ -313,7 +400,7 @@ struct ALLEGRO_AUDIO_STREAM {
                           * streams don't need to be fed by the user.
                           */
 
-   _AL_LIST_ITEM        *dtor_item;
+   _AL_DTOR_ITEM        *dtor_item;
 
    void                  *extra;
                          /* Extra data for use by the flac/vorbis addons. */
@@ -344,7 +431,12 @@ struct ALLEGRO_MIXER {
                            /* Vector of ALLEGRO_SAMPLE_INSTANCE*.  Holds the list of
                             * streams being mixed together.
                             */
-   _AL_LIST_ITEM           *dtor_item;
+   bool                    parallel;
+                           /* Render the attached mixers on the worker
+                            * threads, see al_set_mixer_parallel.
+                            */
+   _AL_KCM_STATS           stats;
+   _AL_DTOR_ITEM           *dtor_item;
 };
 
 extern void _al_kcm_mixer_rejig_sample_matrix(ALLEGRO_MIXER *mixer,
@@ -368,11 +460,31 @@ ALLEGRO_KCM_AUDIO_FUNC(void*, _al_kcm_feed_stream, (ALLEGRO_THREAD *self, void *
 /* Helper to emit an event that the stream has got a buffer ready to be refilled. */
 void _al_kcm_emit_stream_events(ALLEGRO_AUDIO_STREAM *stream);
 
+double _al_kcm_get_stream_time_left(const ALLEGRO_AUDIO_STREAM *stream);
+void _al_kcm_emit_stream_finished(ALLEGRO_AUDIO_STREAM *stream);
+bool _al_kcm_feed_stream_fragment(ALLEGRO_AUDIO_STREAM *stream);
+
+/* Number of sample values each value resampled with a sinc filter is made
+ * from.  Must be a multiple of 4.
+ */
+#define _AL_KCM_SINC_TAPS  32
+
+void _al_kcm_init_resampler(void);
+void _al_kcm_shutdown_resampler(void);
+const float *_al_kcm_get_sinc_table(int step, int step_denom);
+void _al_kcm_sinc_interpolate(const float *table, int err, int step_denom,
+   const float *frames, int maxc, float *out);
+
+void _al_kcm_init_feeders(void);
+void _al_kcm_shutdown_feeders(void);
+ALLEGRO_KCM_AUDIO_FUNC(void, _al_kcm_start_stream_feeder, (ALLEGRO_AUDIO_STREAM *stream));
+ALLEGRO_KCM_AUDIO_FUNC(void, _al_kcm_stop_stream_feeder, (ALLEGRO_AUDIO_STREAM *stream));
+
 void _al_kcm_init_destructors(void);
 void _al_kcm_shutdown_destructors(void);
-_AL_LIST_ITEM *_al_kcm_register_destructor(char const *name, void *object,
+_AL_DTOR_ITEM *_al_kcm_register_destructor(char const *name, void *object,
    void (*func)(void*));
-void _al_kcm_unregister_destructor(_AL_LIST_ITEM *dtor_item);
+void _al_kcm_unregister_destructor(_AL_DTOR_ITEM *dtor_item);
 void _al_kcm_foreach_destructor(
       void (*callback)(void *object, void (*func)(void *), void *udata),
       void *userdata);
@@ -239,8 +239,19 @@ static int alsa_update_nonstream_voice(ALLEGRO_VOICE *voice, void **buf, int *by
 }
 
 
+/* Reports how long the audio already written will take to be played. */
+static void alsa_update_latency(ALLEGRO_VOICE *voice, ALSA_VOICE *alsa_voice)
+{
+   snd_pcm_sframes_t delay;
+
+   if (snd_pcm_delay(alsa_voice->pcm_handle, &delay) == 0) {
+      _al_kcm_set_voice_latency(voice, (double)delay / voice->frequency);
+   }
+}
+
+
 /* Returns true if the voice is ready for more data. */
-static int alsa_voice_is_ready(ALSA_VOICE *alsa_voice)
+static int alsa_voice_is_ready(ALLEGRO_VOICE *voice, ALSA_VOICE *alsa_voice)
 {
    unsigned short revents;
    int err;
@@ -253,8 +264,10 @@ static int alsa_voice_is_ready(ALSA_VOICE *alsa_voice)
       if (snd_pcm_state(alsa_voice->pcm_handle) == SND_PCM_STATE_XRUN ||
           snd_pcm_state(alsa_voice->pcm_handle) == SND_PCM_STATE_SUSPENDED) {
 
-         if (snd_pcm_state(alsa_voice->pcm_handle) == SND_PCM_STATE_XRUN)
+         if (snd_pcm_state(alsa_voice->pcm_handle) == SND_PCM_STATE_XRUN) {
             err = -EPIPE;
+            _al_kcm_voice_underrun(voice);
+         }
          else
             err = -ESTRPIPE;
 
@@ -331,7 +344,7 @@ static void *alsa_update_mmap(ALLEGRO_THREAD *self, void *arg)
          ALLEGRO_DEBUG("snd_pcm_start returned: %d\n", rc);
       }
 
-      ret = alsa_voice_is_ready(alsa_voice);
+      ret = alsa_voice_is_ready(voice, alsa_voice);
       if (ret < 0)
          break;
       if (ret == 0) {
@@ -343,6 +356,8 @@ static void *alsa_update_mmap(ALLEGRO_THREAD *self, void *arg)
       frames = alsa_voice->frag_len;
       ret = snd_pcm_mmap_begin(alsa_voice->pcm_handle, &areas, &offset, &frames);
       if (ret < 0) {
+         if (ret == -EPIPE)
+            _al_kcm_voice_underrun(voice);
          if ((ret = xrun_recovery(alsa_voice->pcm_handle, ret)) < 0) {
             ALLEGRO_ERROR("MMAP begin avail error: %s\n", snd_strerror(ret));
          }
@@ -396,11 +411,14 @@ silence:
 commit:
       commitres = snd_pcm_mmap_commit(alsa_voice->pcm_handle, offset, frames);
       if (commitres < 0 || (snd_pcm_uframes_t)commitres != frames) {
+         if (commitres >= 0 || commitres == -EPIPE)
+            _al_kcm_voice_underrun(voice);
          if ((ret = xrun_recovery(alsa_voice->pcm_handle, commitres >= 0 ? -EPIPE : commitres)) < 0) {
             ALLEGRO_ERROR("MMAP commit error: %s\n", snd_strerror(ret));
             break;
          }
       }
+      alsa_update_latency(voice, alsa_voice);
    }
 
    ALLEGRO_INFO("ALSA update_mmap thread stopped\n");
@@ -463,6 +481,7 @@ static void *alsa_update_rw(ALLEGRO_THREAD *self, void *arg)
       err = snd_pcm_avail_update(alsa_voice->pcm_handle);
       if (err < 0) {
          if (err == -EPIPE) {
+            _al_kcm_voice_underrun(voice);
             snd_pcm_prepare(alsa_voice->pcm_handle);
          }
          else {
@@ -503,9 +522,13 @@ silence:
       err = snd_pcm_writei(alsa_voice->pcm_handle, buf, frames);
       if (err < 0) {
          if (err == -EPIPE) {
+            _al_kcm_voice_underrun(voice);
             snd_pcm_prepare(alsa_voice->pcm_handle);
          }
       }
+      else {
+         alsa_update_latency(voice, alsa_voice);
+      }
    }
 
    ALLEGRO_INFO("ALSA update_rw thread stopped\n");
@@ -0,0 +1,374 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Threads feeding audio streams which were loaded from files.
+ *
+ *      By default all such streams share a small pool of feeder threads.
+ *      The threads wait on one event queue for fragment events from all
+ *      of the streams and always refill the stream which would run out
+ *      of audio first. Setting stream_feeder_threads to 0 in the [audio]
+ *      section of the system config gives each stream its own thread
+ *      instead.
+ *
+ *      See LICENSE.txt for copyright information.
+ */
+
+
+#include <float.h>
+#include <stdlib.h>
+
+#include "allegro5/allegro.h"
+#include "allegro5/allegro_audio.h"
+#include "allegro5/internal/aintern.h"
+#include "allegro5/internal/aintern_audio.h"
+#include "allegro5/internal/aintern_vector.h"
+
+ALLEGRO_DEBUG_CHANNEL("audio")
+
+
+#define DEFAULT_FEEDER_THREADS   2
+#define MAX_FEEDER_THREADS       16
+
+
+static ALLEGRO_MUTEX *feeder_mutex = NULL;
+static ALLEGRO_COND *feeder_cond = NULL;
+static ALLEGRO_EVENT_QUEUE *feeder_queue = NULL;
+static ALLEGRO_EVENT_SOURCE feeder_wakeup;
+static ALLEGRO_THREAD *feeder_threads[MAX_FEEDER_THREADS];
+static int num_feeder_threads = -1;   /* not started yet */
+static bool feeder_quit = false;
+
+/* Vector of ALLEGRO_AUDIO_STREAM*, protected by feeder_mutex. */
+static _AL_VECTOR feeder_streams = _AL_VECTOR_INITIALIZER(ALLEGRO_AUDIO_STREAM *);
+
+
+
+/* Returns the configured number of pool threads; 0 means no pool. */
+static int get_feeder_thread_count(void)
+{
+   const char *value = al_get_config_value(al_get_system_config(), "audio",
+      "stream_feeder_threads");
+   int n = DEFAULT_FEEDER_THREADS;
+
+   if (value && value[0] != '\0')
+      n = strtol(value, NULL, 10);
+   if (n < 0)
+      n = 0;
+   if (n > MAX_FEEDER_THREADS)
+      n = MAX_FEEDER_THREADS;
+   return n;
+}
+
+
+
+/* Called with feeder_mutex held. */
+static ALLEGRO_AUDIO_STREAM *find_stream(const ALLEGRO_EVENT_SOURCE *es)
+{
+   unsigned int i;
+
+   for (i = 0; i < _al_vector_size(&feeder_streams); i++) {
+      ALLEGRO_AUDIO_STREAM **slot = _al_vector_ref(&feeder_streams, i);
+      if (&(*slot)->spl.es == es)
+         return *slot;
+   }
+   return NULL;
+}
+
+
+
+/* Picks the stream which needs refilling with the least audio left to
+ * play. Streams which are not playing come last.
+ * Called with feeder_mutex held.
+ */
+static ALLEGRO_AUDIO_STREAM *next_stream_to_feed(void)
+{
+   ALLEGRO_AUDIO_STREAM *best = NULL;
+   double best_time = 0.0;
+   unsigned int i;
+
+   for (i = 0; i < _al_vector_size(&feeder_streams); i++) {
+      ALLEGRO_AUDIO_STREAM **slot = _al_vector_ref(&feeder_streams, i);
+      ALLEGRO_AUDIO_STREAM *stream = *slot;
+      double time;
+
+      if (!stream->feed_pending || stream->feeding)
+         continue;
+
+      time = stream->spl.is_playing ?
+         _al_kcm_get_stream_time_left(stream) : DBL_MAX;
+      if (!best || time < best_time) {
+         best = stream;
+         best_time = time;
+      }
+   }
+
+   return best;
+}
+
+
+
+static void *feeder_thread_proc(ALLEGRO_THREAD *self, void *unused)
+{
+   (void)self;
+   (void)unused;
+
+   al_lock_mutex(feeder_mutex);
+   while (!feeder_quit) {
+      ALLEGRO_AUDIO_STREAM *stream;
+      ALLEGRO_EVENT event;
+
+      while (al_get_next_event(feeder_queue, &event)) {
+         if (event.type == ALLEGRO_EVENT_AUDIO_STREAM_FRAGMENT) {
+            stream = find_stream(event.any.source);
+            if (!stream)
+               continue;
+            if (!stream->is_draining)
+               stream->feed_pending = true;
+            else if (!stream->spl.is_playing) {
+               /* The mixer stopped the stream once it ran dry. */
+               stream->is_draining = false;
+               _al_kcm_emit_stream_finished(stream);
+            }
+         }
+         else if (event.type == _KCM_STREAM_FEEDER_QUIT_EVENT_TYPE) {
+            /* Pass it on, another thread may be waiting for it. */
+            al_emit_user_event(&feeder_wakeup, &event, NULL);
+            break;
+         }
+      }
+      if (feeder_quit)
+         break;
+
+      stream = next_stream_to_feed();
+      if (!stream) {
+         al_unlock_mutex(feeder_mutex);
+         al_wait_for_event(feeder_queue, NULL);
+         al_lock_mutex(feeder_mutex);
+         continue;
+      }
+
+      stream->feeding = true;
+      al_unlock_mutex(feeder_mutex);
+
+      /* One fragment at a time, so that a stream which has fallen behind
+       * doesn't hold up the others.
+       */
+      _al_kcm_feed_stream_fragment(stream);
+
+      al_lock_mutex(feeder_mutex);
+      stream->feeding = false;
+      stream->feed_pending = !stream->is_draining &&
+         al_get_available_audio_stream_fragments(stream) > 0;
+      al_broadcast_cond(feeder_cond);
+   }
+   al_unlock_mutex(feeder_mutex);
+
+   return NULL;
+}
+
+
+
+/* Called with feeder_mutex held. */
+static void start_feeder_threads(void)
+{
+   int n = get_feeder_thread_count();
+   int i;
+
+   num_feeder_threads = 0;
+   if (n == 0)
+      return;
+
+   /* The queue belongs to the pool, which is shut down with the audio
+    * addon. Allegro's own destructors run before that, and destroying the
+    * queue then would leave the feeder threads waiting on it forever.
+    */
+   _al_push_destructor_owner();
+   feeder_queue = al_create_event_queue();
+   _al_pop_destructor_owner();
+   if (!feeder_queue)
+      return;
+   al_init_user_event_source(&feeder_wakeup);
+   al_register_event_source(feeder_queue, &feeder_wakeup);
+
+   for (i = 0; i < n; i++) {
+      feeder_threads[i] = al_create_thread(feeder_thread_proc, NULL);
+      if (!feeder_threads[i])
+         break;
+      al_start_thread(feeder_threads[i]);
+   }
+   num_feeder_threads = i;
+
+   ALLEGRO_DEBUG("Started %d stream feeder threads.\n", i);
+}
+
+
+
+static void start_own_thread(ALLEGRO_AUDIO_STREAM *stream)
+{
+   stream->feed_thread = al_create_thread(_al_kcm_feed_stream, stream);
+   stream->feed_thread_started_cond = al_create_cond();
+   stream->feed_thread_started_mutex = al_create_mutex();
+   al_start_thread(stream->feed_thread);
+}
+
+
+
+static void stop_own_thread(ALLEGRO_AUDIO_STREAM *stream)
+{
+   ALLEGRO_EVENT quit_event;
+
+   /* Need to wait for the thread to start, otherwise the quit event may be
+    * sent before the event source is registered with the queue. */
+   al_lock_mutex(stream->feed_thread_started_mutex);
+   while (!stream->feed_thread_started) {
+      al_wait_cond(stream->feed_thread_started_cond, stream->feed_thread_started_mutex);
+   }
+   al_unlock_mutex(stream->feed_thread_started_mutex);
+
+   quit_event.type = _KCM_STREAM_FEEDER_QUIT_EVENT_TYPE;
+   al_emit_user_event(al_get_audio_stream_event_source(stream), &quit_event, NULL);
+   al_join_thread(stream->feed_thread, NULL);
+   al_destroy_thread(stream->feed_thread);
+   al_destroy_cond(stream->feed_thread_started_cond);
+   al_destroy_mutex(stream->feed_thread_started_mutex);
+
+   stream->feed_thread = NULL;
+}
+
+
+
+/* _al_kcm_init_feeders:
+ *  Prepares the feeder pool, which is started along with the first stream
+ *  which uses it.
+ */
+void _al_kcm_init_feeders(void)
+{
+   if (!feeder_mutex) {
+      feeder_mutex = al_create_mutex();
+      feeder_cond = al_create_cond();
+   }
+}
+
+
+
+/* _al_kcm_shutdown_feeders:
+ *  Stops the feeder pool. Streams which still exist are not fed any more.
+ */
+void _al_kcm_shutdown_feeders(void)
+{
+   ALLEGRO_EVENT event;
+   unsigned int i;
+   int t;
+
+   if (!feeder_mutex)
+      return;
+
+   al_lock_mutex(feeder_mutex);
+   feeder_quit = true;
+   al_unlock_mutex(feeder_mutex);
+
+   if (feeder_queue) {
+      event.user.type = _KCM_STREAM_FEEDER_QUIT_EVENT_TYPE;
+      al_emit_user_event(&feeder_wakeup, &event, NULL);
+   }
+   for (t = 0; t < num_feeder_threads; t++) {
+      al_join_thread(feeder_threads[t], NULL);
+      al_destroy_thread(feeder_threads[t]);
+   }
+
+   for (i = 0; i < _al_vector_size(&feeder_streams); i++) {
+      ALLEGRO_AUDIO_STREAM **slot = _al_vector_ref(&feeder_streams, i);
+      (*slot)->feed_pooled = false;
+   }
+   _al_vector_free(&feeder_streams);
+
+   if (feeder_queue) {
+      al_destroy_event_queue(feeder_queue);
+      al_destroy_user_event_source(&feeder_wakeup);
+      feeder_queue = NULL;
+   }
+   al_destroy_cond(feeder_cond);
+   al_destroy_mutex(feeder_mutex);
+   feeder_cond = NULL;
+   feeder_mutex = NULL;
+   num_feeder_threads = -1;
+   feeder_quit = false;
+}
+
+
+
+/* _al_kcm_start_stream_feeder:
+ *  Starts feeding the stream with its 'feeder' callback.
+ */
+void _al_kcm_start_stream_feeder(ALLEGRO_AUDIO_STREAM *stream)
+{
+   ASSERT(stream->feeder);
+
+   stream->finished_event_sent = false;
+   if (!stream->feed_mutex)
+      stream->feed_mutex = al_create_mutex();
+
+   if (feeder_mutex) {
+      al_lock_mutex(feeder_mutex);
+      if (num_feeder_threads < 0)
+         start_feeder_threads();
+      if (num_feeder_threads > 0) {
+         ALLEGRO_AUDIO_STREAM **slot = _al_vector_alloc_back(&feeder_streams);
+         if (slot) {
+            *slot = stream;
+            stream->feed_pooled = true;
+            stream->feed_pending = false;
+            stream->feeding = false;
+            al_register_event_source(feeder_queue, &stream->spl.es);
+         }
+      }
+      al_unlock_mutex(feeder_mutex);
+
+      if (stream->feed_pooled)
+         return;
+   }
+
+   start_own_thread(stream);
+}
+
+
+
+/* _al_kcm_stop_stream_feeder:
+ *  Stops feeding the stream, waiting for a fragment which is being filled
+ *  to be finished.
+ */
+void _al_kcm_stop_stream_feeder(ALLEGRO_AUDIO_STREAM *stream)
+{
+   ALLEGRO_EVENT fin_event;
+
+   if (stream->feed_thread) {
+      stop_own_thread(stream);
+      return;
+   }
+
+   if (!stream->feed_pooled)
+      return;
+
+   al_lock_mutex(feeder_mutex);
+   al_unregister_event_source(feeder_queue, &stream->spl.es);
+   _al_vector_find_and_delete(&feeder_streams, &stream);
+   while (stream->feeding)
+      al_wait_cond(feeder_cond, feeder_mutex);
+   stream->feed_pooled = false;
+   al_unlock_mutex(feeder_mutex);
+
+   fin_event.user.type = ALLEGRO_EVENT_AUDIO_STREAM_FINISHED;
+   fin_event.user.timestamp = al_get_time();
+   al_emit_user_event(&stream->spl.es, &fin_event, NULL);
+}
+
+
+
+/* vim: set sts=3 sw=3 et: */
@@ -135,6 +135,7 @@ void _al_kcm_detach_from_parent(ALLEGRO_SAMPLE_INSTANCE *spl)
          _al_kcm_stream_set_mutex(spl, NULL);
 
          spl->spl_read = NULL;
+         spl->sinc_table = NULL;
 
          maybe_unlock_mutex(mixer->ss.mutex);
 
@@ -427,19 +428,30 @@ bool al_set_sample_instance_speed(ALLEGRO_SAMPLE_INSTANCE *spl, float val)
    spl->speed = val;
    if (spl->parent.u.mixer) {
       ALLEGRO_MIXER *mixer = spl->parent.u.mixer;
+      int step = (spl->spl_data.frequency) * spl->speed;
+      const float *sinc_table = NULL;
 
-      maybe_lock_mutex(spl->mutex);
-
-      spl->step = (spl->spl_data.frequency) * spl->speed;
-      spl->step_denom = mixer->ss.spl_data.frequency;
       /* Don't wanna be trapped with a step value of 0 */
-      if (spl->step == 0) {
+      if (step == 0) {
          if (spl->speed > 0.0f)
-            spl->step = 1;
+            step = 1;
          else
-            spl->step = -1;
+            step = -1;
+      }
+      /* The table may have to be built, so don't hold up the mixer. */
+      if (spl->sinc_table) {
+         sinc_table = _al_kcm_get_sinc_table(step,
+            mixer->ss.spl_data.frequency);
       }
 
+      maybe_lock_mutex(spl->mutex);
+
+      spl->step = step;
+      spl->step_denom = mixer->ss.spl_data.frequency;
+      /* If the table can't be built keep using the old one. */
+      if (sinc_table)
+         spl->sinc_table = sinc_table;
+
       maybe_unlock_mutex(spl->mutex);
    }
 
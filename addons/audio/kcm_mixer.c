@@ -8,6 +8,7 @@
 /* Title: Mixer functions
  */
 
+#include <limits.h>
 #include <math.h>
 #include <stdio.h>
 
@@ -15,6 +16,8 @@
 #include "allegro5/internal/aintern.h"
 #include "allegro5/internal/aintern_audio.h"
 #include "allegro5/internal/aintern_audio_cfg.h"
+#include "allegro5/internal/aintern_parallel.h"
+#include "allegro5/internal/aintern_simd.h"
 
 ALLEGRO_DEBUG_CHANNEL("audio")
 
@@ -264,11 +267,484 @@ static INLINE int32_t clamp(int32_t val, int32_t min, int32_t max)
 }
 
 
+/* Sample values are mixed in blocks of up to MIX_BLOCK_FRAMES frames.  First
+ * the positions of a run of frames which need no loop handling are worked
+ * out, then the whole run is converted and interpolated into a scratch
+ * buffer with the switch on the sample depth outside the loop, and finally
+ * the run is multiplied through the channel matrix into the mixer buffer.
+ */
+#define MIX_BLOCK_FRAMES   64
+
+typedef struct MIX_BLOCK {
+   int pos[MIX_BLOCK_FRAMES];
+   int err[MIX_BLOCK_FRAMES];
+} MIX_BLOCK;
+
+
+/* Where the interpolating readers take the sample values around a position
+ * from.  Values before lo are read from lo_repl and values from hi onwards
+ * from hi_repl.
+ */
+typedef struct NEIGHBOURS {
+   int off;
+   int lo, lo_repl;
+   int hi, hi_repl;
+} NEIGHBOURS;
+
+
+/* plan_block:
+ *  Fills in the positions of up to max frames from the current position of
+ *  the sample instance, stopping at the first position which
+ *  fix_looped_position would have to change, and advances the sample
+ *  instance past them.  Returns the number of frames.
+ */
+static int plan_block(ALLEGRO_SAMPLE_INSTANCE *spl, MIX_BLOCK *blk, int max,
+   int delta, int delta_error)
+{
+   int lo = INT_MIN;
+   int hi = INT_MAX;
+   int pos = spl->pos;
+   int err = spl->pos_bresenham_error;
+   int n;
+
+   switch (spl->loop) {
+      case ALLEGRO_PLAYMODE_LOOP:
+         if (spl->loop_end - spl->loop_start != 0) {
+            if (spl->step > 0)
+               hi = spl->loop_end;
+            else if (spl->step < 0)
+               lo = spl->loop_start;
+         }
+         break;
+
+      case ALLEGRO_PLAYMODE_BIDIR:
+         if (spl->loop_end - spl->loop_start != 0) {
+            hi = spl->loop_end;
+            if (spl->step < 0)
+               lo = spl->loop_start;
+         }
+         break;
+
+      case ALLEGRO_PLAYMODE_ONCE:
+         lo = 0;
+         hi = spl->spl_data.len;
+         break;
+
+      case _ALLEGRO_PLAYMODE_STREAM_ONCE:
+      case _ALLEGRO_PLAYMODE_STREAM_ONEDIR:
+         hi = spl->spl_data.len;
+         break;
+   }
+
+   for (n = 0; n < max && pos >= lo && pos < hi; n++) {
+      blk->pos[n] = pos;
+      blk->err[n] = err;
+      pos += delta;
+      err += delta_error;
+      if (err >= spl->step_denom) {
+         pos++;
+         err -= spl->step_denom;
+      }
+   }
+
+   spl->pos = pos;
+   spl->pos_bresenham_error = err;
+   return n;
+}
+
+
+/* get_neighbours:
+ *  Sets up the same edge handling as linear_spl32 (taps == 2) and
+ *  cubic_spl32 (taps == 4) use.  The sinc filter only uses the lag and
+ *  the range of positions it may read from directly.
+ */
+static void get_neighbours(const ALLEGRO_SAMPLE_INSTANCE *spl,
+   NEIGHBOURS *nb, int taps)
+{
+   nb->off = 0;
+   nb->lo = INT_MIN;
+   nb->lo_repl = 0;
+   nb->hi = INT_MAX;
+   nb->hi_repl = 0;
+
+   switch (spl->loop) {
+      case ALLEGRO_PLAYMODE_ONCE:
+         nb->lo = 0;
+         nb->lo_repl = 0;
+         nb->hi = spl->spl_data.len;
+         nb->hi_repl = spl->spl_data.len - 1;
+         break;
+
+      case ALLEGRO_PLAYMODE_LOOP:
+         nb->lo = spl->loop_start;
+         nb->lo_repl = spl->loop_end - 1;
+         nb->hi = spl->loop_end;
+         nb->hi_repl = spl->loop_start;
+         break;
+
+      case ALLEGRO_PLAYMODE_BIDIR:
+         nb->lo = spl->loop_start;
+         nb->lo_repl = spl->loop_end - 1;
+         nb->hi = spl->loop_end;
+         if (taps == 2)
+            nb->hi_repl = _ALLEGRO_MAX(spl->loop_end - 1, spl->loop_start);
+         else
+            nb->hi_repl = spl->loop_start;
+         break;
+
+      case _ALLEGRO_PLAYMODE_STREAM_ONCE:
+      case _ALLEGRO_PLAYMODE_STREAM_ONEDIR:
+         /* Lag behind by one sample for linear, two for cubic and half
+          * the taps for sinc.
+          */
+         nb->off = -taps / 2;
+         break;
+   }
+}
+
+
+/* Conversions of a single sample value, as in kcm_mixer_helpers.inc. */
+#define CONV_F32_FLOAT32(x)   (x)
+#define CONV_F32_INT24(x)     ((float) (x) / ((float) 0x7FFFFF + 0.5f))
+#define CONV_F32_UINT24(x)    ((float) (x) / ((float) 0x7FFFFF + 0.5f) - 1.0f)
+#define CONV_F32_INT16(x)     ((float) (x) / ((float) 0x7FFF + 0.5f))
+#define CONV_F32_UINT16(x)    ((float) (x) / ((float) 0x7FFF + 0.5f) - 1.0f)
+#define CONV_F32_INT8(x)      ((float) (x) / ((float) 0x7F + 0.5f))
+#define CONV_F32_UINT8(x)     ((float) (x) / ((float) 0x7F + 0.5f) - 1.0f)
+
+#define CONV_S16_FLOAT32(x)   ((int16_t) ((x) * 0x7FFF))
+#define CONV_S16_INT24(x)     ((int16_t) ((x) >> 9))
+#define CONV_S16_UINT24(x)    ((int16_t) (((x) - 0x800000) >> 9))
+#define CONV_S16_INT16(x)     (x)
+#define CONV_S16_UINT16(x)    ((int16_t) ((x) - 0x8000))
+#define CONV_S16_INT8(x)      ((int16_t) (x) << 7)
+#define CONV_S16_UINT8(x)     ((int16_t) ((x) - 0x80) << 7)
+
+
+#define POINT_BLOCK(BUF, CONV)                                                \
+   for (j = 0; j < n; j++) {                                                  \
+      const int i0 = blk->pos[j] * maxc;                                      \
+      for (i = 0; i < maxc; i++)                                              \
+         *out++ = CONV(BUF[i0 + i]);                                          \
+   }
+
+#define LINEAR_BLOCK_32(BUF, CONV)                                            \
+   for (j = 0; j < n; j++) {                                                  \
+      const float t = (float) blk->err[j] / spl->step_denom;                  \
+      int p0 = blk->pos[j] + nb.off;                                          \
+      int p1 = p0 + 1;                                                        \
+      if (p1 >= nb.hi)                                                        \
+         p1 = nb.hi_repl;                                                     \
+      p0 *= maxc;                                                             \
+      p1 *= maxc;                                                             \
+      for (i = 0; i < maxc; i++) {                                            \
+         const float x0 = CONV(BUF[p0 + i]);                                  \
+         const float x1 = CONV(BUF[p1 + i]);                                  \
+         *out++ = (x0 * (1.0f - t)) + (x1 * t);                               \
+      }                                                                       \
+   }
+
+#define LINEAR_BLOCK_16(BUF, CONV)                                            \
+   for (j = 0; j < n; j++) {                                                  \
+      const int32_t t = 256 * blk->err[j] / spl->step_denom;                  \
+      int p0 = blk->pos[j] + nb.off;                                          \
+      int p1 = p0 + 1;                                                        \
+      if (p1 >= nb.hi)                                                        \
+         p1 = nb.hi_repl;                                                     \
+      p0 *= maxc;                                                             \
+      p1 *= maxc;                                                             \
+      for (i = 0; i < maxc; i++) {                                            \
+         const int32_t x0 = CONV(BUF[p0 + i]);                                \
+         const int32_t x1 = CONV(BUF[p1 + i]);                                \
+         *out++ = (int16_t) (((x0 * (256 - t)) >> 8) + ((x1 * t) >> 8));      \
+      }                                                                       \
+   }
+
+#define CUBIC_BLOCK_32(BUF, CONV)                                             \
+   for (j = 0; j < n; j++) {                                                  \
+      const float t = (float) blk->err[j] / spl->step_denom;                  \
+      int p1 = blk->pos[j] + nb.off;                                          \
+      int p0 = p1 - 1;                                                        \
+      int p2 = p1 + 1;                                                        \
+      int p3 = p1 + 2;                                                        \
+      if (p0 < nb.lo)                                                         \
+         p0 = nb.lo_repl;                                                     \
+      if (p2 >= nb.hi)                                                        \
+         p2 = nb.hi_repl;                                                     \
+      if (p3 >= nb.hi)                                                        \
+         p3 = nb.hi_repl;                                                     \
+      p0 *= maxc;                                                             \
+      p1 *= maxc;                                                             \
+      p2 *= maxc;                                                             \
+      p3 *= maxc;                                                             \
+      for (i = 0; i < maxc; i++) {                                            \
+         const float x0 = CONV(BUF[p0 + i]);                                  \
+         const float x1 = CONV(BUF[p1 + i]);                                  \
+         const float x2 = CONV(BUF[p2 + i]);                                  \
+         const float x3 = CONV(BUF[p3 + i]);                                  \
+         const float c0 = x1;                                                 \
+         const float c1 = 0.5f * (x2 - x0);                                   \
+         const float c2 = x0 - (2.5f * x1) + (2.0f * x2) - (0.5f * x3);       \
+         const float c3 = (0.5f * (x3 - x0)) + (1.5f * (x1 - x2));            \
+         *out++ = (((((c3 * t) + c2) * t) + c1) * t) + c0;                    \
+      }                                                                       \
+   }
+
+
+/* sinc_tap_position:
+ *  Returns where the sinc filter for the frame at pos takes the sample
+ *  values of position q from, or -1 if they are silence.  Taps which fall
+ *  outside a loop wrap around it, or bounce back for BIDIR, once the loop
+ *  has been reached.  Not used for streams, whose buffers always hold the
+ *  sample values before the current position.
+ */
+static int sinc_tap_position(const ALLEGRO_SAMPLE_INSTANCE *spl, int pos,
+   int q)
+{
+   const int len = spl->loop_end - spl->loop_start;
+   int d;
+
+   switch (spl->loop) {
+      case ALLEGRO_PLAYMODE_LOOP:
+         if (len > 0 && pos >= spl->loop_start &&
+               (q < spl->loop_start || q >= spl->loop_end)) {
+            d = (q - spl->loop_start) % len;
+            if (d < 0)
+               d += len;
+            q = spl->loop_start + d;
+         }
+         break;
+
+      case ALLEGRO_PLAYMODE_BIDIR:
+         if (len > 0 && pos >= spl->loop_start &&
+               (q < spl->loop_start || q >= spl->loop_end)) {
+            d = (q - spl->loop_start) % (2 * len);
+            if (d < 0)
+               d += 2 * len;
+            if (d >= len)
+               d = 2 * len - 1 - d;
+            q = spl->loop_start + d;
+         }
+         break;
+
+      default:
+         break;
+   }
+
+   if (q < 0 || q >= spl->spl_data.len)
+      return -1;
+   return q;
+}
+
+
+/* Float sample values are filtered straight from the sample buffer where
+ * all the taps of a frame lie inside the sample or loop.  Otherwise the taps
+ * are converted into a window first.
+ */
+#define SINC_BLOCK_32(BUF, CONV)                                              \
+   {                                                                          \
+      float win[_AL_KCM_SINC_TAPS * ALLEGRO_MAX_CHANNELS];                    \
+      int k;                                                                  \
+      for (j = 0; j < n; j++) {                                               \
+         const int p = blk->pos[j] + nb.off;                                  \
+         const int q0 = p - (_AL_KCM_SINC_TAPS / 2 - 1);                      \
+         const bool inside = q0 >= nb.lo && q0 <= nb.hi - _AL_KCM_SINC_TAPS;  \
+         const float *frames = win;                                           \
+         if (inside && spl->spl_data.depth == ALLEGRO_AUDIO_DEPTH_FLOAT32) {  \
+            frames = buf.f32 + q0 * maxc;                                     \
+         }                                                                    \
+         else if (inside) {                                                   \
+            const int count = _AL_KCM_SINC_TAPS * maxc;                       \
+            for (k = 0; k < count; k++)                                       \
+               win[k] = CONV(BUF[q0 * maxc + k]);                             \
+         }                                                                    \
+         else {                                                               \
+            float *w = win;                                                   \
+            for (k = 0; k < _AL_KCM_SINC_TAPS; k++) {                         \
+               const int q = sinc_tap_position(spl, p, q0 + k);               \
+               if (q < 0) {                                                   \
+                  for (i = 0; i < maxc; i++)                                  \
+                     *w++ = 0.0f;                                             \
+               }                                                              \
+               else {                                                         \
+                  for (i = 0; i < maxc; i++)                                  \
+                     *w++ = CONV(BUF[q * maxc + i]);                          \
+               }                                                              \
+            }                                                                 \
+         }                                                                    \
+         _al_kcm_sinc_interpolate(spl->sinc_table, blk->err[j],               \
+            spl->step_denom, frames, maxc, out);                              \
+         out += maxc;                                                         \
+      }                                                                       \
+   }
+
+
+/* Converts and interpolates the sample values of n planned frames into out.
+ * TAPS is the number of sample values each output value is made from.
+ */
+#define MAKE_BLOCK_READER(NAME, TYPE, TAPS, BLOCK, CONV)                      \
+static void NAME(TYPE *out, const ALLEGRO_SAMPLE_INSTANCE *spl,               \
+   const MIX_BLOCK *blk, int n, int maxc)                                     \
+{                                                                             \
+   const any_buffer_t buf = spl->spl_data.buffer;                             \
+   NEIGHBOURS nb;                                                             \
+   int i, j;                                                                  \
+                                                                              \
+   get_neighbours(spl, &nb, TAPS);                                            \
+                                                                              \
+   switch (spl->spl_data.depth) {                                             \
+      case ALLEGRO_AUDIO_DEPTH_FLOAT32:                                       \
+         BLOCK(buf.f32, CONV##_FLOAT32)                                       \
+         break;                                                               \
+      case ALLEGRO_AUDIO_DEPTH_INT24:                                         \
+         BLOCK(buf.s24, CONV##_INT24)                                         \
+         break;                                                               \
+      case ALLEGRO_AUDIO_DEPTH_UINT24:                                        \
+         BLOCK(buf.u24, CONV##_UINT24)                                        \
+         break;                                                               \
+      case ALLEGRO_AUDIO_DEPTH_INT16:                                         \
+         BLOCK(buf.s16, CONV##_INT16)                                         \
+         break;                                                               \
+      case ALLEGRO_AUDIO_DEPTH_UINT16:                                        \
+         BLOCK(buf.u16, CONV##_UINT16)                                        \
+         break;                                                               \
+      case ALLEGRO_AUDIO_DEPTH_INT8:                                          \
+         BLOCK(buf.s8, CONV##_INT8)                                           \
+         break;                                                               \
+      case ALLEGRO_AUDIO_DEPTH_UINT8:                                         \
+         BLOCK(buf.u8, CONV##_UINT8)                                          \
+         break;                                                               \
+   }                                                                          \
+}
+
+MAKE_BLOCK_READER(point_block32, float, 1, POINT_BLOCK, CONV_F32)
+MAKE_BLOCK_READER(linear_block32, float, 2, LINEAR_BLOCK_32, CONV_F32)
+MAKE_BLOCK_READER(cubic_block32, float, 4, CUBIC_BLOCK_32, CONV_F32)
+MAKE_BLOCK_READER(sinc_block32, float, _AL_KCM_SINC_TAPS, SINC_BLOCK_32,
+   CONV_F32)
+MAKE_BLOCK_READER(point_block16, int16_t, 1, POINT_BLOCK, CONV_S16)
+MAKE_BLOCK_READER(linear_block16, int16_t, 2, LINEAR_BLOCK_16, CONV_S16)
+
+#undef MAKE_BLOCK_READER
+
+
+/* Adds n frames of maxc sample values, multiplied through the channel
+ * matrix, to n frames of dest_maxc values in the mixer buffer.  The
+ * products for each mixer channel are added from the last source channel
+ * to the first.
+ */
+#define MAKE_BLOCK_MIXER(NAME, TYPE)                                          \
+static void NAME(TYPE *buf, const TYPE *s, int n, int maxc, int dest_maxc,    \
+   const float *matrix)                                                       \
+{                                                                             \
+   int j, c, k;                                                               \
+                                                                              \
+   for (j = 0; j < n; j++) {                                                  \
+      for (c = 0; c < dest_maxc; c++) {                                       \
+         const float *m = matrix + c * maxc;                                  \
+         for (k = maxc - 1; k >= 0; k--)                                      \
+            *buf += s[k] * m[k];                                              \
+         buf++;                                                               \
+      }                                                                       \
+      s += maxc;                                                              \
+   }                                                                          \
+}
+
+MAKE_BLOCK_MIXER(mix_block_float_c, float)
+MAKE_BLOCK_MIXER(mix_block_int16_t, int16_t)
+
+#undef MAKE_BLOCK_MIXER
+
+
+#ifdef _AL_SIMD_SSE2
+
+#include <emmintrin.h>
+
+/* mix_block_float_sse2:
+ *  mix_block_float_c for stereo mixers, two frames per vector, and for
+ *  mixers with a multiple of four channels, one frame at a time.  Each lane
+ *  sees the same additions in the same order as the plain C version.
+ */
+static _AL_TARGET_SSE2 void mix_block_float_sse2(float *buf, const float *s,
+   int n, int maxc, int dest_maxc, const float *matrix)
+{
+   __m128 w[ALLEGRO_MAX_CHANNELS][ALLEGRO_MAX_CHANNELS / 4];
+   int j, k, q;
+
+   if (dest_maxc == 2) {
+      for (k = 0; k < maxc; k++) {
+         w[k][0] = _mm_setr_ps(matrix[k], matrix[maxc + k],
+            matrix[k], matrix[maxc + k]);
+      }
+      for (j = 0; j + 1 < n; j += 2) {
+         __m128 acc = _mm_loadu_ps(buf);
+         if (maxc == 2) {
+            const __m128 v = _mm_loadu_ps(s);
+            acc = _mm_add_ps(acc, _mm_mul_ps(
+               _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 1, 1)), w[1][0]));
+            acc = _mm_add_ps(acc, _mm_mul_ps(
+               _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 0, 0)), w[0][0]));
+         }
+         else {
+            for (k = maxc - 1; k >= 0; k--) {
+               const __m128 v = _mm_setr_ps(s[k], s[k],
+                  s[maxc + k], s[maxc + k]);
+               acc = _mm_add_ps(acc, _mm_mul_ps(v, w[k][0]));
+            }
+         }
+         _mm_storeu_ps(buf, acc);
+         buf += 4;
+         s += 2 * maxc;
+      }
+      n -= j;
+   }
+   else {
+      ASSERT(dest_maxc % 4 == 0);
+      for (k = 0; k < maxc; k++) {
+         for (q = 0; q < dest_maxc / 4; q++) {
+            const float *m = matrix + 4 * q * maxc + k;
+            w[k][q] = _mm_setr_ps(m[0], m[maxc], m[2 * maxc], m[3 * maxc]);
+         }
+      }
+      for (j = 0; j < n; j++) {
+         for (q = 0; q < dest_maxc / 4; q++) {
+            __m128 acc = _mm_loadu_ps(buf + 4 * q);
+            for (k = maxc - 1; k >= 0; k--) {
+               acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(s[k]), w[k][q]));
+            }
+            _mm_storeu_ps(buf + 4 * q, acc);
+         }
+         buf += dest_maxc;
+         s += maxc;
+      }
+      n = 0;
+   }
+
+   mix_block_float_c(buf, s, n, maxc, dest_maxc, matrix);
+}
+
+#endif /* _AL_SIMD_SSE2 */
+
+
+static void mix_block_float(float *buf, const float *s, int n, int maxc,
+   int dest_maxc, const float *matrix)
+{
+#ifdef _AL_SIMD_SSE2
+   if ((dest_maxc == 2 || dest_maxc % 4 == 0) &&
+         (_al_get_cpu_features() & _AL_CPU_SSE2)) {
+      mix_block_float_sse2(buf, s, n, maxc, dest_maxc, matrix);
+      return;
+   }
+#endif
+   mix_block_float_c(buf, s, n, maxc, dest_maxc, matrix);
+}
+
+
 /* Mix as many sample values as possible from the source sample into a mixer
  * buffer.  Implements stream_reader_t.
  *
  * TYPE is the type of the sample values in the mixer buffer, and
- * NEXT_SAMPLE_VALUE must return a buffer of the same type.
+ * NEXT_SAMPLE_VALUE, READ_BLOCK and MIX_FRAMES must work with the same type.
  * 
  * Note: Uses Bresenham to keep the precise sample position.
  */
@@ -279,7 +755,7 @@ static INLINE int32_t clamp(int32_t val, int32_t min, int32_t max)
       delta_error = spl->step - delta * spl->step_denom;                      \
    } while (0)
 
-#define MAKE_MIXER(NAME, NEXT_SAMPLE_VALUE, TYPE)                             \
+#define MAKE_MIXER(NAME, NEXT_SAMPLE_VALUE, READ_BLOCK, MIX_FRAMES, TYPE)     \
 static void NAME(void *source, void **vbuf, unsigned int *samples,            \
    ALLEGRO_AUDIO_DEPTH buffer_depth, size_t dest_maxc)                        \
 {                                                                             \
@@ -287,9 +763,10 @@ static void NAME(void *source, void **vbuf, unsigned int *samples,            \
    TYPE *buf = *vbuf;                                                         \
    size_t maxc = al_get_channel_count(spl->spl_data.chan_conf);               \
    size_t samples_l = *samples;                                               \
-   size_t c;                                                                  \
    int delta, delta_error;                                                    \
    SAMP_BUF samp_buf;                                                         \
+   MIX_BLOCK blk;                                                             \
+   TYPE block_buf[MIX_BLOCK_FRAMES * ALLEGRO_MAX_CHANNELS];                   \
                                                                               \
    BRESENHAM;                                                                 \
                                                                               \
@@ -297,8 +774,8 @@ static void NAME(void *source, void **vbuf, unsigned int *samples,            \
       return;                                                                 \
                                                                               \
    while (samples_l > 0) {                                                    \
-      const TYPE *s;                                                          \
       int old_step = spl->step;                                               \
+      int n;                                                                  \
                                                                               \
       if (!fix_looped_position(spl))                                          \
          return;                                                              \
@@ -306,70 +783,182 @@ static void NAME(void *source, void **vbuf, unsigned int *samples,            \
          BRESENHAM;                                                           \
       }                                                                       \
                                                                               \
-      /* It might be worth preparing multiple sample values at once. */       \
-      s = (TYPE *) NEXT_SAMPLE_VALUE(&samp_buf, spl, maxc);                   \
-                                                                              \
-      for (c = 0; c < dest_maxc; c++) {                                       \
-         ALLEGRO_STATIC_ASSERT(kcm_mixer, ALLEGRO_MAX_CHANNELS == 8);         \
-         switch (maxc) {                                                      \
-            case 8: *buf += s[7] * spl->matrix[c*maxc + 7];                   \
-            /* fall through */                                                \
-            case 7: *buf += s[6] * spl->matrix[c*maxc + 6];                   \
-            /* fall through */                                                \
-            case 6: *buf += s[5] * spl->matrix[c*maxc + 5];                   \
-            /* fall through */                                                \
-            case 5: *buf += s[4] * spl->matrix[c*maxc + 4];                   \
-            /* fall through */                                                \
-            case 4: *buf += s[3] * spl->matrix[c*maxc + 3];                   \
-            /* fall through */                                                \
-            case 3: *buf += s[2] * spl->matrix[c*maxc + 2];                   \
-            /* fall through */                                                \
-            case 2: *buf += s[1] * spl->matrix[c*maxc + 1];                   \
-            /* fall through */                                                \
-            case 1: *buf += s[0] * spl->matrix[c*maxc + 0];                   \
-            /* fall through */                                                \
-            default: break;                                                   \
+      n = plan_block(spl, &blk, _ALLEGRO_MIN(samples_l, MIX_BLOCK_FRAMES),    \
+         delta, delta_error);                                                 \
+      if (n > 0) {                                                            \
+         READ_BLOCK(block_buf, spl, &blk, n, maxc);                           \
+         MIX_FRAMES(buf, block_buf, n, maxc, dest_maxc, spl->matrix);         \
+      }                                                                       \
+      else {                                                                  \
+         /* fix_looped_position left the position outside the sample,        \
+          * e.g. for a stream which has stopped.  Mix one frame from there   \
+          * the same way as ever.                                             \
+          */                                                                  \
+         const TYPE *s = (TYPE *) NEXT_SAMPLE_VALUE(&samp_buf, spl, maxc);    \
+         MIX_FRAMES(buf, s, 1, maxc, dest_maxc, spl->matrix);                 \
+         spl->pos += delta;                                                   \
+         spl->pos_bresenham_error += delta_error;                             \
+         if (spl->pos_bresenham_error >= spl->step_denom) {                   \
+            spl->pos++;                                                       \
+            spl->pos_bresenham_error -= spl->step_denom;                      \
          }                                                                    \
-         buf++;                                                               \
+         n = 1;                                                               \
       }                                                                       \
                                                                               \
-      spl->pos += delta;                                                      \
-      spl->pos_bresenham_error += delta_error;                                \
-      if (spl->pos_bresenham_error >= spl->step_denom) {                      \
-         spl->pos++;                                                          \
-         spl->pos_bresenham_error -= spl->step_denom;                         \
-      }                                                                       \
-      samples_l--;                                                            \
+      buf += n * dest_maxc;                                                   \
+      samples_l -= n;                                                         \
    }                                                                          \
    fix_looped_position(spl);                                                  \
    (void)buffer_depth;                                                        \
 }
 
-MAKE_MIXER(read_to_mixer_point_float_32, point_spl32, float)
-MAKE_MIXER(read_to_mixer_linear_float_32, linear_spl32, float)
-MAKE_MIXER(read_to_mixer_cubic_float_32, cubic_spl32, float)
-MAKE_MIXER(read_to_mixer_point_int16_t_16, point_spl16, int16_t)
-MAKE_MIXER(read_to_mixer_linear_int16_t_16, linear_spl16, int16_t)
+MAKE_MIXER(read_to_mixer_point_float_32, point_spl32, point_block32,
+   mix_block_float, float)
+MAKE_MIXER(read_to_mixer_linear_float_32, linear_spl32, linear_block32,
+   mix_block_float, float)
+MAKE_MIXER(read_to_mixer_cubic_float_32, cubic_spl32, cubic_block32,
+   mix_block_float, float)
+MAKE_MIXER(read_to_mixer_sinc_float_32, cubic_spl32, sinc_block32,
+   mix_block_float, float)
+MAKE_MIXER(read_to_mixer_point_int16_t_16, point_spl16, point_block16,
+   mix_block_int16_t, int16_t)
+MAKE_MIXER(read_to_mixer_linear_int16_t_16, linear_spl16, linear_block16,
+   mix_block_int16_t, int16_t)
 
 #undef MAKE_MIXER
 
 
-/* _al_kcm_mixer_read:
- *  Mixes the streams attached to the mixer and writes additively to the
- *  specified buffer (or if *buf is NULL, indicating a voice, convert it and
- *  set it to the buffer pointer).
+/* Attached mixers of a parallel mixer are rendered in groups of at most
+ * this many at a time.
  */
-void _al_kcm_mixer_read(void *source, void **buf, unsigned int *samples,
-   ALLEGRO_AUDIO_DEPTH buffer_depth, size_t dest_maxc)
+#define MAX_PARALLEL_MIXERS   32
+
+typedef struct PARALLEL_MIXERS {
+   ALLEGRO_MIXER *mixers[MAX_PARALLEL_MIXERS];
+   bool rendered[MAX_PARALLEL_MIXERS];
+   int count;
+   int next;
+   unsigned int samples;
+} PARALLEL_MIXERS;
+
+
+static bool render_mixer(ALLEGRO_MIXER *m, unsigned int samples);
+
+
+static void render_mixer_proc(void *arg, int index)
+{
+   PARALLEL_MIXERS *pm = arg;
+
+   pm->rendered[index] = render_mixer(pm->mixers[index], pm->samples);
+}
+
+
+/* render_parallel_mixers:
+ *  Collects the next group of mixers attached to the mixer, starting at
+ *  index i of its streams and going down like the mixing loop does, and
+ *  renders them on the worker threads.
+ */
+static void render_parallel_mixers(const ALLEGRO_MIXER *mixer,
+   PARALLEL_MIXERS *pm, int i)
+{
+   pm->count = 0;
+   pm->next = 0;
+
+   for (; i >= 0 && pm->count < MAX_PARALLEL_MIXERS; i--) {
+      ALLEGRO_SAMPLE_INSTANCE **slot = _al_vector_ref(&mixer->streams, i);
+      ALLEGRO_SAMPLE_INSTANCE *spl = *slot;
+      if (spl->spl_read == _al_kcm_mixer_read)
+         pm->mixers[pm->count++] = (ALLEGRO_MIXER *)spl;
+   }
+
+   _al_run_parallel(pm->count, render_mixer_proc, pm);
+}
+
+
+/* add_to_mixer_buffer:
+ *  Adds the rendered buffer of a mixer to the buffer of the mixer it is
+ *  attached to.
+ *  Currently we only support mixers of the same audio depth doing this.
+ */
+static void add_to_mixer_buffer(const ALLEGRO_MIXER *mixer, void *buf,
+   int samples_l)
+{
+   switch (mixer->ss.spl_data.depth) {
+      case ALLEGRO_AUDIO_DEPTH_FLOAT32: {
+         /* We don't need to clamp in the mixer yet. */
+         float *lbuf = buf;
+         float *src = mixer->ss.spl_data.buffer.f32;
+         while (samples_l-- > 0) {
+            *lbuf += *src;
+            lbuf++;
+            src++;
+         }
+         break;
+      }
+
+      case ALLEGRO_AUDIO_DEPTH_INT16: {
+         int16_t *lbuf = buf;
+         int16_t *src = mixer->ss.spl_data.buffer.s16;
+         while (samples_l-- > 0) {
+            int32_t x = *lbuf + *src;
+            if (x < -32768)
+               x = -32768;
+            else if (x > 32767)
+               x = 32767;
+            *lbuf = (int16_t)x;
+            lbuf++;
+            src++;
+         }
+         break;
+      }
+
+      case ALLEGRO_AUDIO_DEPTH_INT8:
+      case ALLEGRO_AUDIO_DEPTH_INT24:
+      case ALLEGRO_AUDIO_DEPTH_UINT8:
+      case ALLEGRO_AUDIO_DEPTH_UINT16:
+      case ALLEGRO_AUDIO_DEPTH_UINT24:
+         /* Unsupported mixer depths. */
+         ASSERT(false);
+         break;
+   }
+}
+
+
+/* read_instance:
+ *  Mixes an attached sample instance into the mixer buffer, adding the
+ *  time taken to the statistics if it is a playing stream.
+ */
+static void read_instance(ALLEGRO_MIXER *m, ALLEGRO_SAMPLE_INSTANCE *spl,
+   unsigned int *samples, int maxc)
+{
+   if (spl->loop >= _ALLEGRO_PLAYMODE_STREAM_ONCE && spl->is_playing) {
+      double t0 = al_get_time();
+      spl->spl_read(spl, (void **) &m->ss.spl_data.buffer.ptr,
+         samples, m->ss.spl_data.depth, maxc);
+      _al_kcm_record_mix_time(&((ALLEGRO_AUDIO_STREAM *)spl)->stats,
+         al_get_time() - t0);
+   }
+   else {
+      spl->spl_read(spl, (void **) &m->ss.spl_data.buffer.ptr,
+         samples, m->ss.spl_data.depth, maxc);
+   }
+}
+
+
+/* do_render_mixer:
+ *  Mixes the streams attached to the mixer into the mixer's own buffer and
+ *  applies the post-processing callback and the gain.  Returns false if
+ *  the mixer has nothing to output.
+ */
+static bool do_render_mixer(ALLEGRO_MIXER *m, unsigned int samples)
 {
    const ALLEGRO_MIXER *mixer;
-   ALLEGRO_MIXER *m = (ALLEGRO_MIXER *)source;
    int maxc = al_get_channel_count(m->ss.spl_data.chan_conf);
-   int samples_l = *samples;
+   int samples_l = samples;
    int i;
 
    if (!m->ss.is_playing)
-      return;
+      return false;
 
    /* Make sure the mixer buffer is big enough. */
    if (m->ss.spl_data.len*maxc < samples_l*maxc) {
@@ -379,7 +968,7 @@ void _al_kcm_mixer_read(void *source, void **buf, unsigned int *samples,
          _al_set_error(ALLEGRO_GENERIC_ERROR,
             "Out of memory allocating mixer buffer");
          m->ss.spl_data.len = 0;
-         return;
+         return false;
       }
       m->ss.spl_data.len = samples_l;
    }
@@ -390,18 +979,47 @@ void _al_kcm_mixer_read(void *source, void **buf, unsigned int *samples,
    memset(mixer->ss.spl_data.buffer.ptr, 0, samples_l * maxc * al_get_audio_depth_size(mixer->ss.spl_data.depth));
 
    /* Mix the streams into the mixer buffer. */
-   for (i = _al_vector_size(&mixer->streams) - 1; i >= 0; i--) {
-      ALLEGRO_SAMPLE_INSTANCE **slot = _al_vector_ref(&mixer->streams, i);
-      ALLEGRO_SAMPLE_INSTANCE *spl = *slot;
-      ASSERT(spl->spl_read);
-      spl->spl_read(spl, (void **) &mixer->ss.spl_data.buffer.ptr, samples,
-         m->ss.spl_data.depth, maxc);
+   if (mixer->parallel && _al_get_parallel_thread_count() > 1) {
+      /* Attached mixers are rendered ahead on the worker threads, then
+       * added in the same order as they would have been otherwise.
+       */
+      PARALLEL_MIXERS pm;
+      pm.count = 0;
+      pm.next = 0;
+      pm.samples = samples;
+
+      for (i = _al_vector_size(&mixer->streams) - 1; i >= 0; i--) {
+         ALLEGRO_SAMPLE_INSTANCE **slot = _al_vector_ref(&mixer->streams, i);
+         ALLEGRO_SAMPLE_INSTANCE *spl = *slot;
+         ASSERT(spl->spl_read);
+         if (spl->spl_read == _al_kcm_mixer_read) {
+            if (pm.next == pm.count)
+               render_parallel_mixers(mixer, &pm, i);
+            ASSERT(pm.mixers[pm.next] == (ALLEGRO_MIXER *)spl);
+            if (pm.rendered[pm.next]) {
+               add_to_mixer_buffer((ALLEGRO_MIXER *)spl,
+                  mixer->ss.spl_data.buffer.ptr, samples_l * maxc);
+            }
+            pm.next++;
+         }
+         else {
+            read_instance(m, spl, &samples, maxc);
+         }
+      }
+   }
+   else {
+      for (i = _al_vector_size(&mixer->streams) - 1; i >= 0; i--) {
+         ALLEGRO_SAMPLE_INSTANCE **slot = _al_vector_ref(&mixer->streams, i);
+         ALLEGRO_SAMPLE_INSTANCE *spl = *slot;
+         ASSERT(spl->spl_read);
+         read_instance(m, spl, &samples, maxc);
+      }
    }
 
    /* Call the post-processing callback. */
    if (mixer->postprocess_callback) {
       mixer->postprocess_callback(mixer->ss.spl_data.buffer.ptr,
-         *samples, mixer->pp_callback_userdata);
+         samples, mixer->pp_callback_userdata);
    }
 
    samples_l *= maxc;
@@ -439,48 +1057,44 @@ void _al_kcm_mixer_read(void *source, void **buf, unsigned int *samples,
       }
    }
 
-   /* Feeding to a non-voice.
-    * Currently we only support mixers of the same audio depth doing this.
-    */
-   if (*buf) {
-      switch (m->ss.spl_data.depth) {
-         case ALLEGRO_AUDIO_DEPTH_FLOAT32: {
-            /* We don't need to clamp in the mixer yet. */
-            float *lbuf = *buf;
-            float *src = mixer->ss.spl_data.buffer.f32;
-            while (samples_l-- > 0) {
-               *lbuf += *src;
-               lbuf++;
-               src++;
-            }
-            break;
+   return true;
+}
 
-         case ALLEGRO_AUDIO_DEPTH_INT16: {
-            int16_t *lbuf = *buf;
-            int16_t *src = mixer->ss.spl_data.buffer.s16;
-            while (samples_l-- > 0) {
-               int32_t x = *lbuf + *src;
-               if (x < -32768)
-                  x = -32768;
-               else if (x > 32767)
-                  x = 32767;
-               *lbuf = (int16_t)x;
-               lbuf++;
-               src++;
-            }
-            break;
-         }
 
-         case ALLEGRO_AUDIO_DEPTH_INT8:
-         case ALLEGRO_AUDIO_DEPTH_INT24:
-         case ALLEGRO_AUDIO_DEPTH_UINT8:
-         case ALLEGRO_AUDIO_DEPTH_UINT16:
-         case ALLEGRO_AUDIO_DEPTH_UINT24:
-            /* Unsupported mixer depths. */
-            ASSERT(false);
-            break;
-         }
-      }
+/* render_mixer:
+ *  Renders the mixer, adding the time taken, including that of any
+ *  attached mixers, to its statistics.
+ */
+static bool render_mixer(ALLEGRO_MIXER *m, unsigned int samples)
+{
+   double t0 = al_get_time();
+
+   if (!do_render_mixer(m, samples))
+      return false;
+
+   _al_kcm_record_mix_time(&m->stats, al_get_time() - t0);
+   return true;
+}
+
+
+/* _al_kcm_mixer_read:
+ *  Mixes the streams attached to the mixer and writes additively to the
+ *  specified buffer (or if *buf is NULL, indicating a voice, convert it and
+ *  set it to the buffer pointer).
+ */
+void _al_kcm_mixer_read(void *source, void **buf, unsigned int *samples,
+   ALLEGRO_AUDIO_DEPTH buffer_depth, size_t dest_maxc)
+{
+   const ALLEGRO_MIXER *mixer = (ALLEGRO_MIXER *)source;
+   int maxc = al_get_channel_count(mixer->ss.spl_data.chan_conf);
+   int samples_l = *samples * maxc;
+
+   if (!render_mixer((ALLEGRO_MIXER *)source, *samples))
+      return;
+
+   /* Feeding to a non-voice. */
+   if (*buf) {
+      add_to_mixer_buffer(mixer, *buf, samples_l);
       return;
    }
 
@@ -638,6 +1252,10 @@ ALLEGRO_MIXER *al_create_mixer(unsigned int freq,
          ALLEGRO_INFO("Cubic interpolation\n");
          default_mixer_quality = ALLEGRO_MIXER_QUALITY_CUBIC;
       }
+      else if (!_al_stricmp(p, "sinc")) {
+         ALLEGRO_INFO("Windowed sinc interpolation\n");
+         default_mixer_quality = ALLEGRO_MIXER_QUALITY_SINC;
+      }
    }
 
    if (!freq) {
@@ -700,6 +1318,8 @@ bool al_attach_sample_instance_to_mixer(ALLEGRO_SAMPLE_INSTANCE *spl,
    ALLEGRO_MIXER *mixer)
 {
    ALLEGRO_SAMPLE_INSTANCE **slot;
+   const float *sinc_table = NULL;
+   int step;
 
    ASSERT(mixer);
    ASSERT(spl);
@@ -711,6 +1331,23 @@ bool al_attach_sample_instance_to_mixer(ALLEGRO_SAMPLE_INSTANCE *spl,
       return false;
    }
 
+   step = (spl->spl_data.frequency) * spl->speed;
+   /* Don't want to be trapped with a step value of 0. */
+   if (step == 0) {
+      if (spl->speed > 0.0f)
+         step = 1;
+      else
+         step = -1;
+   }
+
+   /* The resampling table may have to be built first, which shouldn't be
+    * done while holding the mixer's mutex.
+    */
+   if (!spl->is_mixer && mixer->quality == ALLEGRO_MIXER_QUALITY_SINC &&
+         mixer->ss.spl_data.depth == ALLEGRO_AUDIO_DEPTH_FLOAT32) {
+      sinc_table = _al_kcm_get_sinc_table(step, mixer->ss.spl_data.frequency);
+   }
+
    maybe_lock_mutex(mixer->ss.mutex);
    
    _al_kcm_stream_set_mutex(spl, mixer->ss.mutex);
@@ -726,15 +1363,8 @@ bool al_attach_sample_instance_to_mixer(ALLEGRO_SAMPLE_INSTANCE *spl,
    }
    (*slot) = spl;
 
-   spl->step = (spl->spl_data.frequency) * spl->speed;
+   spl->step = step;
    spl->step_denom = mixer->ss.spl_data.frequency;
-   /* Don't want to be trapped with a step value of 0. */
-   if (spl->step == 0) {
-      if (spl->speed > 0.0f)
-         spl->step = 1;
-      else
-         spl->step = -1;
-   }
 
    /* Set the proper sample stream reader. */
    ASSERT(spl->spl_read == NULL);
@@ -754,6 +1384,16 @@ bool al_attach_sample_instance_to_mixer(ALLEGRO_SAMPLE_INSTANCE *spl,
                case ALLEGRO_MIXER_QUALITY_CUBIC:
                   spl->spl_read = read_to_mixer_cubic_float_32;
                   break;
+               case ALLEGRO_MIXER_QUALITY_SINC:
+                  spl->sinc_table = sinc_table;
+                  if (spl->sinc_table) {
+                     spl->spl_read = read_to_mixer_sinc_float_32;
+                  }
+                  else {
+                     ALLEGRO_WARN("Falling back to cubic interpolation\n");
+                     spl->spl_read = read_to_mixer_cubic_float_32;
+                  }
+                  break;
             }
             break;
 
@@ -763,6 +1403,7 @@ bool al_attach_sample_instance_to_mixer(ALLEGRO_SAMPLE_INSTANCE *spl,
                   spl->spl_read = read_to_mixer_point_int16_t_16;
                   break;
                case ALLEGRO_MIXER_QUALITY_CUBIC:
+               case ALLEGRO_MIXER_QUALITY_SINC:
                   ALLEGRO_WARN("Falling back to linear interpolation\n");
                   /* fallthrough */
                case ALLEGRO_MIXER_QUALITY_LINEAR:
@@ -1006,6 +1647,30 @@ bool al_set_mixer_playing(ALLEGRO_MIXER *mixer, bool val)
 }
 
 
+/* Function: al_get_mixer_parallel
+ */
+bool al_get_mixer_parallel(const ALLEGRO_MIXER *mixer)
+{
+   ASSERT(mixer);
+
+   return mixer->parallel;
+}
+
+
+/* Function: al_set_mixer_parallel
+ */
+bool al_set_mixer_parallel(ALLEGRO_MIXER *mixer, bool val)
+{
+   ASSERT(mixer);
+
+   maybe_lock_mutex(mixer->ss.mutex);
+   mixer->parallel = val;
+   maybe_unlock_mutex(mixer->ss.mutex);
+
+   return true;
+}
+
+
 /* Function: al_detach_mixer
  */
 bool al_detach_mixer(ALLEGRO_MIXER *mixer)
@@ -0,0 +1,486 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Windowed sinc resampling.
+ *
+ *      Each output value is the sum of _AL_KCM_SINC_TAPS input values
+ *      around its position, weighted by a Kaiser windowed sinc.  The
+ *      weights are looked up in a table of SINC_PHASES + 1 evenly spaced
+ *      fractional positions, interpolating linearly between neighbouring
+ *      rows.  When the input is played faster than the output rate, the
+ *      cutoff of the filter is lowered to keep it from aliasing.  One
+ *      table is built for each cutoff level in use and shared by all
+ *      sample instances.
+ *
+ *      See LICENSE.txt for copyright information.
+ */
+
+
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "allegro5/allegro.h"
+#include "allegro5/allegro_audio.h"
+#include "allegro5/internal/aintern.h"
+#include "allegro5/internal/aintern_audio.h"
+#include "allegro5/internal/aintern_simd.h"
+
+ALLEGRO_DEBUG_CHANNEL("audio")
+
+
+#define SINC_TAPS          _AL_KCM_SINC_TAPS
+#define SINC_PHASES        128
+#define SINC_TABLE_SIZE    ((SINC_PHASES + 1) * SINC_TAPS)
+
+/* Number of different cutoffs for downsampling. */
+#define SINC_LEVELS        32
+
+/* Cutoff at the input rate, as a fraction of the Nyquist frequency.  It is
+ * below 1 to leave room for the transition band of the filter.
+ */
+#define SINC_CUTOFF        0.88
+
+#define SINC_KAISER_BETA   6.0
+
+
+static ALLEGRO_MUTEX *sinc_mutex = NULL;
+static float *sinc_tables[SINC_LEVELS + 1];
+
+
+
+/* Zeroth order modified Bessel function of the first kind. */
+static double bessel_i0(double x)
+{
+   double sum = 1.0;
+   double term = 1.0;
+   int k;
+
+   for (k = 1; k < 50; k++) {
+      term *= (x / (2.0 * k)) * (x / (2.0 * k));
+      sum += term;
+      if (term < sum * 1e-12)
+         break;
+   }
+   return sum;
+}
+
+
+
+static float *build_sinc_table(int level)
+{
+   const double cutoff = SINC_CUTOFF * level / SINC_LEVELS;
+   const double half = SINC_TAPS / 2;
+   const double i0_beta = bessel_i0(SINC_KAISER_BETA);
+   float *table;
+   int ph, k;
+
+   table = al_malloc(SINC_TABLE_SIZE * sizeof(float));
+   if (!table) {
+      _al_set_error(ALLEGRO_GENERIC_ERROR,
+         "Out of memory allocating resampling table");
+      return NULL;
+   }
+
+   for (ph = 0; ph <= SINC_PHASES; ph++) {
+      double h[SINC_TAPS];
+      double sum = 0.0;
+
+      for (k = 0; k < SINC_TAPS; k++) {
+         /* Distance of the tap from the output position. */
+         const double d = k - (half - 1) - (double) ph / SINC_PHASES;
+         const double x = d / half;
+         double s, w;
+
+         if (d == 0.0)
+            s = cutoff;
+         else
+            s = sin(ALLEGRO_PI * cutoff * d) / (ALLEGRO_PI * d);
+
+         if (x <= -1.0 || x >= 1.0)
+            w = 0.0;
+         else
+            w = bessel_i0(SINC_KAISER_BETA * sqrt(1.0 - x * x)) / i0_beta;
+
+         h[k] = s * w;
+         sum += h[k];
+      }
+
+      /* Keep the gain at 1 for every position. */
+      for (k = 0; k < SINC_TAPS; k++)
+         table[ph * SINC_TAPS + k] = h[k] / sum;
+   }
+
+   return table;
+}
+
+
+
+static int sinc_level(int step, int step_denom)
+{
+   const int64_t abs_step = step < 0 ? -(int64_t) step : step;
+   int level;
+
+   if (abs_step <= step_denom)
+      return SINC_LEVELS;
+
+   level = (int64_t) step_denom * SINC_LEVELS / abs_step;
+   return level > 0 ? level : 1;
+}
+
+
+
+/* _al_kcm_init_resampler:
+ *  Prepares the cache of resampling tables.
+ */
+void _al_kcm_init_resampler(void)
+{
+   if (!sinc_mutex)
+      sinc_mutex = al_create_mutex();
+}
+
+
+
+/* _al_kcm_shutdown_resampler:
+ *  Frees the resampling tables.  Nothing may be using them any more.
+ */
+void _al_kcm_shutdown_resampler(void)
+{
+   int i;
+
+   for (i = 0; i <= SINC_LEVELS; i++) {
+      al_free(sinc_tables[i]);
+      sinc_tables[i] = NULL;
+   }
+
+   al_destroy_mutex(sinc_mutex);
+   sinc_mutex = NULL;
+}
+
+
+
+/* _al_kcm_get_sinc_table:
+ *  Returns the table for resampling with the given step, building it if
+ *  necessary, or NULL if it could not be built.  Since building a table
+ *  takes a while, call this before taking any mutex the mixer needs.
+ */
+const float *_al_kcm_get_sinc_table(int step, int step_denom)
+{
+   const int level = sinc_level(step, step_denom);
+   float *table;
+   float *built;
+
+   if (sinc_mutex)
+      al_lock_mutex(sinc_mutex);
+   table = sinc_tables[level];
+   if (sinc_mutex)
+      al_unlock_mutex(sinc_mutex);
+   if (table)
+      return table;
+
+   /* Build it without the mutex held, so that looking up other tables
+    * isn't held up.  If another thread got there first, use its table.
+    */
+   built = build_sinc_table(level);
+   if (!built)
+      return NULL;
+
+   if (sinc_mutex)
+      al_lock_mutex(sinc_mutex);
+   table = sinc_tables[level];
+   if (!table) {
+      table = sinc_tables[level] = built;
+      built = NULL;
+      ALLEGRO_DEBUG("Built resampling table for cutoff level %d/%d\n",
+         level, SINC_LEVELS);
+   }
+   if (sinc_mutex)
+      al_unlock_mutex(sinc_mutex);
+
+   al_free(built);
+   return table;
+}
+
+
+
+static void sinc_interpolate_c(const float *row, float f, const float *frames,
+   int maxc, float *out)
+{
+   float coefs[SINC_TAPS];
+   int k, c;
+
+   for (k = 0; k < SINC_TAPS; k++)
+      coefs[k] = row[k] + f * (row[SINC_TAPS + k] - row[k]);
+
+   for (c = 0; c < maxc; c++) {
+      const float *x = frames + c;
+      float acc = 0.0f;
+      for (k = 0; k < SINC_TAPS; k++) {
+         acc += coefs[k] * *x;
+         x += maxc;
+      }
+      out[c] = acc;
+   }
+}
+
+
+
+#ifdef _AL_SIMD_SSE2
+
+#include <emmintrin.h>
+
+/* sinc_interpolate_sse2:
+ *  sinc_interpolate_c for mono and stereo, four taps or two stereo taps
+ *  per vector.  The products are summed in four separate accumulators so
+ *  that the additions don't have to wait for each other.
+ */
+static _AL_TARGET_SSE2 void sinc_interpolate_sse2(const float *row, float f,
+   const float *frames, int maxc, float *out)
+{
+   const __m128 vf = _mm_set1_ps(f);
+   __m128 acc0 = _mm_setzero_ps();
+   __m128 acc1 = _mm_setzero_ps();
+   __m128 acc2 = _mm_setzero_ps();
+   __m128 acc3 = _mm_setzero_ps();
+   float sum[4];
+   int k;
+
+   if (maxc == 1) {
+      for (k = 0; k < SINC_TAPS; k += 8) {
+         const __m128 a0 = _mm_loadu_ps(row + k);
+         const __m128 a1 = _mm_loadu_ps(row + k + 4);
+         const __m128 b0 = _mm_loadu_ps(row + SINC_TAPS + k);
+         const __m128 b1 = _mm_loadu_ps(row + SINC_TAPS + k + 4);
+         const __m128 c0 = _mm_add_ps(a0, _mm_mul_ps(vf, _mm_sub_ps(b0, a0)));
+         const __m128 c1 = _mm_add_ps(a1, _mm_mul_ps(vf, _mm_sub_ps(b1, a1)));
+         acc0 = _mm_add_ps(acc0, _mm_mul_ps(c0, _mm_loadu_ps(frames + k)));
+         acc1 = _mm_add_ps(acc1, _mm_mul_ps(c1, _mm_loadu_ps(frames + k + 4)));
+      }
+      acc0 = _mm_add_ps(acc0, acc1);
+      _mm_storeu_ps(sum, acc0);
+      out[0] = (sum[0] + sum[1]) + (sum[2] + sum[3]);
+   }
+   else {
+      ASSERT(maxc == 2);
+      for (k = 0; k < SINC_TAPS; k += 8) {
+         const __m128 a0 = _mm_loadu_ps(row + k);
+         const __m128 a1 = _mm_loadu_ps(row + k + 4);
+         const __m128 b0 = _mm_loadu_ps(row + SINC_TAPS + k);
+         const __m128 b1 = _mm_loadu_ps(row + SINC_TAPS + k + 4);
+         const __m128 c0 = _mm_add_ps(a0, _mm_mul_ps(vf, _mm_sub_ps(b0, a0)));
+         const __m128 c1 = _mm_add_ps(a1, _mm_mul_ps(vf, _mm_sub_ps(b1, a1)));
+         /* c0 c0 c1 c1 against L0 R0 L1 R1, then c2 c2 c3 c3, etc. */
+         acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_unpacklo_ps(c0, c0),
+            _mm_loadu_ps(frames + 2 * k)));
+         acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_unpackhi_ps(c0, c0),
+            _mm_loadu_ps(frames + 2 * k + 4)));
+         acc2 = _mm_add_ps(acc2, _mm_mul_ps(_mm_unpacklo_ps(c1, c1),
+            _mm_loadu_ps(frames + 2 * k + 8)));
+         acc3 = _mm_add_ps(acc3, _mm_mul_ps(_mm_unpackhi_ps(c1, c1),
+            _mm_loadu_ps(frames + 2 * k + 12)));
+      }
+      acc0 = _mm_add_ps(_mm_add_ps(acc0, acc1), _mm_add_ps(acc2, acc3));
+      _mm_storeu_ps(sum, acc0);
+      out[0] = sum[0] + sum[2];
+      out[1] = sum[1] + sum[3];
+   }
+}
+
+#endif /* _AL_SIMD_SSE2 */
+
+
+
+/* _al_kcm_sinc_interpolate:
+ *  Writes the maxc values of the frame at the fractional position
+ *  err / step_denom between the middle two of the _AL_KCM_SINC_TAPS
+ *  interleaved frames at 'frames' to 'out'.
+ */
+void _al_kcm_sinc_interpolate(const float *table, int err, int step_denom,
+   const float *frames, int maxc, float *out)
+{
+   const float p = (float) err / step_denom * SINC_PHASES;
+   int ph = (int) p;
+   float f;
+
+   if (ph >= SINC_PHASES)
+      ph = SINC_PHASES - 1;
+   f = p - ph;
+
+#ifdef _AL_SIMD_SSE2
+   if (maxc <= 2 && (_al_get_cpu_features() & _AL_CPU_SSE2)) {
+      sinc_interpolate_sse2(table + ph * SINC_TAPS, f, frames, maxc, out);
+      return;
+   }
+#endif
+   sinc_interpolate_c(table + ph * SINC_TAPS, f, frames, maxc, out);
+}
+
+
+
+static float get_float_value(const any_buffer_t buf, ALLEGRO_AUDIO_DEPTH depth,
+   size_t i)
+{
+   switch (depth) {
+      case ALLEGRO_AUDIO_DEPTH_FLOAT32:
+         return buf.f32[i];
+      case ALLEGRO_AUDIO_DEPTH_INT24:
+         return (float) buf.s24[i] / ((float) 0x7FFFFF + 0.5f);
+      case ALLEGRO_AUDIO_DEPTH_UINT24:
+         return (float) buf.u24[i] / ((float) 0x7FFFFF + 0.5f) - 1.0f;
+      case ALLEGRO_AUDIO_DEPTH_INT16:
+         return (float) buf.s16[i] / ((float) 0x7FFF + 0.5f);
+      case ALLEGRO_AUDIO_DEPTH_UINT16:
+         return (float) buf.u16[i] / ((float) 0x7FFF + 0.5f) - 1.0f;
+      case ALLEGRO_AUDIO_DEPTH_INT8:
+         return (float) buf.s8[i] / ((float) 0x7F + 0.5f);
+      case ALLEGRO_AUDIO_DEPTH_UINT8:
+         return (float) buf.u8[i] / ((float) 0x7F + 0.5f) - 1.0f;
+   }
+   ASSERT(false);
+   return 0.0f;
+}
+
+
+
+static int32_t clamp_to_int(float x, int32_t max)
+{
+   const float y = x * ((float) max + 0.5f);
+
+   if (y >= max)
+      return max;
+   if (y <= -max - 1)
+      return -max - 1;
+   return (int32_t) y;
+}
+
+
+
+static void put_float_value(any_buffer_t buf, ALLEGRO_AUDIO_DEPTH depth,
+   size_t i, float x)
+{
+   switch (depth) {
+      case ALLEGRO_AUDIO_DEPTH_FLOAT32:
+         buf.f32[i] = x;
+         break;
+      case ALLEGRO_AUDIO_DEPTH_INT24:
+         buf.s24[i] = clamp_to_int(x, 0x7FFFFF);
+         break;
+      case ALLEGRO_AUDIO_DEPTH_UINT24:
+         buf.u24[i] = clamp_to_int(x, 0x7FFFFF) + 0x800000;
+         break;
+      case ALLEGRO_AUDIO_DEPTH_INT16:
+         buf.s16[i] = clamp_to_int(x, 0x7FFF);
+         break;
+      case ALLEGRO_AUDIO_DEPTH_UINT16:
+         buf.u16[i] = clamp_to_int(x, 0x7FFF) + 0x8000;
+         break;
+      case ALLEGRO_AUDIO_DEPTH_INT8:
+         buf.s8[i] = clamp_to_int(x, 0x7F);
+         break;
+      case ALLEGRO_AUDIO_DEPTH_UINT8:
+         buf.u8[i] = clamp_to_int(x, 0x7F) + 0x80;
+         break;
+   }
+}
+
+
+
+/* Function: al_resample_sample
+ */
+ALLEGRO_SAMPLE *al_resample_sample(const ALLEGRO_SAMPLE *spl,
+   unsigned int freq)
+{
+   const size_t pad = SINC_TAPS / 2;
+   ALLEGRO_SAMPLE *result;
+   any_buffer_t dest;
+   float *src;
+   float *table;
+   size_t src_len;
+   size_t len;
+   size_t i, c;
+   size_t pos = 0;
+   int maxc;
+   int delta, delta_error;
+   int err = 0;
+
+   ASSERT(spl);
+
+   if (freq == 0 || freq > INT_MAX || spl->frequency > INT_MAX) {
+      _al_set_error(ALLEGRO_INVALID_PARAM, "Invalid sample frequency");
+      return NULL;
+   }
+
+   maxc = al_get_channel_count(spl->chan_conf);
+   delta = spl->frequency / freq;
+   delta_error = spl->frequency % freq;
+
+   len = ((uint64_t) spl->len * freq + spl->frequency - 1) / spl->frequency;
+   if (len == 0) {
+      _al_set_error(ALLEGRO_INVALID_PARAM,
+         "Attempted to resample a sample to no sample values");
+      return NULL;
+   }
+
+   table = build_sinc_table(sinc_level(spl->frequency, freq));
+   if (!table)
+      return NULL;
+
+   /* Work on a float copy of the sample with silence on either side, so
+    * that every output frame can take all its taps from it.
+    */
+   src_len = spl->len + 2 * pad;
+   src = al_malloc(src_len * maxc * sizeof(float));
+   dest.ptr = al_malloc(len * maxc * al_get_audio_depth_size(spl->depth));
+   if (!src || !dest.ptr) {
+      _al_set_error(ALLEGRO_GENERIC_ERROR,
+         "Out of memory allocating resampled sample");
+      al_free(src);
+      al_free(dest.ptr);
+      al_free(table);
+      return NULL;
+   }
+
+   memset(src, 0, pad * maxc * sizeof(float));
+   for (i = 0; i < (size_t) spl->len * maxc; i++)
+      src[pad * maxc + i] = get_float_value(spl->buffer, spl->depth, i);
+   memset(src + (pad + spl->len) * maxc, 0, pad * maxc * sizeof(float));
+
+   for (i = 0; i < len; i++) {
+      float frame[ALLEGRO_MAX_CHANNELS];
+
+      /* The first tap of the frame at pos is pos - (SINC_TAPS/2 - 1), which
+       * is pos + 1 in the padded copy.
+       */
+      _al_kcm_sinc_interpolate(table, err, freq, src + (pos + 1) * maxc,
+         maxc, frame);
+      for (c = 0; c < (size_t) maxc; c++)
+         put_float_value(dest, spl->depth, i * maxc + c, frame[c]);
+
+      pos += delta;
+      err += delta_error;
+      if (err >= (int) freq) {
+         pos++;
+         err -= freq;
+      }
+   }
+
+   al_free(src);
+   al_free(table);
+
+   result = al_create_sample(dest.ptr, len, freq, spl->depth, spl->chan_conf,
+      true);
+   if (!result)
+      al_free(dest.ptr);
+   return result;
+}
+
+
+
+/* vim: set sts=3 sw=3 et: */
@@ -18,6 +18,8 @@
 /* Title: Sample audio interface
  */
 
+#include <math.h>
+
 #include "allegro5/allegro.h"
 #include "allegro5/allegro_audio.h"
 #include "allegro5/internal/aintern.h"
@@ -32,18 +34,39 @@ static ALLEGRO_MIXER *allegro_mixer = NULL;
 static ALLEGRO_MIXER *default_mixer = NULL;
 
 
+/* A slot in auto_samples has an instance which is attached to the default
+ * mixer. A slot in virtual_samples has no instance; it belongs to a sample
+ * which was played but didn't get a real slot, or lost it, and only keeps
+ * track of where that sample would be now so that it can take over a real
+ * slot again when one becomes free.
+ */
 typedef struct AUTO_SAMPLE {
    ALLEGRO_SAMPLE_INSTANCE *instance;
    int id;
    bool locked;
+   int priority;
+   ALLEGRO_SAMPLE *sample;
+   /* The rest is only used by virtual samples. */
+   float gain;
+   float pan;
+   float speed;
+   ALLEGRO_PLAYMODE loop;
+   double start_pos;
+   double start_time;
 } AUTO_SAMPLE;
 
 static _AL_VECTOR auto_samples = _AL_VECTOR_INITIALIZER(AUTO_SAMPLE);
+static _AL_VECTOR virtual_samples = _AL_VECTOR_INITIALIZER(AUTO_SAMPLE);
+static ALLEGRO_SAMPLE_STEAL_MODE steal_mode = ALLEGRO_SAMPLE_STEAL_NONE;
+static ALLEGRO_SAMPLE_POOL_STATS pool_stats;
+static int next_id = 0;
 
 
 static bool create_default_mixer(void);
 static bool do_play_sample(ALLEGRO_SAMPLE_INSTANCE *spl, ALLEGRO_SAMPLE *data,
-      float gain, float pan, float speed, ALLEGRO_PLAYMODE loop);
+      float gain, float pan, float speed, ALLEGRO_PLAYMODE loop,
+      unsigned int pos);
+static void forget_virtual_samples(ALLEGRO_SAMPLE *spl);
 static void free_sample_vector(void);
 
 
@@ -190,10 +213,14 @@ void al_destroy_sample(ALLEGRO_SAMPLE *spl)
    if (spl) {
       _al_kcm_foreach_destructor(stop_sample_instances_helper,
          al_get_sample_data(spl));
+      forget_virtual_samples(spl);
       _al_kcm_unregister_destructor(spl->dtor_item);
 
       if (spl->free_buf && spl->buffer.ptr) {
-         al_free(spl->buffer.ptr);
+         if (spl->free_buf_proc)
+            spl->free_buf_proc(spl);
+         else
+            al_free(spl->buffer.ptr);
       }
       spl->buffer.ptr = NULL;
       spl->free_buf = false;
@@ -224,9 +251,8 @@ bool al_reserve_samples(int reserve_samples)
       /* We need to reserve more samples than currently are reserved. */
       for (i = 0; i < reserve_samples - current_samples_count; i++) {
          AUTO_SAMPLE *slot = _al_vector_alloc_back(&auto_samples);
-         slot->id = 0;
+         memset(slot, 0, sizeof(*slot));
          slot->instance = al_create_sample_instance(NULL);
-         slot->locked = false;
          if (!slot->instance) {
             ALLEGRO_ERROR("al_create_sample failed\n");
             goto Error;
@@ -337,13 +363,310 @@ void al_set_default_voice(ALLEGRO_VOICE *voice)
 }
 
 
+/* Function: al_reserve_virtual_samples
+ */
+bool al_reserve_virtual_samples(int reserve_samples)
+{
+   int current_samples_count = (int) _al_vector_size(&virtual_samples);
+
+   ASSERT(reserve_samples >= 0);
+
+   while (current_samples_count < reserve_samples) {
+      AUTO_SAMPLE *slot = _al_vector_alloc_back(&virtual_samples);
+      if (!slot)
+         return false;
+      memset(slot, 0, sizeof(*slot));
+      current_samples_count++;
+   }
+
+   while (current_samples_count > reserve_samples) {
+      _al_vector_delete_at(&virtual_samples, --current_samples_count);
+   }
+
+   return true;
+}
+
+
+/* Function: al_set_sample_steal_mode
+ */
+void al_set_sample_steal_mode(ALLEGRO_SAMPLE_STEAL_MODE mode)
+{
+   steal_mode = mode;
+}
+
+
+/* Function: al_get_sample_steal_mode
+ */
+ALLEGRO_SAMPLE_STEAL_MODE al_get_sample_steal_mode(void)
+{
+   return steal_mode;
+}
+
+
+/* Where a virtual sample would be now if it had been playing all along, or
+ * -1 if it would have finished.
+ */
+static double virtual_sample_position(const AUTO_SAMPLE *slot, double now)
+{
+   double len = al_get_sample_length(slot->sample);
+   double pos = slot->start_pos + (now - slot->start_time) *
+      slot->speed * al_get_sample_frequency(slot->sample);
+
+   if (len <= 0.0)
+      return -1.0;
+
+   switch (slot->loop) {
+      case ALLEGRO_PLAYMODE_LOOP:
+         return fmod(pos, len);
+      case ALLEGRO_PLAYMODE_BIDIR:
+         /* The direction is lost; it resumes forwards. */
+         pos = fmod(pos, 2.0 * len);
+         return (pos < len) ? pos : 2.0 * len - pos - 1.0;
+      default:
+         return (pos < len) ? pos : -1.0;
+   }
+}
+
+
+static int slot_index(_AL_VECTOR *vec, AUTO_SAMPLE *slot)
+{
+   return (int) (slot - (AUTO_SAMPLE *) _al_vector_ref(vec, 0));
+}
+
+
+static AUTO_SAMPLE *find_free_virtual_slot(void)
+{
+   unsigned int i;
+
+   for (i = 0; i < _al_vector_size(&virtual_samples); i++) {
+      AUTO_SAMPLE *slot = _al_vector_ref(&virtual_samples, i);
+      if (!slot->sample)
+         return slot;
+   }
+
+   return NULL;
+}
+
+
+static void free_virtual_slot(AUTO_SAMPLE *slot)
+{
+   slot->sample = NULL;
+   slot->id = 0;
+}
+
+
+/* Moves the sample playing in a real slot to a virtual slot, if there is one
+ * free, and stops the slot's instance either way.
+ */
+static void steal_slot(AUTO_SAMPLE *slot)
+{
+   ALLEGRO_SAMPLE_INSTANCE *inst = slot->instance;
+   AUTO_SAMPLE *vslot = find_free_virtual_slot();
+
+   pool_stats.stolen++;
+
+   if (vslot) {
+      vslot->id = slot->id;
+      vslot->priority = slot->priority;
+      vslot->sample = slot->sample;
+      vslot->gain = al_get_sample_instance_gain(inst);
+      vslot->pan = al_get_sample_instance_pan(inst);
+      vslot->speed = al_get_sample_instance_speed(inst);
+      vslot->loop = al_get_sample_instance_playmode(inst);
+      vslot->start_pos = al_get_sample_instance_position(inst);
+      vslot->start_time = al_get_time();
+   }
+   else {
+      pool_stats.dropped++;
+   }
+
+   al_stop_sample_instance(inst);
+   slot->id = 0;
+}
+
+
+/* Returns whether the playing slot a is a better one to steal than b. */
+static bool better_victim(AUTO_SAMPLE *a, AUTO_SAMPLE *b)
+{
+   float gain_a = al_get_sample_instance_gain(a->instance);
+   float gain_b = al_get_sample_instance_gain(b->instance);
+
+   if ((gain_a <= 0.0f) != (gain_b <= 0.0f))
+      return gain_a <= 0.0f;
+   if (a->priority != b->priority)
+      return a->priority < b->priority;
+   if (steal_mode == ALLEGRO_SAMPLE_STEAL_QUIETEST && gain_a != gain_b)
+      return gain_a < gain_b;
+   return a->id < b->id;
+}
+
+
+/* Finds a real slot for a sample of the given priority, either a free one or
+ * one which may be stolen: one which is inaudible, if its sample can carry
+ * on as a virtual sample, or, if the steal mode allows it, one with a lower
+ * priority (or equal, unless `strict').
+ */
+static AUTO_SAMPLE *find_real_slot(int priority, bool strict)
+{
+   bool have_virtual = (find_free_virtual_slot() != NULL);
+   AUTO_SAMPLE *victim = NULL;
+   unsigned int i;
+
+   for (i = 0; i < _al_vector_size(&auto_samples); i++) {
+      AUTO_SAMPLE *slot = _al_vector_ref(&auto_samples, i);
+
+      if (slot->locked)
+         continue;
+      if (!al_get_sample_instance_playing(slot->instance))
+         return slot;
+
+      if (have_virtual && al_get_sample_instance_gain(slot->instance) <= 0.0f) {
+         /* Always fair game. */
+      }
+      else if (steal_mode == ALLEGRO_SAMPLE_STEAL_NONE ||
+            slot->priority > priority ||
+            (strict && slot->priority == priority)) {
+         continue;
+      }
+
+      if (!victim || better_victim(slot, victim))
+         victim = slot;
+   }
+
+   return victim;
+}
+
+
+static bool play_in_real_slot(AUTO_SAMPLE *slot, ALLEGRO_SAMPLE *spl,
+   float gain, float pan, float speed, ALLEGRO_PLAYMODE loop,
+   unsigned int pos, int priority, int id)
+{
+   if (al_get_sample_instance_playing(slot->instance))
+      steal_slot(slot);
+
+   if (!do_play_sample(slot->instance, spl, gain, pan, speed, loop, pos)) {
+      slot->id = 0;
+      return false;
+   }
+
+   slot->id = id;
+   slot->priority = priority;
+   slot->sample = spl;
+   return true;
+}
+
+
+/* Forgets virtual samples which would have finished by now, and moves the
+ * most important of the rest which are audible back to real slots while
+ * there are real slots to be had for them.
+ *
+ * The slots aren't protected by any lock, so this is only called from the
+ * pool functions and never from the mixer when an instance finishes.
+ */
+static void update_virtual_samples(void)
+{
+   double now;
+   unsigned int i;
+
+   if (_al_vector_is_empty(&virtual_samples))
+      return;
+
+   now = al_get_time();
+
+   for (;;) {
+      AUTO_SAMPLE *best = NULL;
+      AUTO_SAMPLE *slot;
+      AUTO_SAMPLE resumed;
+      double pos = 0.0;
+
+      for (i = 0; i < _al_vector_size(&virtual_samples); i++) {
+         AUTO_SAMPLE *vslot = _al_vector_ref(&virtual_samples, i);
+         double p;
+
+         if (!vslot->sample)
+            continue;
+
+         p = virtual_sample_position(vslot, now);
+         if (p < 0.0) {
+            free_virtual_slot(vslot);
+            continue;
+         }
+
+         if (vslot->gain > 0.0f && (!best || vslot->priority > best->priority)) {
+            best = vslot;
+            pos = p;
+         }
+      }
+
+      if (!best)
+         return;
+
+      /* Free the virtual slot first so a sample it steals from can use it.
+       * Stealing from equals here could have two samples take turns.
+       */
+      resumed = *best;
+      free_virtual_slot(best);
+      slot = find_real_slot(resumed.priority, true);
+      if (!slot) {
+         *best = resumed;
+         return;
+      }
+
+      if (play_in_real_slot(slot, resumed.sample, resumed.gain, resumed.pan,
+            resumed.speed, resumed.loop, (unsigned int)pos, resumed.priority,
+            resumed.id)) {
+         pool_stats.resumed++;
+      }
+      else {
+         pool_stats.dropped++;
+      }
+   }
+}
+
+
+/* Finds a virtual slot for a new sample, giving up the one with the lowest
+ * priority below the new sample's if none are free.
+ */
+static AUTO_SAMPLE *find_virtual_slot(int priority)
+{
+   AUTO_SAMPLE *victim = NULL;
+   unsigned int i;
+
+   for (i = 0; i < _al_vector_size(&virtual_samples); i++) {
+      AUTO_SAMPLE *slot = _al_vector_ref(&virtual_samples, i);
+
+      if (!slot->sample)
+         return slot;
+      if (slot->priority < priority &&
+            (!victim || slot->priority < victim->priority)) {
+         victim = slot;
+      }
+   }
+
+   if (victim)
+      pool_stats.dropped++;
+
+   return victim;
+}
+
+
 /* Function: al_play_sample
  */
 bool al_play_sample(ALLEGRO_SAMPLE *spl, float gain, float pan, float speed,
    ALLEGRO_PLAYMODE loop, ALLEGRO_SAMPLE_ID *ret_id)
 {
-   static int next_id = 0;
-   unsigned int i;
+   return al_play_sample_with_priority(spl, gain, pan, speed, loop, 0, ret_id);
+}
+
+
+/* Function: al_play_sample_with_priority
+ */
+bool al_play_sample_with_priority(ALLEGRO_SAMPLE *spl, float gain, float pan,
+   float speed, ALLEGRO_PLAYMODE loop, int priority, ALLEGRO_SAMPLE_ID *ret_id)
+{
+   AUTO_SAMPLE *slot = NULL;
+   int id = next_id + 1;
+   int index = 0;
    
    ASSERT(spl);
 
@@ -352,28 +675,55 @@ bool al_play_sample(ALLEGRO_SAMPLE *spl, float gain, float pan, float speed,
       ret_id->_index = 0;
    }
 
-   for (i = 0; i < _al_vector_size(&auto_samples); i++) {
-      AUTO_SAMPLE *slot = _al_vector_ref(&auto_samples, i);
-
-      if (!al_get_sample_instance_playing(slot->instance) && !slot->locked) {
-         if (!do_play_sample(slot->instance, spl, gain, pan, speed, loop))
-            break;
+   update_virtual_samples();
 
-         if (ret_id != NULL) {
-            ret_id->_index = (int) i;
-            ret_id->_id = slot->id = ++next_id;
-         }
+   /* Inaudible samples needn't be mixed if they can be virtual. */
+   if (gain > 0.0f || !find_free_virtual_slot()) {
+      slot = find_real_slot(priority, false);
+   }
 
-         return true;
+   if (slot) {
+      if (!play_in_real_slot(slot, spl, gain, pan, speed, loop, 0, priority,
+            id)) {
+         pool_stats.dropped++;
+         return false;
       }
+      index = slot_index(&auto_samples, slot);
    }
+   else {
+      slot = find_virtual_slot(priority);
+      if (!slot) {
+         pool_stats.dropped++;
+         return false;
+      }
 
-   return false;
+      slot->id = id;
+      slot->priority = priority;
+      slot->sample = spl;
+      slot->gain = gain;
+      slot->pan = pan;
+      slot->speed = speed;
+      slot->loop = loop;
+      slot->start_pos = 0.0;
+      slot->start_time = al_get_time();
+      index = -1 - slot_index(&virtual_samples, slot);
+   }
+
+   next_id = id;
+   pool_stats.started++;
+
+   if (ret_id != NULL) {
+      ret_id->_index = index;
+      ret_id->_id = id;
+   }
+
+   return true;
 }
 
 
 static bool do_play_sample(ALLEGRO_SAMPLE_INSTANCE *splinst,
-   ALLEGRO_SAMPLE *spl, float gain, float pan, float speed, ALLEGRO_PLAYMODE loop)
+   ALLEGRO_SAMPLE *spl, float gain, float pan, float speed, ALLEGRO_PLAYMODE loop,
+   unsigned int pos)
 {
    if (!al_set_sample(splinst, spl)) {
       ALLEGRO_ERROR("al_set_sample failed\n");
@@ -383,7 +733,8 @@ static bool do_play_sample(ALLEGRO_SAMPLE_INSTANCE *splinst,
    if (!al_set_sample_instance_gain(splinst, gain) ||
          !al_set_sample_instance_pan(splinst, pan) ||
          !al_set_sample_instance_speed(splinst, speed) ||
-         !al_set_sample_instance_playmode(splinst, loop)) {
+         !al_set_sample_instance_playmode(splinst, loop) ||
+         !al_set_sample_instance_position(splinst, pos)) {
       return false;
    }
 
@@ -396,19 +747,54 @@ static bool do_play_sample(ALLEGRO_SAMPLE_INSTANCE *splinst,
 }
 
 
-/* Function: al_stop_sample
+/* Returns the slot of the sample an ID was returned for, which may have been
+ * moved between real and virtual slots since, or NULL if it's long gone.
+ * The index in the ID tells where it was first put: a real slot if it's
+ * non-negative, otherwise a virtual one.
  */
-void al_stop_sample(ALLEGRO_SAMPLE_ID *spl_id)
+static AUTO_SAMPLE *find_sample_id(ALLEGRO_SAMPLE_ID *spl_id)
 {
-   AUTO_SAMPLE *slot;
+   _AL_VECTOR *vec = (spl_id->_index >= 0) ? &auto_samples : &virtual_samples;
+   int index = (spl_id->_index >= 0) ? spl_id->_index : -1 - spl_id->_index;
+   unsigned int i;
 
    ASSERT(spl_id->_id != -1);
-   ASSERT(spl_id->_index < (int) _al_vector_size(&auto_samples));
 
-   slot = _al_vector_ref(&auto_samples, spl_id->_index);
-   if (slot->id == spl_id->_id) {
-      al_stop_sample_instance(slot->instance);
+   if (index < (int) _al_vector_size(vec)) {
+      AUTO_SAMPLE *slot = _al_vector_ref(vec, index);
+      if (slot->id == spl_id->_id)
+         return slot;
+   }
+
+   for (i = 0; i < _al_vector_size(&auto_samples); i++) {
+      AUTO_SAMPLE *slot = _al_vector_ref(&auto_samples, i);
+      if (slot->id == spl_id->_id)
+         return slot;
+   }
+   for (i = 0; i < _al_vector_size(&virtual_samples); i++) {
+      AUTO_SAMPLE *slot = _al_vector_ref(&virtual_samples, i);
+      if (slot->id == spl_id->_id)
+         return slot;
+   }
+
+   return NULL;
+}
+
+
+/* Function: al_stop_sample
+ */
+void al_stop_sample(ALLEGRO_SAMPLE_ID *spl_id)
+{
+   AUTO_SAMPLE *slot = find_sample_id(spl_id);
+
+   if (slot) {
+      if (slot->instance)
+         al_stop_sample_instance(slot->instance);
+      else
+         free_virtual_slot(slot);
    }
+
+   update_virtual_samples();
 }
 
 
@@ -416,13 +802,9 @@ void al_stop_sample(ALLEGRO_SAMPLE_ID *spl_id)
  */
 ALLEGRO_SAMPLE_INSTANCE* al_lock_sample_id(ALLEGRO_SAMPLE_ID *spl_id)
 {
-   AUTO_SAMPLE *slot;
+   AUTO_SAMPLE *slot = find_sample_id(spl_id);
 
-   ASSERT(spl_id->_id != -1);
-   ASSERT(spl_id->_index < (int) _al_vector_size(&auto_samples));
-
-   slot = _al_vector_ref(&auto_samples, spl_id->_index);
-   if (slot->id == spl_id->_id) {
+   if (slot && slot->instance) {
       slot->locked = true;
       return slot->instance;
    }
@@ -434,15 +816,13 @@ ALLEGRO_SAMPLE_INSTANCE* al_lock_sample_id(ALLEGRO_SAMPLE_ID *spl_id)
  */
 void al_unlock_sample_id(ALLEGRO_SAMPLE_ID *spl_id)
 {
-   AUTO_SAMPLE *slot;
-
-   ASSERT(spl_id->_id != -1);
-   ASSERT(spl_id->_index < (int) _al_vector_size(&auto_samples));
+   AUTO_SAMPLE *slot = find_sample_id(spl_id);
 
-   slot = _al_vector_ref(&auto_samples, spl_id->_index);
-   if (slot->id == spl_id->_id) {
+   if (slot && slot->instance) {
       slot->locked = false;
    }
+
+   update_virtual_samples();
 }
 
 
@@ -456,6 +836,51 @@ void al_stop_samples(void)
       AUTO_SAMPLE *slot = _al_vector_ref(&auto_samples, i);
       al_stop_sample_instance(slot->instance);
    }
+   for (i = 0; i < _al_vector_size(&virtual_samples); i++) {
+      free_virtual_slot(_al_vector_ref(&virtual_samples, i));
+   }
+}
+
+
+/* Function: al_get_sample_pool_stats
+ */
+void al_get_sample_pool_stats(ALLEGRO_SAMPLE_POOL_STATS *stats)
+{
+   unsigned int i;
+
+   ASSERT(stats);
+
+   update_virtual_samples();
+
+   *stats = pool_stats;
+   stats->reserved = (int) _al_vector_size(&auto_samples);
+   stats->virtual_reserved = (int) _al_vector_size(&virtual_samples);
+   stats->playing = 0;
+   stats->virtual_playing = 0;
+
+   for (i = 0; i < _al_vector_size(&auto_samples); i++) {
+      AUTO_SAMPLE *slot = _al_vector_ref(&auto_samples, i);
+      if (al_get_sample_instance_playing(slot->instance))
+         stats->playing++;
+   }
+   for (i = 0; i < _al_vector_size(&virtual_samples); i++) {
+      AUTO_SAMPLE *slot = _al_vector_ref(&virtual_samples, i);
+      if (slot->sample)
+         stats->virtual_playing++;
+   }
+}
+
+
+/* Forgets the virtual samples of a sample which is being destroyed. */
+static void forget_virtual_samples(ALLEGRO_SAMPLE *spl)
+{
+   unsigned int i;
+
+   for (i = 0; i < _al_vector_size(&virtual_samples); i++) {
+      AUTO_SAMPLE *slot = _al_vector_ref(&virtual_samples, i);
+      if (slot->sample == spl)
+         free_virtual_slot(slot);
+   }
 }
 
 
@@ -519,12 +944,14 @@ static void free_sample_vector(void)
       al_destroy_sample_instance(slot->instance);
    }
    _al_vector_free(&auto_samples);
+   _al_vector_free(&virtual_samples);
 }
 
 
 void _al_kcm_shutdown_default_mixer(void)
 {
    free_sample_vector(); 
+   memset(&pool_stats, 0, sizeof(pool_stats));
    al_destroy_mixer(allegro_mixer);
    al_destroy_voice(allegro_voice);
 
@@ -0,0 +1,312 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Audio pipeline statistics.
+ *
+ *      Voices, mixers and streams keep running counters of how long
+ *      rendering each buffer took and how often they ran dry.  The
+ *      counters are updated by the audio thread under the object's mutex
+ *      and copied out by the al_get_*_stats functions.  Optionally each
+ *      voice emits an ALLEGRO_EVENT_AUDIO_STATS event at a fixed interval
+ *      so the counters can be logged without polling.
+ *
+ *      See LICENSE.txt for copyright information.
+ */
+
+
+#include <string.h>
+
+#include "allegro5/allegro.h"
+#include "allegro5/allegro_audio.h"
+#include "allegro5/internal/aintern.h"
+#include "allegro5/internal/aintern_audio.h"
+#include "allegro5/internal/aintern_vector.h"
+
+ALLEGRO_DEBUG_CHANNEL("audio")
+
+
+static ALLEGRO_EVENT_SOURCE stats_event_source;
+static bool stats_event_source_inited = false;
+static double stats_interval = 0.0;
+
+
+static void maybe_lock_mutex(ALLEGRO_MUTEX *mutex)
+{
+   if (mutex) {
+      al_lock_mutex(mutex);
+   }
+}
+
+
+static void maybe_unlock_mutex(ALLEGRO_MUTEX *mutex)
+{
+   if (mutex) {
+      al_unlock_mutex(mutex);
+   }
+}
+
+
+/* _al_kcm_init_stats:
+ *  Sets up the statistics event source.  Called by al_install_audio.
+ */
+void _al_kcm_init_stats(void)
+{
+   if (!stats_event_source_inited) {
+      al_init_user_event_source(&stats_event_source);
+      stats_event_source_inited = true;
+   }
+   stats_interval = 0.0;
+}
+
+
+/* _al_kcm_shutdown_stats:
+ *  Destroys the statistics event source.  Called by al_uninstall_audio
+ *  after all the voices are gone.
+ */
+void _al_kcm_shutdown_stats(void)
+{
+   stats_interval = 0.0;
+   if (stats_event_source_inited) {
+      al_destroy_user_event_source(&stats_event_source);
+      stats_event_source_inited = false;
+   }
+}
+
+
+/* _al_kcm_record_mix_time:
+ *  Adds the time taken to render one buffer to the counters.
+ */
+void _al_kcm_record_mix_time(_AL_KCM_STATS *stats, double seconds)
+{
+   if (stats->buffers == 0 || seconds < stats->min_time)
+      stats->min_time = seconds;
+   if (seconds > stats->max_time)
+      stats->max_time = seconds;
+   stats->total_time += seconds;
+   stats->buffers++;
+}
+
+
+/* _al_kcm_voice_underrun:
+ *  Called by drivers when the device ran out of data to play.
+ */
+void _al_kcm_voice_underrun(ALLEGRO_VOICE *voice)
+{
+   al_lock_mutex(voice->mutex);
+   voice->stats.underruns++;
+   al_unlock_mutex(voice->mutex);
+}
+
+
+/* _al_kcm_set_voice_latency:
+ *  Called by drivers from their update thread with the time the audio
+ *  they just wrote will take to reach the speakers.
+ */
+void _al_kcm_set_voice_latency(ALLEGRO_VOICE *voice, double seconds)
+{
+   al_lock_mutex(voice->mutex);
+   voice->latency = seconds;
+   al_unlock_mutex(voice->mutex);
+}
+
+
+/* _al_kcm_emit_voice_stats:
+ *  Emits ALLEGRO_EVENT_AUDIO_STATS for the voice if the interval set with
+ *  al_set_audio_stats_interval has passed since the last one.  Called by
+ *  _al_voice_update without the voice mutex held.
+ */
+void _al_kcm_emit_voice_stats(ALLEGRO_VOICE *voice)
+{
+   double interval = stats_interval;
+   double now;
+   ALLEGRO_EVENT event;
+
+   if (interval <= 0.0 || !stats_event_source_inited)
+      return;
+
+   now = al_get_time();
+   if (now - voice->last_stats_event < interval)
+      return;
+   voice->last_stats_event = now;
+
+   event.user.type = ALLEGRO_EVENT_AUDIO_STATS;
+   event.user.timestamp = now;
+   event.user.data1 = (intptr_t)voice;
+   event.user.data2 = 0;
+   event.user.data3 = 0;
+   event.user.data4 = 0;
+   al_emit_user_event(&stats_event_source, &event, NULL);
+}
+
+
+static void copy_stats(const _AL_KCM_STATS *in, ALLEGRO_AUDIO_STATS *out)
+{
+   memset(out, 0, sizeof(*out));
+   out->buffers = in->buffers;
+   out->min_mix_time = in->min_time;
+   out->max_mix_time = in->max_time;
+   if (in->buffers > 0)
+      out->avg_mix_time = in->total_time / in->buffers;
+   out->underruns = in->underruns;
+   out->late_fragments = in->late_fragments;
+}
+
+
+static void clear_stats(_AL_KCM_STATS *stats)
+{
+   memset(stats, 0, sizeof(*stats));
+}
+
+
+/* parent_voice_latency:
+ *  Returns the latency of the voice the instance ends up playing on, or -1
+ *  if it isn't attached to a voice or the driver doesn't report one.  The
+ *  instance's mutex must be held.
+ */
+static double parent_voice_latency(const ALLEGRO_SAMPLE_INSTANCE *spl)
+{
+   while (spl->parent.u.ptr) {
+      if (spl->parent.is_voice)
+         return spl->parent.u.voice->latency;
+      spl = &spl->parent.u.mixer->ss;
+   }
+   return -1.0;
+}
+
+
+/* Function: al_get_voice_stats
+ */
+bool al_get_voice_stats(ALLEGRO_VOICE *voice, ALLEGRO_AUDIO_STATS *stats)
+{
+   ASSERT(voice);
+   ASSERT(stats);
+
+   al_lock_mutex(voice->mutex);
+   copy_stats(&voice->stats, stats);
+   stats->latency = voice->latency;
+   al_unlock_mutex(voice->mutex);
+
+   return true;
+}
+
+
+/* Function: al_get_mixer_stats
+ */
+bool al_get_mixer_stats(ALLEGRO_MIXER *mixer, ALLEGRO_AUDIO_STATS *stats)
+{
+   ASSERT(mixer);
+   ASSERT(stats);
+
+   maybe_lock_mutex(mixer->ss.mutex);
+   copy_stats(&mixer->stats, stats);
+   stats->latency = parent_voice_latency(&mixer->ss);
+   maybe_unlock_mutex(mixer->ss.mutex);
+
+   return true;
+}
+
+
+/* Function: al_get_audio_stream_stats
+ */
+bool al_get_audio_stream_stats(ALLEGRO_AUDIO_STREAM *stream,
+   ALLEGRO_AUDIO_STATS *stats)
+{
+   double latency;
+
+   ASSERT(stream);
+   ASSERT(stats);
+
+   maybe_lock_mutex(stream->spl.mutex);
+   copy_stats(&stream->stats, stats);
+   stats->queued_fragments =
+      _al_kcm_fragment_ring_count(&stream->pending_bufs);
+   latency = parent_voice_latency(&stream->spl);
+   if (latency >= 0.0)
+      latency += _al_kcm_get_stream_time_left(stream);
+   stats->latency = latency;
+   maybe_unlock_mutex(stream->spl.mutex);
+
+   return true;
+}
+
+
+static bool is_stream(const ALLEGRO_SAMPLE_INSTANCE *spl)
+{
+   return spl->loop >= _ALLEGRO_PLAYMODE_STREAM_ONCE;
+}
+
+
+/* reset_object_stats:
+ *  Clears the counters of a voice or mixer and of the streams attached to
+ *  it.  Streams aren't registered as destructors, so unattached ones keep
+ *  their counters.
+ */
+static void reset_object_stats(void *object, void (*func)(void *),
+   void *userdata)
+{
+   (void)userdata;
+
+   if (func == (void (*)(void *))al_destroy_voice) {
+      ALLEGRO_VOICE *voice = object;
+      ALLEGRO_SAMPLE_INSTANCE *spl;
+
+      al_lock_mutex(voice->mutex);
+      clear_stats(&voice->stats);
+      spl = voice->attached_stream;
+      if (spl && is_stream(spl))
+         clear_stats(&((ALLEGRO_AUDIO_STREAM *)spl)->stats);
+      al_unlock_mutex(voice->mutex);
+   }
+   else if (func == (void (*)(void *))al_destroy_mixer) {
+      ALLEGRO_MIXER *mixer = object;
+      unsigned int i;
+
+      maybe_lock_mutex(mixer->ss.mutex);
+      clear_stats(&mixer->stats);
+      for (i = 0; i < _al_vector_size(&mixer->streams); i++) {
+         ALLEGRO_SAMPLE_INSTANCE **slot = _al_vector_ref(&mixer->streams, i);
+         if (is_stream(*slot))
+            clear_stats(&((ALLEGRO_AUDIO_STREAM *)*slot)->stats);
+      }
+      maybe_unlock_mutex(mixer->ss.mutex);
+   }
+}
+
+
+/* Function: al_reset_audio_stats
+ */
+void al_reset_audio_stats(void)
+{
+   _al_kcm_foreach_destructor(reset_object_stats, NULL);
+}
+
+
+/* Function: al_set_audio_stats_interval
+ */
+void al_set_audio_stats_interval(double seconds)
+{
+   if (seconds < 0.0)
+      seconds = 0.0;
+   stats_interval = seconds;
+   ALLEGRO_DEBUG("Audio stats interval set to %f\n", seconds);
+}
+
+
+/* Function: al_get_audio_stats_event_source
+ */
+ALLEGRO_EVENT_SOURCE *al_get_audio_stats_event_source(void)
+{
+   if (!stats_event_source_inited)
+      return NULL;
+   return &stats_event_source;
+}
+
+
+/* vim: set sts=3 sw=3 et: */
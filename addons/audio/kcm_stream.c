@@ -17,11 +17,11 @@
 ALLEGRO_DEBUG_CHANNEL("audio")
 
 /*
- * The highest quality interpolator is a cubic interpolator requiring
- * four sample points.  In the streaming case we lag the true sample
- * position by three.
+ * The highest quality interpolator is the sinc filter requiring
+ * _AL_KCM_SINC_TAPS sample points.  In the streaming case we keep that many
+ * sample values, less one, from before each fragment.
  */
-#define MAX_LAG   (3)
+#define MAX_LAG   (_AL_KCM_SINC_TAPS - 1)
 
 
 /*
@@ -44,6 +44,88 @@ static void maybe_unlock_mutex(ALLEGRO_MUTEX *mutex)
    }
 }
 
+
+/* _al_kcm_init_fragment_ring:
+ *  Sets up an empty ring holding up to 'size' fragments in 'slots'.
+ */
+void _al_kcm_init_fragment_ring(_AL_FRAGMENT_RING *ring, void **slots,
+   unsigned int size)
+{
+   ring->slots = slots;
+   ring->size = size;
+   ring->head = 0;
+   ring->tail = 0;
+}
+
+
+static unsigned int ring_distance(const _AL_FRAGMENT_RING *ring,
+   _AL_ATOMIC head, _AL_ATOMIC tail)
+{
+   return ((unsigned int)tail + 2 * ring->size - (unsigned int)head)
+      % (2 * ring->size);
+}
+
+
+/* _al_kcm_fragment_ring_count:
+ *  Returns the number of fragments in the ring.  Unless called by the
+ *  producer or the consumer the result may be out of date at once.
+ */
+unsigned int _al_kcm_fragment_ring_count(const _AL_FRAGMENT_RING *ring)
+{
+   _AL_ATOMIC head = _al_atomic_load_acquire((volatile _AL_ATOMIC *)&ring->head);
+   _AL_ATOMIC tail = _al_atomic_load_acquire((volatile _AL_ATOMIC *)&ring->tail);
+
+   return ring_distance(ring, head, tail);
+}
+
+
+/* _al_kcm_fragment_ring_push:
+ *  Adds a fragment to the back of the ring.  Only the producer may call
+ *  this.  Returns false if the ring is full.
+ */
+bool _al_kcm_fragment_ring_push(_AL_FRAGMENT_RING *ring, void *fragment)
+{
+   _AL_ATOMIC tail = ring->tail;
+   _AL_ATOMIC head = _al_atomic_load_acquire(&ring->head);
+
+   if (ring_distance(ring, head, tail) == ring->size)
+      return false;
+
+   ring->slots[tail % ring->size] = fragment;
+   _al_atomic_store_release(&ring->tail, (tail + 1) % (2 * ring->size));
+   return true;
+}
+
+
+/* _al_kcm_fragment_ring_peek:
+ *  Returns the fragment at the front of the ring, or NULL if the ring is
+ *  empty.  Only the consumer may call this.
+ */
+void *_al_kcm_fragment_ring_peek(const _AL_FRAGMENT_RING *ring)
+{
+   _AL_ATOMIC head = ring->head;
+   _AL_ATOMIC tail = _al_atomic_load_acquire((volatile _AL_ATOMIC *)&ring->tail);
+
+   if (head == tail)
+      return NULL;
+   return ring->slots[head % ring->size];
+}
+
+
+/* _al_kcm_fragment_ring_pop:
+ *  Removes the fragment at the front of the ring and returns it, or returns
+ *  NULL if the ring is empty.  Only the consumer may call this.
+ */
+void *_al_kcm_fragment_ring_pop(_AL_FRAGMENT_RING *ring)
+{
+   _AL_ATOMIC head = ring->head;
+   void *fragment = _al_kcm_fragment_ring_peek(ring);
+
+   if (fragment)
+      _al_atomic_store_release(&ring->head, (head + 1) % (2 * ring->size));
+   return fragment;
+}
+
 /* Function: al_create_audio_stream
  */
 ALLEGRO_AUDIO_STREAM *al_create_audio_stream(size_t fragment_count,
@@ -53,6 +135,7 @@ ALLEGRO_AUDIO_STREAM *al_create_audio_stream(size_t fragment_count,
    ALLEGRO_AUDIO_STREAM *stream;
    unsigned long bytes_per_sample;
    unsigned long bytes_per_frag_buf;
+   void **slots;
    size_t i;
 
    if (!fragment_count) {
@@ -99,15 +182,16 @@ ALLEGRO_AUDIO_STREAM *al_create_audio_stream(size_t fragment_count,
 
    stream->buf_count = fragment_count;
 
-   stream->used_bufs = al_calloc(1, fragment_count * sizeof(void *) * 2);
-   if (!stream->used_bufs) {
-      al_free(stream->used_bufs);
+   slots = al_calloc(1, fragment_count * sizeof(void *) * 2);
+   if (!slots) {
       al_free(stream);
       _al_set_error(ALLEGRO_GENERIC_ERROR,
          "Out of memory allocating stream buffer pointers");
       return NULL;
    }
-   stream->pending_bufs = stream->used_bufs + fragment_count;
+   _al_kcm_init_fragment_ring(&stream->used_bufs, slots, fragment_count);
+   _al_kcm_init_fragment_ring(&stream->pending_bufs, slots + fragment_count,
+      fragment_count);
 
    /* The main_buffer holds all the buffer fragments in contiguous memory.
     * To support interpolation across buffer fragments, we allocate extra
@@ -117,7 +201,7 @@ ALLEGRO_AUDIO_STREAM *al_create_audio_stream(size_t fragment_count,
    stream->main_buffer = al_calloc(1,
       (MAX_LAG * bytes_per_sample + bytes_per_frag_buf) * fragment_count);
    if (!stream->main_buffer) {
-      al_free(stream->used_bufs);
+      al_free(slots);
       al_free(stream);
       _al_set_error(ALLEGRO_GENERIC_ERROR,
          "Out of memory allocating stream buffer");
@@ -128,7 +212,8 @@ ALLEGRO_AUDIO_STREAM *al_create_audio_stream(size_t fragment_count,
       char *buffer = (char *)stream->main_buffer
          + i * (MAX_LAG * bytes_per_sample + bytes_per_frag_buf);
       al_fill_silence(buffer, MAX_LAG, depth, chan_conf);
-      stream->used_bufs[i] = buffer + MAX_LAG * bytes_per_sample;
+      _al_kcm_fragment_ring_push(&stream->used_bufs,
+         buffer + MAX_LAG * bytes_per_sample);
    }
 
    al_init_user_event_source(&stream->spl.es);
@@ -145,7 +230,7 @@ ALLEGRO_AUDIO_STREAM *al_create_audio_stream(size_t fragment_count,
 void al_destroy_audio_stream(ALLEGRO_AUDIO_STREAM *stream)
 {
    if (stream) {
-      if (stream->feed_thread) {
+      if (stream->feed_thread || stream->feed_pooled) {
          stream->unload_feeder(stream);
       }
       /* See commented out call to _al_kcm_register_destructor. */
@@ -153,8 +238,10 @@ void al_destroy_audio_stream(ALLEGRO_AUDIO_STREAM *stream)
       _al_kcm_detach_from_parent(&stream->spl);
 
       al_destroy_user_event_source(&stream->spl.es);
+      if (stream->feed_mutex)
+         al_destroy_mutex(stream->feed_mutex);
       al_free(stream->main_buffer);
-      al_free(stream->used_bufs);
+      al_free(stream->used_bufs.slots);
       al_free(stream);
    }
 }
@@ -215,12 +302,9 @@ unsigned int al_get_audio_stream_fragments(const ALLEGRO_AUDIO_STREAM *stream)
 unsigned int al_get_available_audio_stream_fragments(
    const ALLEGRO_AUDIO_STREAM *stream)
 {
-   unsigned int i;
    ASSERT(stream);
 
-   for (i = 0; i < stream->buf_count && stream->used_bufs[i]; i++)
-      ;
-   return i;
+   return _al_kcm_fragment_ring_count(&stream->used_bufs);
 }
 
 
@@ -327,32 +411,27 @@ uint64_t al_get_audio_stream_played_samples(const ALLEGRO_AUDIO_STREAM *stream)
    return result;
 }
 
-/* Function: al_get_audio_stream_fragment
+/* Function: al_get_audio_stream_near_underruns
 */
-void *al_get_audio_stream_fragment(const ALLEGRO_AUDIO_STREAM *stream)
+unsigned int al_get_audio_stream_near_underruns(
+   const ALLEGRO_AUDIO_STREAM *stream)
 {
-   size_t i;
-   void *fragment;
-   ALLEGRO_MUTEX *stream_mutex;
    ASSERT(stream);
 
-   stream_mutex = maybe_lock_mutex(stream->spl.mutex);
-
-   if (!stream->used_bufs[0]) {
-      /* No free fragments are available. */
-      fragment = NULL;
-   }
-   else {
-      fragment = stream->used_bufs[0];
-      for (i = 0; i < stream->buf_count-1 && stream->used_bufs[i]; i++) {
-         stream->used_bufs[i] = stream->used_bufs[i+1];
-      }
-      stream->used_bufs[i] = NULL;
-   }
+   return stream->near_underruns;
+}
 
-   maybe_unlock_mutex(stream_mutex);
+/* Function: al_get_audio_stream_fragment
+*/
+void *al_get_audio_stream_fragment(const ALLEGRO_AUDIO_STREAM *stream)
+{
+   ASSERT(stream);
 
-   return fragment;
+   /* Returns NULL if no free fragments are available.  The mixer only
+    * ever adds to used_bufs, so there's no need to lock the stream.
+    */
+   return _al_kcm_fragment_ring_pop(
+      (_AL_FRAGMENT_RING *)&stream->used_bufs);
 }
 
 
@@ -377,15 +456,28 @@ bool al_set_audio_stream_speed(ALLEGRO_AUDIO_STREAM *stream, float val)
    stream->spl.speed = val;
    if (stream->spl.parent.u.mixer) {
       ALLEGRO_MIXER *mixer = stream->spl.parent.u.mixer;
-      ALLEGRO_MUTEX *stream_mutex = maybe_lock_mutex(stream->spl.mutex);
+      ALLEGRO_MUTEX *stream_mutex;
+      int step = (stream->spl.spl_data.frequency) * stream->spl.speed;
+      const float *sinc_table = NULL;
 
-      stream->spl.step = (stream->spl.spl_data.frequency) * stream->spl.speed;
-      stream->spl.step_denom = mixer->ss.spl_data.frequency;
       /* Don't wanna be trapped with a step value of 0 */
-      if (stream->spl.step == 0) {
-         stream->spl.step = 1;
+      if (step == 0) {
+         step = 1;
+      }
+      /* The table may have to be built, so don't hold up the mixer. */
+      if (stream->spl.sinc_table) {
+         sinc_table = _al_kcm_get_sinc_table(step,
+            mixer->ss.spl_data.frequency);
       }
 
+      stream_mutex = maybe_lock_mutex(stream->spl.mutex);
+
+      stream->spl.step = step;
+      stream->spl.step_denom = mixer->ss.spl_data.frequency;
+      /* If the table can't be built keep using the old one. */
+      if (sinc_table)
+         stream->spl.sinc_table = sinc_table;
+
       maybe_unlock_mutex(stream_mutex);
    }
 
@@ -490,7 +582,8 @@ static void reset_stopped_stream(ALLEGRO_AUDIO_STREAM *stream)
       al_get_audio_depth_size(stream->spl.spl_data.depth);
    const int fragment_buffer_size =
       bytes_per_sample * (stream->spl.spl_data.len + MAX_LAG);
-   size_t i, n;
+   size_t i;
+   void *fragment;
 
    /* Write silence to the "invisible" part in between fragment buffers to
     * avoid interpolation artifacts.  It's tempting to zero the complete
@@ -504,20 +597,9 @@ static void reset_stopped_stream(ALLEGRO_AUDIO_STREAM *stream)
          MAX_LAG, stream->spl.spl_data.depth, stream->spl.spl_data.chan_conf);
    }
 
-   /* Get the current number of entries in the used_buf list. */
-   for (n = 0; n < stream->buf_count && stream->used_bufs[n]; n++)
-      ;
-
    /* Move everything from pending_bufs to used_bufs. */
-   i = 0;
-   while (i < stream->buf_count &&
-         n < stream->buf_count &&
-         stream->pending_bufs[i])
-   {
-      stream->used_bufs[n] = stream->pending_bufs[i];
-      stream->pending_bufs[i] = NULL;
-      n++;
-      i++;
+   while ((fragment = _al_kcm_fragment_ring_pop(&stream->pending_bufs))) {
+      _al_kcm_fragment_ring_push(&stream->used_bufs, fragment);
    }
 
    /* No fragment buffer is currently playing. */
@@ -580,28 +662,18 @@ bool al_detach_audio_stream(ALLEGRO_AUDIO_STREAM *stream)
  */
 bool al_set_audio_stream_fragment(ALLEGRO_AUDIO_STREAM *stream, void *val)
 {
-   size_t i;
-   bool ret;
-   ALLEGRO_MUTEX *stream_mutex;
    ASSERT(stream);
 
-   stream_mutex = maybe_lock_mutex(stream->spl.mutex);
-
-   for (i = 0; i < stream->buf_count && stream->pending_bufs[i] ; i++)
-      ;
-   if (i < stream->buf_count) {
-      stream->pending_bufs[i] = val;
-      ret = true;
-   }
-   else {
+   /* The mixer only ever takes from pending_bufs, so there's no need to
+    * lock the stream.
+    */
+   if (!_al_kcm_fragment_ring_push(&stream->pending_bufs, val)) {
       _al_set_error(ALLEGRO_INVALID_OBJECT,
          "Attempted to set a stream buffer with a full pending list");
-      ret = false;
+      return false;
    }
 
-   maybe_unlock_mutex(stream_mutex);
-
-   return ret;
+   return true;
 }
 
 
@@ -619,32 +691,38 @@ bool _al_kcm_refill_stream(ALLEGRO_AUDIO_STREAM *stream)
    ALLEGRO_SAMPLE_INSTANCE *spl = &stream->spl;
    void *old_buf = spl->spl_data.buffer.ptr;
    void *new_buf;
-   size_t i;
    int new_pos = spl->pos - spl->spl_data.len;
 
    if (old_buf) {
-      /* Slide the buffers down one position and put the
-       * completed buffer into the used array to be refilled.
+      /* Put the completed buffer, which is at the front of the pending
+       * ring, into the used ring to be refilled.
        */
-      for (i = 0;
-            i < stream->buf_count-1 && stream->pending_bufs[i];
-            i++) {
-         stream->pending_bufs[i] = stream->pending_bufs[i+1];
-      }
-      stream->pending_bufs[i] = NULL;
-
-      for (i = 0; stream->used_bufs[i]; i++)
-         ;
-      stream->used_bufs[i] = old_buf;
+      void *done = _al_kcm_fragment_ring_pop(&stream->pending_bufs);
+      ASSERT(done == old_buf);
+      (void)done;
+      _al_kcm_fragment_ring_push(&stream->used_bufs, old_buf);
    }
 
-   new_buf = stream->pending_bufs[0];
+   new_buf = _al_kcm_fragment_ring_peek(&stream->pending_bufs);
    stream->spl.spl_data.buffer.ptr = new_buf;
    if (!new_buf) {
       ALLEGRO_WARN("Out of buffers\n");
+      /* Only count running dry in the middle of playing. */
+      if (old_buf && !stream->is_draining)
+         stream->stats.underruns++;
       return false;
    }
 
+   /* Nothing queued behind the fragment we are about to play. The first
+    * fragment doesn't count, and neither do streams of two fragments: the
+    * other one was only just handed back to be refilled.
+    */
+   if (old_buf && stream->buf_count > 2 &&
+         _al_kcm_fragment_ring_count(&stream->pending_bufs) == 1 &&
+         !stream->is_draining) {
+      stream->stats.late_fragments++;
+   }
+
    /* Copy the last MAX_LAG sample values to the front of the new buffer
     * for interpolation.
     */
@@ -667,6 +745,139 @@ bool _al_kcm_refill_stream(ALLEGRO_AUDIO_STREAM *stream)
 }
 
 
+/* _al_kcm_get_stream_time_left:
+ *  Returns roughly how many seconds the stream can play before it runs out
+ *  of filled fragments.  The stream is not locked so this is only good as a
+ *  hint to the feeders.
+ */
+double _al_kcm_get_stream_time_left(const ALLEGRO_AUDIO_STREAM *stream)
+{
+   double rate = stream->spl.spl_data.frequency * stream->spl.speed;
+   unsigned int len = stream->spl.spl_data.len;
+   unsigned int pending = _al_kcm_fragment_ring_count(&stream->pending_bufs);
+   double frames = 0.0;
+
+   /* The fragment being played is still at the front of pending_bufs. */
+   if (stream->spl.spl_data.buffer.ptr && pending > 0) {
+      pending--;
+      if (stream->spl.pos < (int)len)
+         frames = len - stream->spl.pos;
+   }
+   frames += (double)pending * len;
+
+   if (rate <= 0.0)
+      return 0.0;
+   return frames / rate;
+}
+
+
+/* _al_kcm_emit_stream_finished:
+ *  Emits ALLEGRO_EVENT_AUDIO_STREAM_FINISHED once the stream has been
+ *  drained, unless it was already emitted since the stream last played
+ *  a full fragment.
+ */
+void _al_kcm_emit_stream_finished(ALLEGRO_AUDIO_STREAM *stream)
+{
+   if (!stream->finished_event_sent) {
+      ALLEGRO_EVENT fin_event;
+      fin_event.user.type = ALLEGRO_EVENT_AUDIO_STREAM_FINISHED;
+      fin_event.user.timestamp = al_get_time();
+      al_emit_user_event(&stream->spl.es, &fin_event, NULL);
+      stream->finished_event_sent = true;
+   }
+}
+
+
+/* _al_kcm_feed_stream_fragment:
+ *  Fills one free fragment of the stream using its 'feeder' callback.
+ *  Returns false if there was nothing to do.
+ */
+bool _al_kcm_feed_stream_fragment(ALLEGRO_AUDIO_STREAM *stream)
+{
+   char *fragment;
+   unsigned long bytes;
+   unsigned long bytes_written;
+   ALLEGRO_MUTEX *stream_mutex;
+   double fragment_time;
+
+   if (stream->is_draining)
+      return false;
+
+   fragment = al_get_audio_stream_fragment(stream);
+   if (!fragment) {
+      /* This is not an error. */
+      return false;
+   }
+
+   /* Count it as a near underrun if less than half a fragment was left.
+    * Filling the stream before it has played anything doesn't count.
+    */
+   fragment_time = stream->spl.spl_data.len /
+      (stream->spl.spl_data.frequency * stream->spl.speed);
+   if (stream->spl.is_playing && stream->spl.spl_data.buffer.ptr &&
+         _al_kcm_get_stream_time_left(stream) < fragment_time / 2) {
+      stream->near_underruns++;
+   }
+
+   bytes = (stream->spl.spl_data.len) *
+         al_get_channel_count(stream->spl.spl_data.chan_conf) *
+         al_get_audio_depth_size(stream->spl.spl_data.depth);
+
+   stream_mutex = maybe_lock_mutex(stream->feed_mutex);
+   bytes_written = stream->feeder(stream, fragment, bytes);
+   maybe_unlock_mutex(stream_mutex);
+
+   if (stream->spl.loop == _ALLEGRO_PLAYMODE_STREAM_ONEDIR) {
+      /* Keep rewinding until the fragment is filled. */
+      while (bytes_written < bytes &&
+               stream->spl.loop == _ALLEGRO_PLAYMODE_STREAM_ONEDIR) {
+         size_t bw;
+         al_rewind_audio_stream(stream);
+         stream_mutex = maybe_lock_mutex(stream->feed_mutex);
+         bw = stream->feeder(stream, fragment + bytes_written,
+            bytes - bytes_written);
+         bytes_written += bw;
+         maybe_unlock_mutex(stream_mutex);
+      }
+   }
+   else if (bytes_written < bytes) {
+      /* Fill the rest of the fragment with silence. */
+      int silence_samples = (bytes - bytes_written) /
+         (al_get_channel_count(stream->spl.spl_data.chan_conf) *
+          al_get_audio_depth_size(stream->spl.spl_data.depth));
+      al_fill_silence(fragment + bytes_written, silence_samples,
+                      stream->spl.spl_data.depth, stream->spl.spl_data.chan_conf);
+   }
+
+   if (!al_set_audio_stream_fragment(stream, fragment)) {
+      ALLEGRO_ERROR("Error setting stream buffer.\n");
+      return true;
+   }
+
+   /* The streaming source doesn't feed any more, so drain buffers.
+    * Don't quit in case the user decides to seek and then restart the
+    * stream. */
+   if (bytes_written != bytes &&
+      stream->spl.loop == _ALLEGRO_PLAYMODE_STREAM_ONCE) {
+      if (stream->feed_pooled && al_get_audio_stream_attached(stream)) {
+         /* Waiting here would hold up a shared feeder thread.  The feeder
+          * threads notice when the stream stops and call
+          * _al_kcm_emit_stream_finished then.
+          */
+         stream->is_draining = true;
+         return true;
+      }
+
+      al_drain_audio_stream(stream);
+      _al_kcm_emit_stream_finished(stream);
+   } else {
+      stream->finished_event_sent = false;
+   }
+
+   return true;
+}
+
+
 /* _al_kcm_feed_stream:
  * A routine running in another thread that feeds the stream buffers as
  * necessary, usually getting data from some file reader backend.
@@ -675,7 +886,6 @@ void *_al_kcm_feed_stream(ALLEGRO_THREAD *self, void *vstream)
 {
    ALLEGRO_AUDIO_STREAM *stream = vstream;
    ALLEGRO_EVENT_QUEUE *queue;
-   bool finished_event_sent = false;
    (void)self;
 
    ALLEGRO_DEBUG("Stream feeder thread started.\n");
@@ -689,77 +899,15 @@ void *_al_kcm_feed_stream(ALLEGRO_THREAD *self, void *vstream)
    al_unlock_mutex(stream->feed_thread_started_mutex);
 
    stream->quit_feed_thread = false;
+   stream->finished_event_sent = false;
 
    while (!stream->quit_feed_thread) {
-      char *fragment;
       ALLEGRO_EVENT event;
 
       al_wait_for_event(queue, &event);
 
-      if (event.type == ALLEGRO_EVENT_AUDIO_STREAM_FRAGMENT
-          && !stream->is_draining) {
-         unsigned long bytes;
-         unsigned long bytes_written;
-         ALLEGRO_MUTEX *stream_mutex;
-
-         fragment = al_get_audio_stream_fragment(stream);
-         if (!fragment) {
-            /* This is not an error. */
-            continue;
-         }
-
-         bytes = (stream->spl.spl_data.len) *
-               al_get_channel_count(stream->spl.spl_data.chan_conf) *
-               al_get_audio_depth_size(stream->spl.spl_data.depth);
-
-         stream_mutex = maybe_lock_mutex(stream->spl.mutex);
-         bytes_written = stream->feeder(stream, fragment, bytes);
-         maybe_unlock_mutex(stream_mutex);
-
-         if (stream->spl.loop == _ALLEGRO_PLAYMODE_STREAM_ONEDIR) {
-            /* Keep rewinding until the fragment is filled. */
-            while (bytes_written < bytes &&
-                     stream->spl.loop == _ALLEGRO_PLAYMODE_STREAM_ONEDIR) {
-               size_t bw;
-               al_rewind_audio_stream(stream);
-               stream_mutex = maybe_lock_mutex(stream->spl.mutex);
-               bw = stream->feeder(stream, fragment + bytes_written,
-                  bytes - bytes_written);
-               bytes_written += bw;
-               maybe_unlock_mutex(stream_mutex);
-            }
-         }
-         else if (bytes_written < bytes) {
-            /* Fill the rest of the fragment with silence. */
-            int silence_samples = (bytes - bytes_written) /
-               (al_get_channel_count(stream->spl.spl_data.chan_conf) *
-                al_get_audio_depth_size(stream->spl.spl_data.depth));
-            al_fill_silence(fragment + bytes_written, silence_samples,
-                            stream->spl.spl_data.depth, stream->spl.spl_data.chan_conf);
-         }
-
-         if (!al_set_audio_stream_fragment(stream, fragment)) {
-            ALLEGRO_ERROR("Error setting stream buffer.\n");
-            continue;
-         }
-
-         /* The streaming source doesn't feed any more, so drain buffers.
-          * Don't quit in case the user decides to seek and then restart the
-          * stream. */
-         if (bytes_written != bytes &&
-            stream->spl.loop == _ALLEGRO_PLAYMODE_STREAM_ONCE) {
-            al_drain_audio_stream(stream);
-
-            if (!finished_event_sent) {
-               ALLEGRO_EVENT fin_event;
-               fin_event.user.type = ALLEGRO_EVENT_AUDIO_STREAM_FINISHED;
-               fin_event.user.timestamp = al_get_time();
-               al_emit_user_event(&stream->spl.es, &fin_event, NULL);
-               finished_event_sent = true;
-            }
-         } else {
-            finished_event_sent = false;
-         }
+      if (event.type == ALLEGRO_EVENT_AUDIO_STREAM_FRAGMENT) {
+         _al_kcm_feed_stream_fragment(stream);
       }
       else if (event.type == _KCM_STREAM_FEEDER_QUIT_EVENT_TYPE) {
          ALLEGRO_EVENT fin_event;
@@ -810,7 +958,7 @@ bool al_rewind_audio_stream(ALLEGRO_AUDIO_STREAM *stream)
    bool ret;
 
    if (stream->rewind_feeder) {
-      ALLEGRO_MUTEX *stream_mutex = maybe_lock_mutex(stream->spl.mutex);
+      ALLEGRO_MUTEX *stream_mutex = maybe_lock_mutex(stream->feed_mutex);
       ret = stream->rewind_feeder(stream);
       maybe_unlock_mutex(stream_mutex);
       return ret;
@@ -827,7 +975,7 @@ bool al_seek_audio_stream_secs(ALLEGRO_AUDIO_STREAM *stream, double time)
    bool ret;
 
    if (stream->seek_feeder) {
-      ALLEGRO_MUTEX *stream_mutex = maybe_lock_mutex(stream->spl.mutex);
+      ALLEGRO_MUTEX *stream_mutex = maybe_lock_mutex(stream->feed_mutex);
       ret = stream->seek_feeder(stream, time);
       maybe_unlock_mutex(stream_mutex);
       return ret;
@@ -844,7 +992,7 @@ double al_get_audio_stream_position_secs(ALLEGRO_AUDIO_STREAM *stream)
    double ret;
 
    if (stream->get_feeder_position) {
-      ALLEGRO_MUTEX *stream_mutex = maybe_lock_mutex(stream->spl.mutex);
+      ALLEGRO_MUTEX *stream_mutex = maybe_lock_mutex(stream->feed_mutex);
       ret = stream->get_feeder_position(stream);
       maybe_unlock_mutex(stream_mutex);
       return ret;
@@ -861,7 +1009,7 @@ double al_get_audio_stream_length_secs(ALLEGRO_AUDIO_STREAM *stream)
    double ret;
 
    if (stream->get_feeder_length) {
-      ALLEGRO_MUTEX *stream_mutex = maybe_lock_mutex(stream->spl.mutex);
+      ALLEGRO_MUTEX *stream_mutex = maybe_lock_mutex(stream->feed_mutex);
       ret = stream->get_feeder_length(stream);
       maybe_unlock_mutex(stream_mutex);
       return ret;
@@ -882,7 +1030,7 @@ bool al_set_audio_stream_loop_secs(ALLEGRO_AUDIO_STREAM *stream,
       return false;
 
    if (stream->set_feeder_loop) {
-      ALLEGRO_MUTEX *stream_mutex = maybe_lock_mutex(stream->spl.mutex);
+      ALLEGRO_MUTEX *stream_mutex = maybe_lock_mutex(stream->feed_mutex);
       ret = stream->set_feeder_loop(stream, start, end);
       maybe_unlock_mutex(stream_mutex);
       return ret;
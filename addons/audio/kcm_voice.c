@@ -50,12 +50,22 @@ const void *_al_voice_update(ALLEGRO_VOICE *voice, ALLEGRO_MUTEX *mutex,
 
    al_lock_mutex(voice->mutex);
    if (voice->attached_stream) {
-      ASSERT(voice->attached_stream->spl_read);
-      voice->attached_stream->spl_read(voice->attached_stream, &buf, samples,
-         voice->depth, 0);
+      ALLEGRO_SAMPLE_INSTANCE *spl = voice->attached_stream;
+      double t0 = al_get_time();
+      double dt;
+
+      ASSERT(spl->spl_read);
+      spl->spl_read(spl, &buf, samples, voice->depth, 0);
+
+      dt = al_get_time() - t0;
+      _al_kcm_record_mix_time(&voice->stats, dt);
+      if (spl->loop >= _ALLEGRO_PLAYMODE_STREAM_ONCE)
+         _al_kcm_record_mix_time(&((ALLEGRO_AUDIO_STREAM *)spl)->stats, dt);
    }
    al_unlock_mutex(voice->mutex);
 
+   _al_kcm_emit_voice_stats(voice);
+
    return buf;
 }
 
@@ -80,6 +90,7 @@ ALLEGRO_VOICE *al_create_voice(unsigned int freq,
    voice->depth     = depth;
    voice->chan_conf = chan_conf;
    voice->frequency = freq;
+   voice->latency   = -1.0;
 
    voice->mutex = al_create_mutex();
    voice->cond = al_create_cond();
@@ -216,15 +227,17 @@ static void stream_read(void *source, void **vbuf, unsigned int *samples,
       /* XXX: Handle the case where we need to call _al_kcm_refill_stream
        * multiple times due to ludicrous playback speed. */
       _al_kcm_refill_stream(stream);
-      if (!stream->pending_bufs[0]) {
+      if (!_al_kcm_fragment_ring_peek(&stream->pending_bufs)) {
          if (stream->is_draining) {
             stream->spl.is_playing = false;
+            /* Lets the feeder threads know the stream was drained. */
+            _al_kcm_emit_stream_events(stream);
          }
          *vbuf = NULL;
          *samples = 0;
          return;
       }
-      *vbuf = stream->pending_bufs[0];
+      *vbuf = _al_kcm_fragment_ring_peek(&stream->pending_bufs);
       pos = *samples;
 
       _al_kcm_emit_stream_events(stream);
@@ -232,7 +245,8 @@ static void stream_read(void *source, void **vbuf, unsigned int *samples,
    else {
       int bytes = pos * al_get_channel_count(stream->spl.spl_data.chan_conf)
                       * al_get_audio_depth_size(stream->spl.spl_data.depth);
-      *vbuf = ((char *)stream->pending_bufs[0]) + bytes;
+      *vbuf = ((char *)_al_kcm_fragment_ring_peek(&stream->pending_bufs))
+         + bytes;
 
       if (pos + *samples > len)
          *samples = len - pos;
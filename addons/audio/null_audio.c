@@ -0,0 +1,484 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Null sound driver.
+ *
+ *      Renders voices without a sound device, either on a thread of its own
+ *      as fast as possible or at a multiple of real time, or only when the
+ *      user asks for it with al_render_voice.  The output can be written to
+ *      a WAV or raw file.
+ *
+ *      See LICENSE.txt for copyright information.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "allegro5/allegro.h"
+#include "allegro5/internal/aintern.h"
+#include "allegro5/internal/aintern_audio.h"
+
+ALLEGRO_DEBUG_CHANNEL("null_audio")
+
+#define DEFAULT_BUFFER_SIZE   1024
+
+
+typedef struct NULL_VOICE {
+   ALLEGRO_THREAD *thread;
+                  /* NULL if the voice is only rendered by al_render_voice. */
+   ALLEGRO_COND *cond;
+   bool is_playing;
+   bool quit;
+                  /* Protected by the voice mutex. */
+
+   unsigned int frame_size;
+   unsigned int buffer_frames;
+   char *buffer;
+
+   double start_time;
+   uint64_t frames_since_start;
+                  /* For keeping to null_speed, only used by the thread. */
+
+   ALLEGRO_FILE *output;
+   bool output_is_wav;
+   uint64_t output_bytes;
+} NULL_VOICE;
+
+
+static double null_speed;
+static bool null_manual;
+static unsigned int null_buffer_size;
+static const char *null_output_path;
+static bool null_output_taken;
+
+
+
+static int null_open(void)
+{
+   ALLEGRO_CONFIG *config = al_get_system_config();
+   const char *val;
+
+   null_speed = 0.0;
+   null_manual = false;
+   null_buffer_size = DEFAULT_BUFFER_SIZE;
+   null_output_path = NULL;
+   null_output_taken = false;
+
+   val = al_get_config_value(config, "null", "speed");
+   if (val && val[0] != '\0') {
+      null_speed = atof(val);
+      if (null_speed < 0.0)
+         null_speed = 0.0;
+   }
+
+   val = al_get_config_value(config, "null", "manual");
+   if (val && (!_al_stricmp(val, "true") || !_al_stricmp(val, "yes") ||
+         !strcmp(val, "1"))) {
+      null_manual = true;
+   }
+
+   val = al_get_config_value(config, "null", "buffer_size");
+   if (val && val[0] != '\0') {
+      int n = atoi(val);
+      if (n > 0)
+         null_buffer_size = n;
+   }
+
+   val = al_get_config_value(config, "null", "output");
+   if (val && val[0] != '\0')
+      null_output_path = val;
+
+   ALLEGRO_INFO("speed %f, manual %d, buffer size %u\n", null_speed,
+      null_manual, null_buffer_size);
+
+   return 0;
+}
+
+
+static void null_close(void)
+{
+}
+
+
+
+/* Writes the WAV header, with the sizes as they are so far. */
+static void write_wav_header(ALLEGRO_VOICE *voice, NULL_VOICE *nv)
+{
+   const int channels = al_get_channel_count(voice->chan_conf);
+   const int bits = al_get_audio_depth_size(voice->depth) * 8;
+   const bool is_float = (voice->depth == ALLEGRO_AUDIO_DEPTH_FLOAT32);
+
+   al_fputs(nv->output, "RIFF");
+   al_fwrite32le(nv->output, 36 + nv->output_bytes);
+   al_fputs(nv->output, "WAVE");
+
+   al_fputs(nv->output, "fmt ");
+   al_fwrite32le(nv->output, 16);
+   al_fwrite16le(nv->output, is_float ? 3 : 1);
+   al_fwrite16le(nv->output, channels);
+   al_fwrite32le(nv->output, voice->frequency);
+   al_fwrite32le(nv->output, voice->frequency * nv->frame_size);
+   al_fwrite16le(nv->output, nv->frame_size);
+   al_fwrite16le(nv->output, bits);
+
+   al_fputs(nv->output, "data");
+   al_fwrite32le(nv->output, nv->output_bytes);
+}
+
+
+static void open_output(ALLEGRO_VOICE *voice, NULL_VOICE *nv)
+{
+   const char *ext;
+
+   /* Only the first voice is written out. */
+   if (!null_output_path || null_output_taken)
+      return;
+
+   nv->output = al_fopen(null_output_path, "wb");
+   if (!nv->output) {
+      ALLEGRO_ERROR("Unable to open %s for writing.\n", null_output_path);
+      return;
+   }
+   null_output_taken = true;
+
+   ext = strrchr(null_output_path, '.');
+   if (ext && !_al_stricmp(ext, ".wav")) {
+      if (voice->depth == ALLEGRO_AUDIO_DEPTH_FLOAT32 ||
+            voice->depth == ALLEGRO_AUDIO_DEPTH_INT16 ||
+            voice->depth == ALLEGRO_AUDIO_DEPTH_UINT8) {
+         nv->output_is_wav = true;
+         write_wav_header(voice, nv);
+      }
+      else {
+         ALLEGRO_WARN("Voice depth can't be stored in a WAV file, "
+            "writing raw samples to %s.\n", null_output_path);
+      }
+   }
+}
+
+
+static void close_output(ALLEGRO_VOICE *voice, NULL_VOICE *nv)
+{
+   if (!nv->output)
+      return;
+
+   if (nv->output_is_wav && al_fseek(nv->output, 0, ALLEGRO_SEEK_SET))
+      write_wav_header(voice, nv);
+
+   al_fclose(nv->output);
+   nv->output = NULL;
+   null_output_taken = false;
+}
+
+
+
+/* Copies up to 'frames' frames of a sample attached directly to the voice.
+ * Called with the voice mutex held.
+ */
+static unsigned int read_nonstream_voice(ALLEGRO_VOICE *voice, NULL_VOICE *nv,
+   char *buf, unsigned int frames)
+{
+   ALLEGRO_SAMPLE_INSTANCE *spl = voice->attached_stream;
+   unsigned int end = spl->spl_data.len;
+   unsigned int n;
+
+   if (spl->loop == ALLEGRO_PLAYMODE_LOOP && spl->loop_end > 0 &&
+         (unsigned int)spl->loop_end <= end) {
+      end = spl->loop_end;
+   }
+
+   if ((unsigned int)spl->pos >= end) {
+      if (spl->loop == ALLEGRO_PLAYMODE_LOOP) {
+         spl->pos = spl->loop_start;
+      }
+      else {
+         spl->pos = 0;
+         nv->is_playing = false;
+         return 0;
+      }
+   }
+
+   n = end - spl->pos;
+   if (n > frames)
+      n = frames;
+   memcpy(buf, (char *)spl->spl_data.buffer.ptr + spl->pos * nv->frame_size,
+      n * nv->frame_size);
+   spl->pos += n;
+
+   return n;
+}
+
+
+/* Renders 'frames' frames of the voice into 'buf', padding with silence if
+ * the voice stops or runs dry.  Must not be called with the voice mutex
+ * held.
+ */
+static void render(ALLEGRO_VOICE *voice, NULL_VOICE *nv, char *buf,
+   unsigned int frames)
+{
+   unsigned int done = 0;
+
+   while (done < frames) {
+      unsigned int n = frames - done;
+
+      al_lock_mutex(voice->mutex);
+      if (!nv->is_playing || !voice->attached_stream) {
+         al_unlock_mutex(voice->mutex);
+         break;
+      }
+      if (!voice->is_streaming) {
+         n = read_nonstream_voice(voice, nv, buf + done * nv->frame_size, n);
+         al_unlock_mutex(voice->mutex);
+         if (n == 0)
+            break;
+      }
+      else {
+         const void *data;
+         al_unlock_mutex(voice->mutex);
+         data = _al_voice_update(voice, voice->mutex, &n);
+         if (!data || n == 0)
+            break;
+         memcpy(buf + done * nv->frame_size, data, n * nv->frame_size);
+      }
+
+      done += n;
+   }
+
+   if (done < frames) {
+      al_fill_silence(buf + done * nv->frame_size, frames - done,
+         voice->depth, voice->chan_conf);
+   }
+
+   if (nv->output) {
+      nv->output_bytes += al_fwrite(nv->output, buf, frames * nv->frame_size);
+   }
+}
+
+
+static void *null_update(ALLEGRO_THREAD *self, void *arg)
+{
+   ALLEGRO_VOICE *voice = arg;
+   NULL_VOICE *nv = voice->extra;
+   (void)self;
+
+   for (;;) {
+      al_lock_mutex(voice->mutex);
+      if (!nv->is_playing && !nv->quit) {
+         while (!nv->is_playing && !nv->quit)
+            al_wait_cond(nv->cond, voice->mutex);
+         nv->start_time = al_get_time();
+         nv->frames_since_start = 0;
+      }
+      if (nv->quit) {
+         al_unlock_mutex(voice->mutex);
+         break;
+      }
+      al_unlock_mutex(voice->mutex);
+
+      render(voice, nv, nv->buffer, nv->buffer_frames);
+
+      if (null_speed > 0.0) {
+         double due;
+
+         nv->frames_since_start += nv->buffer_frames;
+         due = nv->start_time +
+            nv->frames_since_start / (voice->frequency * null_speed);
+         if (due > al_get_time())
+            al_rest(due - al_get_time());
+      }
+   }
+
+   return NULL;
+}
+
+
+
+static int null_allocate_voice(ALLEGRO_VOICE *voice)
+{
+   NULL_VOICE *nv = al_calloc(1, sizeof(*nv));
+   if (!nv)
+      return 1;
+
+   nv->frame_size = al_get_channel_count(voice->chan_conf) *
+      al_get_audio_depth_size(voice->depth);
+   nv->buffer_frames = null_buffer_size;
+   nv->start_time = al_get_time();
+   nv->cond = al_create_cond();
+   if (!nv->cond) {
+      al_free(nv);
+      return 1;
+   }
+
+   voice->extra = nv;
+   open_output(voice, nv);
+
+   /* Nothing is buffered past the block being rendered. */
+   voice->latency = null_manual ? 0.0 :
+      (double)nv->buffer_frames / voice->frequency;
+
+   if (!null_manual) {
+      nv->buffer = al_malloc(nv->buffer_frames * nv->frame_size);
+      nv->thread = al_create_thread(null_update, voice);
+      if (!nv->buffer || !nv->thread) {
+         ALLEGRO_ERROR("Unable to start voice thread.\n");
+         if (nv->thread)
+            al_destroy_thread(nv->thread);
+         al_free(nv->buffer);
+         close_output(voice, nv);
+         al_destroy_cond(nv->cond);
+         al_free(nv);
+         voice->extra = NULL;
+         return 1;
+      }
+      al_start_thread(nv->thread);
+   }
+
+   return 0;
+}
+
+
+static void null_deallocate_voice(ALLEGRO_VOICE *voice)
+{
+   NULL_VOICE *nv = voice->extra;
+
+   if (nv->thread) {
+      al_lock_mutex(voice->mutex);
+      nv->quit = true;
+      al_signal_cond(nv->cond);
+      al_unlock_mutex(voice->mutex);
+
+      al_join_thread(nv->thread, NULL);
+      al_destroy_thread(nv->thread);
+   }
+
+   close_output(voice, nv);
+   al_destroy_cond(nv->cond);
+   al_free(nv->buffer);
+   al_free(nv);
+   voice->extra = NULL;
+}
+
+
+static int null_load_voice(ALLEGRO_VOICE *voice, const void *data)
+{
+   (void)data;
+
+   if (voice->attached_stream->loop == ALLEGRO_PLAYMODE_BIDIR) {
+      ALLEGRO_INFO("Backwards playing not supported by the driver.\n");
+      return -1;
+   }
+
+   voice->attached_stream->pos = 0;
+   return 0;
+}
+
+
+static void null_unload_voice(ALLEGRO_VOICE *voice)
+{
+   (void)voice;
+}
+
+
+static int null_start_voice(ALLEGRO_VOICE *voice)
+{
+   NULL_VOICE *nv = voice->extra;
+
+   nv->is_playing = true;
+   al_signal_cond(nv->cond);
+   return 0;
+}
+
+
+static int null_stop_voice(ALLEGRO_VOICE *voice)
+{
+   NULL_VOICE *nv = voice->extra;
+
+   nv->is_playing = false;
+   if (!voice->is_streaming) {
+      voice->attached_stream->pos = 0;
+   }
+   return 0;
+}
+
+
+static bool null_voice_is_playing(const ALLEGRO_VOICE *voice)
+{
+   NULL_VOICE *nv = voice->extra;
+   return nv->is_playing;
+}
+
+
+static unsigned int null_get_voice_position(const ALLEGRO_VOICE *voice)
+{
+   return voice->attached_stream->pos;
+}
+
+
+static int null_set_voice_position(ALLEGRO_VOICE *voice, unsigned int val)
+{
+   voice->attached_stream->pos = val;
+   return 0;
+}
+
+
+ALLEGRO_AUDIO_DRIVER _al_kcm_null_driver =
+{
+   "null",
+
+   null_open,
+   null_close,
+
+   null_allocate_voice,
+   null_deallocate_voice,
+
+   null_load_voice,
+   null_unload_voice,
+
+   null_start_voice,
+   null_stop_voice,
+
+   null_voice_is_playing,
+
+   null_get_voice_position,
+   null_set_voice_position,
+
+   NULL,
+   NULL
+};
+
+
+
+/* Function: al_render_voice
+ */
+bool al_render_voice(ALLEGRO_VOICE *voice, void *buffer, unsigned int samples)
+{
+   NULL_VOICE *nv;
+   ASSERT(voice);
+   ASSERT(buffer);
+
+   if (voice->driver != &_al_kcm_null_driver) {
+      _al_set_error(ALLEGRO_INVALID_OBJECT,
+         "Only voices of the null audio driver can be rendered");
+      return false;
+   }
+
+   nv = voice->extra;
+   if (nv->thread) {
+      _al_set_error(ALLEGRO_INVALID_OBJECT,
+         "The voice is rendered by its own thread");
+      return false;
+   }
+
+   render(voice, nv, buffer, samples);
+   return true;
+}
+
+
+/* vim: set sts=3 sw=3 et: */
@@ -419,6 +419,23 @@ static void oss_update_silence(ALLEGRO_VOICE *voice, OSS_VOICE *oss_voice)
 }
 
 
+/* Reports how long the audio already written will take to be played. */
+static void oss_update_latency(ALLEGRO_VOICE *voice, OSS_VOICE *oss_voice)
+{
+#ifdef SNDCTL_DSP_GETODELAY
+   int delay;
+
+   if (ioctl(oss_voice->fd, SNDCTL_DSP_GETODELAY, &delay) != -1) {
+      _al_kcm_set_voice_latency(voice,
+         (double)delay / (oss_voice->frame_size * voice->frequency));
+   }
+#else
+   (void)voice;
+   (void)oss_voice;
+#endif
+}
+
+
 static void* oss_update(ALLEGRO_THREAD *self, void *arg)
 {
    ALLEGRO_VOICE *voice = arg;
@@ -462,6 +479,7 @@ static void* oss_update(ALLEGRO_THREAD *self, void *arg)
             if (errno != EINTR)
                return NULL;
          }
+         oss_update_latency(voice, oss_voice);
       }
       else if (voice->is_streaming && !oss_voice->stopped) {
          const void *data = _al_voice_update(voice, voice->mutex, &frames);
@@ -474,6 +492,7 @@ static void* oss_update(ALLEGRO_THREAD *self, void *arg)
             if (errno != EINTR)
                return NULL;
          }
+         oss_update_latency(voice, oss_voice);
       }
       else {
          /* If stopped just fill with silence. */
@@ -155,6 +155,17 @@ static void pulseaudio_close(void)
 {
 }
 
+// Reports how long the audio already written will take to be played.
+static void pulseaudio_update_latency(ALLEGRO_VOICE *voice,
+   PULSEAUDIO_VOICE *pv)
+{
+   int error;
+   pa_usec_t latency = pa_simple_get_latency(pv->s, &error);
+   if (latency != (pa_usec_t)-1) {
+      _al_kcm_set_voice_latency(voice, latency / 1000000.0);
+   }
+}
+
 static void *pulseaudio_update(ALLEGRO_THREAD *self, void *data)
 {
    ALLEGRO_VOICE *voice = data;
@@ -182,6 +193,7 @@ static void *pulseaudio_update(ALLEGRO_THREAD *self, void *data)
             if (data) {
                pa_simple_write(pv->s, data,
                   frames * pv->frame_size_in_bytes, NULL);
+               pulseaudio_update_latency(voice, pv);
             }
          }
          else {
@@ -207,6 +219,7 @@ static void *pulseaudio_update(ALLEGRO_THREAD *self, void *data)
             al_unlock_mutex(pv->buffer_mutex);
 
             pa_simple_write(pv->s, data, len, NULL);
+            pulseaudio_update_latency(voice, pv);
          }
       }
       else if (status == PV_STOPPING) {
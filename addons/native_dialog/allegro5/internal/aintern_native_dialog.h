@@ -1,7 +1,7 @@
 #ifndef __al_included_allegro_aintern_native_dialog_h
 #define __al_included_allegro_aintern_native_dialog_h
 
-#include "allegro5/internal/aintern_list.h"
+#include "allegro5/internal/aintern_dtor.h"
 #include "allegro5/internal/aintern_vector.h"
 #include "allegro5/internal/aintern_native_dialog_cfg.h"
 
@@ -43,7 +43,7 @@ struct ALLEGRO_NATIVE_DIALOG
    void *window;
    void *async_queue;
    
-   _AL_LIST_ITEM *dtor_item;
+   _AL_DTOR_ITEM *dtor_item;
 };
 
 extern bool _al_init_native_dialog_addon(void);
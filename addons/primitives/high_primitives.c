@@ -42,6 +42,7 @@
 #include "allegro5/allegro_opengl.h"
 #endif
 #include "allegro5/internal/aintern_bitmap.h"
+#include "allegro5/internal/aintern_prim_soft.h"
 #include "allegro5/debug.h"
 #include <math.h>
 
@@ -408,6 +409,9 @@ void al_draw_filled_rectangle(float x1, float y1, float x2, float y2,
    ALLEGRO_VERTEX vtx[4];
    int ii;
 
+   if (_al_draw_filled_rectangle_soft(x1, y1, x2, y2, color))
+      return;
+
    vtx[0].x = x1; vtx[0].y = y1;
    vtx[1].x = x1; vtx[1].y = y2;
    vtx[2].x = x2; vtx[2].y = y2;
@@ -25,6 +25,7 @@
 #include "allegro5/internal/aintern_prim_soft.h"
 #include "allegro5/internal/aintern_prim.h"
 #include "allegro5/internal/aintern_tri_soft.h"
+#include "allegro5/internal/aintern_vector.h"
 
 /*
 The vertex cache allows for bulk transformation of vertices, for faster run speeds
@@ -100,6 +101,35 @@ static void convert_vtx(ALLEGRO_BITMAP* texture, const char* src, ALLEGRO_VERTEX
    }
 }
 
+/*
+Triangles drawn into a target with the ALLEGRO_PARALLEL_DRAWING flag, or
+while drawing is held, are collected and then rasterised (or recorded)
+together by _al_triangles_2d.
+*/
+static void add_triangle(_AL_VECTOR* batch, ALLEGRO_BITMAP* texture,
+   ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX* v2, ALLEGRO_VERTEX* v3)
+{
+   if (batch) {
+      ALLEGRO_VERTEX tri[3];
+      tri[0] = *v1;
+      tri[1] = *v2;
+      tri[2] = *v3;
+      _al_vector_append_array(batch, 3, tri);
+   }
+   else {
+      _al_triangle_2d(texture, v1, v2, v3);
+   }
+}
+
+static void flush_triangles(_AL_VECTOR* batch, ALLEGRO_BITMAP* texture)
+{
+   if (batch) {
+      if (_al_vector_is_nonempty(batch))
+         _al_triangles_2d(texture, _al_vector_ref_front(batch), _al_vector_size(batch) / 3);
+      _al_vector_free(batch);
+   }
+}
+
 int _al_draw_prim_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_VERTEX_DECL* decl, int start, int end, int type)
 {
    LOCAL_VERTEX_CACHE;
@@ -108,6 +138,9 @@ int _al_draw_prim_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_
    int use_cache;
    int stride = decl ? decl->stride : (int)sizeof(ALLEGRO_VERTEX);
    const ALLEGRO_TRANSFORM* global_trans = al_get_current_transform();
+   _AL_VECTOR batch_vtx = _AL_VECTOR_INITIALIZER(ALLEGRO_VERTEX);
+   _AL_VECTOR* batch = (_al_is_parallel_drawing_target() || al_is_bitmap_drawing_held()) ?
+      &batch_vtx : NULL;
    
    num_primitives = 0;
    num_vtx = end - start;
@@ -199,7 +232,7 @@ int _al_draw_prim_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_
          if (use_cache) {
             int ii;
             for (ii = 0; ii < num_vtx - 2; ii += 3) {
-               _al_triangle_2d(texture, &vertex_cache[ii], &vertex_cache[ii + 1], &vertex_cache[ii + 2]);
+               add_triangle(batch, texture, &vertex_cache[ii], &vertex_cache[ii + 1], &vertex_cache[ii + 2]);
             }
          } else {
             int ii;
@@ -209,7 +242,7 @@ int _al_draw_prim_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_
                SET_VERTEX(v2, ii + 1);
                SET_VERTEX(v3, ii + 2);
                
-               _al_triangle_2d(texture, &v1, &v2, &v3);
+               add_triangle(batch, texture, &v1, &v2, &v3);
             }
          }
          num_primitives = num_vtx / 3;
@@ -219,7 +252,7 @@ int _al_draw_prim_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_
          if (use_cache) {
             int ii;
             for (ii = 2; ii < num_vtx; ii++) {
-               _al_triangle_2d(texture, &vertex_cache[ii - 2], &vertex_cache[ii - 1], &vertex_cache[ii]);
+               add_triangle(batch, texture, &vertex_cache[ii - 2], &vertex_cache[ii - 1], &vertex_cache[ii]);
             }
          } else {
             int ii;
@@ -230,7 +263,7 @@ int _al_draw_prim_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_
             for (ii = start + 2; ii < end; ii++) {
                SET_VERTEX(vtx[idx], ii);
                
-               _al_triangle_2d(texture, &vtx[0], &vtx[1], &vtx[2]);
+               add_triangle(batch, texture, &vtx[0], &vtx[1], &vtx[2]);
                idx = (idx + 1) % 3;
             }
          }
@@ -241,7 +274,7 @@ int _al_draw_prim_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_
          if (use_cache) {
             int ii;
             for (ii = 1; ii < num_vtx; ii++) {
-               _al_triangle_2d(texture, &vertex_cache[0], &vertex_cache[ii], &vertex_cache[ii - 1]);
+               add_triangle(batch, texture, &vertex_cache[0], &vertex_cache[ii], &vertex_cache[ii - 1]);
             }
          } else {
             int ii;
@@ -252,7 +285,7 @@ int _al_draw_prim_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_
             SET_VERTEX(vtx[0], start + 1);
             for (ii = start + 1; ii < end; ii++) {
                SET_VERTEX(vtx[idx], ii)
-               _al_triangle_2d(texture, &v0, &vtx[0], &vtx[1]);
+               add_triangle(batch, texture, &v0, &vtx[0], &vtx[1]);
                idx = 1 - idx;
             }
          }
@@ -278,6 +311,8 @@ int _al_draw_prim_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_
          break;
       };
    }
+
+   flush_triangles(batch, texture);
    
    if(texture)
        al_unlock_bitmap(texture);
@@ -296,6 +331,9 @@ int _al_draw_prim_indexed_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const
    int ii;
    int stride = decl ? decl->stride : (int)sizeof(ALLEGRO_VERTEX);
    const ALLEGRO_TRANSFORM* global_trans = al_get_current_transform();
+   _AL_VECTOR batch_vtx = _AL_VECTOR_INITIALIZER(ALLEGRO_VERTEX);
+   _AL_VECTOR* batch = (_al_is_parallel_drawing_target() || al_is_bitmap_drawing_held()) ?
+      &batch_vtx : NULL;
 
    num_primitives = 0;   
    use_cache = 1;
@@ -419,7 +457,7 @@ int _al_draw_prim_indexed_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const
                int idx1 = indices[ii] - min_idx;
                int idx2 = indices[ii + 1] - min_idx;
                int idx3 = indices[ii + 2] - min_idx;
-               _al_triangle_2d(texture, &vertex_cache[idx1], &vertex_cache[idx2], &vertex_cache[idx3]);
+               add_triangle(batch, texture, &vertex_cache[idx1], &vertex_cache[idx2], &vertex_cache[idx3]);
             }
          } else {
             int ii;
@@ -433,7 +471,7 @@ int _al_draw_prim_indexed_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const
                SET_VERTEX(v2, idx2);
                SET_VERTEX(v3, idx3);
                
-               _al_triangle_2d(texture, &v1, &v2, &v3);
+               add_triangle(batch, texture, &v1, &v2, &v3);
             }
          }
          num_primitives = num_vtx / 3;
@@ -446,7 +484,7 @@ int _al_draw_prim_indexed_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const
                int idx1 = indices[ii - 2] - min_idx;
                int idx2 = indices[ii - 1] - min_idx;
                int idx3 = indices[ii] - min_idx;
-               _al_triangle_2d(texture, &vertex_cache[idx1], &vertex_cache[idx2], &vertex_cache[idx3]);
+               add_triangle(batch, texture, &vertex_cache[idx1], &vertex_cache[idx2], &vertex_cache[idx3]);
             }
          } else {
             int ii;
@@ -457,7 +495,7 @@ int _al_draw_prim_indexed_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const
             for (ii = 2; ii < num_vtx; ii ++) {
                SET_VERTEX(vtx[idx], indices[ii]);
                
-               _al_triangle_2d(texture, &vtx[0], &vtx[1], &vtx[2]);
+               add_triangle(batch, texture, &vtx[0], &vtx[1], &vtx[2]);
                idx = (idx + 1) % 3;
             }
          }
@@ -471,7 +509,7 @@ int _al_draw_prim_indexed_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const
             for (ii = 1; ii < num_vtx; ii++) {
                int idx1 = indices[ii] - min_idx;
                int idx2 = indices[ii - 1] - min_idx;
-               _al_triangle_2d(texture, &vertex_cache[idx0], &vertex_cache[idx1], &vertex_cache[idx2]);
+               add_triangle(batch, texture, &vertex_cache[idx0], &vertex_cache[idx1], &vertex_cache[idx2]);
             }
          } else {
             int ii;
@@ -482,7 +520,7 @@ int _al_draw_prim_indexed_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const
             SET_VERTEX(vtx[0], indices[1]);
             for (ii = 2; ii < num_vtx; ii ++) {
                SET_VERTEX(vtx[idx], indices[ii])
-               _al_triangle_2d(texture, &v0, &vtx[0], &vtx[1]);
+               add_triangle(batch, texture, &v0, &vtx[0], &vtx[1]);
                idx = 1 - idx;
             }
          }
@@ -510,6 +548,8 @@ int _al_draw_prim_indexed_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const
       };
    }
 
+   flush_triangles(batch, texture);
+
    if(texture)
        al_unlock_bitmap(texture);
    
@@ -517,6 +557,25 @@ int _al_draw_prim_indexed_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const
 #undef SET_VERTEX
 }
 
+/*
+Filled rectangles drawn into a memory bitmap are filled row by row, as
+long as the transformation keeps them axis aligned and unscaled.
+*/
+bool _al_draw_filled_rectangle_soft(float x1, float y1, float x2, float y2, ALLEGRO_COLOR color)
+{
+   ALLEGRO_BITMAP* target = al_get_target_bitmap();
+   const ALLEGRO_TRANSFORM* t = al_get_current_transform();
+
+   if (!(al_get_bitmap_flags(target) & ALLEGRO_MEMORY_BITMAP))
+      return false;
+   if (t->m[0][0] != 1 || t->m[0][1] != 0 || t->m[1][0] != 0 || t->m[1][1] != 1)
+      return false;
+
+   al_transform_coordinates(t, &x1, &y1);
+   al_transform_coordinates(t, &x2, &y2);
+   return _al_fill_rectangle_2d(x1, y1, x2, y2, color);
+}
+
 /* Function: al_draw_soft_triangle
  */
 void al_draw_soft_triangle(
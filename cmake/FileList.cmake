@@ -10,6 +10,7 @@ set(ALLEGRO_SRC_FILES
     src/clipboard.c
     src/config.c
     src/convert.c
+    src/convert_simd.c
     src/cpu.c
     src/debug.c
     src/display.c
@@ -37,6 +38,7 @@ set(ALLEGRO_SRC_FILES
     src/monitor.c
     src/mousenu.c
     src/mouse_cursor.c
+    src/parallel.c
     src/path.c
     src/pixels.c
     src/shader.c
@@ -30,6 +30,12 @@ enum {
    ALLEGRO_CONVERT_BITMAP           = 0x1000
 };
 
+#if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_SRC)
+enum {
+   ALLEGRO_PARALLEL_DRAWING         = 0x2000
+};
+#endif
+
 
 AL_FUNC(void, al_set_new_bitmap_format, (int format));
 AL_FUNC(void, al_set_new_bitmap_flags, (int flags));
@@ -49,6 +49,13 @@ AL_FUNC(int, _al_stricmp, (const char *s1, const char *s2));
 
 #define _AL_INCHES_PER_MM 0.039370
 
+/* instruction set extensions, see _al_get_cpu_features */
+#define _AL_CPU_SSE2    0x0001
+#define _AL_CPU_AVX2    0x0002
+#define _AL_CPU_NEON    0x0004
+
+AL_FUNC(int, _al_get_cpu_features, (void));
+
 #ifdef __cplusplus
    }
 #endif
@@ -19,6 +19,28 @@
       return __sync_sub_and_fetch(ptr, 1);
    })
 
+   AL_INLINE(_AL_ATOMIC,
+      _al_atomic_load_acquire, (volatile _AL_ATOMIC *ptr),
+   {
+      _AL_ATOMIC value = *ptr;
+      __sync_synchronize();
+      return value;
+   })
+
+   AL_INLINE(void,
+      _al_atomic_store_release, (volatile _AL_ATOMIC *ptr, _AL_ATOMIC value),
+   {
+      __sync_synchronize();
+      *ptr = value;
+   })
+
+   AL_INLINE(bool,
+      _al_compare_and_swap, (volatile _AL_ATOMIC *ptr, _AL_ATOMIC old_value,
+         _AL_ATOMIC new_value),
+   {
+      return __sync_bool_compare_and_swap(ptr, old_value, new_value);
+   })
+
 #elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
 
    /* gcc, x86 or x86-64 */
@@ -49,11 +71,45 @@
       return old - 1;
    })
 
+   /* x86 doesn't reorder loads with older loads or stores with older
+    * stores, so only the compiler needs to be kept from doing so.
+    */
+   AL_INLINE(_AL_ATOMIC,
+      _al_atomic_load_acquire, (volatile _AL_ATOMIC *ptr),
+   {
+      _AL_ATOMIC value = *ptr;
+      __asm__ __volatile__ ("" : : : "memory");
+      return value;
+   })
+
+   AL_INLINE(void,
+      _al_atomic_store_release, (volatile _AL_ATOMIC *ptr, _AL_ATOMIC value),
+   {
+      __asm__ __volatile__ ("" : : : "memory");
+      *ptr = value;
+   })
+
+   AL_INLINE(bool,
+      _al_compare_and_swap, (volatile _AL_ATOMIC *ptr, _AL_ATOMIC old_value,
+         _AL_ATOMIC new_value),
+   {
+      _AL_ATOMIC prev;
+      __asm__ __volatile__ (
+         "lock; cmpxchgl %2, %1"
+         : "=a" (prev), "+m" (*ptr)
+         : "r" (new_value), "0" (old_value)
+         : "memory"
+      );
+      return prev == old_value;
+   })
+
 #elif defined(_MSC_VER) && _M_IX86 >= 400
 
    /* MSVC, x86 */
    /* MinGW supports these too, but we already have asm code above. */
 
+   #include <windows.h>
+
    typedef LONG _AL_ATOMIC;
 
    AL_INLINE(_AL_ATOMIC,
@@ -68,6 +124,26 @@
       return InterlockedDecrement(ptr);
    })
 
+   /* MSVC gives volatile accesses acquire and release semantics on x86. */
+   AL_INLINE(_AL_ATOMIC,
+      _al_atomic_load_acquire, (volatile _AL_ATOMIC *ptr),
+   {
+      return *ptr;
+   })
+
+   AL_INLINE(void,
+      _al_atomic_store_release, (volatile _AL_ATOMIC *ptr, _AL_ATOMIC value),
+   {
+      *ptr = value;
+   })
+
+   AL_INLINE(bool,
+      _al_compare_and_swap, (volatile _AL_ATOMIC *ptr, _AL_ATOMIC old_value,
+         _AL_ATOMIC new_value),
+   {
+      return InterlockedCompareExchange(ptr, new_value, old_value) == old_value;
+   })
+
 #elif defined(ALLEGRO_HAVE_OSATOMIC_H)
 
    /* OS X, GCC < 4.1
@@ -93,6 +169,29 @@
       return OSAtomicDecrement32Barrier((_AL_ATOMIC *)ptr);
    })
 
+   AL_INLINE(_AL_ATOMIC,
+      _al_atomic_load_acquire, (volatile _AL_ATOMIC *ptr),
+   {
+      _AL_ATOMIC value = *ptr;
+      OSMemoryBarrier();
+      return value;
+   })
+
+   AL_INLINE(void,
+      _al_atomic_store_release, (volatile _AL_ATOMIC *ptr, _AL_ATOMIC value),
+   {
+      OSMemoryBarrier();
+      *ptr = value;
+   })
+
+   AL_INLINE(bool,
+      _al_compare_and_swap, (volatile _AL_ATOMIC *ptr, _AL_ATOMIC old_value,
+         _AL_ATOMIC new_value),
+   {
+      return OSAtomicCompareAndSwap32Barrier(old_value, new_value,
+         (_AL_ATOMIC *)ptr);
+   })
+
 
 #else
 
@@ -113,6 +212,28 @@
       return --(*ptr);
    })
 
+   AL_INLINE(_AL_ATOMIC,
+      _al_atomic_load_acquire, (volatile _AL_ATOMIC *ptr),
+   {
+      return *ptr;
+   })
+
+   AL_INLINE(void,
+      _al_atomic_store_release, (volatile _AL_ATOMIC *ptr, _AL_ATOMIC value),
+   {
+      *ptr = value;
+   })
+
+   AL_INLINE(bool,
+      _al_compare_and_swap, (volatile _AL_ATOMIC *ptr, _AL_ATOMIC old_value,
+         _AL_ATOMIC new_value),
+   {
+      if (*ptr != old_value)
+         return false;
+      *ptr = new_value;
+      return true;
+   })
+
 #endif
 
 #endif
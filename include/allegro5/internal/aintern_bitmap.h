@@ -7,13 +7,14 @@
 #include "allegro5/render_state.h"
 #include "allegro5/transformations.h"
 #include "allegro5/internal/aintern_display.h"
-#include "allegro5/internal/aintern_list.h"
+#include "allegro5/internal/aintern_dtor.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 typedef struct ALLEGRO_BITMAP_INTERFACE ALLEGRO_BITMAP_INTERFACE;
+typedef struct _AL_HELD_DRAWING _AL_HELD_DRAWING;
 
 struct ALLEGRO_BITMAP
 {
@@ -103,10 +104,15 @@ struct ALLEGRO_BITMAP
    /* Extra data for display bitmaps, like texture id and so on. */
    void *extra;
 
-   _AL_LIST_ITEM *dtor_item;
+   _AL_DTOR_ITEM *dtor_item;
 
    /* set_target_bitmap and lock_bitmap mark bitmaps as dirty for preservation */
    bool dirty;
+
+   /* Drawing recorded while drawing into this memory bitmap is held,
+    * see memblit.c.
+    */
+   _AL_HELD_DRAWING *held_drawing;
 };
 
 struct ALLEGRO_BITMAP_INTERFACE
@@ -153,6 +159,9 @@ extern void (*_al_convert_funcs[ALLEGRO_NUM_PIXEL_FORMATS]
    [ALLEGRO_NUM_PIXEL_FORMATS])(const void *, int, void *, int,
    int, int, int, int, int, int);
 
+void _al_init_convert_funcs(void);
+void _al_init_convert_bands(void);
+
 /* Bitmap conversion */
 void _al_convert_bitmap_data(
 	const void *src, int src_format, int src_pitch,
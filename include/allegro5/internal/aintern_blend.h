@@ -2,6 +2,7 @@
 #define __al_included_allegro5_aintern_blend_h
 
 #include "allegro5/internal/aintern.h"
+#include "allegro5/internal/aintern_display.h"
 
 #ifdef __cplusplus
    extern "C" {
@@ -244,6 +245,9 @@ void _al_blend_inline(
 
 void _al_blend_memory(ALLEGRO_COLOR *src_color, ALLEGRO_BITMAP *dest,
    int dx, int dy, ALLEGRO_COLOR *result);
+void _al_compile_blender(ALLEGRO_BLENDER *blender);
+const ALLEGRO_BLENDER *_al_get_blender(void);
+const ALLEGRO_BLENDER *_al_get_bitmap_blender(void);
 
 
 #ifdef __cplusplus
@@ -6,9 +6,36 @@
 #endif
 
 
+#define _AL_TRACE_CHANNEL_CACHE_SIZE  8
+
+/* Per-thread logging state, kept in the thread local storage. */
+typedef struct _AL_TRACE_THREAD_STATE
+{
+   /* Header of the message being logged, saved by _al_trace_prefix for
+    * _al_trace_suffix.
+    */
+   char const *channel;
+   char const *file;
+   char const *function;
+   int line;
+   int level;
+
+   /* Whether recently used channels pass the channel filter, keyed by the
+    * channel pointer.  Entries are stale if the generation doesn't match.
+    */
+   struct {
+      char const *channel;
+      int generation;
+      bool included;
+   } channels[_AL_TRACE_CHANNEL_CACHE_SIZE];
+} _AL_TRACE_THREAD_STATE;
+
+
 void _al_configure_logging(void);
 void _al_shutdown_logging(void);
 
+_AL_TRACE_THREAD_STATE *_al_tls_get_trace_state(void);
+
 
 #ifdef __cplusplus
 }
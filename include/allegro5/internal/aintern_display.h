@@ -88,7 +88,14 @@ struct ALLEGRO_DISPLAY_INTERFACE
 
 struct ALLEGRO_OGL_EXTRAS;
 
-typedef struct ALLEGRO_BLENDER
+typedef struct ALLEGRO_BLENDER ALLEGRO_BLENDER;
+
+/* Blends one pixel in software, see _al_compile_blender. */
+typedef void (*_AL_BLEND_FUNC)(const ALLEGRO_COLOR *scol,
+   const ALLEGRO_COLOR *dcol, ALLEGRO_COLOR *constcol,
+   const ALLEGRO_BLENDER *blender, ALLEGRO_COLOR *result);
+
+struct ALLEGRO_BLENDER
 {
    int blend_op;
    int blend_source;
@@ -97,7 +104,9 @@ typedef struct ALLEGRO_BLENDER
    int blend_alpha_source;
    int blend_alpha_dest;
    ALLEGRO_COLOR blend_color;
-} ALLEGRO_BLENDER;
+   /* Must be updated whenever any of the modes above change. */
+   _AL_BLEND_FUNC blend_func;
+};
 
 typedef struct _ALLEGRO_RENDER_STATE {
    int write_mask;
@@ -8,6 +8,8 @@
 
 extern const ALLEGRO_FILE_INTERFACE _al_file_interface_stdio;
 
+AL_FUNC(int, _al_get_file_fd, (ALLEGRO_FILE *f));
+
 #define ALLEGRO_UNGETC_SIZE 16
 
 struct ALLEGRO_FILE
@@ -1,6 +1,8 @@
 #ifndef __al_included_allegro5_aintern_memblit_h
 #define __al_included_allegro5_aintern_memblit_h
 
+#include "allegro5/internal/aintern_tri_soft.h"
+
 #ifdef __cplusplus
    extern "C" {
 #endif
@@ -10,6 +12,13 @@ void _al_draw_bitmap_region_memory(ALLEGRO_BITMAP *bitmap,
    ALLEGRO_COLOR tint,
    int sx, int sy, int sw, int sh, int dx, int dy, int flags);
 
+bool _al_hold_triangles_memory(ALLEGRO_BITMAP *texture, ALLEGRO_VERTEX *vtx,
+   int num_triangles);
+void _al_hold_memory_bitmap_drawing(ALLEGRO_BITMAP *target, bool hold);
+bool _al_is_memory_bitmap_drawing_held(ALLEGRO_BITMAP *target);
+void _al_flush_held_memory_drawing(ALLEGRO_BITMAP *bitmap, int lock_flags);
+void _al_destroy_held_memory_drawing(ALLEGRO_BITMAP *bitmap);
+
 
 #ifdef __cplusplus
    }
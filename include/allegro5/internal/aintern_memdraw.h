@@ -8,6 +8,8 @@
 
 void _al_clear_bitmap_by_locking(ALLEGRO_BITMAP *bitmap, ALLEGRO_COLOR *color);
 void _al_draw_pixel_memory(ALLEGRO_BITMAP *bmp, float x, float y, ALLEGRO_COLOR *color);
+void _al_fill_memory_region(void *data, int pitch, int pixel_size,
+   const void *pixel, int w, int h);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,21 @@
+#ifndef __al_included_allegro5_aintern_parallel_h
+#define __al_included_allegro5_aintern_parallel_h
+
+#ifdef __cplusplus
+   extern "C" {
+#endif
+
+
+void _al_init_parallel(void);
+AL_FUNC(int, _al_get_parallel_thread_count, (void));
+AL_FUNC(void, _al_run_parallel, (int count,
+   void (*proc)(void *arg, int index), void *arg));
+
+
+#ifdef __cplusplus
+   }
+#endif
+
+#endif
+
+/* vim: set sts=3 sw=3 et: */
@@ -0,0 +1,30 @@
+#ifndef __al_included_allegro5_aintern_simd_h
+#define __al_included_allegro5_aintern_simd_h
+
+/* Which vector instruction sets the compiler lets us use here.
+ *
+ * The x86 sets are compiled for their instruction set regardless of the
+ * flags used for the rest of the library, so code using them must only
+ * be called after checking _al_get_cpu_features(). Functions containing
+ * such code are marked with _AL_TARGET_SSE2 or _AL_TARGET_AVX2.
+ */
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+   #if defined(_MSC_VER) && _MSC_VER >= 1700
+      #define _AL_SIMD_SSE2
+      #define _AL_SIMD_AVX2
+      #define _AL_TARGET_SSE2
+      #define _AL_TARGET_AVX2
+   #elif defined(__clang__) || (defined(__GNUC__) && \
+         (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+      #define _AL_SIMD_SSE2
+      #define _AL_SIMD_AVX2
+      #define _AL_TARGET_SSE2  __attribute__((target("sse2")))
+      #define _AL_TARGET_AVX2  __attribute__((target("avx2")))
+   #endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+   #define _AL_SIMD_NEON
+#endif
+
+#endif
+
+/* vim: set sts=3 sw=3 et: */
@@ -17,6 +17,9 @@ struct ALLEGRO_VERTEX {
 #endif
 
 AL_FUNC(void, _al_triangle_2d, (ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX* v2, ALLEGRO_VERTEX* v3));
+AL_FUNC(void, _al_triangles_2d, (ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX* vtx, int num_triangles));
+AL_FUNC(bool, _al_is_parallel_drawing_target, (void));
+AL_FUNC(bool, _al_fill_rectangle_2d, (float x1, float y1, float x2, float y2, ALLEGRO_COLOR color));
 AL_FUNC(void, _al_draw_soft_triangle, (
    ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX* v2, ALLEGRO_VERTEX* v3, uintptr_t state,
    void (*init)(uintptr_t, ALLEGRO_VERTEX*, ALLEGRO_VERTEX*, ALLEGRO_VERTEX*),
@@ -59,6 +59,23 @@ AL_FUNC(void, al_set_timer_count, (ALLEGRO_TIMER *timer, int64_t count));
 AL_FUNC(void, al_add_timer_count, (ALLEGRO_TIMER *timer, int64_t diff));
 AL_FUNC(ALLEGRO_EVENT_SOURCE *, al_get_timer_event_source, (ALLEGRO_TIMER *timer));
 
+#if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_SRC)
+/* Type: ALLEGRO_TIMER_STATS
+ */
+typedef struct ALLEGRO_TIMER_STATS ALLEGRO_TIMER_STATS;
+
+struct ALLEGRO_TIMER_STATS
+{
+   int64_t ticks;
+   double min_lateness;
+   double avg_lateness;
+   double max_lateness;
+};
+
+AL_FUNC(void, al_get_timer_stats, (ALLEGRO_TIMER *timer, ALLEGRO_TIMER_STATS *stats));
+AL_FUNC(void, al_reset_timer_stats, (ALLEGRO_TIMER *timer));
+#endif
+
 
 #ifdef __cplusplus
    }
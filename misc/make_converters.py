@@ -77,6 +77,68 @@ def parse_format(format):
         float=False,
     )
 
+def component_ops(info_a, info_b):
+    """
+    Work out the (mask, shift, add, size_a, size_b, mask_pos) operation
+    needed for each component when converting between two packed integer
+    formats. Returns the ordered component names and the operations.
+    """
+    names = list(info_b.components.keys())
+    names.sort()
+
+    # Generate a list of (mask, shift, add) tuples for all components.
+    ops = {}
+    for name in names:
+        if name == "X": continue # We simply ignore X components.
+        c_b = info_b.components[name]
+        if name not in info_a.components:
+            # Set A component to all 1 bits if the source doesn't have it.
+            if name == "A":
+                add = (1 << c_b.size) - 1
+                add <<= c_b.position
+                ops[name] = (0, 0, add, 0, 0, 0)
+            continue
+        c_a = info_a.components[name]
+        mask = (1 << c_b.size) - 1
+        shift_right = c_a.position
+        mask_pos = c_a.position
+        shift_left = c_b.position
+        bitdiff = c_a.size - c_b.size
+        if bitdiff > 0:
+            shift_right += bitdiff
+            mask_pos += bitdiff
+        else:
+            shift_left -= bitdiff
+            mask = (1 << c_a.size) - 1
+
+        mask <<= mask_pos
+        shift = shift_left - shift_right
+        ops[name] = (mask, shift, 0, c_a.size, c_b.size, mask_pos)
+
+    # Collapse multiple components if possible.
+    common_shifts = {}
+    for name, (mask, shift, add, size_a, size_b, mask_pos) in ops.items():
+        if not add and not (size_a != 8 and size_b == 8):
+            if shift in common_shifts: common_shifts[shift].append(name)
+            else: common_shifts[shift] = [name]
+    for newshift, colors in common_shifts.items():
+        if len(colors) == 1: continue
+        newname = ""
+        newmask = 0
+        colors.sort()
+        masks_pos = []
+        for name in colors:
+            mask, shift, add, size_a, size_b, mask_pos = ops[name]
+
+            names.remove(name)
+            newname += name
+            newmask |= mask
+            masks_pos.append(mask_pos)
+        names.append(newname)
+        ops[newname] = (newmask, newshift, 0, size_a, size_b, min(masks_pos))
+
+    return names, ops
+
 def macro_lines(info_a, info_b):
     """
     Write out the lines of a conversion macro.
@@ -154,56 +216,7 @@ def macro_lines(info_a, info_b):
         r += "   " + scale + "\n"
         return r
 
-    # Generate a list of (mask, shift, add) tuples for all components.
-    ops = {}
-    for name in names:
-        if name == "X": continue # We simply ignore X components.
-        c_b = info_b.components[name]
-        if name not in info_a.components:
-            # Set A component to all 1 bits if the source doesn't have it.
-            if name == "A":
-                add = (1 << c_b.size) - 1
-                add <<= c_b.position
-                ops[name] = (0, 0, add, 0, 0, 0)
-            continue
-        c_a = info_a.components[name]
-        mask = (1 << c_b.size) - 1
-        shift_right = c_a.position
-        mask_pos = c_a.position
-        shift_left = c_b.position
-        bitdiff = c_a.size - c_b.size
-        if bitdiff > 0:
-            shift_right += bitdiff
-            mask_pos += bitdiff
-        else:
-            shift_left -= bitdiff
-            mask = (1 << c_a.size) - 1
-
-        mask <<= mask_pos
-        shift = shift_left - shift_right
-        ops[name] = (mask, shift, 0, c_a.size, c_b.size, mask_pos)
-
-    # Collapse multiple components if possible.
-    common_shifts = {}
-    for name, (mask, shift, add, size_a, size_b, mask_pos) in ops.items():
-        if not add and not (size_a != 8 and size_b == 8):
-            if shift in common_shifts: common_shifts[shift].append(name)
-            else: common_shifts[shift] = [name]
-    for newshift, colors in common_shifts.items():
-        if len(colors) == 1: continue
-        newname = ""
-        newmask = 0
-        colors.sort()
-        masks_pos = []
-        for name in colors:
-            mask, shift, add, size_a, size_b, mask_pos = ops[name]
-
-            names.remove(name)
-            newname += name
-            newmask |= mask
-            masks_pos.append(mask_pos)
-        names.append(newname)
-        ops[newname] = (newmask, newshift, 0, size_a, size_b, min(masks_pos))
+    names, ops = component_ops(info_a, info_b)
 
     # Write out a line for each remaining operation.
     lines = []
@@ -446,13 +459,135 @@ void (*_al_convert_funcs[ALLEGRO_NUM_PIXEL_FORMATS]
 // Warning: This file was created by make_converters.py - do not edit.
 """)
 
+def simd_convertible(info_a, info_b):
+    """
+    Whether a conversion can be vectorised. Only conversions between packed
+    16 and 32 bit formats which can be expressed purely with masks and
+    shifts qualify; anything needing a lookup table or a 24 bit access
+    stays scalar.
+    """
+    if not info_a or not info_b: return False
+    if info_a.float or info_b.float: return False
+    if info_a.single_channel or info_b.single_channel: return False
+    if info_a.size not in (15, 16, 32) or info_b.size not in (15, 16, 32):
+        return False
+    names, ops = component_ops(info_a, info_b)
+    for name in names:
+        if not name in ops: continue
+        mask, shift, add, size_a, size_b, mask_pos = ops[name]
+        if not add and size_a != 8 and size_b == 8:
+            return False
+    return True
+
+def simd_expression(info_a, info_b):
+    """
+    Create the VEC_* expression which converts the pixels in the vector p,
+    one pixel per 32 bit lane.
+    """
+    names, ops = component_ops(info_a, info_b)
+    terms = []
+    for name in names:
+        if not name in ops: continue
+        mask, shift, add, size_a, size_b, mask_pos = ops[name]
+        if add:
+            terms.append("VEC_SET1(0x%08x)" % add)
+            continue
+        # A right shift which moves the mask down to bit 0 leaves nothing
+        # else behind, so it needs no masking.
+        top = (1 << (32 if info_a.size == 32 else 16)) - 1
+        if shift < 0 and mask == top & ~((1 << -shift) - 1):
+            terms.append("VEC_SHR(p, %d)" % -shift)
+            continue
+        masked = "VEC_AND(p, VEC_SET1(0x%08x))" % mask
+        if shift > 0:
+            terms.append("VEC_SHL(%s, %d)" % (masked, shift))
+        elif shift < 0:
+            terms.append("VEC_SHR(%s, %d)" % (masked, -shift))
+        else:
+            terms.append(masked)
+
+    r = terms[-1]
+    for term in reversed(terms[:-1]):
+        r = "VEC_OR(" + term + ",\n               " + r + ")"
+    return r
+
+def converter_simd_function(info_a, info_b):
+    """
+    Create a string with one vectorised conversion function. The VEC_*
+    macros are supplied by src/convert_simd.c, once per instruction set.
+    """
+    name = info_a.name.lower() + "_to_" + info_b.name.lower()
+    macro_name = "ALLEGRO_CONVERT_" + info_a.name + "_TO_" + info_b.name
+    a_type = "uint32_t" if info_a.size == 32 else "uint16_t"
+    b_type = "uint32_t" if info_b.size == 32 else "uint16_t"
+    a_bits = 32 if info_a.size == 32 else 16
+    b_bits = 32 if info_b.size == 32 else 16
+    expression = simd_expression(info_a, info_b)
+
+    return """\
+VEC_TARGET static void VEC_FUNC(%(name)s)(const void *src, int src_pitch,
+   void *dst, int dst_pitch,
+   int sx, int sy, int dx, int dy, int width, int height)
+{
+   int x, y;
+   const char *src_row = (const char *)src + sy * src_pitch;
+   char *dst_row = (char *)dst + dy * dst_pitch;
+   for (y = 0; y < height; y++) {
+      const %(a_type)s *src_ptr = (const %(a_type)s *)src_row + sx;
+      %(b_type)s *dst_ptr = (%(b_type)s *)dst_row + dx;
+      for (x = 0; x <= width - VEC_PIXELS; x += VEC_PIXELS) {
+         VEC_TYPE p = VEC_LOAD_%(a_bits)d(src_ptr + x);
+         VEC_STORE_%(b_bits)d(dst_ptr + x,
+            %(expression)s);
+      }
+      for (; x < width; x++) {
+         dst_ptr[x] = %(macro_name)s(src_ptr[x]);
+      }
+      src_row += src_pitch;
+      dst_row += dst_pitch;
+   }
+}
+""" % locals()
+
+def write_convert_simd_inc(filename):
+    """
+    Write out the file with the vectorised conversion functions.
+    """
+    f = open(filename, "w")
+    f.write("""\
+// Warning: This file was created by make_converters.py - do not edit.
+// It is included by convert_simd.c once for each instruction set.
+""")
+
+    pairs = []
+    for a in formats_list:
+        for b in formats_list:
+            if b == a: continue
+            if not simd_convertible(a, b): continue
+            f.write(converter_simd_function(a, b))
+            pairs.append((a, b))
+
+    f.write("""\
+static void VEC_FUNC(install)(void)
+{
+""")
+    for a, b in pairs:
+        name = a.name.lower() + "_to_" + b.name.lower()
+        f.write("   _al_convert_funcs[ALLEGRO_PIXEL_FORMAT_%s]\n" % a.name)
+        f.write("      [ALLEGRO_PIXEL_FORMAT_%s] = VEC_FUNC(%s);\n" % (b.name, name))
+    f.write("""\
+}
+
+// Warning: This file was created by make_converters.py - do not edit.
+""")
+
 def main(argv):
     global options
     p = optparse.OptionParser()
     p.description = """\
-When run from the toplevel A5 folder, this will re-create the convert.h and
-convert.c files containing all the low-level color conversion macros and
-functions."""
+When run from the toplevel A5 folder, this will re-create the convert.h,
+convert.c and convert_simd.inc files containing all the low-level color
+conversion macros and functions."""
     options, args = p.parse_args()
 
     # Read in color.h to get the available formats.
@@ -472,6 +607,9 @@ functions."""
     # Output a function for each possible conversion.
     write_convert_c("src/convert.c")
 
+    # Output the vectorised versions of the simple conversions.
+    write_convert_simd_inc("src/convert_simd.inc")
+
 if __name__ == "__main__":
     main(sys.argv)
 
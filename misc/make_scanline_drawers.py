@@ -111,6 +111,7 @@ def make_drawer(name):
       int op, src_mode, dst_mode;
       int op_alpha, src_alpha, dst_alpha;
       ALLEGRO_COLOR const_color;
+      const ALLEGRO_BLENDER *blender = _al_get_bitmap_blender();
       al_get_separate_bitmap_blender(&op, &src_mode, &dst_mode,
          &op_alpha, &src_alpha, &dst_alpha);
       const_color = al_get_blend_color();
@@ -142,6 +143,11 @@ def make_drawer(name):
          + x1 * target->locked_region.pixel_size;
       """)
 
+   # Opaque white textures are copied without any conversion already.
+   fixed = not (opaque and white)
+   if fixed:
+      make_fixed_setup()
+
    if shade:
       make_if_blender_loop(
             op='ALLEGRO_ADD',
@@ -152,7 +158,8 @@ def make_drawer(name):
             dst_alpha='ALLEGRO_INVERSE_ALPHA',
             const_color='NULL',
             if_format='ALLEGRO_PIXEL_FORMAT_ARGB_8888',
-            alpha_only=True
+            alpha_only=True,
+            fixed=fixed
             )
       print("else")
       make_if_blender_loop(
@@ -164,7 +171,8 @@ def make_drawer(name):
             dst_alpha='ALLEGRO_INVERSE_ALPHA',
             const_color='NULL',
             if_format='ALLEGRO_PIXEL_FORMAT_ARGB_8888',
-            alpha_only=True
+            alpha_only=True,
+            fixed=fixed
             )
       print("else")
       make_if_blender_loop(
@@ -176,7 +184,8 @@ def make_drawer(name):
             dst_alpha='ALLEGRO_ONE',
             const_color='NULL',
             if_format='ALLEGRO_PIXEL_FORMAT_ARGB_8888',
-            alpha_only=True
+            alpha_only=True,
+            fixed=fixed
             )
       print("else")
 
@@ -188,6 +197,9 @@ def make_drawer(name):
       make_loop(copy_format=True, src_size='2')
       print("else")
    else:
+      if not shade:
+         make_loop(fixed=True)
+         print("else")
       make_loop(
             if_format='ALLEGRO_PIXEL_FORMAT_ARGB_8888'
             )
@@ -213,7 +225,8 @@ def make_if_blender_loop(
       dst_format='dst_format',
       const_color='NULL',
       if_format=None,
-      alpha_only=False
+      alpha_only=False,
+      fixed=False
       ):
    print(interp("""\
       if (op == #{op} &&
@@ -224,6 +237,14 @@ def make_if_blender_loop(
             dst_alpha == #{dst_alpha}) {
       """))
 
+   if fixed:
+      make_loop(
+            src_mode=src_mode,
+            dst_mode=dst_mode,
+            fixed=True
+            )
+      print("else")
+
    if texture and if_format:
       make_loop(
             op=op,
@@ -263,10 +284,14 @@ def make_loop(
       const_color='&const_color',
       if_format=None,
       copy_format=False,
-      alpha_only=False
+      alpha_only=False,
+      fixed=False
       ):
 
-   if if_format:
+   if fixed:
+      src_size = '4'
+      print("if (use_fix)")
+   elif if_format:
       src_format = if_format
       dst_format = if_format
       print(interp("if (dst_format == #{dst_format}"))
@@ -310,7 +335,8 @@ def make_loop(
             src_size=src_size,
             copy_format=copy_format,
             tiling=False,
-            alpha_only=alpha_only
+            alpha_only=alpha_only,
+            fixed=fixed
             )
          print("} else")
 
@@ -326,11 +352,41 @@ def make_loop(
       const_color=const_color,
       src_size=src_size,
       copy_format=copy_format,
-      alpha_only=alpha_only
+      alpha_only=alpha_only,
+      fixed=fixed
       )
 
    print("}")
 
+def make_fixed_setup():
+   """The state the fixed point loops need; use_fix says whether they apply."""
+   if texture:
+      same_format = "src_format == dst_format && "
+   else:
+      same_format = ""
+
+   if grad:
+      print(interp("""\
+         int32_t grad_fix[4], grad_fix_dx[4];
+         const bool use_fix = #{same_format}fix_gradient(cur_color,
+            gs->color_dx, x2 - x1 + 1, dst_format, grad_fix, grad_fix_dx);
+         """))
+   elif not texture:
+      print("""\
+         uint32_t src_fix[4];
+         const bool use_fix = fix_color(cur_color, dst_format, src_fix);
+         """)
+   elif white:
+      print(interp("""\
+         const bool use_fix = #{same_format}fix_format(dst_format);
+         """))
+   else:
+      print(interp("""\
+         uint32_t tint_fix[4];
+         const bool use_fix = #{same_format}fix_tint(s->cur_color,
+            dst_format, tint_fix);
+         """))
+
 def make_innermost_loop(
       op='op',
       src_mode='src_mode',
@@ -344,7 +400,8 @@ def make_innermost_loop(
       src_size='src_size',
       copy_format=False,
       tiling=True,
-      alpha_only=True
+      alpha_only=True,
+      fixed=False
       ):
 
    print("{")
@@ -372,9 +429,15 @@ def make_innermost_loop(
    print("for (; x1 <= x2; x1++) {")
 
    if not texture:
-      print("""\
+      if not fixed:
+         print("""\
          ALLEGRO_COLOR src_color = cur_color;
          """)
+      elif grad:
+         print("""\
+         uint32_t src_fix[4];
+         fix_grad_color(src_fix, grad_fix);
+         """)
    else:
       print(interp("""\
          const int src_x = (uu >> 16) + #{uu_ofs};
@@ -386,6 +449,18 @@ def make_innermost_loop(
 
       if copy_format:
          pass
+      elif fixed:
+         print("uint32_t src_fix[4];")
+         if white:
+            print("fix_texel_white(src_fix, *(uint32_t *)src_data);")
+         elif grad:
+            print("""\
+            uint32_t tint_fix[4];
+            fix_grad_tint(tint_fix, grad_fix);
+            fix_texel(src_fix, *(uint32_t *)src_data, tint_fix);
+            """)
+         else:
+            print("fix_texel(src_fix, *(uint32_t *)src_data, tint_fix);")
       else:
          print(interp("""\
             ALLEGRO_COLOR src_color;
@@ -420,6 +495,29 @@ def make_innermost_loop(
                break;
          }
          """))
+   elif fixed and shade:
+      print(interp("""\
+         *(uint32_t *)dst_data = fix_blend_pixel(src_fix, *(uint32_t *)dst_data,
+            #{src_mode}, #{dst_mode});
+         dst_data += 4;
+         """))
+   elif fixed:
+      print("""\
+         *(uint32_t *)dst_data = fix_pack_pixel(src_fix);
+         dst_data += 4;
+         """)
+   elif shade and op == 'op':
+      # The blender isn't one of the above, use the compiled one.
+      print(interp("""\
+         {
+            ALLEGRO_COLOR dst_color;
+            ALLEGRO_COLOR result;
+            _AL_INLINE_GET_PIXEL(#{dst_format}, dst_data, dst_color, false);
+            blender->blend_func(&src_color, &dst_color, #{const_color},
+               blender, &result);
+            _AL_INLINE_PUT_PIXEL(#{dst_format}, dst_data, result, true);
+         }
+         """))
    elif shade:
       blend = "_al_blend_inline"
       if alpha_only:
@@ -460,7 +558,11 @@ def make_innermost_loop(
             vv -= h;
          """)
 
-   if grad:
+   if grad and fixed:
+      print("""\
+         fix_grad_step(grad_fix, grad_fix_dx);
+         """)
+   elif grad:
       print("""\
          cur_color.r += gs->color_dx.r;
          cur_color.g += gs->color_dx.g;
@@ -19,11 +19,17 @@
  */
 
 
+#define _AL_NO_BLEND_INLINE_FUNC
+
+#include <stdlib.h>
 #include <string.h>
 #include "allegro5/allegro.h"
 #include "allegro5/internal/aintern.h"
 #include "allegro5/internal/aintern_bitmap.h"
+#include "allegro5/internal/aintern_blend.h"
 #include "allegro5/internal/aintern_display.h"
+#include "allegro5/internal/aintern_memblit.h"
+#include "allegro5/internal/aintern_parallel.h"
 #include "allegro5/internal/aintern_pixels.h"
 #include "allegro5/internal/aintern_shader.h"
 #include "allegro5/internal/aintern_system.h"
@@ -208,6 +214,9 @@ void al_destroy_bitmap(ALLEGRO_BITMAP *bitmap)
       return;
    }
 
+   /* Held drawing may still have to draw from the bitmap. */
+   _al_flush_held_memory_drawing(bitmap, ALLEGRO_LOCK_READWRITE);
+
    /* As a convenience, implicitly untarget the bitmap on the calling thread
     * before it is destroyed, but maintain the current display.
     */
@@ -219,6 +228,8 @@ void al_destroy_bitmap(ALLEGRO_BITMAP *bitmap)
          al_set_target_bitmap(NULL);
    }
 
+   _al_destroy_held_memory_drawing(bitmap);
+
    _al_set_bitmap_shader_field(bitmap, NULL);
 
    _al_unregister_destructor(_al_dtor_list, bitmap->dtor_item);
@@ -426,6 +437,22 @@ void al_get_separate_bitmap_blender(int *op, int *src, int *dst, int *alpha_op,
       *alpha_dst = b->blend_alpha_dest;
 }
 
+/* Internal function: _al_get_bitmap_blender
+ *  The blender al_get_separate_bitmap_blender reports, including the
+ *  compiled blending function.
+ */
+const ALLEGRO_BLENDER *_al_get_bitmap_blender(void)
+{
+   ALLEGRO_BITMAP *bitmap = al_get_target_bitmap();
+
+   ASSERT(bitmap);
+
+   if (!bitmap->use_bitmap_blender)
+      return _al_get_blender();
+
+   return &bitmap->blender;
+}
+
 /* Function: al_set_bitmap_blend_color
  */
 void al_set_bitmap_blend_color(ALLEGRO_COLOR col)
@@ -467,6 +494,7 @@ void al_set_separate_bitmap_blender(int op, int src, int dst, int alpha_op, int
    b->blend_alpha_op = alpha_op;
    b->blend_alpha_source = alpha_src;
    b->blend_alpha_dest = alpha_dst;
+   _al_compile_blender(b);
 }
 
 /* Function: al_reset_bitmap_blender
@@ -759,15 +787,11 @@ void _al_copy_bitmap_data(
    }
 }
 
-void _al_convert_bitmap_data(
+static void convert_bitmap_data(
    const void *src, int src_format, int src_pitch,
    void *dst, int dst_format, int dst_pitch,
    int sx, int sy, int dx, int dy, int width, int height)
 {
-   ASSERT(src);
-   ASSERT(dst);
-   ASSERT(_al_pixel_format_is_real(dst_format));
-
    /* Use memcpy if no conversion is needed. */
    if (src_format == dst_format) {
       _al_copy_bitmap_data(src, src_pitch, dst, dst_pitch, sx, sy,
@@ -785,6 +809,131 @@ void _al_convert_bitmap_data(
 }
 
 
+/* Large conversions can be split into bands of rows which are converted
+ * by the worker threads. This is only done if enabled in the [graphics]
+ * section of the system configuration, and only for conversions of at
+ * least parallel_conversion_threshold pixels. Both are read once by
+ * _al_init_convert_bands, since conversions are frequent and mostly small.
+ */
+#define MIN_CONVERT_BAND_ROWS        16
+#define CONVERT_BANDS_PER_THREAD     2
+#define DEFAULT_CONVERT_THRESHOLD    (1024 * 1024)
+
+typedef struct CONVERT_JOB {
+   const void *src;
+   int src_format, src_pitch;
+   void *dst;
+   int dst_format, dst_pitch;
+   int sx, sy, dx, dy, width, height;
+   int bands;
+} CONVERT_JOB;
+
+static int convert_threads = 1;
+static int64_t convert_threshold = INT64_MAX;
+
+
+void _al_init_convert_bands(void)
+{
+   ALLEGRO_CONFIG *config = al_get_system_config();
+   const char *value;
+   int64_t threshold = DEFAULT_CONVERT_THRESHOLD;
+
+   convert_threads = 1;
+   convert_threshold = INT64_MAX;
+
+   value = al_get_config_value(config, "graphics", "parallel_conversion");
+   if (!value || _al_stricmp(value, "true"))
+      return;
+
+   value = al_get_config_value(config, "graphics",
+      "parallel_conversion_threshold");
+   if (value && value[0] != '\0') {
+      char *end;
+      long n = strtol(value, &end, 10);
+      if (*end != '\0' || n < 0) {
+         ALLEGRO_WARN("Ignoring bad parallel_conversion_threshold: %s\n",
+            value);
+      }
+      else {
+         threshold = n;
+      }
+   }
+
+   convert_threads = _al_get_parallel_thread_count();
+   if (convert_threads >= 2)
+      convert_threshold = threshold;
+   ALLEGRO_INFO("Parallel conversion: %d threads, threshold %ld pixels\n",
+      convert_threads, (long)threshold);
+}
+
+
+static void convert_band(void *arg, int band)
+{
+   const CONVERT_JOB *job = arg;
+   int y1 = (int)((int64_t)job->height * band / job->bands);
+   int y2 = (int)((int64_t)job->height * (band + 1) / job->bands);
+
+   convert_bitmap_data(job->src, job->src_format, job->src_pitch,
+      job->dst, job->dst_format, job->dst_pitch,
+      job->sx, job->sy + y1, job->dx, job->dy + y1, job->width, y2 - y1);
+}
+
+
+/* Returns how many bands a conversion should be split into. */
+static int get_convert_bands(int src_format, int dst_format,
+   int width, int height)
+{
+   int bands;
+
+   if ((int64_t)width * height < convert_threshold ||
+         height < 2 * MIN_CONVERT_BAND_ROWS)
+      return 1;
+   /* Compressed formats are converted in blocks of several rows. */
+   if (_al_pixel_format_is_compressed(src_format) ||
+         _al_pixel_format_is_compressed(dst_format))
+      return 1;
+
+   bands = convert_threads * CONVERT_BANDS_PER_THREAD;
+   if (bands > height / MIN_CONVERT_BAND_ROWS)
+      bands = height / MIN_CONVERT_BAND_ROWS;
+   return bands;
+}
+
+
+void _al_convert_bitmap_data(
+   const void *src, int src_format, int src_pitch,
+   void *dst, int dst_format, int dst_pitch,
+   int sx, int sy, int dx, int dy, int width, int height)
+{
+   CONVERT_JOB job;
+
+   ASSERT(src);
+   ASSERT(dst);
+   ASSERT(_al_pixel_format_is_real(dst_format));
+
+   job.bands = get_convert_bands(src_format, dst_format, width, height);
+   if (job.bands < 2) {
+      convert_bitmap_data(src, src_format, src_pitch, dst, dst_format,
+         dst_pitch, sx, sy, dx, dy, width, height);
+      return;
+   }
+
+   job.src = src;
+   job.src_format = src_format;
+   job.src_pitch = src_pitch;
+   job.dst = dst;
+   job.dst_format = dst_format;
+   job.dst_pitch = dst_pitch;
+   job.sx = sx;
+   job.sy = sy;
+   job.dx = dx;
+   job.dy = dy;
+   job.width = width;
+   job.height = height;
+   _al_run_parallel(job.bands, convert_band, &job);
+}
+
+
 /* Function: al_clone_bitmap
  */
 ALLEGRO_BITMAP *al_clone_bitmap(ALLEGRO_BITMAP *bitmap)
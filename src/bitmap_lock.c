@@ -17,6 +17,7 @@
 #include "allegro5/allegro.h"
 #include "allegro5/internal/aintern.h"
 #include "allegro5/internal/aintern_bitmap.h"
+#include "allegro5/internal/aintern_memblit.h"
 #include "allegro5/internal/aintern_pixels.h"
 
 
@@ -41,6 +42,8 @@ ALLEGRO_LOCKED_REGION *al_lock_bitmap_region(ALLEGRO_BITMAP *bitmap,
       ASSERT(al_get_pixel_block_height(format) == 1);
    }
 
+   _al_flush_held_memory_drawing(bitmap, flags);
+
    /* For sub-bitmaps */
    if (bitmap->parent) {
       x += bitmap->xofs;
@@ -208,6 +211,8 @@ ALLEGRO_LOCKED_REGION *al_lock_bitmap_region_blocked(ALLEGRO_BITMAP *bitmap,
    ASSERT(_al_pixel_format_is_compressed(bitmap_format));
    ASSERT(!(bitmap_flags & ALLEGRO_MEMORY_BITMAP));
 
+   _al_flush_held_memory_drawing(bitmap, flags);
+
    /* For sub-bitmaps */
    if (bitmap->parent) {
       if (bitmap->xofs % block_width != 0 ||
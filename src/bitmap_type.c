@@ -85,8 +85,8 @@ void _al_unregister_convert_bitmap(ALLEGRO_BITMAP *bitmap)
 static void swap_bitmaps(ALLEGRO_BITMAP *bitmap, ALLEGRO_BITMAP *other)
 {
    ALLEGRO_BITMAP temp;
-   _AL_LIST_ITEM *bitmap_dtor_item = bitmap->dtor_item;
-   _AL_LIST_ITEM *other_dtor_item = other->dtor_item;
+   _AL_DTOR_ITEM *bitmap_dtor_item = bitmap->dtor_item;
+   _AL_DTOR_ITEM *other_dtor_item = other->dtor_item;
    ALLEGRO_DISPLAY *bitmap_display, *other_display;
 
    _al_unregister_convert_bitmap(bitmap);
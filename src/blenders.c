@@ -22,21 +22,98 @@
 #include "allegro5/internal/aintern_display.h"
 #include <string.h>
 
+/* The blender is resolved into one of the functions below whenever it
+ * changes, rather than having every pixel switch on the six blend modes.
+ * Each function is _al_blend_inline with the modes as constants, so it
+ * gives exactly the same results.
+ *
+ * Only blenders using the same operation and factors for colour and alpha,
+ * with the factors being ALLEGRO_ZERO, ALLEGRO_ONE, ALLEGRO_ALPHA or
+ * ALLEGRO_INVERSE_ALPHA get their own function. That covers al_set_blender
+ * with all of the usual modes; anything else takes the generic path.
+ */
+#define NUM_COMPILED_MODES (ALLEGRO_INVERSE_ALPHA + 1)
+
+static void blend_generic(const ALLEGRO_COLOR *scol,
+   const ALLEGRO_COLOR *dcol, ALLEGRO_COLOR *constcol,
+   const ALLEGRO_BLENDER *b, ALLEGRO_COLOR *result)
+{
+   _al_blend_inline(scol, dcol,
+                    b->blend_op, b->blend_source, b->blend_dest,
+                    b->blend_alpha_op, b->blend_alpha_source,
+                    b->blend_alpha_dest,
+                    constcol, result);
+}
+
+#define BLEND_FUNC(op, src, dst)                                             \
+   static void blend_##op##_##src##_##dst(const ALLEGRO_COLOR *scol,         \
+      const ALLEGRO_COLOR *dcol, ALLEGRO_COLOR *constcol,                    \
+      const ALLEGRO_BLENDER *b, ALLEGRO_COLOR *result)                       \
+   {                                                                         \
+      (void)b;                                                               \
+      _al_blend_inline(scol, dcol,                                           \
+         ALLEGRO_##op, ALLEGRO_##src, ALLEGRO_##dst,                         \
+         ALLEGRO_##op, ALLEGRO_##src, ALLEGRO_##dst,                         \
+         constcol, result);                                                  \
+   }
+
+#define BLEND_FUNCS_SRC(op, src)                                             \
+   BLEND_FUNC(op, src, ZERO)                                                 \
+   BLEND_FUNC(op, src, ONE)                                                  \
+   BLEND_FUNC(op, src, ALPHA)                                                \
+   BLEND_FUNC(op, src, INVERSE_ALPHA)
+
+#define BLEND_FUNCS_OP(op)                                                   \
+   BLEND_FUNCS_SRC(op, ZERO)                                                 \
+   BLEND_FUNCS_SRC(op, ONE)                                                  \
+   BLEND_FUNCS_SRC(op, ALPHA)                                                \
+   BLEND_FUNCS_SRC(op, INVERSE_ALPHA)
+
+BLEND_FUNCS_OP(ADD)
+BLEND_FUNCS_OP(SRC_MINUS_DEST)
+BLEND_FUNCS_OP(DEST_MINUS_SRC)
+
+#define BLEND_ROW(op, src)                                                   \
+   { blend_##op##_##src##_ZERO, blend_##op##_##src##_ONE,                    \
+     blend_##op##_##src##_ALPHA, blend_##op##_##src##_INVERSE_ALPHA }
+
+#define BLEND_TABLE(op)                                                      \
+   { BLEND_ROW(op, ZERO), BLEND_ROW(op, ONE),                                \
+     BLEND_ROW(op, ALPHA), BLEND_ROW(op, INVERSE_ALPHA) }
+
+static const _AL_BLEND_FUNC blend_funcs
+   [ALLEGRO_NUM_BLEND_OPERATIONS][NUM_COMPILED_MODES][NUM_COMPILED_MODES] = {
+   BLEND_TABLE(ADD),
+   BLEND_TABLE(SRC_MINUS_DEST),
+   BLEND_TABLE(DEST_MINUS_SRC)
+};
+
+
+/* Choose the blending function for the modes in the blender. */
+void _al_compile_blender(ALLEGRO_BLENDER *b)
+{
+   if (b->blend_op == b->blend_alpha_op &&
+         b->blend_source == b->blend_alpha_source &&
+         b->blend_dest == b->blend_alpha_dest &&
+         b->blend_source < NUM_COMPILED_MODES &&
+         b->blend_dest < NUM_COMPILED_MODES) {
+      b->blend_func = blend_funcs[b->blend_op][b->blend_source][b->blend_dest];
+   }
+   else {
+      b->blend_func = blend_generic;
+   }
+}
+
+
 void _al_blend_memory(ALLEGRO_COLOR *scol,
    ALLEGRO_BITMAP *dest,
    int dx, int dy, ALLEGRO_COLOR *result)
 {
    ALLEGRO_COLOR dcol;
    ALLEGRO_COLOR constcol;
-   int op, src_blend, dest_blend, alpha_op, alpha_src_blend, alpha_dest_blend;
+   const ALLEGRO_BLENDER *b = _al_get_bitmap_blender();
    dcol = al_get_pixel(dest, dx, dy);
-   al_get_separate_bitmap_blender(&op, &src_blend, &dest_blend,
-                                  &alpha_op, &alpha_src_blend,
-                                  &alpha_dest_blend);
    constcol = al_get_blend_color();
-   _al_blend_inline(scol, &dcol,
-                    op, src_blend, dest_blend,
-                    alpha_op, alpha_src_blend, alpha_dest_blend,
-                    &constcol, result);
+   b->blend_func(scol, &dcol, &constcol, b, result);
    (void) _al_blend_alpha_inline; // silence compiler
 }
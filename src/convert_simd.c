@@ -0,0 +1,198 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Vectorised pixel format conversion.
+ *
+ *      The kernels themselves are generated by misc/make_converters.py
+ *      into convert_simd.inc, written against the VEC_* macros below.
+ *      That file is included once for each instruction set we know
+ *      about, and the best set supported by the CPU replaces the scalar
+ *      entries of _al_convert_funcs at startup.
+ *
+ *      See LICENSE.txt for copyright information.
+ */
+
+
+#include "allegro5/allegro.h"
+#include "allegro5/internal/aintern.h"
+#include "allegro5/internal/aintern_bitmap.h"
+#include "allegro5/internal/aintern_convert.h"
+#include "allegro5/internal/aintern_simd.h"
+
+ALLEGRO_DEBUG_CHANNEL("convert")
+
+
+/* The generated kernels rely on the little endian layout of the _LE
+ * formats, and on every pixel of a packed format fitting a 32 bit lane.
+ */
+#if defined(ALLEGRO_LITTLE_ENDIAN)
+   #if defined(_AL_SIMD_SSE2)
+      #define CONVERT_SSE2
+      #define CONVERT_AVX2
+   #elif defined(_AL_SIMD_NEON)
+      #define CONVERT_NEON
+   #endif
+#endif
+
+
+#ifdef CONVERT_SSE2
+
+#include <emmintrin.h>
+
+#define VEC_TARGET         _AL_TARGET_SSE2
+#define VEC_FUNC(name)     name##_sse2
+#define VEC_TYPE           __m128i
+#define VEC_PIXELS         4
+#define VEC_SET1(x)        _mm_set1_epi32((int)(x))
+#define VEC_AND(a, b)      _mm_and_si128((a), (b))
+#define VEC_OR(a, b)       _mm_or_si128((a), (b))
+#define VEC_SHL(a, n)      _mm_slli_epi32((a), (n))
+#define VEC_SHR(a, n)      _mm_srli_epi32((a), (n))
+#define VEC_LOAD_32(ptr)   _mm_loadu_si128((const __m128i *)(ptr))
+#define VEC_LOAD_16(ptr)   load_16_sse2(ptr)
+#define VEC_STORE_32(ptr, v)  _mm_storeu_si128((__m128i *)(ptr), (v))
+#define VEC_STORE_16(ptr, v)  store_16_sse2((ptr), (v))
+
+static INLINE _AL_TARGET_SSE2 __m128i load_16_sse2(const uint16_t *ptr)
+{
+   return _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)ptr),
+      _mm_setzero_si128());
+}
+
+static INLINE _AL_TARGET_SSE2 void store_16_sse2(uint16_t *ptr, __m128i v)
+{
+   /* SSE2 only has a signed saturating pack, so sign extend the low 16
+    * bits first to have them come through unchanged.
+    */
+   v = _mm_srai_epi32(_mm_slli_epi32(v, 16), 16);
+   _mm_storel_epi64((__m128i *)ptr, _mm_packs_epi32(v, v));
+}
+
+#include "convert_simd.inc"
+
+#undef VEC_TARGET
+#undef VEC_FUNC
+#undef VEC_TYPE
+#undef VEC_PIXELS
+#undef VEC_SET1
+#undef VEC_AND
+#undef VEC_OR
+#undef VEC_SHL
+#undef VEC_SHR
+#undef VEC_LOAD_32
+#undef VEC_LOAD_16
+#undef VEC_STORE_32
+#undef VEC_STORE_16
+
+#endif /* CONVERT_SSE2 */
+
+
+#ifdef CONVERT_AVX2
+
+#include <immintrin.h>
+
+#define VEC_TARGET         _AL_TARGET_AVX2
+#define VEC_FUNC(name)     name##_avx2
+#define VEC_TYPE           __m256i
+#define VEC_PIXELS         8
+#define VEC_SET1(x)        _mm256_set1_epi32((int)(x))
+#define VEC_AND(a, b)      _mm256_and_si256((a), (b))
+#define VEC_OR(a, b)       _mm256_or_si256((a), (b))
+#define VEC_SHL(a, n)      _mm256_slli_epi32((a), (n))
+#define VEC_SHR(a, n)      _mm256_srli_epi32((a), (n))
+#define VEC_LOAD_32(ptr)   _mm256_loadu_si256((const __m256i *)(ptr))
+#define VEC_LOAD_16(ptr)   \
+   _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(ptr)))
+#define VEC_STORE_32(ptr, v)  _mm256_storeu_si256((__m256i *)(ptr), (v))
+#define VEC_STORE_16(ptr, v)  store_16_avx2((ptr), (v))
+
+static INLINE _AL_TARGET_AVX2 void store_16_avx2(uint16_t *ptr, __m256i v)
+{
+   /* The pack works within each 128 bit half, so gather the two useful
+    * quarters into the low half afterwards.
+    */
+   v = _mm256_packus_epi32(v, v);
+   v = _mm256_permute4x64_epi64(v, 0x08);
+   _mm_storeu_si128((__m128i *)ptr, _mm256_castsi256_si128(v));
+}
+
+#include "convert_simd.inc"
+
+#undef VEC_TARGET
+#undef VEC_FUNC
+#undef VEC_TYPE
+#undef VEC_PIXELS
+#undef VEC_SET1
+#undef VEC_AND
+#undef VEC_OR
+#undef VEC_SHL
+#undef VEC_SHR
+#undef VEC_LOAD_32
+#undef VEC_LOAD_16
+#undef VEC_STORE_32
+#undef VEC_STORE_16
+
+#endif /* CONVERT_AVX2 */
+
+
+#ifdef CONVERT_NEON
+
+#include <arm_neon.h>
+
+#define VEC_TARGET
+#define VEC_FUNC(name)     name##_neon
+#define VEC_TYPE           uint32x4_t
+#define VEC_PIXELS         4
+#define VEC_SET1(x)        vdupq_n_u32((x))
+#define VEC_AND(a, b)      vandq_u32((a), (b))
+#define VEC_OR(a, b)       vorrq_u32((a), (b))
+#define VEC_SHL(a, n)      vshlq_n_u32((a), (n))
+#define VEC_SHR(a, n)      vshrq_n_u32((a), (n))
+#define VEC_LOAD_32(ptr)   vld1q_u32((const uint32_t *)(ptr))
+#define VEC_LOAD_16(ptr)   vmovl_u16(vld1_u16((const uint16_t *)(ptr)))
+#define VEC_STORE_32(ptr, v)  vst1q_u32((uint32_t *)(ptr), (v))
+#define VEC_STORE_16(ptr, v)  vst1_u16((uint16_t *)(ptr), vmovn_u32(v))
+
+#include "convert_simd.inc"
+
+#endif /* CONVERT_NEON */
+
+
+/* Replace the scalar conversion functions by vectorised ones where the
+ * CPU allows. The scalar versions remain the reference implementation:
+ * the vectorised ones must produce bit-identical results.
+ */
+void _al_init_convert_funcs(void)
+{
+   int features = _al_get_cpu_features();
+   (void)features;
+
+#ifdef CONVERT_SSE2
+   if (features & _AL_CPU_SSE2) {
+      ALLEGRO_DEBUG("Using SSE2 pixel format converters.\n");
+      install_sse2();
+   }
+#endif
+#ifdef CONVERT_AVX2
+   if (features & _AL_CPU_AVX2) {
+      ALLEGRO_DEBUG("Using AVX2 pixel format converters.\n");
+      install_avx2();
+   }
+#endif
+#ifdef CONVERT_NEON
+   if (features & _AL_CPU_NEON) {
+      ALLEGRO_DEBUG("Using NEON pixel format converters.\n");
+      install_neon();
+   }
+#endif
+}
+
+
+/* vim: set sts=3 sw=3 et: */
@@ -44,6 +44,10 @@
 #include <windows.h>
 #endif
 
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#endif
+
 
 /* Function: al_get_cpu_count
  */
@@ -107,5 +111,51 @@ int al_get_ram_size(void)
 }
 
 
+static int detect_cpu_features(void)
+{
+   int features = 0;
+#if (defined(__i386__) || defined(__x86_64__)) && (defined(__clang__) || \
+      (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 8))))
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("sse2"))
+      features |= _AL_CPU_SSE2;
+   if (__builtin_cpu_supports("avx2"))
+      features |= _AL_CPU_AVX2;
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+   int info[4];
+   int max_leaf;
+   __cpuid(info, 0);
+   max_leaf = info[0];
+   __cpuid(info, 1);
+   if (info[3] & (1 << 26))
+      features |= _AL_CPU_SSE2;
+   /* AVX2 also needs the OS to save the YMM registers (OSXSAVE, XCR0). */
+   if (max_leaf >= 7 && (info[2] & (1 << 27)) && (info[2] & (1 << 28)) &&
+         (_xgetbv(0) & 6) == 6) {
+      __cpuidex(info, 7, 0);
+      if (info[1] & (1 << 5))
+         features |= _AL_CPU_AVX2;
+   }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+   features |= _AL_CPU_NEON;
+#endif
+   return features;
+}
+
+
+/* Internal function: _al_get_cpu_features
+ *  Returns a mask of the _AL_CPU_* instruction set extensions which both
+ *  the CPU and the operating system support. The detection only runs
+ *  once, so this is cheap enough to call before every drawing operation.
+ */
+int _al_get_cpu_features(void)
+{
+   static int features = -1;
+   if (features == -1)
+      features = detect_cpu_features();
+   return features;
+}
+
+
 /* vi: set ts=4 sw=4 expandtab: */
       
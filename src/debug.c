@@ -17,6 +17,7 @@
 #include <stdio.h>
 
 #include "allegro5/allegro.h"
+#include "allegro5/internal/aintern_atomicops.h"
 #include "allegro5/internal/aintern_debug.h"
 #include "allegro5/internal/aintern_thread.h"
 #include "allegro5/internal/aintern_vector.h"
@@ -31,6 +32,28 @@
 #endif
 
 
+#define TRACE_LINE_SIZE    2048
+
+/* Number of lines the asynchronous writer can fall behind by before new
+ * lines are dropped.  Must be a power of two.
+ */
+#define TRACE_RING_SLOTS   256
+
+/* How long the writer sleeps when it wasn't woken up. */
+#define TRACE_WRITER_IDLE  0.1
+
+
+/* A line waiting to be written.  The sequence number says whether the slot
+ * is free for the producer whose ticket equals it, or holds a line for the
+ * writer if it is one greater; see enqueue_line.
+ */
+typedef struct TRACE_SLOT
+{
+   volatile _AL_ATOMIC sequence;
+   char text[TRACE_LINE_SIZE];
+} TRACE_SLOT;
+
+
 /* tracing */
 typedef struct TRACE_INFO
 {
@@ -45,8 +68,13 @@ typedef struct TRACE_INFO
    /* List of channels to log. NULL to log all channels. */
    _AL_VECTOR channels;
    _AL_VECTOR excluded;
+   /* Bumped whenever the lists change, invalidating the per-thread caches. */
+   volatile _AL_ATOMIC generation;
    /* Whether settings have been read from allegro5.cfg or not. */
    bool configured;
+
+   /* Whether lines should be handed to a writer thread. */
+   bool async;
 } TRACE_INFO;
 
 
@@ -59,10 +87,30 @@ static TRACE_INFO trace_info =
    7,
    _AL_VECTOR_INITIALIZER(ALLEGRO_USTR *),
    _AL_VECTOR_INITIALIZER(ALLEGRO_USTR *),
+   0,
+   false,
    false
 };
 
-static char static_trace_buffer[2048];
+
+/* The asynchronous writer thread and the ring of lines it drains. */
+typedef struct TRACE_WRITER
+{
+   volatile _AL_ATOMIC running;
+   _AL_THREAD thread;
+   _AL_MUTEX mutex;
+   _AL_COND cond;
+   volatile _AL_ATOMIC idle;
+   TRACE_SLOT *ring;
+   volatile _AL_ATOMIC enqueue_pos;
+   _AL_ATOMIC dequeue_pos;
+   /* Lines dropped because the ring was full. */
+   volatile _AL_ATOMIC dropped;
+   _AL_ATOMIC reported_dropped;
+} TRACE_WRITER;
+
+
+static TRACE_WRITER trace_writer;
 
 /* run-time assertions */
 void (*_al_user_assert_handler)(char const *expr, char const *file,
@@ -83,50 +131,65 @@ static void delete_string_list(_AL_VECTOR *v)
 }
 
 
+static void read_channel_lists(char const *v)
+{
+   ALLEGRO_USTR_INFO uinfo;
+   const ALLEGRO_USTR *u = al_ref_cstr(&uinfo, v);
+   int pos = 0;
+   bool got_all = false;
+
+   while (pos >= 0) {
+      int comma = al_ustr_find_chr(u, pos, ',');
+      int first;
+      ALLEGRO_USTR *u2, **iter;
+      if (comma == -1)
+         u2 = al_ustr_dup_substr(u, pos, al_ustr_length(u));
+      else
+         u2 = al_ustr_dup_substr(u, pos, comma);
+      al_ustr_trim_ws(u2);
+      first = al_ustr_get(u2, 0);
+
+      if (first == '-') {
+         al_ustr_remove_chr(u2, 0);
+         iter = _al_vector_alloc_back(&trace_info.excluded);
+         *iter = u2;
+      }
+      else {
+         if (first == '+')
+            al_ustr_remove_chr(u2, 0);
+         iter = _al_vector_alloc_back(&trace_info.channels);
+         *iter = u2;
+         if (!strcmp(al_cstr(u2), "all"))
+            got_all = true;
+      }
+      pos = comma;
+      al_ustr_get_next(u, &pos);
+   }
+
+   if (got_all)
+      delete_string_list(&trace_info.channels);
+}
+
+
 void _al_configure_logging(void)
 {
    ALLEGRO_CONFIG *config;
    char const *v;
-   bool got_all = false;
+
+   if (!trace_info.configured)
+      _al_mutex_init(&trace_info.trace_mutex);
 
    config = al_get_system_config();
-   v = al_get_config_value(config, "trace", "channels");
-   if (v) {
-      ALLEGRO_USTR_INFO uinfo;
-      const ALLEGRO_USTR *u = al_ref_cstr(&uinfo, v);
-      int pos = 0;
-
-      while (pos >= 0) {
-         int comma = al_ustr_find_chr(u, pos, ',');
-         int first;
-         ALLEGRO_USTR *u2, **iter;
-         if (comma == -1)
-            u2 = al_ustr_dup_substr(u, pos, al_ustr_length(u));
-         else
-            u2 = al_ustr_dup_substr(u, pos, comma);
-         al_ustr_trim_ws(u2);
-         first = al_ustr_get(u2, 0);
-
-         if (first == '-') {
-            al_ustr_remove_chr(u2, 0);
-            iter = _al_vector_alloc_back(&trace_info.excluded);
-            *iter = u2;
-         }
-         else {
-            if (first == '+')
-               al_ustr_remove_chr(u2, 0);
-            iter = _al_vector_alloc_back(&trace_info.channels);
-            *iter = u2;
-            if (!strcmp(al_cstr(u2), "all"))
-               got_all = true;
-         }
-         pos = comma;
-         al_ustr_get_next(u, &pos);
-      }
 
-      if (got_all)
-         delete_string_list(&trace_info.channels);
-   }
+   /* Threads may be logging while the settings are re-read. */
+   _al_mutex_lock(&trace_info.trace_mutex);
+
+   delete_string_list(&trace_info.channels);
+   delete_string_list(&trace_info.excluded);
+   v = al_get_config_value(config, "trace", "channels");
+   if (v)
+      read_channel_lists(v);
+   _al_fetch_and_add1(&trace_info.generation);
 
 #ifdef DEBUGMODE
    trace_info.level = 0;
@@ -161,8 +224,10 @@ void _al_configure_logging(void)
    else
       trace_info.flags &= ~1;
 
-   if (!trace_info.configured)
-      _al_mutex_init(&trace_info.trace_mutex);
+   v = al_get_config_value(config, "trace", "async");
+   trace_info.async = (v && strcmp(v, "0") && strcmp(v, "false"));
+
+   _al_mutex_unlock(&trace_info.trace_mutex);
 
    trace_info.configured = true;
 }
@@ -189,35 +254,15 @@ static void open_trace_file(void)
 }
 
 
-static void do_trace(const char *msg, ...)
-{
-   va_list ap;
-   int s = strlen(static_trace_buffer);
-   va_start(ap, msg);
-   vsnprintf(static_trace_buffer + s, sizeof(static_trace_buffer) - s,
-      msg, ap);
-   va_end(ap);
-}
-
-
-/* _al_trace_prefix:
- *  Conditionally write the initial part of a trace message.  If we do, return true
- *  and continue to hold the trace_mutex lock.
+/* channel_filter_matches:
+ *  Checks the channel against the configured lists.  The trace_mutex must
+ *  be held.
  */
-bool _al_trace_prefix(char const *channel, int level,
-   char const *file, int line, char const *function)
+static bool channel_filter_matches(char const *channel)
 {
    size_t i;
-   char *name;
    _AL_VECTOR const *v;
 
-   if (!trace_info.configured) {
-      _al_configure_logging();
-   }
-
-   if (level < trace_info.level)
-      return false;
-
    v = &trace_info.channels;
    if (_al_vector_is_empty(v))
       goto channel_included;
@@ -241,79 +286,151 @@ channel_included:
       }
    }
 
-   /* Avoid interleaved output from different threads. */
+   return true;
+}
+
+
+/* channel_included:
+ *  Returns whether messages for the channel should be logged.  Each
+ *  ALLEGRO_DEBUG_CHANNEL is a single string, so the answer is cached per
+ *  thread by its address and the lists are only searched on a miss.
+ */
+static bool channel_included(_AL_TRACE_THREAD_STATE *state,
+   char const *channel)
+{
+   int generation = _al_atomic_load_acquire(&trace_info.generation);
+   unsigned int i = ((uintptr_t)channel >> 3) % _AL_TRACE_CHANNEL_CACHE_SIZE;
+   bool included;
+
+   if (state->channels[i].channel == channel &&
+         state->channels[i].generation == generation) {
+      return state->channels[i].included;
+   }
+
    _al_mutex_lock(&trace_info.trace_mutex);
+   included = channel_filter_matches(channel);
+   _al_mutex_unlock(&trace_info.trace_mutex);
 
-   if (!_al_user_trace_handler)
-      open_trace_file();
+   state->channels[i].channel = channel;
+   state->channels[i].generation = generation;
+   state->channels[i].included = included;
+   return included;
+}
 
-   do_trace("%-8s ", channel);
-   if (level == 0) do_trace("D ");
-   if (level == 1) do_trace("I ");
-   if (level == 2) do_trace("W ");
-   if (level == 3) do_trace("E ");
 
-#ifdef ALLEGRO_ANDROID
-   {
-      char pid_buf[16];
-      snprintf(pid_buf, sizeof(pid_buf), "%i: ", gettid());
-      do_trace(pid_buf);
+/* _al_trace_prefix:
+ *  Decide whether a trace message should be written.  If so, remember its
+ *  header for _al_trace_suffix and return true.
+ */
+bool _al_trace_prefix(char const *channel, int level,
+   char const *file, int line, char const *function)
+{
+   _AL_TRACE_THREAD_STATE *state;
+
+   if (!trace_info.configured) {
+      _al_configure_logging();
    }
+
+   if (level < trace_info.level)
+      return false;
+
+   state = _al_tls_get_trace_state();
+   if (!state)
+      return false;
+
+   if (!channel_included(state, channel))
+      return false;
+
+   state->channel = channel;
+   state->level = level;
+   state->file = file;
+   state->line = line;
+   state->function = function;
+
+   return true;
+}
+
+
+static size_t do_trace(char *buf, size_t size, size_t len,
+   const char *msg, ...)
+{
+   va_list ap;
+   int n;
+
+   if (len >= size - 1)
+      return len;
+
+   va_start(ap, msg);
+   n = vsnprintf(buf + len, size - len, msg, ap);
+   va_end(ap);
+
+   if (n < 0)
+      return len;
+   len += n;
+   return (len < size - 1) ? len : size - 1;
+}
+
+
+/* format_header:
+ *  Writes the channel, level, location and time of the message into BUF.
+ *  Returns the length written.
+ */
+static size_t format_header(_AL_TRACE_THREAD_STATE *state, char *buf,
+   size_t size)
+{
+   char const *name;
+   size_t len = 0;
+
+   buf[0] = '\0';
+   len = do_trace(buf, size, len, "%-8s ", state->channel);
+   if (state->level == 0) len = do_trace(buf, size, len, "D ");
+   if (state->level == 1) len = do_trace(buf, size, len, "I ");
+   if (state->level == 2) len = do_trace(buf, size, len, "W ");
+   if (state->level == 3) len = do_trace(buf, size, len, "E ");
+
+#ifdef ALLEGRO_ANDROID
+   len = do_trace(buf, size, len, "%i: ", gettid());
 #endif
 
 #ifdef ALLEGRO_MSVC
-   name = strrchr(file, '\\');
+   name = strrchr(state->file, '\\');
 #else
-   name = strrchr(file, '/');
+   name = strrchr(state->file, '/');
 #endif
    if (trace_info.flags & 1) {
-      do_trace("%20s:%-4d ", name ? name + 1 : file, line);
+      len = do_trace(buf, size, len, "%20s:%-4d ",
+         name ? name + 1 : state->file, state->line);
    }
    if (trace_info.flags & 2) {
-      do_trace("%-32s ", function);
+      len = do_trace(buf, size, len, "%-32s ", state->function);
    }
    if (trace_info.flags & 4) {
       double t = 0;
       if (al_is_system_installed())
          t = al_get_time();
-      do_trace("[%10.5f] ", t);
+      len = do_trace(buf, size, len, "[%10.5f] ", t);
    }
 
-   /* Do not unlock trace_mutex here; that is done by _al_trace_suffix. */
-   return true;
+   return len;
 }
 
 
-/* _al_trace_suffix:
- *  Output the final part of a trace message, and release the trace_mutex lock.
+/* write_line:
+ *  Send a finished line to the platform log and the trace file.  The
+ *  trace_mutex must be held.
  */
-void _al_trace_suffix(const char *msg, ...)
+static void write_line(const char *text)
 {
-   int olderr = errno;
-   va_list ap;
-   int s = strlen(static_trace_buffer);
-   va_start(ap, msg);
-   vsnprintf(static_trace_buffer + s, sizeof(static_trace_buffer) - s,
-      msg, ap);
-   va_end(ap);
-
-   if (_al_user_trace_handler) {
-      _al_user_trace_handler(static_trace_buffer);
-      static_trace_buffer[0] = '\0';
-      return;
-   }
-
 #ifdef ALLEGRO_ANDROID
-   (void)__android_log_print(ANDROID_LOG_INFO, "allegro", "%s",
-      static_trace_buffer);
+   (void)__android_log_print(ANDROID_LOG_INFO, "allegro", "%s", text);
 #endif
 #ifdef ALLEGRO_IPHONE
-   fprintf(stderr, "%s", static_trace_buffer);
+   fprintf(stderr, "%s", text);
    fflush(stderr);
 #endif
 #ifdef ALLEGRO_WINDOWS
    {
-      TCHAR *windows_output = _twin_utf8_to_tchar(static_trace_buffer);
+      TCHAR *windows_output = _twin_utf8_to_tchar(text);
       OutputDebugString(windows_output);
       al_free(windows_output);
    }
@@ -322,12 +439,248 @@ void _al_trace_suffix(const char *msg, ...)
    /* We're intentially still writing to a file if it's set even with the
     * additional logging options above. */
    if (trace_info.trace_file) {
-      fprintf(trace_info.trace_file, "%s", static_trace_buffer);
+      fprintf(trace_info.trace_file, "%s", text);
+   }
+}
+
+
+/* ring_distance:
+ *  Returns A - B for ring positions, allowing for wrap-around.
+ */
+static int ring_distance(_AL_ATOMIC a, _AL_ATOMIC b)
+{
+   return (int)((unsigned int)a - (unsigned int)b);
+}
+
+
+static TRACE_SLOT *ring_slot(_AL_ATOMIC pos)
+{
+   return &trace_writer.ring[(unsigned int)pos % TRACE_RING_SLOTS];
+}
+
+
+/* enqueue_line:
+ *  Hand a line to the writer thread without blocking.  Returns false if
+ *  there is no writer running and the caller must write the line itself.
+ *  If the writer has fallen too far behind the line is dropped.
+ *
+ *  Any number of threads may call this at once.  A producer claims the
+ *  position at the head of the ring with a compare-and-swap once the slot
+ *  there is free, copies the line in, then publishes it by advancing the
+ *  slot's sequence number.
+ */
+static bool enqueue_line(const char *text, size_t len)
+{
+   TRACE_SLOT *slot;
+   _AL_ATOMIC pos;
+
+   if (!_al_atomic_load_acquire(&trace_writer.running))
+      return false;
+
+   for (;;) {
+      int diff;
+
+      pos = _al_atomic_load_acquire(&trace_writer.enqueue_pos);
+      slot = ring_slot(pos);
+      diff = ring_distance(_al_atomic_load_acquire(&slot->sequence), pos);
+
+      if (diff == 0) {
+         if (_al_compare_and_swap(&trace_writer.enqueue_pos, pos, pos + 1))
+            break;
+      }
+      else if (diff < 0) {
+         /* The writer hasn't emptied this slot yet. */
+         _al_fetch_and_add1(&trace_writer.dropped);
+         return true;
+      }
+      /* Otherwise another producer took the position first; retry. */
+   }
+
+   memcpy(slot->text, text, len + 1);
+   _al_atomic_store_release(&slot->sequence, pos + 1);
+
+   if (_al_atomic_load_acquire(&trace_writer.idle))
+      _al_cond_signal(&trace_writer.cond);
+
+   return true;
+}
+
+
+/* drain_ring:
+ *  Writes out all the queued lines.  Only called by the writer thread.
+ *  Returns whether there was anything to write.
+ */
+static bool drain_ring(void)
+{
+   bool wrote = false;
+   _AL_ATOMIC dropped;
+
+   _al_mutex_lock(&trace_info.trace_mutex);
+
+   for (;;) {
+      _AL_ATOMIC pos = trace_writer.dequeue_pos;
+      TRACE_SLOT *slot = ring_slot(pos);
+
+      if (ring_distance(_al_atomic_load_acquire(&slot->sequence), pos) != 1)
+         break;
+
+      write_line(slot->text);
+      trace_writer.dequeue_pos = pos + 1;
+      _al_atomic_store_release(&slot->sequence, pos + TRACE_RING_SLOTS);
+      wrote = true;
+   }
+
+   dropped = _al_atomic_load_acquire(&trace_writer.dropped);
+   if (dropped != trace_writer.reported_dropped) {
+      char text[80];
+      snprintf(text, sizeof(text), "%-8s W %d trace lines dropped\n",
+         "trace", ring_distance(dropped, trace_writer.reported_dropped));
+      write_line(text);
+      trace_writer.reported_dropped = dropped;
+      wrote = true;
+   }
+
+   if (wrote && trace_info.trace_file)
       fflush(trace_info.trace_file);
+
+   _al_mutex_unlock(&trace_info.trace_mutex);
+
+   return wrote;
+}
+
+
+static void trace_writer_proc(_AL_THREAD *thread, void *arg)
+{
+   (void)arg;
+
+   while (!_al_get_thread_should_stop(thread)) {
+      ALLEGRO_TIMEOUT timeout;
+
+      if (drain_ring())
+         continue;
+
+      _al_mutex_lock(&trace_writer.mutex);
+      _al_atomic_store_release(&trace_writer.idle, 1);
+      /* A producer may have queued a line before it could see the flag. */
+      if (ring_distance(_al_atomic_load_acquire(&trace_writer.enqueue_pos),
+            trace_writer.dequeue_pos) == 0 &&
+            !_al_get_thread_should_stop(thread)) {
+         al_init_timeout(&timeout, TRACE_WRITER_IDLE);
+         _al_cond_timedwait(&trace_writer.cond, &trace_writer.mutex,
+            &timeout);
+      }
+      _al_atomic_store_release(&trace_writer.idle, 0);
+      _al_mutex_unlock(&trace_writer.mutex);
+   }
+
+   drain_ring();
+}
+
+
+/* start_writer:
+ *  Starts the asynchronous writer if it was asked for and isn't running.
+ *  It needs the timer routines, so must wait for the system driver.
+ */
+static void start_writer(void)
+{
+   int i;
+
+   if (!trace_info.async || trace_writer.running ||
+         !al_is_system_installed())
+      return;
+
+   _al_mutex_lock(&trace_info.trace_mutex);
+
+   if (!trace_writer.running) {
+      open_trace_file();
+      trace_writer.ring = al_malloc(TRACE_RING_SLOTS * sizeof(TRACE_SLOT));
+      if (trace_writer.ring) {
+         for (i = 0; i < TRACE_RING_SLOTS; i++)
+            trace_writer.ring[i].sequence = i;
+         trace_writer.enqueue_pos = 0;
+         trace_writer.dequeue_pos = 0;
+         trace_writer.dropped = 0;
+         trace_writer.reported_dropped = 0;
+         trace_writer.idle = 0;
+
+         _AL_MARK_MUTEX_UNINITED(trace_writer.mutex);
+         _al_mutex_init(&trace_writer.mutex);
+         _al_cond_init(&trace_writer.cond);
+         _al_thread_create(&trace_writer.thread, trace_writer_proc, NULL);
+         _al_atomic_store_release(&trace_writer.running, 1);
+      }
+      else {
+         trace_info.async = false;
+      }
    }
-   static_trace_buffer[0] = '\0';
 
    _al_mutex_unlock(&trace_info.trace_mutex);
+}
+
+
+/* stop_writer:
+ *  Stops the asynchronous writer after it has written everything queued.
+ *  Other threads must have stopped logging by now.
+ */
+static void stop_writer(void)
+{
+   if (!trace_writer.running)
+      return;
+
+   _al_atomic_store_release(&trace_writer.running, 0);
+
+   _al_mutex_lock(&trace_writer.mutex);
+   _al_thread_set_should_stop(&trace_writer.thread);
+   _al_cond_signal(&trace_writer.cond);
+   _al_mutex_unlock(&trace_writer.mutex);
+   _al_thread_join(&trace_writer.thread);
+
+   _al_cond_destroy(&trace_writer.cond);
+   _al_mutex_destroy(&trace_writer.mutex);
+   al_free(trace_writer.ring);
+   trace_writer.ring = NULL;
+}
+
+
+/* _al_trace_suffix:
+ *  Format the message with the header saved by _al_trace_prefix and write
+ *  it out, or queue it for the writer thread.
+ */
+void _al_trace_suffix(const char *msg, ...)
+{
+   int olderr = errno;
+   _AL_TRACE_THREAD_STATE *state = _al_tls_get_trace_state();
+   char text[TRACE_LINE_SIZE];
+   size_t len;
+   va_list ap;
+   int n;
+
+   len = format_header(state, text, sizeof(text));
+   va_start(ap, msg);
+   n = vsnprintf(text + len, sizeof(text) - len, msg, ap);
+   va_end(ap);
+   if (n > 0)
+      len = (len + n < sizeof(text)) ? len + n : sizeof(text) - 1;
+
+   if (_al_user_trace_handler) {
+      /* Avoid calling the handler from several threads at once. */
+      _al_mutex_lock(&trace_info.trace_mutex);
+      _al_user_trace_handler(text);
+      _al_mutex_unlock(&trace_info.trace_mutex);
+      errno = olderr;
+      return;
+   }
+
+   start_writer();
+
+   if (!enqueue_line(text, len)) {
+      _al_mutex_lock(&trace_info.trace_mutex);
+      open_trace_file();
+      write_line(text);
+      if (trace_info.trace_file)
+         fflush(trace_info.trace_file);
+      _al_mutex_unlock(&trace_info.trace_mutex);
+   }
 
    errno = olderr;
 }
@@ -335,11 +688,14 @@ void _al_trace_suffix(const char *msg, ...)
 
 void _al_shutdown_logging(void)
 {
+   stop_writer();
+
    if (trace_info.configured) {
       _al_mutex_destroy(&trace_info.trace_mutex);
 
       delete_string_list(&trace_info.channels);
       delete_string_list(&trace_info.excluded);
+      _al_fetch_and_add1(&trace_info.generation);
 
       trace_info.configured = false;
    }
@@ -26,6 +26,7 @@
 #include "allegro5/internal/aintern.h"
 #include "allegro5/internal/aintern_bitmap.h"
 #include "allegro5/internal/aintern_display.h"
+#include "allegro5/internal/aintern_memblit.h"
 #include "allegro5/internal/aintern_shader.h"
 #include "allegro5/internal/aintern_system.h"
 
@@ -495,6 +496,11 @@ ALLEGRO_EVENT_SOURCE *al_get_display_event_source(ALLEGRO_DISPLAY *display)
 void al_hold_bitmap_drawing(bool hold)
 {
    ALLEGRO_DISPLAY *current_display = al_get_current_display();
+   ALLEGRO_BITMAP *target = al_get_target_bitmap();
+
+   /* Memory bitmaps are drawn to without the display, see memblit.c. */
+   if (target && (al_get_bitmap_flags(target) & ALLEGRO_MEMORY_BITMAP))
+      _al_hold_memory_bitmap_drawing(target, hold);
 
    if (current_display) {
       if (hold && !current_display->cache_enabled) {
@@ -531,6 +537,10 @@ void al_hold_bitmap_drawing(bool hold)
 bool al_is_bitmap_drawing_held(void)
 {
    ALLEGRO_DISPLAY *current_display = al_get_current_display();
+   ALLEGRO_BITMAP *target = al_get_target_bitmap();
+
+   if (target && _al_is_memory_bitmap_drawing_held(target))
+      return true;
 
    if (current_display)
       return current_display->cache_enabled;
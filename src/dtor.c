@@ -26,10 +26,10 @@
 
 #include "allegro5/allegro.h"
 #include "allegro5/internal/aintern.h"
+#include "allegro5/internal/aintern_atomicops.h"
 #include "allegro5/internal/aintern_dtor.h"
 #include "allegro5/internal/aintern_thread.h"
 #include "allegro5/internal/aintern_tls.h"
-#include "allegro5/internal/aintern_list.h"
 
 /* XXX The dependency on tls.c is not nice but the DllMain stuff for Windows
  * does not it easy to make abstract away TLS API differences.
@@ -38,17 +38,147 @@
 ALLEGRO_DEBUG_CHANNEL("dtor")
 
 
-struct _AL_DTOR_LIST {
-   _AL_MUTEX mutex;
-   _AL_LIST* dtors;
-};
+/* The registry is split into shards so that threads creating objects at the
+ * same time don't all serialise on one mutex.  Each thread is given a shard
+ * the first time it registers something.  An object can be unregistered from
+ * any thread, so every item remembers the shard it lives in.
+ *
+ * Items are carved out of blocks owned by the shard and recycled through a
+ * free list, so registering an object does not normally allocate.  The blocks
+ * are only released by _al_shutdown_destructors.
+ *
+ * Every item is stamped with a serial number taken from a counter shared by
+ * all shards so that _al_run_destructors can still destroy the objects in
+ * the reverse order of their creation.
+ */
+#define DTOR_SHARDS        8
+#define DTOR_BLOCK_ITEMS   64
+
 
+typedef struct DTOR_SHARD DTOR_SHARD;
 
-typedef struct DTOR {
+struct _AL_DTOR_ITEM {
+   _AL_DTOR_ITEM *next;
+   _AL_DTOR_ITEM *prev;
+   DTOR_SHARD *shard;
+   unsigned int serial;
    char const *name;
    void *object;
    void (*func)(void*);
-} DTOR;
+};
+
+
+typedef struct DTOR_BLOCK {
+   struct DTOR_BLOCK *next;
+   _AL_DTOR_ITEM items[DTOR_BLOCK_ITEMS];
+} DTOR_BLOCK;
+
+
+struct DTOR_SHARD {
+   _AL_MUTEX mutex;
+   _AL_DTOR_ITEM root;        /* sentinel, items in registration order */
+   _AL_DTOR_ITEM *free_items;
+   DTOR_BLOCK *blocks;
+};
+
+
+struct _AL_DTOR_LIST {
+   DTOR_SHARD shards[DTOR_SHARDS];
+   volatile _AL_ATOMIC next_serial;
+};
+
+
+static volatile _AL_ATOMIC next_thread_shard = 0;
+
+
+/* serial_after:
+ *  Returns true if serial number A was handed out after B.  Tolerates the
+ *  counter wrapping around.
+ */
+static bool serial_after(unsigned int a, unsigned int b)
+{
+   return (int)(a - b) > 0;
+}
+
+
+
+/* get_thread_shard:
+ *  Returns the shard objects created by the calling thread are added to.
+ */
+static DTOR_SHARD *get_thread_shard(_AL_DTOR_LIST *dtors)
+{
+   int *shard = _al_tls_get_dtor_shard();
+
+   /* Zero means the thread hasn't been assigned a shard yet. */
+   if (*shard == 0) {
+      *shard = 1 + (unsigned int)_al_fetch_and_add1(&next_thread_shard)
+         % DTOR_SHARDS;
+   }
+
+   return &dtors->shards[*shard - 1];
+}
+
+
+
+/* shard_is_empty:
+ *  The shard's mutex must be held.
+ */
+static bool shard_is_empty(DTOR_SHARD *shard)
+{
+   return shard->root.next == &shard->root;
+}
+
+
+
+/* shard_alloc_item:
+ *  Takes an item off the shard's free list, adding a new block of items to
+ *  it first if it is empty.  The shard's mutex must be held.
+ */
+static _AL_DTOR_ITEM *shard_alloc_item(DTOR_SHARD *shard)
+{
+   _AL_DTOR_ITEM *item;
+
+   if (!shard->free_items) {
+      DTOR_BLOCK *block = al_malloc(sizeof(DTOR_BLOCK));
+      int i;
+
+      if (!block)
+         return NULL;
+
+      block->next = shard->blocks;
+      shard->blocks = block;
+      for (i = 0; i < DTOR_BLOCK_ITEMS; i++) {
+         block->items[i].shard = shard;
+         block->items[i].next = shard->free_items;
+         shard->free_items = &block->items[i];
+      }
+   }
+
+   item = shard->free_items;
+   shard->free_items = item->next;
+   return item;
+}
+
+
+
+/* shard_free_item:
+ *  Unlinks the item and returns it to the shard's free list.  The shard's
+ *  mutex must be held.
+ */
+static void shard_free_item(DTOR_SHARD *shard, _AL_DTOR_ITEM *item)
+{
+   ASSERT(item->shard == shard);
+
+   item->prev->next = item->next;
+   item->next->prev = item->prev;
+
+   item->object = NULL;
+   item->func = NULL;
+   item->prev = NULL;
+   item->next = shard->free_items;
+   shard->free_items = item;
+}
+
 
 
 /* Internal function: _al_init_destructors
@@ -57,10 +187,20 @@ typedef struct DTOR {
 _AL_DTOR_LIST *_al_init_destructors(void)
 {
    _AL_DTOR_LIST *dtors = al_malloc(sizeof(*dtors));
-
-   _AL_MARK_MUTEX_UNINITED(dtors->mutex);
-   _al_mutex_init(&dtors->mutex);
-   dtors->dtors = _al_list_create();
+   int i;
+
+   for (i = 0; i < DTOR_SHARDS; i++) {
+      DTOR_SHARD *shard = &dtors->shards[i];
+
+      _AL_MARK_MUTEX_UNINITED(shard->mutex);
+      _al_mutex_init(&shard->mutex);
+      shard->root.next = &shard->root;
+      shard->root.prev = &shard->root;
+      shard->root.shard = shard;
+      shard->free_items = NULL;
+      shard->blocks = NULL;
+   }
+   dtors->next_serial = 0;
 
    return dtors;
 }
@@ -95,37 +235,71 @@ void _al_pop_destructor_owner(void)
 
 
 
+/* find_newest_shard:
+ *  Returns the shard whose most recently registered object is the newest of
+ *  all, or NULL if every shard is empty.  Also returns the serial number of
+ *  that object.
+ */
+static DTOR_SHARD *find_newest_shard(_AL_DTOR_LIST *dtors,
+   unsigned int *serial)
+{
+   DTOR_SHARD *newest = NULL;
+   int i;
+
+   for (i = 0; i < DTOR_SHARDS; i++) {
+      DTOR_SHARD *shard = &dtors->shards[i];
+
+      _al_mutex_lock(&shard->mutex);
+      if (!shard_is_empty(shard)) {
+         unsigned int back = shard->root.prev->serial;
+         if (!newest || serial_after(back, *serial)) {
+            newest = shard;
+            *serial = back;
+         }
+      }
+      _al_mutex_unlock(&shard->mutex);
+   }
+
+   return newest;
+}
+
+
+
 /* _al_run_destructors:
  *  Run all the destructors on the list in reverse order.
  */
 void _al_run_destructors(_AL_DTOR_LIST *dtors)
 {
+   DTOR_SHARD *shard;
+   unsigned int serial;
+
    if (!dtors) {
       return;
    }
 
    /* call the destructors in reverse order */
-   _al_mutex_lock(&dtors->mutex);
-   {
-      _AL_LIST_ITEM *iter = _al_list_back(dtors->dtors);
-      while (iter) {
-         DTOR *dtor = _al_list_item_data(iter);
-         void *object = dtor->object;
-         void (*func)(void *) = dtor->func;
-
+   while ((shard = find_newest_shard(dtors, &serial))) {
+      _AL_DTOR_ITEM *item;
+      void *object = NULL;
+      void (*func)(void *) = NULL;
+
+      _al_mutex_lock(&shard->mutex);
+      item = shard->root.prev;
+      /* Another thread may have changed the shard since we looked. */
+      if (item != &shard->root && item->serial == serial) {
+         object = item->object;
+         func = item->func;
          ALLEGRO_DEBUG("calling dtor for %s %p, func %p\n",
-            dtor->name, object, func);
-         _al_mutex_unlock(&dtors->mutex);
-         {
-            (*func)(object);
-         }
-         _al_mutex_lock(&dtors->mutex);
-         /* Don't do normal iteration as the destructors will possibly run
-          * multiple destructors at once. */
-         iter = _al_list_back(dtors->dtors);
+            item->name, object, func);
+      }
+      _al_mutex_unlock(&shard->mutex);
+
+      /* Don't do normal iteration as the destructors will possibly run
+       * multiple destructors at once. */
+      if (func) {
+         (*func)(object);
       }
    }
-   _al_mutex_unlock(&dtors->mutex);
 }
 
 
@@ -135,35 +309,74 @@ void _al_run_destructors(_AL_DTOR_LIST *dtors)
  */
 void _al_shutdown_destructors(_AL_DTOR_LIST *dtors)
 {
+   int i;
+
    if (!dtors) {
       return;
    }
 
    /* free resources used by the destructor subsystem */
-   ASSERT(_al_list_is_empty(dtors->dtors));
-   _al_list_destroy(dtors->dtors);
-
-   _al_mutex_destroy(&dtors->mutex);
+   for (i = 0; i < DTOR_SHARDS; i++) {
+      DTOR_SHARD *shard = &dtors->shards[i];
+
+      ASSERT(shard_is_empty(shard));
+      while (shard->blocks) {
+         DTOR_BLOCK *next = shard->blocks->next;
+         al_free(shard->blocks);
+         shard->blocks = next;
+      }
+      _al_mutex_destroy(&shard->mutex);
+   }
 
    al_free(dtors);
 }
 
 
 
+#ifdef DEBUGMODE
+/* is_registered:
+ *  Returns true if the object is in any of the shards.
+ */
+static bool is_registered(_AL_DTOR_LIST *dtors, void *object)
+{
+   bool found = false;
+   int i;
+
+   for (i = 0; i < DTOR_SHARDS && !found; i++) {
+      DTOR_SHARD *shard = &dtors->shards[i];
+      _AL_DTOR_ITEM *iter;
+
+      _al_mutex_lock(&shard->mutex);
+      for (iter = shard->root.next; iter != &shard->root; iter = iter->next) {
+         if (iter->object == object) {
+            found = true;
+            break;
+         }
+      }
+      _al_mutex_unlock(&shard->mutex);
+   }
+
+   return found;
+}
+#endif /* DEBUGMODE */
+
+
+
 /* Internal function: _al_register_destructor
  *  Register OBJECT to be destroyed by FUNC during Allegro shutdown.
  *  This would be done in the object's constructor function.
  *
- *  Returns a list item representing the destructor's position in the list
+ *  Returns an item representing the destructor's position in the list
  *  (possibly null).
  *
  *  [thread-safe]
  */
-_AL_LIST_ITEM *_al_register_destructor(_AL_DTOR_LIST *dtors, char const *name,
+_AL_DTOR_ITEM *_al_register_destructor(_AL_DTOR_LIST *dtors, char const *name,
    void *object, void (*func)(void*))
 {
    int *dtor_owner_count;
-   _AL_LIST_ITEM *ret = NULL;
+   DTOR_SHARD *shard;
+   _AL_DTOR_ITEM *item;
    ASSERT(object);
    ASSERT(func);
 
@@ -171,40 +384,37 @@ _AL_LIST_ITEM *_al_register_destructor(_AL_DTOR_LIST *dtors, char const *name,
    if (*dtor_owner_count > 0)
       return NULL;
 
-   _al_mutex_lock(&dtors->mutex);
-   {
 #ifdef DEBUGMODE
-      /* make sure the object is not registered twice */
-      {
-         _AL_LIST_ITEM *iter = _al_list_front(dtors->dtors);
-
-         while (iter) {
-            DTOR *dtor = _al_list_item_data(iter);
-            ASSERT(dtor->object != object);
-            iter = _al_list_next(dtors->dtors, iter);
-         }
-      }
-#endif /* DEBUGMODE */
+   /* make sure the object is not registered twice */
+   ASSERT(!is_registered(dtors, object));
+#endif
+
+   shard = get_thread_shard(dtors);
 
+   _al_mutex_lock(&shard->mutex);
+   {
       /* add the destructor to the list */
-      {
-         DTOR *new_dtor = al_malloc(sizeof(DTOR));
-         if (new_dtor) {
-            new_dtor->object = object;
-            new_dtor->func = func;
-            new_dtor->name = name;
-            ALLEGRO_DEBUG("added dtor for %s %p, func %p\n", name,
-               object, func);
-            ret = _al_list_push_back(dtors->dtors, new_dtor);
-         }
-         else {
-            ALLEGRO_WARN("failed to add dtor for %s %p\n", name,
-               object);
-         }
+      item = shard_alloc_item(shard);
+      if (item) {
+         item->object = object;
+         item->func = func;
+         item->name = name;
+         /* Taken under the shard mutex so that each shard stays sorted. */
+         item->serial = (unsigned int)_al_fetch_and_add1(&dtors->next_serial);
+         item->prev = shard->root.prev;
+         item->next = &shard->root;
+         shard->root.prev->next = item;
+         shard->root.prev = item;
+         ALLEGRO_DEBUG("added dtor for %s %p, func %p\n", name,
+            object, func);
+      }
+      else {
+         ALLEGRO_WARN("failed to add dtor for %s %p\n", name,
+            object);
       }
    }
-   _al_mutex_unlock(&dtors->mutex);
-   return ret;
+   _al_mutex_unlock(&shard->mutex);
+   return item;
 }
 
 
@@ -215,43 +425,48 @@ _AL_LIST_ITEM *_al_register_destructor(_AL_DTOR_LIST *dtors, char const *name,
  *
  *  [thread-safe]
  */
-void _al_unregister_destructor(_AL_DTOR_LIST *dtors, _AL_LIST_ITEM *dtor_item)
+void _al_unregister_destructor(_AL_DTOR_LIST *dtors, _AL_DTOR_ITEM *dtor_item)
 {
+   DTOR_SHARD *shard;
+   (void)dtors;
+
    if (!dtor_item) {
       return;
    }
 
-   _al_mutex_lock(&dtors->mutex);
+   shard = dtor_item->shard;
+   _al_mutex_lock(&shard->mutex);
    {
-      DTOR *dtor = _al_list_item_data(dtor_item);
-      ALLEGRO_DEBUG("removed dtor for %s %p\n", dtor->name, dtor->object);
-      al_free(dtor);
-      _al_list_erase(dtors->dtors, dtor_item);
+      ALLEGRO_DEBUG("removed dtor for %s %p\n", dtor_item->name,
+         dtor_item->object);
+      shard_free_item(shard, dtor_item);
    }
-   _al_mutex_unlock(&dtors->mutex);
+   _al_mutex_unlock(&shard->mutex);
 }
 
 
 
 /* Internal function: _al_foreach_destructor
- *  Call the callback for each registered object.
+ *  Call the callback for each registered object.  Objects are visited one
+ *  shard at a time, not in the order they were registered.
  *  [thread-safe]
  */
 void _al_foreach_destructor(_AL_DTOR_LIST *dtors,
    void (*callback)(void *object, void (*func)(void *), void *udata),
    void *userdata)
 {
-   _al_mutex_lock(&dtors->mutex);
-   {
-      _AL_LIST_ITEM *iter = _al_list_front(dtors->dtors);
+   int i;
+
+   for (i = 0; i < DTOR_SHARDS; i++) {
+      DTOR_SHARD *shard = &dtors->shards[i];
+      _AL_DTOR_ITEM *iter;
 
-      while (iter) {
-         DTOR *dtor = _al_list_item_data(iter);
-         callback(dtor->object, dtor->func, userdata);
-         iter = _al_list_next(dtors->dtors, iter);
+      _al_mutex_lock(&shard->mutex);
+      for (iter = shard->root.next; iter != &shard->root; iter = iter->next) {
+         callback(iter->object, iter->func, userdata);
       }
+      _al_mutex_unlock(&shard->mutex);
    }
-   _al_mutex_unlock(&dtors->mutex);
 }
 
 
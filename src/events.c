@@ -40,9 +40,10 @@ struct ALLEGRO_EVENT_QUEUE
    unsigned int events_head;  /* write end of circular array */
    unsigned int events_tail;  /* read end of circular array */
    bool paused;
+   int waiters;  /* number of threads blocked on cond */
    _AL_MUTEX mutex;
    _AL_COND cond;
-   _AL_LIST_ITEM *dtor_item;
+   _AL_DTOR_ITEM *dtor_item;
 };
 
 
@@ -101,6 +102,7 @@ ALLEGRO_EVENT_QUEUE *al_create_event_queue(void)
       queue->events_head = 0;
       queue->events_tail = 0;
       queue->paused = false;
+      queue->waiters = 0;
 
       _AL_MARK_MUTEX_UNINITED(queue->mutex);
       _al_mutex_init(&queue->mutex);
@@ -316,6 +318,47 @@ bool al_get_next_event(ALLEGRO_EVENT_QUEUE *queue, ALLEGRO_EVENT *ret_event)
 
 
 
+/* Function: al_get_next_events
+ */
+int al_get_next_events(ALLEGRO_EVENT_QUEUE *queue, ALLEGRO_EVENT *ret_events,
+   int max)
+{
+   int count = 0;
+   ASSERT(queue);
+   ASSERT(ret_events || max <= 0);
+
+   heartbeat();
+
+   _al_mutex_lock(&queue->mutex);
+
+   /* Copy the events in at most two runs, before and after the end of
+    * the circular array.  Don't increment reference count on user events.
+    */
+   while (count < max && !is_event_queue_empty(queue)) {
+      const unsigned int size = _al_vector_size(&queue->events);
+      const unsigned int tail = queue->events_tail;
+      unsigned int run;
+
+      if (queue->events_head > tail)
+         run = queue->events_head - tail;
+      else
+         run = size - tail;
+      if (run > (unsigned int)(max - count))
+         run = max - count;
+
+      memcpy(ret_events + count, _al_vector_ref(&queue->events, tail),
+         run * sizeof(ALLEGRO_EVENT));
+      count += run;
+      queue->events_tail = (tail + run) % size;
+   }
+
+   _al_mutex_unlock(&queue->mutex);
+
+   return count;
+}
+
+
+
 /* Function: al_peek_next_event
  */
 bool al_peek_next_event(ALLEGRO_EVENT_QUEUE *queue, ALLEGRO_EVENT *ret_event)
@@ -402,9 +445,11 @@ void al_wait_for_event(ALLEGRO_EVENT_QUEUE *queue, ALLEGRO_EVENT *ret_event)
 
    _al_mutex_lock(&queue->mutex);
    {
+      queue->waiters++;
       while (is_event_queue_empty(queue)) {
          _al_cond_wait(&queue->cond, &queue->mutex);
       }
+      queue->waiters--;
 
       if (ret_event) {
          next_event = get_next_event_if_any(queue, true);
@@ -467,9 +512,11 @@ static bool do_wait_for_event(ALLEGRO_EVENT_QUEUE *queue,
        * variable, which will be signaled when an event is placed into
        * the queue.
        */
+      queue->waiters++;
       while (is_event_queue_empty(queue) && (result != -1)) {
          result = _al_cond_timedwait(&queue->cond, &queue->mutex, timeout);
       }
+      queue->waiters--;
 
       if (result == -1)
          timed_out = true;
@@ -502,14 +549,27 @@ static void expand_events_array(ALLEGRO_EVENT_QUEUE *queue)
       _al_vector_alloc_back(&queue->events);
    }
 
-   /* Move wrapped-around elements at the start of the array to the back. */
+   /* If the events wrap around, move whichever of the two runs is
+    * shorter so they are contiguous again, in one go.
+    */
    if (queue->events_head < queue->events_tail) {
-      for (i = 0; i < queue->events_head; i++) {
-         ALLEGRO_EVENT *old_ev = _al_vector_ref(&queue->events, i);
-         ALLEGRO_EVENT *new_ev = _al_vector_ref(&queue->events, old_size + i);
-         copy_event(new_ev, old_ev);
+      const size_t head_len = queue->events_head;
+      const size_t tail_len = old_size - queue->events_tail;
+
+      if (head_len <= tail_len) {
+         if (head_len > 0) {
+            memcpy(_al_vector_ref(&queue->events, old_size),
+               _al_vector_ref(&queue->events, 0),
+               head_len * sizeof(ALLEGRO_EVENT));
+         }
+         queue->events_head += old_size;
+      }
+      else {
+         memcpy(_al_vector_ref(&queue->events, new_size - tail_len),
+            _al_vector_ref(&queue->events, queue->events_tail),
+            tail_len * sizeof(ALLEGRO_EVENT));
+         queue->events_tail = new_size - tail_len;
       }
-      queue->events_head += old_size;
    }
 }
 
@@ -600,14 +660,18 @@ void _al_event_queue_push_event(ALLEGRO_EVENT_QUEUE *queue,
 
    _al_mutex_lock(&queue->mutex);
    {
+      const bool was_empty = is_event_queue_empty(queue);
+
       new_event = alloc_event(queue);
       copy_event(new_event, orig_event);
       ref_if_user_event(new_event);
 
       /* Wake up threads that are waiting for an event to be placed in
-       * the queue.
+       * the queue.  Threads only wait while the queue is empty, so there
+       * is nobody to wake if it already held events.
        */
-      _al_cond_broadcast(&queue->cond);
+      if (was_empty && queue->waiters > 0)
+         _al_cond_broadcast(&queue->cond);
    }
    _al_mutex_unlock(&queue->mutex);
 }
@@ -102,6 +102,29 @@ ALLEGRO_FILE *al_fopen_fd(int fd, const char *mode)
 }
 
 
+/* _al_get_file_fd:
+ *  Returns the file descriptor underlying a file which was opened with the
+ *  stdio file interface, or -1 for any other kind of file.
+ */
+int _al_get_file_fd(ALLEGRO_FILE *f)
+{
+   USERDATA *userdata;
+
+   if (!f || f->vtable != &_al_file_interface_stdio)
+      return -1;
+
+   userdata = get_userdata(f);
+   if (!userdata->fp)
+      return -1;
+
+#ifdef ALLEGRO_MSVC
+   return _fileno(userdata->fp);
+#else
+   return fileno(userdata->fp);
+#endif
+}
+
+
 static void *file_stdio_fopen(const char *path, const char *mode)
 {
    FILE *fp;
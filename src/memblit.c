@@ -19,9 +19,14 @@
 #include "allegro5/internal/aintern_blend.h"
 #include "allegro5/internal/aintern_convert.h"
 #include "allegro5/internal/aintern_memblit.h"
+#include "allegro5/internal/aintern_pixels.h"
+#include "allegro5/internal/aintern_simd.h"
 #include "allegro5/internal/aintern_transform.h"
 #include "allegro5/internal/aintern_tri_soft.h"
 #include <math.h>
+#include <string.h>
+
+ALLEGRO_DEBUG_CHANNEL("memblit")
 
 #define MIN _ALLEGRO_MIN
 #define MAX _ALLEGRO_MAX
@@ -33,6 +38,14 @@ static void _al_draw_transformed_scaled_bitmap_memory(
 static void _al_draw_bitmap_region_memory_fast(ALLEGRO_BITMAP *bitmap,
    int sx, int sy, int sw, int sh,
    int dx, int dy, int flags);
+static bool _al_draw_bitmap_region_memory_blend(ALLEGRO_BITMAP *src,
+   ALLEGRO_COLOR tint,
+   int sx, int sy, int sw, int sh,
+   int dx, int dy, int flags);
+static bool _al_draw_scaled_bitmap_memory_filtered(ALLEGRO_BITMAP *src,
+   ALLEGRO_COLOR tint, int sx, int sy, int sw, int sh, int dx, int dy);
+static bool hold_bitmap_region(int kind, ALLEGRO_BITMAP *src,
+   ALLEGRO_COLOR tint, int sx, int sy, int sw, int sh, int dx, int dy);
 
 
 /* The CLIPPER macro takes pre-clipped coordinates for both the source
@@ -130,6 +143,55 @@ static void _al_draw_bitmap_region_memory_fast(ALLEGRO_BITMAP *bitmap,
 }
 
 
+/* Kinds of held bitmap drawing, see below. */
+enum {
+   HELD_TRIANGLES,
+   HELD_COPY,
+   HELD_BLEND
+};
+
+
+/* Returns true if the source bitmap is locked as a whole in its own
+ * format, as done while held drawing is carried out, so that its lock
+ * can be used directly.
+ */
+static bool source_lock_is_usable(ALLEGRO_BITMAP *src)
+{
+   return src->lock_x == 0 && src->lock_y == 0 &&
+      src->lock_w >= src->w && src->lock_h >= src->h &&
+      src->locked_region.format == al_get_bitmap_format(src);
+}
+
+
+/* Locks a region of the source bitmap for reading. If the source is
+ * already locked in a usable way, the region is taken from that lock and
+ * *unlock is set to false.
+ */
+static bool lock_source_region(ALLEGRO_BITMAP *src,
+   int x, int y, int w, int h, ALLEGRO_LOCKED_REGION *region, bool *unlock)
+{
+   ALLEGRO_LOCKED_REGION *lr;
+
+   if (al_is_bitmap_locked(src)) {
+      if (!source_lock_is_usable(src))
+         return false;
+      *region = src->locked_region;
+      region->data = (char *)region->data + y * region->pitch +
+         x * region->pixel_size;
+      *unlock = false;
+      return true;
+   }
+
+   if (!(lr = al_lock_bitmap_region(src, x, y, w, h,
+         ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_READONLY))) {
+      return false;
+   }
+   *region = *lr;
+   *unlock = true;
+   return true;
+}
+
+
 void _al_draw_bitmap_region_memory(ALLEGRO_BITMAP *src,
    ALLEGRO_COLOR tint,
    int sx, int sy, int sw, int sh,
@@ -152,6 +214,20 @@ void _al_draw_bitmap_region_memory(ALLEGRO_BITMAP *src,
       return;
    }
 
+   if (_al_transform_is_translation(al_get_current_transform(), &xtrans, &ytrans) &&
+      xtrans == (int)xtrans && ytrans == (int)ytrans &&
+      _al_draw_bitmap_region_memory_blend(src, tint, sx, sy, sw, sh,
+         dx + xtrans, dy + ytrans, flags))
+   {
+      return;
+   }
+
+   if (_al_draw_scaled_bitmap_memory_filtered(src, tint, sx, sy, sw, sh,
+         dx, dy))
+   {
+      return;
+   }
+
    /* We used to have special cases for translation/scaling only, but the
     * general version received much more optimisation and ended up being
     * faster.
@@ -170,6 +246,7 @@ static void _al_draw_transformed_bitmap_memory(ALLEGRO_BITMAP *src,
    int tl = 0, tr = 1, bl = 3, br = 2;
    int tmp;
    ALLEGRO_VERTEX v[4];
+   ALLEGRO_VERTEX tri[6];
 
    ASSERT(_al_pixel_format_is_real(al_get_bitmap_format(src)));
 
@@ -236,10 +313,16 @@ static void _al_draw_transformed_bitmap_memory(ALLEGRO_BITMAP *src,
    v[bl].v = sy + sh;
    v[bl].color = tint;
 
+   tri[0] = v[tl];
+   tri[1] = v[tr];
+   tri[2] = v[br];
+   tri[3] = v[tl];
+   tri[4] = v[br];
+   tri[5] = v[bl];
+
    al_lock_bitmap(src, ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_READONLY);
 
-   _al_triangle_2d(src, &v[tl], &v[tr], &v[br]);
-   _al_triangle_2d(src, &v[tl], &v[br], &v[bl]);
+   _al_triangles_2d(src, tri, 2);
 
    al_unlock_bitmap(src);
 }
@@ -264,9 +347,10 @@ static void _al_draw_bitmap_region_memory_fast(ALLEGRO_BITMAP *bitmap,
    int sx, int sy, int sw, int sh,
    int dx, int dy, int flags)
 {
-   ALLEGRO_LOCKED_REGION *src_region;
+   ALLEGRO_LOCKED_REGION src_region;
    ALLEGRO_LOCKED_REGION *dst_region;
    ALLEGRO_BITMAP *dest = al_get_target_bitmap();
+   bool unlock_src;
    int dw = sw, dh = sh;
 
    ASSERT(_al_pixel_format_is_real(al_get_bitmap_format(bitmap)));
@@ -279,27 +363,1260 @@ static void _al_draw_bitmap_region_memory_fast(ALLEGRO_BITMAP *bitmap,
    ASSERT(flags == 0);
    (void)flags;
 
+   if (hold_bitmap_region(HELD_COPY, bitmap, al_map_rgba_f(1, 1, 1, 1),
+         sx, sy, sw, sh, dx, dy))
+      return;
+
    CLIPPER(bitmap, sx, sy, sw, sh, dest, dx, dy, dw, dh, 1, 1, flags)
 
-   if (!(src_region = al_lock_bitmap_region(bitmap, sx, sy, sw, sh,
-         ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_READONLY))) {
+   if (!lock_source_region(bitmap, sx, sy, sw, sh, &src_region, &unlock_src)) {
       return;
    }
 
    if (!(dst_region = al_lock_bitmap_region(dest, dx, dy, sw, sh,
          ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_WRITEONLY))) {
-      al_unlock_bitmap(bitmap);
+      if (unlock_src)
+         al_unlock_bitmap(bitmap);
       return;
    }
 
    /* will detect if no conversion is needed */
    _al_convert_bitmap_data(
-      src_region->data, src_region->format, src_region->pitch,
+      src_region.data, src_region.format, src_region.pitch,
       dst_region->data, dst_region->format, dst_region->pitch,
       0, 0, 0, 0, sw, sh);
 
-   al_unlock_bitmap(bitmap);
+   if (unlock_src)
+      al_unlock_bitmap(bitmap);
+   al_unlock_bitmap(dest);
+}
+
+
+/* Blending blits between 32 bit bitmaps.
+ *
+ * The general path above rasterises two textured triangles and blends
+ * each pixel in turn. For the very common case of drawing a bitmap
+ * untransformed onto another bitmap of the same 8888 format with an
+ * ALLEGRO_ADD blender, we instead blend whole rows directly, with one
+ * SSE2 vector holding the four components of a pixel.
+ *
+ * Every blend factor can be written as k + ks*S + kd*D + ka*Sa where S
+ * and D are the source and destination components and Sa the source
+ * alpha, so one generic kernel per blend operation handles all factor
+ * combinations. The premultiplied and non-premultiplied alpha blenders
+ * get kernels of their own. All of them perform the same float
+ * operations in the same order as _al_blend_inline, so the results are
+ * bit-identical to those of the general path. Each kernel has its own
+ * row functions, chosen once per blit.
+ */
+
+#ifdef _AL_SIMD_SSE2
+
+#include <emmintrin.h>
+
+typedef struct BLEND_FACTOR {
+   float k[4], ks[4], kd[4], ka[4];
+} BLEND_FACTOR;
+
+typedef struct BLEND_PARAMS BLEND_PARAMS;
+
+struct BLEND_PARAMS {
+   /* Blends a row of source pixels onto the destination. */
+   void (*blend_row)(const BLEND_PARAMS *bp, const uint32_t *src,
+      uint32_t *dst, int n);
+   /* Blends a row of colours, already in lane order, onto the
+    * destination.
+    */
+   void (*store_row)(const BLEND_PARAMS *bp, const ALLEGRO_COLOR *src,
+      uint32_t *dst, int n);
+   bool rotate;
+   float tint[4];
+   BLEND_FACTOR src, dst;
+};
+
+
+/* The lanes of a pixel vector are its bytes in memory order, which puts
+ * the alpha component in lane 3 for all formats we handle once
+ * ALLEGRO_PIXEL_FORMAT_RGBA_8888 pixels are rotated by a byte.
+ */
+static bool blend_lanes(int format, int *r, int *g, int *b, bool *rotate)
+{
+   switch (format) {
+      case ALLEGRO_PIXEL_FORMAT_ARGB_8888:
+      case ALLEGRO_PIXEL_FORMAT_RGBA_8888:
+         *r = 2; *g = 1; *b = 0;
+         break;
+      case ALLEGRO_PIXEL_FORMAT_ABGR_8888:
+      case ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE:
+         *r = 0; *g = 1; *b = 2;
+         break;
+      default:
+         return false;
+   }
+   *rotate = (format == ALLEGRO_PIXEL_FORMAT_RGBA_8888);
+   return true;
+}
+
+
+static void set_blend_factor(BLEND_FACTOR *f, int lane, int mode, float c)
+{
+   f->k[lane] = f->ks[lane] = f->kd[lane] = f->ka[lane] = 0;
+
+   switch (mode) {
+      case ALLEGRO_ZERO:
+         break;
+      case ALLEGRO_ONE:
+         f->k[lane] = 1;
+         break;
+      case ALLEGRO_ALPHA:
+         f->ka[lane] = 1;
+         break;
+      case ALLEGRO_INVERSE_ALPHA:
+         f->k[lane] = 1;
+         f->ka[lane] = -1;
+         break;
+      case ALLEGRO_SRC_COLOR:
+         f->ks[lane] = 1;
+         break;
+      case ALLEGRO_DEST_COLOR:
+         f->kd[lane] = 1;
+         break;
+      case ALLEGRO_INVERSE_SRC_COLOR:
+         f->k[lane] = 1;
+         f->ks[lane] = -1;
+         break;
+      case ALLEGRO_INVERSE_DEST_COLOR:
+         f->k[lane] = 1;
+         f->kd[lane] = -1;
+         break;
+      case ALLEGRO_CONST_COLOR:
+         f->k[lane] = c;
+         break;
+      case ALLEGRO_INVERSE_CONST_COLOR:
+         f->k[lane] = 1 - c;
+         break;
+   }
+}
+
+
+static INLINE _AL_TARGET_SSE2 __m128 blend_load_sse2(uint32_t p, bool rotate)
+{
+   __m128i v;
+
+   if (rotate)
+      p = (p >> 8) | (p << 24);
+   v = _mm_cvtsi32_si128((int)p);
+   v = _mm_unpacklo_epi8(v, _mm_setzero_si128());
+   v = _mm_unpacklo_epi16(v, _mm_setzero_si128());
+   return _mm_div_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(255));
+}
+
+
+static INLINE _AL_TARGET_SSE2 uint32_t blend_store_sse2(__m128 c, bool rotate)
+{
+   __m128i v = _mm_cvttps_epi32(_mm_mul_ps(c, _mm_set1_ps(255)));
+   uint32_t p;
+
+   v = _mm_packs_epi32(v, v);
+   p = (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(v, v));
+   if (rotate)
+      p = (p << 8) | (p >> 24);
+   return p;
+}
+
+
+/* Like blend_store_sse2, but rounds to the nearest level instead of
+ * truncating. Used by the filtered blits.
+ */
+static INLINE _AL_TARGET_SSE2 uint32_t blend_store_rounded_sse2(__m128 c,
+   bool rotate)
+{
+   __m128i v = _mm_cvtps_epi32(_mm_mul_ps(c, _mm_set1_ps(255)));
+   uint32_t p;
+
+   v = _mm_packs_epi32(v, v);
+   p = (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(v, v));
+   if (rotate)
+      p = (p << 8) | (p >> 24);
+   return p;
+}
+
+
+static INLINE _AL_TARGET_SSE2 __m128 blend_factor_sse2(const BLEND_FACTOR *f,
+   __m128 s, __m128 d, __m128 sa)
+{
+   __m128 x = _mm_add_ps(_mm_loadu_ps(f->k), _mm_mul_ps(_mm_loadu_ps(f->ks), s));
+   x = _mm_add_ps(x, _mm_mul_ps(_mm_loadu_ps(f->kd), d));
+   return _mm_add_ps(x, _mm_mul_ps(_mm_loadu_ps(f->ka), sa));
+}
+
+
+/* The blend kernels below blend the tinted source pixel s onto the
+ * destination pixel d.
+ */
+
+/* ALLEGRO_ADD with any factors. */
+static INLINE _AL_TARGET_SSE2 __m128 blend_add_sse2(const BLEND_PARAMS *bp,
+   __m128 s, __m128 d)
+{
+   __m128 sa = _mm_shuffle_ps(s, s, _MM_SHUFFLE(3, 3, 3, 3));
+   __m128 fs = blend_factor_sse2(&bp->src, s, d, sa);
+   __m128 fd = blend_factor_sse2(&bp->dst, s, d, sa);
+
+   s = _mm_add_ps(_mm_mul_ps(s, fs), _mm_mul_ps(d, fd));
+   return _mm_min_ps(_mm_set1_ps(1), s);
+}
+
+
+/* ALLEGRO_SRC_MINUS_DEST with any factors. */
+static INLINE _AL_TARGET_SSE2 __m128 blend_src_minus_dest_sse2(
+   const BLEND_PARAMS *bp, __m128 s, __m128 d)
+{
+   __m128 sa = _mm_shuffle_ps(s, s, _MM_SHUFFLE(3, 3, 3, 3));
+   __m128 fs = blend_factor_sse2(&bp->src, s, d, sa);
+   __m128 fd = blend_factor_sse2(&bp->dst, s, d, sa);
+
+   s = _mm_sub_ps(_mm_mul_ps(s, fs), _mm_mul_ps(d, fd));
+   return _mm_max_ps(_mm_setzero_ps(), s);
+}
+
+
+/* ALLEGRO_DEST_MINUS_SRC with any factors. */
+static INLINE _AL_TARGET_SSE2 __m128 blend_dest_minus_src_sse2(
+   const BLEND_PARAMS *bp, __m128 s, __m128 d)
+{
+   __m128 sa = _mm_shuffle_ps(s, s, _MM_SHUFFLE(3, 3, 3, 3));
+   __m128 fs = blend_factor_sse2(&bp->src, s, d, sa);
+   __m128 fd = blend_factor_sse2(&bp->dst, s, d, sa);
+
+   s = _mm_sub_ps(_mm_mul_ps(d, fd), _mm_mul_ps(s, fs));
+   return _mm_max_ps(_mm_setzero_ps(), s);
+}
+
+
+/* ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_INVERSE_ALPHA */
+static INLINE _AL_TARGET_SSE2 __m128 blend_premultiplied_sse2(
+   const BLEND_PARAMS *bp, __m128 s, __m128 d)
+{
+   const __m128 one = _mm_set1_ps(1);
+   __m128 sa = _mm_shuffle_ps(s, s, _MM_SHUFFLE(3, 3, 3, 3));
+   (void)bp;
+
+   s = _mm_add_ps(s, _mm_mul_ps(d, _mm_sub_ps(one, sa)));
+   return _mm_min_ps(one, s);
+}
+
+
+/* ALLEGRO_ADD, ALLEGRO_ALPHA, ALLEGRO_INVERSE_ALPHA */
+static INLINE _AL_TARGET_SSE2 __m128 blend_alpha_sse2(const BLEND_PARAMS *bp,
+   __m128 s, __m128 d)
+{
+   const __m128 one = _mm_set1_ps(1);
+   __m128 sa = _mm_shuffle_ps(s, s, _MM_SHUFFLE(3, 3, 3, 3));
+   (void)bp;
+
+   s = _mm_add_ps(_mm_mul_ps(s, sa), _mm_mul_ps(d, _mm_sub_ps(one, sa)));
+   return _mm_min_ps(one, s);
+}
+
+
+/* Defines the blend_row and store_row functions of a kernel. */
+#define DEFINE_BLEND_ROWS_SSE2(kernel)                                        \
+static _AL_TARGET_SSE2 void blend_row_##kernel##_sse2(                        \
+   const BLEND_PARAMS *bp, const uint32_t *src, uint32_t *dst, int n)        \
+{                                                                             \
+   const __m128 tint = _mm_loadu_ps(bp->tint);                                \
+   const bool rotate = bp->rotate;                                            \
+   int i;                                                                     \
+                                                                              \
+   for (i = 0; i < n; i++) {                                                  \
+      __m128 s = _mm_mul_ps(blend_load_sse2(src[i], rotate), tint);           \
+      __m128 d = blend_load_sse2(dst[i], rotate);                             \
+      dst[i] = blend_store_sse2(blend_##kernel##_sse2(bp, s, d), rotate);     \
+   }                                                                          \
+}                                                                             \
+                                                                              \
+static _AL_TARGET_SSE2 void store_row_##kernel##_sse2(                        \
+   const BLEND_PARAMS *bp, const ALLEGRO_COLOR *src, uint32_t *dst, int n)   \
+{                                                                             \
+   const bool rotate = bp->rotate;                                            \
+   int i;                                                                     \
+                                                                              \
+   for (i = 0; i < n; i++) {                                                  \
+      __m128 s = _mm_loadu_ps((const float *)(src + i));                      \
+      __m128 d = blend_load_sse2(dst[i], rotate);                             \
+      dst[i] = blend_store_rounded_sse2(blend_##kernel##_sse2(bp, s, d),      \
+         rotate);                                                             \
+   }                                                                          \
+}
+
+DEFINE_BLEND_ROWS_SSE2(add)
+DEFINE_BLEND_ROWS_SSE2(src_minus_dest)
+DEFINE_BLEND_ROWS_SSE2(dest_minus_src)
+DEFINE_BLEND_ROWS_SSE2(premultiplied)
+DEFINE_BLEND_ROWS_SSE2(alpha)
+
+#undef DEFINE_BLEND_ROWS_SSE2
+
+
+static bool color_is_normalized(const ALLEGRO_COLOR *c)
+{
+   return c->r >= 0 && c->r <= 1 && c->g >= 0 && c->g <= 1 &&
+      c->b >= 0 && c->b <= 1 && c->a >= 0 && c->a <= 1;
+}
+
+
+/* Fills in the parameters for blending src onto the target, or returns
+ * false if we can't handle that combination here.
+ */
+static bool get_blend_params(ALLEGRO_BITMAP *src, ALLEGRO_BITMAP *dest,
+   ALLEGRO_COLOR tint, BLEND_PARAMS *bp)
+{
+   int op, src_mode, dst_mode;
+   int op_alpha, src_alpha, dst_alpha;
+   ALLEGRO_COLOR bc = al_get_blend_color();
+   int format = al_get_bitmap_format(src);
+   int r, g, b;
+
+   if (!(_al_get_cpu_features() & _AL_CPU_SSE2))
+      return false;
+
+   if (format != al_get_bitmap_format(dest) ||
+         !blend_lanes(format, &r, &g, &b, &bp->rotate))
+      return false;
+
+   al_get_separate_bitmap_blender(&op,
+      &src_mode, &dst_mode, &op_alpha, &src_alpha, &dst_alpha);
+   if (op != op_alpha)
+      return false;
+
+   /* Keeps every result within [0, 1] so packing can't saturate. */
+   if (!color_is_normalized(&tint) || !color_is_normalized(&bc))
+      return false;
+
+   bp->tint[r] = tint.r;
+   bp->tint[g] = tint.g;
+   bp->tint[b] = tint.b;
+   bp->tint[3] = tint.a;
+
+   if (op == ALLEGRO_ADD && src_mode == src_alpha &&
+         dst_mode == dst_alpha && dst_mode == ALLEGRO_INVERSE_ALPHA) {
+      if (src_mode == ALLEGRO_ONE) {
+         bp->blend_row = blend_row_premultiplied_sse2;
+         bp->store_row = store_row_premultiplied_sse2;
+         return true;
+      }
+      if (src_mode == ALLEGRO_ALPHA) {
+         bp->blend_row = blend_row_alpha_sse2;
+         bp->store_row = store_row_alpha_sse2;
+         return true;
+      }
+   }
+
+   switch (op) {
+      case ALLEGRO_ADD:
+         bp->blend_row = blend_row_add_sse2;
+         bp->store_row = store_row_add_sse2;
+         break;
+      case ALLEGRO_SRC_MINUS_DEST:
+         bp->blend_row = blend_row_src_minus_dest_sse2;
+         bp->store_row = store_row_src_minus_dest_sse2;
+         break;
+      case ALLEGRO_DEST_MINUS_SRC:
+         bp->blend_row = blend_row_dest_minus_src_sse2;
+         bp->store_row = store_row_dest_minus_src_sse2;
+         break;
+      default:
+         return false;
+   }
+   set_blend_factor(&bp->src, r, src_mode, bc.r);
+   set_blend_factor(&bp->src, g, src_mode, bc.g);
+   set_blend_factor(&bp->src, b, src_mode, bc.b);
+   set_blend_factor(&bp->src, 3, src_alpha, bc.a);
+   set_blend_factor(&bp->dst, r, dst_mode, bc.r);
+   set_blend_factor(&bp->dst, g, dst_mode, bc.g);
+   set_blend_factor(&bp->dst, b, dst_mode, bc.b);
+   set_blend_factor(&bp->dst, 3, dst_alpha, bc.a);
+
+   return true;
+}
+
+
+static void blend_bitmap_region(ALLEGRO_BITMAP *src, const BLEND_PARAMS *bp,
+   int sx, int sy, int sw, int sh, int dx, int dy)
+{
+   ALLEGRO_LOCKED_REGION src_region;
+   ALLEGRO_LOCKED_REGION *dst_region;
+   ALLEGRO_BITMAP *dest = al_get_target_bitmap();
+   bool unlock_src;
+   int dw = sw, dh = sh;
+   int y;
+
+   CLIPPER(src, sx, sy, sw, sh, dest, dx, dy, dw, dh, 1, 1, 0)
+
+   if (!lock_source_region(src, sx, sy, sw, sh, &src_region, &unlock_src)) {
+      return;
+   }
+
+   if (!(dst_region = al_lock_bitmap_region(dest, dx, dy, sw, sh,
+         ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_READWRITE))) {
+      if (unlock_src)
+         al_unlock_bitmap(src);
+      return;
+   }
+
+   for (y = 0; y < sh; y++) {
+      bp->blend_row(bp,
+         (const uint32_t *)((char *)src_region.data + y * src_region.pitch),
+         (uint32_t *)((char *)dst_region->data + y * dst_region->pitch), sw);
+   }
+
+   if (unlock_src)
+      al_unlock_bitmap(src);
+   al_unlock_bitmap(dest);
+}
+
+#endif /* _AL_SIMD_SSE2 */
+
+
+/* Returns false if the blit must go through the general path instead. */
+static bool _al_draw_bitmap_region_memory_blend(ALLEGRO_BITMAP *src,
+   ALLEGRO_COLOR tint,
+   int sx, int sy, int sw, int sh,
+   int dx, int dy, int flags)
+{
+#ifdef _AL_SIMD_SSE2
+   ALLEGRO_BITMAP *dest = al_get_target_bitmap();
+   ALLEGRO_BITMAP *dest_root = dest->parent ? dest->parent : dest;
+   BLEND_PARAMS bp;
+
+   ASSERT(src->parent == NULL);
+
+   /* Flipping is done with the transformation by the callers, and
+    * drawing into a locked bitmap needs the care taken by the general
+    * path.
+    */
+   if (flags != 0 || src == dest_root || al_is_bitmap_locked(dest_root) ||
+         (al_is_bitmap_locked(src) && !source_lock_is_usable(src)))
+      return false;
+
+   if (!get_blend_params(src, dest_root, tint, &bp))
+      return false;
+
+   if (!hold_bitmap_region(HELD_BLEND, src, tint, sx, sy, sw, sh, dx, dy))
+      blend_bitmap_region(src, &bp, sx, sy, sw, sh, dx, dy);
+   return true;
+#else
+   (void)src;
+   (void)tint;
+   (void)sx;
+   (void)sy;
+   (void)sw;
+   (void)sh;
+   (void)dx;
+   (void)dy;
+   (void)flags;
+   return false;
+#endif
+}
+
+
+
+/* Filtered scaled blits.
+ *
+ * The general path samples the nearest texel for each pixel, whatever
+ * the ALLEGRO_MIN_LINEAR and ALLEGRO_MAG_LINEAR flags of the source say.
+ * When such a bitmap is drawn scaled, but neither rotated nor sheared, we
+ * resample it with a separable filter instead: a destination pixel
+ * averages the source area it covers along an axis which is shrunk, and
+ * interpolates linearly between the two nearest texels along an axis
+ * which is enlarged. Source rows are converted to floats and filtered
+ * horizontally only once, into a small ring of rows which the vertical
+ * filter then combines for each destination row.
+ *
+ * Between 8888 bitmaps which the SSE2 blitter above can blend, the rows
+ * hold its pixel vectors instead of colours, and are blended by it.
+ */
+
+/* The source texels contributing to each pixel of a destination span. */
+typedef struct FILTER_TAPS {
+   int max_taps;
+   int *first;       /* first texel of each pixel */
+   int *count;       /* number of texels of each pixel */
+   float *weights;   /* max_taps weights per pixel */
+} FILTER_TAPS;
+
+
+/* Returns the scaling and translation of the transformation, or false if
+ * it does more than that.
+ */
+static bool transform_is_scale(const ALLEGRO_TRANSFORM *trans,
+   float *xscale, float *yscale, float *dx, float *dy)
+{
+   if (trans->m[1][0] == 0 &&
+          trans->m[2][0] == 0 &&
+          trans->m[0][1] == 0 &&
+          trans->m[2][1] == 0 &&
+          trans->m[0][2] == 0 &&
+          trans->m[1][2] == 0 &&
+          trans->m[2][2] == 1 &&
+          trans->m[3][2] == 0 &&
+          trans->m[0][3] == 0 &&
+          trans->m[1][3] == 0 &&
+          trans->m[2][3] == 0 &&
+          trans->m[3][3] == 1 &&
+          trans->m[0][0] != 0 &&
+          trans->m[1][1] != 0) {
+      *xscale = trans->m[0][0];
+      *yscale = trans->m[1][1];
+      *dx = trans->m[3][0];
+      *dy = trans->m[3][1];
+      return true;
+   }
+   return false;
+}
+
+
+/* Sets up the taps of the n pixels starting at destination coordinate d,
+ * for a span of size texels which starts at destination coordinate
+ * origin and is scaled by scale, which may be negative.
+ */
+static bool init_filter_taps(FILTER_TAPS *taps, int n, int d,
+   float origin, float scale, int size)
+{
+   const bool box = fabsf(scale) <= 1;
+   int i, k;
+
+   if (box)
+      taps->max_taps = MIN(size, (int)ceilf(1 / fabsf(scale)) + 2);
+   else
+      taps->max_taps = MIN(size, 2);
+
+   taps->first = al_malloc(n * (2 * sizeof(int) +
+      taps->max_taps * sizeof(float)));
+   if (!taps->first)
+      return false;
+   taps->count = taps->first + n;
+   taps->weights = (float *)(taps->count + n);
+
+   for (i = 0; i < n; i++) {
+      float *w = taps->weights + i * taps->max_taps;
+      float c = (d + i + 0.5f - origin) / scale;
+      int first, count;
+
+      if (box) {
+         /* Texels are weighted by how much of them the pixel covers. */
+         float a = (d + i - origin) / scale;
+         float b = (d + i + 1 - origin) / scale;
+         if (a > b) {
+            float t = a;
+            a = b;
+            b = t;
+         }
+         a = MAX(a, 0.0f);
+         b = MIN(b, (float)size);
+         first = (int)floorf(a);
+         count = MIN((int)ceilf(b) - first, taps->max_taps);
+         if (b > a && count > 0) {
+            for (k = 0; k < count; k++) {
+               w[k] = (MIN(b, (float)(first + k + 1)) -
+                  MAX(a, (float)(first + k))) / (b - a);
+            }
+         }
+         else {
+            first = (int)floorf(c);
+            count = 1;
+            w[0] = 1;
+         }
+      }
+      else {
+         /* Texel centres are at half coordinates. */
+         float f;
+         c -= 0.5f;
+         first = (int)floorf(c);
+         f = c - first;
+         if (first < 0 || first >= size - 1) {
+            count = 1;
+            w[0] = 1;
+         }
+         else {
+            count = 2;
+            w[0] = 1 - f;
+            w[1] = f;
+         }
+      }
+
+      /* Make the weights add up to exactly 1, or flat areas come out a
+       * level darker and opaque ones translucent.
+       */
+      if (count > 1) {
+         float sum = 0;
+         for (k = 0; k < count - 1; k++)
+            sum += w[k];
+         w[count - 1] = 1 - sum;
+      }
+
+      taps->first[i] = MAX(0, MIN(first, size - count));
+      taps->count[i] = count;
+   }
+
+   return true;
+}
+
+
+/* Returns the range of texels used by the first n pixels. */
+static void get_filter_span(const FILTER_TAPS *taps, int n, int *lo, int *hi)
+{
+   int i;
+
+   *lo = taps->first[0];
+   *hi = taps->first[0] + taps->count[0];
+   for (i = 1; i < n; i++) {
+      *lo = MIN(*lo, taps->first[i]);
+      *hi = MAX(*hi, taps->first[i] + taps->count[i]);
+   }
+}
+
+
+static void load_row(int format, int pixel_size, char *data,
+   ALLEGRO_COLOR *dst, int n)
+{
+   int i;
+
+   for (i = 0; i < n; i++) {
+      _AL_INLINE_GET_PIXEL(format, data, dst[i], false);
+      data += pixel_size;
+   }
+}
+
+
+static void filter_row(const FILTER_TAPS *taps, const ALLEGRO_COLOR *src,
+   ALLEGRO_COLOR *dst, int n)
+{
+   int i, k;
+
+   for (i = 0; i < n; i++) {
+      const ALLEGRO_COLOR *s = src + taps->first[i];
+      const float *w = taps->weights + i * taps->max_taps;
+      ALLEGRO_COLOR c = {0, 0, 0, 0};
+
+      for (k = 0; k < taps->count[i]; k++) {
+         c.r += s[k].r * w[k];
+         c.g += s[k].g * w[k];
+         c.b += s[k].b * w[k];
+         c.a += s[k].a * w[k];
+      }
+      dst[i] = c;
+   }
+}
+
+
+static void combine_rows(ALLEGRO_COLOR **rows, const float *w, int count,
+   const float *tint, ALLEGRO_COLOR *dst, int n)
+{
+   int i, k;
+
+   for (i = 0; i < n; i++) {
+      ALLEGRO_COLOR c = {0, 0, 0, 0};
+
+      for (k = 0; k < count; k++) {
+         c.r += rows[k][i].r * w[k];
+         c.g += rows[k][i].g * w[k];
+         c.b += rows[k][i].b * w[k];
+         c.a += rows[k][i].a * w[k];
+      }
+      dst[i].r = c.r * tint[0];
+      dst[i].g = c.g * tint[1];
+      dst[i].b = c.b * tint[2];
+      dst[i].a = c.a * tint[3];
+   }
+}
+
+
+/* Stores the pixels, rounding the colours to the nearest 8-bit level
+ * before the pixel format truncates them. The filtered colour of a flat
+ * area is only within a rounding error of its texels, which truncating
+ * alone would turn into a whole level.
+ */
+static void store_row(int format, int pixel_size, const ALLEGRO_COLOR *src,
+   char *data, int n, bool copy)
+{
+   const ALLEGRO_BLENDER *blender = _al_get_bitmap_blender();
+   ALLEGRO_COLOR constcol = al_get_blend_color();
+   const float half =
+      (format == ALLEGRO_PIXEL_FORMAT_ABGR_F32) ? 0 : 0.5f / 255;
+   int i;
+
+   for (i = 0; i < n; i++) {
+      ALLEGRO_COLOR result;
+
+      if (copy) {
+         result = src[i];
+      }
+      else {
+         ALLEGRO_COLOR dcol;
+         _AL_INLINE_GET_PIXEL(format, data, dcol, false);
+         blender->blend_func(&src[i], &dcol, &constcol, blender, &result);
+      }
+      result.r = MIN(result.r + half, 1.0f);
+      result.g = MIN(result.g + half, 1.0f);
+      result.b = MIN(result.b + half, 1.0f);
+      result.a = MIN(result.a + half, 1.0f);
+      _AL_INLINE_PUT_PIXEL(format, data, result, false);
+      data += pixel_size;
+   }
+}
+
+
+#ifdef _AL_SIMD_SSE2
+
+/* The same as above with one vector per pixel. The texels are loaded
+ * without scaling them down to [0, 1], which is left to the tint.
+ */
+static _AL_TARGET_SSE2 void load_row_sse2(const uint32_t *src,
+   ALLEGRO_COLOR *dst, int n, bool rotate)
+{
+   const __m128i zero = _mm_setzero_si128();
+   int i;
+
+   for (i = 0; i < n; i++) {
+      uint32_t p = src[i];
+      __m128i v;
+      if (rotate)
+         p = (p >> 8) | (p << 24);
+      v = _mm_cvtsi32_si128((int)p);
+      v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(v, zero), zero);
+      _mm_storeu_ps((float *)(dst + i), _mm_cvtepi32_ps(v));
+   }
+}
+
+
+static _AL_TARGET_SSE2 void filter_row_sse2(const FILTER_TAPS *taps,
+   const ALLEGRO_COLOR *src, ALLEGRO_COLOR *dst, int n)
+{
+   int i, k;
+
+   for (i = 0; i < n; i++) {
+      const float *s = (const float *)(src + taps->first[i]);
+      const float *w = taps->weights + i * taps->max_taps;
+      __m128 c = _mm_setzero_ps();
+
+      for (k = 0; k < taps->count[i]; k++) {
+         c = _mm_add_ps(c, _mm_mul_ps(_mm_loadu_ps(s + 4 * k),
+            _mm_set1_ps(w[k])));
+      }
+      _mm_storeu_ps((float *)(dst + i), c);
+   }
+}
+
+
+static _AL_TARGET_SSE2 void combine_rows_sse2(ALLEGRO_COLOR **rows,
+   const float *w, int count, const float *tint, ALLEGRO_COLOR *dst, int n)
+{
+   const __m128 t = _mm_loadu_ps(tint);
+   int i, k;
+
+   for (i = 0; i < n; i++) {
+      __m128 c = _mm_setzero_ps();
+
+      for (k = 0; k < count; k++) {
+         c = _mm_add_ps(c, _mm_mul_ps(_mm_loadu_ps((float *)(rows[k] + i)),
+            _mm_set1_ps(w[k])));
+      }
+      _mm_storeu_ps((float *)(dst + i), _mm_mul_ps(c, t));
+   }
+}
+
+
+static _AL_TARGET_SSE2 void store_row_sse2(const BLEND_PARAMS *bp,
+   const ALLEGRO_COLOR *src, uint32_t *dst, int n, bool copy)
+{
+   int i;
+
+   if (!copy) {
+      bp->store_row(bp, src, dst, n);
+      return;
+   }
+
+   for (i = 0; i < n; i++) {
+      __m128 s = _mm_loadu_ps((const float *)(src + i));
+      dst[i] = blend_store_rounded_sse2(s, bp->rotate);
+   }
+}
+
+#endif /* _AL_SIMD_SSE2 */
+
+
+/* Returns false if the blit must go through the general path instead. */
+static bool _al_draw_scaled_bitmap_memory_filtered(ALLEGRO_BITMAP *src,
+   ALLEGRO_COLOR tint, int sx, int sy, int sw, int sh, int dx, int dy)
+{
+   ALLEGRO_BITMAP *dest = al_get_target_bitmap();
+   ALLEGRO_BITMAP *dest_root = dest->parent ? dest->parent : dest;
+   const int src_flags = al_get_bitmap_flags(src);
+   int op, src_mode, dst_mode;
+   int op_alpha, src_alpha, dst_alpha;
+   float xscale, yscale, xtrans, ytrans;
+   float left, top, right, bottom;
+   int clip_x, clip_y, clip_w, clip_h;
+   int x1, y1, x2, y2, w, h;
+   int col_lo, col_hi, row_lo, row_hi;
+   FILTER_TAPS xtaps, ytaps;
+   ALLEGRO_LOCKED_REGION src_region;
+   ALLEGRO_LOCKED_REGION *dst_region;
+   ALLEGRO_COLOR *src_row, *ring, *out;
+   ALLEGRO_COLOR **row_ptrs;
+   int *ring_row;
+   float tint4[4];
+   void (*filter)(const FILTER_TAPS *, const ALLEGRO_COLOR *,
+      ALLEGRO_COLOR *, int) = filter_row;
+   void (*combine)(ALLEGRO_COLOR **, const float *, int, const float *,
+      ALLEGRO_COLOR *, int) = combine_rows;
+   bool copy, unlock_src;
+   int y, k;
+#ifdef _AL_SIMD_SSE2
+   BLEND_PARAMS bp;
+   bool lanes = false;
+#endif
+
+   ASSERT(src->parent == NULL);
+
+   if (!(src_flags & (ALLEGRO_MIN_LINEAR | ALLEGRO_MAG_LINEAR)) ||
+         !transform_is_scale(al_get_current_transform(),
+            &xscale, &yscale, &xtrans, &ytrans))
+      return false;
+
+   /* An axis which is neither shrunk nor enlarged needs no filter, so
+    * without any such axis the general path gives the same result.
+    */
+   if (fabsf(xscale) == 1 && fabsf(yscale) == 1)
+      return false;
+   if ((fabsf(xscale) < 1 || fabsf(yscale) < 1) &&
+         !(src_flags & ALLEGRO_MIN_LINEAR))
+      return false;
+   if ((fabsf(xscale) > 1 || fabsf(yscale) > 1) &&
+         !(src_flags & ALLEGRO_MAG_LINEAR))
+      return false;
+
+   if (src == dest_root || al_is_bitmap_locked(dest_root) ||
+         (al_is_bitmap_locked(src) && !source_lock_is_usable(src)) ||
+         _al_pixel_format_is_compressed(al_get_bitmap_format(src)) ||
+         _al_pixel_format_is_compressed(al_get_bitmap_format(dest)))
+      return false;
+
+   /* The pixels whose centres lie inside the drawn rectangle. */
+   left = xscale * dx + xtrans;
+   top = yscale * dy + ytrans;
+   right = left + xscale * sw;
+   bottom = top + yscale * sh;
+   al_get_clipping_rectangle(&clip_x, &clip_y, &clip_w, &clip_h);
+   x1 = MAX((int)ceilf(MIN(left, right) - 0.5f), clip_x);
+   x2 = MIN((int)ceilf(MAX(left, right) - 0.5f), clip_x + clip_w);
+   y1 = MAX((int)ceilf(MIN(top, bottom) - 0.5f), clip_y);
+   y2 = MIN((int)ceilf(MAX(top, bottom) - 0.5f), clip_y + clip_h);
+   if (dest->parent) {
+      /* Sub-bitmaps may reach outside their parent. */
+      x1 = MAX(x1, -dest->xofs);
+      x2 = MIN(x2, dest_root->w - dest->xofs);
+      y1 = MAX(y1, -dest->yofs);
+      y2 = MIN(y2, dest_root->h - dest->yofs);
+   }
+   if (x1 >= x2 || y1 >= y2)
+      return true;
+   w = x2 - x1;
+   h = y2 - y1;
+
+   if (!init_filter_taps(&xtaps, w, x1, left, xscale, sw))
+      return false;
+   if (!init_filter_taps(&ytaps, h, y1, top, yscale, sh)) {
+      al_free(xtaps.first);
+      return false;
+   }
+   get_filter_span(&xtaps, w, &col_lo, &col_hi);
+   get_filter_span(&ytaps, h, &row_lo, &row_hi);
+
+   src_row = al_malloc((col_hi - col_lo + (ytaps.max_taps + 1) * w) *
+      sizeof(ALLEGRO_COLOR) + ytaps.max_taps * (sizeof(int) +
+      sizeof(ALLEGRO_COLOR *)));
+   if (!src_row) {
+      al_free(xtaps.first);
+      al_free(ytaps.first);
+      return false;
+   }
+   ring = src_row + (col_hi - col_lo);
+   out = ring + ytaps.max_taps * w;
+   row_ptrs = (ALLEGRO_COLOR **)(out + w);
+   ring_row = (int *)(row_ptrs + ytaps.max_taps);
+   for (k = 0; k < ytaps.max_taps; k++)
+      ring_row[k] = -1;
+
+   /* The taps address texels from the first one locked. */
+   for (k = 0; k < w; k++)
+      xtaps.first[k] -= col_lo;
+
+   al_get_separate_bitmap_blender(&op,
+      &src_mode, &dst_mode, &op_alpha, &src_alpha, &dst_alpha);
+   copy = _AL_DEST_IS_ZERO && _AL_SRC_NOT_MODIFIED &&
+      tint.r >= 0 && tint.r <= 1 && tint.g >= 0 && tint.g <= 1 &&
+      tint.b >= 0 && tint.b <= 1 && tint.a >= 0 && tint.a <= 1;
+   tint4[0] = tint.r;
+   tint4[1] = tint.g;
+   tint4[2] = tint.b;
+   tint4[3] = tint.a;
+
+#ifdef _AL_SIMD_SSE2
+   if (_al_get_cpu_features() & _AL_CPU_SSE2) {
+      filter = filter_row_sse2;
+      combine = combine_rows_sse2;
+      if (get_blend_params(src, dest_root, tint, &bp)) {
+         lanes = true;
+         for (k = 0; k < 4; k++)
+            tint4[k] = bp.tint[k] / 255;
+      }
+   }
+#endif
+
+   if (!lock_source_region(src, sx + col_lo, sy + row_lo, col_hi - col_lo,
+         row_hi - row_lo, &src_region, &unlock_src))
+      goto done;
+
+   if (!(dst_region = al_lock_bitmap_region(dest, x1, y1, w, h,
+         ALLEGRO_PIXEL_FORMAT_ANY,
+         copy ? ALLEGRO_LOCK_WRITEONLY : ALLEGRO_LOCK_READWRITE))) {
+      if (unlock_src)
+         al_unlock_bitmap(src);
+      goto done;
+   }
+
+   for (y = 0; y < h; y++) {
+      char *data = (char *)dst_region->data + y * dst_region->pitch;
+
+      for (k = 0; k < ytaps.count[y]; k++) {
+         const int r = ytaps.first[y] + k;
+         const int slot = r % ytaps.max_taps;
+         ALLEGRO_COLOR *row = ring + slot * w;
+
+         if (ring_row[slot] != r) {
+            char *texel = (char *)src_region.data +
+               (r - row_lo) * src_region.pitch;
+#ifdef _AL_SIMD_SSE2
+            if (lanes)
+               load_row_sse2((uint32_t *)texel, src_row, col_hi - col_lo,
+                  bp.rotate);
+            else
+#endif
+               load_row(src_region.format, src_region.pixel_size, texel,
+                  src_row, col_hi - col_lo);
+            filter(&xtaps, src_row, row, w);
+            ring_row[slot] = r;
+         }
+         row_ptrs[k] = row;
+      }
+
+      combine(row_ptrs, ytaps.weights + y * ytaps.max_taps, ytaps.count[y],
+         tint4, out, w);
+
+#ifdef _AL_SIMD_SSE2
+      if (lanes)
+         store_row_sse2(&bp, out, (uint32_t *)data, w, copy);
+      else
+#endif
+         store_row(dst_region->format, dst_region->pixel_size, out, data, w,
+            copy);
+   }
+
+   if (unlock_src)
+      al_unlock_bitmap(src);
    al_unlock_bitmap(dest);
+
+done:
+   al_free(src_row);
+   al_free(xtaps.first);
+   al_free(ytaps.first);
+   return true;
+}
+
+
+/* Held drawing into memory bitmaps.
+ *
+ * While drawing into a memory bitmap is held with al_hold_bitmap_drawing,
+ * blits and batches of triangles are recorded as commands on the target
+ * bitmap instead of being drawn right away. The commands are carried out
+ * in order when the drawing is released, or as soon as something locks
+ * the target or locks any bitmap for writing. Each source bitmap is then
+ * locked only once for a run of commands drawing from it, and consecutive
+ * triangle batches with the same texture, such as the glyphs of a
+ * transformed text, are rasterised together.
+ *
+ * Like with the display drivers, the blender and the clipping rectangle
+ * must not be changed while drawing is held. The transformation may be,
+ * as the commands are recorded with it already applied.
+ */
+
+/* Held drawing is carried out early once this much has been recorded. */
+#define MAX_HELD_COMMANDS  4096
+#define MAX_HELD_VERTICES  (3 * 16384)
+
+typedef struct HELD_COMMAND {
+   int kind;
+   ALLEGRO_BITMAP *bitmap;    /* source or texture, may be NULL */
+   ALLEGRO_COLOR tint;
+   int sx, sy, sw, sh, dx, dy;
+   int first_vertex;
+   int num_vertices;
+} HELD_COMMAND;
+
+struct _AL_HELD_DRAWING {
+   bool held;
+   bool running;
+   HELD_COMMAND *commands;
+   int num_commands;
+   int commands_size;
+   ALLEGRO_VERTEX *vertices;
+   int num_vertices;
+   int vertices_size;
+};
+
+
+static void run_held_drawing(_AL_HELD_DRAWING *held)
+{
+   ALLEGRO_BITMAP *locked = NULL;
+   int i;
+
+   held->running = true;
+
+   for (i = 0; i < held->num_commands; i++) {
+      HELD_COMMAND *cmd = &held->commands[i];
+
+      if (cmd->bitmap != locked) {
+         if (locked)
+            al_unlock_bitmap(locked);
+         locked = NULL;
+         if (cmd->bitmap && al_lock_bitmap(cmd->bitmap,
+               ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_READONLY))
+            locked = cmd->bitmap;
+      }
+
+      switch (cmd->kind) {
+         case HELD_TRIANGLES:
+            _al_triangles_2d(cmd->bitmap, held->vertices + cmd->first_vertex,
+               cmd->num_vertices / 3);
+            break;
+         case HELD_COPY:
+            _al_draw_bitmap_region_memory_fast(cmd->bitmap,
+               cmd->sx, cmd->sy, cmd->sw, cmd->sh, cmd->dx, cmd->dy, 0);
+            break;
+         case HELD_BLEND:
+            _al_draw_bitmap_region_memory_blend(cmd->bitmap, cmd->tint,
+               cmd->sx, cmd->sy, cmd->sw, cmd->sh, cmd->dx, cmd->dy, 0);
+            break;
+      }
+   }
+
+   if (locked)
+      al_unlock_bitmap(locked);
+
+   held->num_commands = 0;
+   held->num_vertices = 0;
+   held->running = false;
+}
+
+
+/* Returns the held drawing of the target if drawing from the given bitmap
+ * can be recorded. Otherwise carries out anything recorded so far, so
+ * that it is drawn before what the caller is going to draw.
+ */
+static _AL_HELD_DRAWING *get_held_drawing(ALLEGRO_BITMAP *bitmap,
+   bool may_be_locked)
+{
+   ALLEGRO_BITMAP *target = al_get_target_bitmap();
+   _AL_HELD_DRAWING *held = target ? target->held_drawing : NULL;
+   ALLEGRO_BITMAP *root;
+
+   if (!held || held->running)
+      return NULL;
+
+   root = target->parent ? target->parent : target;
+   if (held->held && !al_is_bitmap_locked(root) &&
+         (!bitmap || ((bitmap->parent ? bitmap->parent : bitmap) != root &&
+            (may_be_locked || !al_is_bitmap_locked(bitmap)))))
+      return held;
+
+   if (held->num_commands > 0)
+      run_held_drawing(held);
+   return NULL;
+}
+
+
+static HELD_COMMAND *add_held_command(_AL_HELD_DRAWING *held)
+{
+   if (held->num_commands == held->commands_size) {
+      int size = held->commands_size ? 2 * held->commands_size : 64;
+      HELD_COMMAND *commands = al_realloc(held->commands,
+         size * sizeof(HELD_COMMAND));
+      if (!commands)
+         return NULL;
+      held->commands = commands;
+      held->commands_size = size;
+   }
+   return &held->commands[held->num_commands++];
+}
+
+
+static ALLEGRO_VERTEX *add_held_vertices(_AL_HELD_DRAWING *held, int num)
+{
+   if (held->num_vertices + num > held->vertices_size) {
+      int size = 2 * (held->num_vertices + num);
+      ALLEGRO_VERTEX *vertices = al_realloc(held->vertices,
+         size * sizeof(ALLEGRO_VERTEX));
+      if (!vertices)
+         return NULL;
+      held->vertices = vertices;
+      held->vertices_size = size;
+   }
+   held->num_vertices += num;
+   return held->vertices + held->num_vertices - num;
+}
+
+
+/* Returns true if the blit was recorded to be done later. */
+static bool hold_bitmap_region(int kind, ALLEGRO_BITMAP *src,
+   ALLEGRO_COLOR tint, int sx, int sy, int sw, int sh, int dx, int dy)
+{
+   _AL_HELD_DRAWING *held = get_held_drawing(src, false);
+   HELD_COMMAND *cmd;
+
+   if (!held)
+      return false;
+
+   if (held->num_commands >= MAX_HELD_COMMANDS)
+      run_held_drawing(held);
+
+   if (!(cmd = add_held_command(held))) {
+      run_held_drawing(held);
+      return false;
+   }
+
+   cmd->kind = kind;
+   cmd->bitmap = src;
+   cmd->tint = tint;
+   cmd->sx = sx;
+   cmd->sy = sy;
+   cmd->sw = sw;
+   cmd->sh = sh;
+   cmd->dx = dx;
+   cmd->dy = dy;
+   cmd->first_vertex = 0;
+   cmd->num_vertices = 0;
+   return true;
+}
+
+
+/* Records a batch of triangles for _al_triangles_2d if drawing is held.
+ * The texture is locked by the caller, as it is when drawing right away.
+ */
+bool _al_hold_triangles_memory(ALLEGRO_BITMAP *texture, ALLEGRO_VERTEX *vtx,
+   int num_triangles)
+{
+   _AL_HELD_DRAWING *held = get_held_drawing(texture, true);
+   HELD_COMMAND *cmd;
+   ALLEGRO_VERTEX *dst;
+   int num = num_triangles * 3;
+
+   if (!held)
+      return false;
+
+   if (held->num_commands >= MAX_HELD_COMMANDS ||
+         held->num_vertices + num > MAX_HELD_VERTICES)
+      run_held_drawing(held);
+
+   if (!(dst = add_held_vertices(held, num))) {
+      run_held_drawing(held);
+      return false;
+   }
+   memcpy(dst, vtx, num * sizeof(ALLEGRO_VERTEX));
+
+   /* Only triangle commands add vertices, so the vertices of the last
+    * command end where the new ones start.
+    */
+   cmd = held->num_commands > 0 ? &held->commands[held->num_commands - 1] : NULL;
+   if (cmd && cmd->kind == HELD_TRIANGLES && cmd->bitmap == texture) {
+      cmd->num_vertices += num;
+      return true;
+   }
+
+   if (!(cmd = add_held_command(held))) {
+      held->num_vertices -= num;
+      run_held_drawing(held);
+      return false;
+   }
+
+   cmd->kind = HELD_TRIANGLES;
+   cmd->bitmap = texture;
+   cmd->first_vertex = held->num_vertices - num;
+   cmd->num_vertices = num;
+   return true;
+}
+
+
+void _al_hold_memory_bitmap_drawing(ALLEGRO_BITMAP *target, bool hold)
+{
+   _AL_HELD_DRAWING *held = target->held_drawing;
+
+   if (hold) {
+      if (!held) {
+         if (!(held = al_calloc(1, sizeof *held)))
+            return;
+         target->held_drawing = held;
+      }
+      held->held = true;
+   }
+   else if (held) {
+      held->held = false;
+      if (!held->running)
+         run_held_drawing(held);
+   }
+}
+
+
+bool _al_is_memory_bitmap_drawing_held(ALLEGRO_BITMAP *target)
+{
+   return target->held_drawing && target->held_drawing->held;
+}
+
+
+/* Carries out the drawing held for the target of the calling thread
+ * before the given bitmap is locked with the given flags, if that lock
+ * may see the target or change a bitmap drawn from.
+ */
+void _al_flush_held_memory_drawing(ALLEGRO_BITMAP *bitmap, int lock_flags)
+{
+   ALLEGRO_BITMAP *target = al_get_target_bitmap();
+   _AL_HELD_DRAWING *held = target ? target->held_drawing : NULL;
+
+   if (!held || held->running || held->num_commands == 0)
+      return;
+
+   if (lock_flags & ALLEGRO_LOCK_READONLY) {
+      ALLEGRO_BITMAP *root = target->parent ? target->parent : target;
+      if ((bitmap->parent ? bitmap->parent : bitmap) != root)
+         return;
+   }
+
+   run_held_drawing(held);
+}
+
+
+void _al_destroy_held_memory_drawing(ALLEGRO_BITMAP *bitmap)
+{
+   _AL_HELD_DRAWING *held = bitmap->held_drawing;
+
+   if (held) {
+      al_free(held->commands);
+      al_free(held->vertices);
+      al_free(held);
+      bitmap->held_drawing = NULL;
+   }
 }
 
 
@@ -16,24 +16,14 @@
  */
 
 
+#include <limits.h>
+#include <string.h>
 #include "allegro5/allegro.h"
 #include "allegro5/internal/aintern_bitmap.h"
 #include "allegro5/internal/aintern_blend.h"
 #include "allegro5/internal/aintern_memdraw.h"
 #include "allegro5/internal/aintern_pixels.h"
 
-/* generic versions of the video memory access helpers */
-/* FIXME: why do we need macros for this? */
-#define bmp_write16(addr, c)        (*((uint16_t *)(addr)) = (c))
-#define bmp_write32(addr, c)        (*((uint32_t *)(addr)) = (c))
-
-#define bmp_read16(addr)            (*((uint16_t *)(addr)))
-#define bmp_read32(addr)            (*((uint32_t *)(addr)))
-
-typedef struct {
-   float x[4];
-} float4;
-
 
 void _al_draw_pixel_memory(ALLEGRO_BITMAP *bitmap, float x, float y,
    ALLEGRO_COLOR *color)
@@ -51,12 +41,68 @@ void _al_draw_pixel_memory(ALLEGRO_BITMAP *bitmap, float x, float y,
 }
 
 
+#define FILL_CHUNK  256
+
+/* Fills one row with w copies of a pixel_size bytes long pixel value. */
+static void fill_row(uint8_t *row, const uint8_t *pixel, int pixel_size, int w)
+{
+   int size = w * pixel_size;
+   int done;
+   int x;
+
+   for (x = 1; x < pixel_size; x++) {
+      if (pixel[x] != pixel[0])
+         break;
+   }
+   if (x == pixel_size) {
+      memset(row, pixel[0], size);
+      return;
+   }
+
+   /* Double the filled start of the row until it is a few cache lines
+    * long, then copy that along the rest of the row.
+    */
+   memcpy(row, pixel, _ALLEGRO_MIN(pixel_size, size));
+   for (done = pixel_size; done < size && done < FILL_CHUNK; done *= 2)
+      memcpy(row + done, row, _ALLEGRO_MIN(done, size - done));
+   for (x = done; x < size; x += done)
+      memcpy(row + x, row, _ALLEGRO_MIN(done, size - x));
+}
+
+
+/* Fills a w by h pixel region of locked bitmap data with a raw pixel
+ * value, which is given in the same format as the data.
+ */
+void _al_fill_memory_region(void *data, int pitch, int pixel_size,
+   const void *pixel, int w, int h)
+{
+   uint8_t *line_ptr = data;
+   int y;
+
+   ASSERT(data);
+   ASSERT(pixel);
+
+   if (w <= 0 || h <= 0)
+      return;
+
+   /* Rows which are next to each other are filled as one. */
+   if (pitch == w * pixel_size && h <= INT_MAX / pitch) {
+      fill_row(line_ptr, pixel, pixel_size, w * h);
+      return;
+   }
+
+   for (y = 0; y < h; y++) {
+      fill_row(line_ptr, pixel, pixel_size, w);
+      line_ptr += pitch;
+   }
+}
+
+
 void _al_clear_bitmap_by_locking(ALLEGRO_BITMAP *bitmap, ALLEGRO_COLOR *color)
 {
    ALLEGRO_LOCKED_REGION *lr;
    int x1, y1, w, h;
-   int x, y;
-   unsigned char *line_ptr;
+   uint32_t pixel[4];
 
    /* This function is not just used on memory bitmaps, but also on OpenGL
     * video bitmaps which are not the current target, or when locked.
@@ -70,6 +116,16 @@ void _al_clear_bitmap_by_locking(ALLEGRO_BITMAP *bitmap, ALLEGRO_COLOR *color)
    w = bitmap->cr_excl - x1;
    h = bitmap->cb_excl - y1;
 
+   if (bitmap->parent) {
+      /* Sub-bitmaps may reach outside their parent. */
+      int x2 = _ALLEGRO_MIN(x1 + w, bitmap->parent->w - bitmap->xofs);
+      int y2 = _ALLEGRO_MIN(y1 + h, bitmap->parent->h - bitmap->yofs);
+      x1 = _ALLEGRO_MAX(x1, -bitmap->xofs);
+      y1 = _ALLEGRO_MAX(y1, -bitmap->yofs);
+      w = x2 - x1;
+      h = y2 - y1;
+   }
+
    if (w <= 0 || h <= 0)
       return;
 
@@ -78,83 +134,15 @@ void _al_clear_bitmap_by_locking(ALLEGRO_BITMAP *bitmap, ALLEGRO_COLOR *color)
    if (!lr)
       return;
 
+   ASSERT(lr->pixel_size <= (int)sizeof(pixel));
+
    /* Write a single pixel so we can get the raw value. */
    _al_put_pixel(bitmap, x1, y1, *color);
+   memcpy(pixel, lr->data, lr->pixel_size);
 
    /* Fill in the region. */
-   line_ptr = lr->data;
-   switch (lr->pixel_size) {
-      case 2: {
-         int pixel_value = bmp_read16(line_ptr);
-         for (y = y1; y < y1 + h; y++) {
-            if (pixel_value == 0) {    /* fast path */
-               memset(line_ptr, 0, 2 * w);
-            }
-            else {
-               uint16_t *data = (uint16_t *)line_ptr;
-               for (x = 0; x < w; x++) {
-                  bmp_write16(data, pixel_value);
-                  data++;
-               }
-            }
-            line_ptr += lr->pitch;
-         }
-         break;
-      }
-
-      case 3: {
-         int pixel_value = _AL_READ3BYTES(line_ptr);
-         for (y = y1; y < y1 + h; y++) {
-            unsigned char *data = (unsigned char *)line_ptr;
-            if (pixel_value == 0) {    /* fast path */
-               memset(data, 0, 3 * w);
-            }
-            else {
-               for (x = 0; x < w; x++) {
-                  _AL_WRITE3BYTES(data, pixel_value);
-                  data += 3;
-               }
-            }
-            line_ptr += lr->pitch;
-         }
-         break;
-      }
-
-      case 4: {
-         int pixel_value = bmp_read32(line_ptr);
-         for (y = y1; y < y1 + h; y++) {
-            uint32_t *data = (uint32_t *)line_ptr;
-            /* Special casing pixel_value == 0 doesn't seem to make any
-             * difference to speed, so don't bother.
-             */
-            for (x = 0; x < w; x++) {
-               bmp_write32(data, pixel_value);
-               data++;
-            }
-            line_ptr += lr->pitch;
-         }
-         break;
-      }
-
-      case sizeof(float4): {
-         float4 *data = (float4 *)line_ptr;
-         float4 pixel_value = *data;
-
-         for (y = y1; y < y1 + h; y++) {
-            data = (float4 *)line_ptr;
-            for (x = 0; x < w; x++) {
-               *data = pixel_value;
-               data++;
-            }
-            line_ptr += lr->pitch;
-         }
-         break;
-      }
-
-      default:
-        ASSERT(false);
-        break;
-   }
+   _al_fill_memory_region(lr->data, lr->pitch, lr->pixel_size, pixel,
+      w, h);
 
    al_unlock_bitmap(bitmap);
 }
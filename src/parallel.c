@@ -0,0 +1,206 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Worker threads for splitting up internal work.
+ *
+ *      _al_run_parallel calls a function once for each index of a job,
+ *      spreading the calls over a pool of worker threads plus the
+ *      calling thread, and returns when all of them have finished. The
+ *      pool is started by the first job and lives until Allegro is
+ *      uninstalled.
+ *
+ *      Only one job runs at a time. A job submitted while another one
+ *      is running, which includes jobs submitted from inside a job, is
+ *      simply run on the calling thread.
+ *
+ *      See LICENSE.txt for copyright information.
+ */
+
+
+#include "allegro5/allegro.h"
+#include "allegro5/internal/aintern.h"
+#include "allegro5/internal/aintern_exitfunc.h"
+#include "allegro5/internal/aintern_parallel.h"
+#include "allegro5/internal/aintern_thread.h"
+
+ALLEGRO_DEBUG_CHANNEL("parallel")
+
+
+#define MAX_WORKERS  63
+
+
+static ALLEGRO_MUTEX *pool_mutex = NULL;
+static ALLEGRO_COND *work_cond = NULL;
+static ALLEGRO_COND *done_cond = NULL;
+static _AL_THREAD *workers = NULL;
+static int num_workers = -1;  /* not started yet */
+static bool quit = false;
+static bool busy = false;
+
+/* The current job, protected by pool_mutex. */
+static void (*job_proc)(void *arg, int index);
+static void *job_arg;
+static int job_count;
+static int job_next;
+static int job_unfinished;
+
+
+
+/* Runs indices of the current job until there are none left to start.
+ * Called with pool_mutex held.
+ */
+static void run_job_indices(void)
+{
+   while (job_next < job_count) {
+      void (*proc)(void *, int) = job_proc;
+      void *arg = job_arg;
+      int index = job_next++;
+
+      al_unlock_mutex(pool_mutex);
+      proc(arg, index);
+      al_lock_mutex(pool_mutex);
+
+      if (--job_unfinished == 0)
+         al_broadcast_cond(done_cond);
+   }
+}
+
+
+
+static void worker_proc(_AL_THREAD *self, void *unused)
+{
+   (void)self;
+   (void)unused;
+
+   al_lock_mutex(pool_mutex);
+   while (!quit) {
+      run_job_indices();
+      if (!quit)
+         al_wait_cond(work_cond, pool_mutex);
+   }
+   al_unlock_mutex(pool_mutex);
+}
+
+
+
+/* Called with pool_mutex held. */
+static void start_workers(void)
+{
+   int n = al_get_cpu_count() - 1;
+   int i;
+
+   if (n > MAX_WORKERS)
+      n = MAX_WORKERS;
+   if (n > 0)
+      workers = al_calloc(n, sizeof(_AL_THREAD));
+   if (!workers)
+      n = 0;
+
+   for (i = 0; i < n; i++)
+      _al_thread_create(&workers[i], worker_proc, NULL);
+
+   num_workers = n;
+   ALLEGRO_DEBUG("Started %d worker threads.\n", n);
+}
+
+
+
+static void shutdown_parallel(void)
+{
+   int i;
+
+   al_lock_mutex(pool_mutex);
+   quit = true;
+   al_broadcast_cond(work_cond);
+   al_unlock_mutex(pool_mutex);
+
+   for (i = 0; i < num_workers; i++)
+      _al_thread_join(&workers[i]);
+
+   al_free(workers);
+   workers = NULL;
+   num_workers = -1;
+   quit = false;
+
+   al_destroy_cond(done_cond);
+   al_destroy_cond(work_cond);
+   al_destroy_mutex(pool_mutex);
+   done_cond = NULL;
+   work_cond = NULL;
+   pool_mutex = NULL;
+}
+
+
+
+void _al_init_parallel(void)
+{
+   pool_mutex = al_create_mutex();
+   work_cond = al_create_cond();
+   done_cond = al_create_cond();
+   _al_add_exit_func(shutdown_parallel, "shutdown_parallel");
+}
+
+
+
+/* Internal function: _al_get_parallel_thread_count
+ *  Returns the number of threads a job can be spread over, including the
+ *  calling thread. Callers use this to decide how finely to split up
+ *  their work.
+ */
+int _al_get_parallel_thread_count(void)
+{
+   int n = al_get_cpu_count();
+
+   if (!pool_mutex || n < 1)
+      return 1;
+   return n > MAX_WORKERS + 1 ? MAX_WORKERS + 1 : n;
+}
+
+
+
+/* Internal function: _al_run_parallel
+ *  Calls proc(arg, index) for every index in [0, count), in any order
+ *  and possibly concurrently, and returns once all calls have returned.
+ */
+void _al_run_parallel(int count, void (*proc)(void *arg, int index),
+   void *arg)
+{
+   int i;
+
+   if (count > 1 && pool_mutex) {
+      al_lock_mutex(pool_mutex);
+      if (num_workers < 0)
+         start_workers();
+      if (!busy && num_workers > 0) {
+         busy = true;
+         job_proc = proc;
+         job_arg = arg;
+         job_count = count;
+         job_next = 0;
+         job_unfinished = count;
+         al_broadcast_cond(work_cond);
+
+         run_job_indices();
+         while (job_unfinished > 0)
+            al_wait_cond(done_cond, pool_mutex);
+
+         busy = false;
+         al_unlock_mutex(pool_mutex);
+         return;
+      }
+      al_unlock_mutex(pool_mutex);
+   }
+
+   for (i = 0; i < count; i++)
+      proc(arg, i);
+}
+
+
+/* vim: set sts=3 sw=3 et: */
@@ -29,6 +29,7 @@
 #include "allegro5/internal/aintern_debug.h"
 #include "allegro5/internal/aintern_dtor.h"
 #include "allegro5/internal/aintern_exitfunc.h"
+#include "allegro5/internal/aintern_parallel.h"
 #include "allegro5/internal/aintern_pixels.h"
 #include "allegro5/internal/aintern_system.h"
 #include "allegro5/internal/aintern_thread.h"
@@ -278,12 +279,18 @@ bool al_install_system(int version, int (*atexit_ptr)(void (*)(void)))
 
    _al_init_pixels();
 
+   _al_init_convert_funcs();
+
    _al_init_iio_table();
    
    _al_init_convert_bitmap_list();
 
    _al_init_timers();
 
+   _al_init_parallel();
+
+   _al_init_convert_bands();
+
 #ifdef ALLEGRO_CFG_SHADER_GLSL
    _al_glsl_init_shaders();
 #endif
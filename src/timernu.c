@@ -34,7 +34,7 @@
 
 
 /* forward declarations */
-static void timer_handle_tick(ALLEGRO_TIMER *timer);
+static void timer_handle_tick(ALLEGRO_TIMER *timer, double lateness);
 
 
 struct ALLEGRO_TIMER
@@ -43,14 +43,26 @@ struct ALLEGRO_TIMER
    bool started;
    double speed_secs;
    int64_t count;
-   double counter;		/* counts down to zero=blastoff */
-   _AL_LIST_ITEM *dtor_item;
+   double counter;		/* time left to the next tick while stopped */
+   double deadline;		/* al_get_time() of the next tick while started */
+   unsigned int heap_index;	/* position in active_timers */
+   int64_t stats_ticks;
+   double total_lateness;
+   double min_lateness;
+   double max_lateness;
+   _AL_DTOR_ITEM *dtor_item;
 };
 
 
 
 /*
  * The timer thread that runs in the background to drive the timers.
+ *
+ * The started timers are kept in active_timers as a binary min-heap
+ * ordered by deadline, so the thread only ever looks at the timers which
+ * are due and can sleep until exactly the next deadline.  Starting,
+ * stopping or changing the speed of a timer signals timer_cond so the
+ * thread picks up the new earliest deadline.
  */
 
 static ALLEGRO_MUTEX *timers_mutex;
@@ -59,6 +71,108 @@ static _AL_THREAD * volatile timer_thread = NULL;
 static ALLEGRO_COND *timer_cond = NULL;
 static bool destroy_thread = false;
 
+/* How long _al_timer_thread_handle_tick asks to be called again after
+ * when no timer is running.
+ */
+#define IDLE_DELAY   0.032768
+
+
+
+static ALLEGRO_TIMER *heap_get(unsigned int i)
+{
+   ALLEGRO_TIMER **slot = _al_vector_ref(&active_timers, i);
+   return *slot;
+}
+
+
+
+static void heap_set(unsigned int i, ALLEGRO_TIMER *timer)
+{
+   ALLEGRO_TIMER **slot = _al_vector_ref(&active_timers, i);
+   *slot = timer;
+   timer->heap_index = i;
+}
+
+
+
+static void heap_sift_up(unsigned int i)
+{
+   ALLEGRO_TIMER *timer = heap_get(i);
+
+   while (i > 0) {
+      unsigned int parent = (i - 1) / 2;
+      ALLEGRO_TIMER *p = heap_get(parent);
+      if (p->deadline <= timer->deadline)
+         break;
+      heap_set(i, p);
+      i = parent;
+   }
+   heap_set(i, timer);
+}
+
+
+
+static void heap_sift_down(unsigned int i)
+{
+   const unsigned int size = _al_vector_size(&active_timers);
+   ALLEGRO_TIMER *timer = heap_get(i);
+
+   for (;;) {
+      unsigned int child = 2 * i + 1;
+      ALLEGRO_TIMER *c;
+      if (child >= size)
+         break;
+      c = heap_get(child);
+      if (child + 1 < size && heap_get(child + 1)->deadline < c->deadline) {
+         child++;
+         c = heap_get(child);
+      }
+      if (timer->deadline <= c->deadline)
+         break;
+      heap_set(i, c);
+      i = child;
+   }
+   heap_set(i, timer);
+}
+
+
+
+/* heap_update:
+ *  Moves the timer to its place in the heap after its deadline changed.
+ */
+static void heap_update(ALLEGRO_TIMER *timer)
+{
+   heap_sift_up(timer->heap_index);
+   heap_sift_down(timer->heap_index);
+}
+
+
+
+static void heap_insert(ALLEGRO_TIMER *timer)
+{
+   _al_vector_alloc_back(&active_timers);
+   heap_set(_al_vector_size(&active_timers) - 1, timer);
+   heap_sift_up(timer->heap_index);
+}
+
+
+
+static void heap_remove(ALLEGRO_TIMER *timer)
+{
+   const unsigned int i = timer->heap_index;
+   const unsigned int last = _al_vector_size(&active_timers) - 1;
+   ALLEGRO_TIMER *moved = heap_get(last);
+
+   ASSERT(heap_get(i) == timer);
+
+   _al_vector_delete_at(&active_timers, last);
+   if (i != last) {
+      heap_set(i, moved);
+      heap_update(moved);
+   }
+}
+
+
 
 /* timer_thread_proc: [timer thread]
  *  The timer thread procedure itself.
@@ -95,64 +209,59 @@ static void timer_thread_proc(_AL_THREAD *self, void *unused)
    }
 #endif
 
-   double old_time = al_get_time();
-   double new_time;
-   double interval = 0.032768;
+   al_lock_mutex(timers_mutex);
+   while (!_al_get_thread_should_stop(self) && !destroy_thread) {
+      double delay;
 
-   while (!_al_get_thread_should_stop(self)) {
-      al_lock_mutex(timers_mutex);
-      while (_al_vector_size(&active_timers) == 0 && !destroy_thread) {
+      if (_al_vector_size(&active_timers) == 0) {
          al_wait_cond(timer_cond, timers_mutex);
-         old_time = al_get_time() - interval;
+         continue;
       }
-      al_unlock_mutex(timers_mutex);
 
-      al_rest(interval);
-
-      al_lock_mutex(timers_mutex);
-      {
-         /* Calculate actual time elapsed.  */
-         new_time = al_get_time();
-         interval = new_time - old_time;
-         old_time = new_time;
-
-         /* Handle a tick.  */
-         interval = _al_timer_thread_handle_tick(interval);
+      /* Handle the due ticks, then sleep until the next deadline or
+       * until the set of timers changes.
+       */
+      delay = _al_timer_thread_handle_tick(al_get_time());
+      if (delay > 0) {
+         ALLEGRO_TIMEOUT timeout;
+         al_init_timeout(&timeout, delay);
+         al_wait_cond_until(timer_cond, timers_mutex, &timeout);
       }
-      al_unlock_mutex(timers_mutex);
    }
+   al_unlock_mutex(timers_mutex);
 
    (void)unused;
 }
 
 
 
-/* timer_thread_handle_tick: [timer thread]
- *  Call handle_tick() method of every timer in active_timers, and
- *  returns the duration that the timer thread should try to sleep
- *  next time.
+/* _al_timer_thread_handle_tick: [timer thread]
+ *  Ticks every active timer whose deadline is at or before `now`, as
+ *  many times as it is due, and returns the time until the next
+ *  deadline.  The timers mutex must be held.
  */
-double _al_timer_thread_handle_tick(double interval)
+double _al_timer_thread_handle_tick(double now)
 {
-   double new_delay = 0.032768;
-   unsigned int i;
-
-   for (i = 0; i < _al_vector_size(&active_timers); i++) {
-      ALLEGRO_TIMER **slot = _al_vector_ref(&active_timers, i);
-      ALLEGRO_TIMER *timer = *slot;
-
-      timer->counter -= interval;
-
-      while (timer->counter <= 0) {
-         timer_handle_tick(timer);
-         timer->counter += timer->speed_secs;
-      }
-
-      if ((timer->counter > 0) && (timer->counter < new_delay))
-         new_delay = timer->counter;
+   while (_al_vector_size(&active_timers) > 0) {
+      ALLEGRO_TIMER *timer = heap_get(0);
+      double lateness = now - timer->deadline;
+
+      if (lateness < 0)
+         return -lateness;
+
+      if (timer->stats_ticks == 0 || lateness < timer->min_lateness)
+         timer->min_lateness = lateness;
+      if (lateness > timer->max_lateness)
+         timer->max_lateness = lateness;
+      timer->total_lateness += lateness;
+      timer->stats_ticks++;
+
+      timer_handle_tick(timer, lateness);
+      timer->deadline += timer->speed_secs;
+      heap_sift_down(0);
    }
 
-   return new_delay;
+   return IDLE_DELAY;
 }
 
 
@@ -194,15 +303,13 @@ static void enable_timer(ALLEGRO_TIMER *timer, bool reset_counter)
 
       al_lock_mutex(timers_mutex);
       {
-         ALLEGRO_TIMER **slot;
-
          timer->started = true;
 
          if (reset_counter)
             timer->counter = timer->speed_secs;
 
-         slot = _al_vector_alloc_back(&active_timers);
-         *slot = timer;
+         timer->deadline = al_get_time() + timer->counter;
+         heap_insert(timer);
 
          al_signal_cond(timer_cond);
       }
@@ -254,6 +361,12 @@ ALLEGRO_TIMER *al_create_timer(double speed_secs)
          timer->count = 0;
          timer->speed_secs = speed_secs;
          timer->counter = 0;
+         timer->deadline = 0;
+         timer->heap_index = 0;
+         timer->stats_ticks = 0;
+         timer->total_lateness = 0;
+         timer->min_lateness = 0;
+         timer->max_lateness = 0;
 
          timer->dtor_item = _al_register_destructor(_al_dtor_list, "timer", timer,
             (void (*)(void *)) al_destroy_timer);
@@ -310,7 +423,9 @@ void al_stop_timer(ALLEGRO_TIMER *timer)
 
       al_lock_mutex(timers_mutex);
       {
-         _al_vector_find_and_delete(&active_timers, &timer);
+         /* Remember how long was left for al_resume_timer. */
+         timer->counter = timer->deadline - al_get_time();
+         heap_remove(timer);
          timer->started = false;
       }
       al_unlock_mutex(timers_mutex);
@@ -351,8 +466,10 @@ void al_set_timer_speed(ALLEGRO_TIMER *timer, double new_speed_secs)
    al_lock_mutex(timers_mutex);
    {
       if (timer->started) {
-         timer->counter -= timer->speed_secs;
-         timer->counter += new_speed_secs;
+         timer->deadline -= timer->speed_secs;
+         timer->deadline += new_speed_secs;
+         heap_update(timer);
+         al_signal_cond(timer_cond);
       }
 
       timer->speed_secs = new_speed_secs;
@@ -403,9 +520,9 @@ void al_add_timer_count(ALLEGRO_TIMER *timer, int64_t diff)
 
 
 /* timer_handle_tick: [timer thread]
- *  Handle a single tick.
+ *  Handle a single tick, `lateness` seconds after it was due.
  */
-static void timer_handle_tick(ALLEGRO_TIMER *timer)
+static void timer_handle_tick(ALLEGRO_TIMER *timer, double lateness)
 {
    /* Lock out event source helper functions (e.g. the release hook
     * could be invoked simultaneously with this function).
@@ -421,7 +538,7 @@ static void timer_handle_tick(ALLEGRO_TIMER *timer)
          event.timer.type = ALLEGRO_EVENT_TIMER;
          event.timer.timestamp = al_get_time();
          event.timer.count = timer->count;
-         event.timer.error = -timer->counter;
+         event.timer.error = lateness;
          _al_event_source_emit_event(&timer->es, &event);
       }
    }
@@ -430,6 +547,45 @@ static void timer_handle_tick(ALLEGRO_TIMER *timer)
 
 
 
+/* Function: al_get_timer_stats
+ */
+void al_get_timer_stats(ALLEGRO_TIMER *timer, ALLEGRO_TIMER_STATS *stats)
+{
+   ASSERT(timer);
+   ASSERT(stats);
+
+   al_lock_mutex(timers_mutex);
+   {
+      stats->ticks = timer->stats_ticks;
+      stats->min_lateness = timer->min_lateness;
+      stats->max_lateness = timer->max_lateness;
+      stats->avg_lateness = 0;
+      if (timer->stats_ticks > 0)
+         stats->avg_lateness = timer->total_lateness / timer->stats_ticks;
+   }
+   al_unlock_mutex(timers_mutex);
+}
+
+
+
+/* Function: al_reset_timer_stats
+ */
+void al_reset_timer_stats(ALLEGRO_TIMER *timer)
+{
+   ASSERT(timer);
+
+   al_lock_mutex(timers_mutex);
+   {
+      timer->stats_ticks = 0;
+      timer->total_lateness = 0;
+      timer->min_lateness = 0;
+      timer->max_lateness = 0;
+   }
+   al_unlock_mutex(timers_mutex);
+}
+
+
+
 /* Function: al_get_timer_event_source
  */
 ALLEGRO_EVENT_SOURCE *al_get_timer_event_source(ALLEGRO_TIMER *timer)
@@ -35,10 +35,14 @@
  * WANT_TLS, or fix the static linking case...
  */
 
+#define _AL_NO_BLEND_INLINE_FUNC
+
 #include <string.h>
 #include "allegro5/allegro.h"
 #include "allegro5/internal/aintern.h"
 #include "allegro5/internal/aintern_bitmap.h"
+#include "allegro5/internal/aintern_blend.h"
+#include "allegro5/internal/aintern_debug.h"
 #include "allegro5/internal/aintern_display.h"
 #include "allegro5/internal/aintern_file.h"
 #include "allegro5/internal/aintern_fshook.h"
@@ -107,6 +111,12 @@ typedef struct thread_local_state {
 
    /* Destructor ownership count */
    int dtor_owner_count;
+
+   /* Destructor registry shard used by this thread, plus one. */
+   int dtor_shard;
+
+   /* Logging state */
+   _AL_TRACE_THREAD_STATE trace_state;
 } thread_local_state;
 
 
@@ -130,6 +140,7 @@ static void initialize_blender(ALLEGRO_BLENDER *b)
    b->blend_alpha_source = ALLEGRO_ONE;
    b->blend_alpha_dest = ALLEGRO_INVERSE_ALPHA;
    b->blend_color = al_map_rgba_f(1.0f, 1.0f, 1.0f, 1.0f);
+   _al_compile_blender(b);
 }
 
 
@@ -565,6 +576,7 @@ void al_set_separate_blender(int op, int src, int dst,
    b->blend_alpha_op = alpha_op;
    b->blend_alpha_source = alpha_src;
    b->blend_alpha_dest = alpha_dst;
+   _al_compile_blender(b);
 }
 
 
@@ -625,6 +637,24 @@ void al_get_separate_blender(int *op, int *src, int *dst,
 
 
 
+/* Internal function: _al_get_blender
+ *  The thread's blender, for the software blending routines.
+ */
+const ALLEGRO_BLENDER *_al_get_blender(void)
+{
+   static ALLEGRO_BLENDER fallback;
+   thread_local_state *tls;
+
+   if ((tls = tls_get()) == NULL) {
+      initialize_blender(&fallback);
+      return &fallback;
+   }
+
+   return &tls->current_blender;
+}
+
+
+
 /* Function: al_set_new_bitmap_format
  */
 void al_set_new_bitmap_format(int format)
@@ -973,4 +1003,23 @@ int *_al_tls_get_dtor_owner_count(void)
 }
 
 
+int *_al_tls_get_dtor_shard(void)
+{
+   thread_local_state *tls;
+
+   tls = tls_get();
+   return &tls->dtor_shard;
+}
+
+
+_AL_TRACE_THREAD_STATE *_al_tls_get_trace_state(void)
+{
+   thread_local_state *tls;
+
+   if ((tls = tls_get()) == NULL)
+      return NULL;
+   return &tls->trace_state;
+}
+
+
 /* vim: set sts=3 sw=3 et: */
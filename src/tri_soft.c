@@ -21,9 +21,14 @@
 #include "allegro5/internal/aintern.h"
 #include "allegro5/internal/aintern_bitmap.h"
 #include "allegro5/internal/aintern_blend.h"
+#include "allegro5/internal/aintern_memblit.h"
+#include "allegro5/internal/aintern_memdraw.h"
+#include "allegro5/internal/aintern_parallel.h"
 #include "allegro5/internal/aintern_pixels.h"
 #include "allegro5/internal/aintern_tri_soft.h"
+#include <limits.h>
 #include <math.h>
+#include <string.h>
 
 ALLEGRO_DEBUG_CHANNEL("tri_soft")
 
@@ -404,13 +409,196 @@ static void shader_texture_grad_any_step(uintptr_t state, int minor)
 }
 
 
+/*========================== Fixed Point Shading =============================*/
+
+/*
+When the target is one of the 8888 formats below (and a texture, if any,
+has the same format), the blenders the scanline drawers specialise for are
+done in integer arithmetic instead of unpacking every pixel to floats.
+Colour channels are held in 8.8 fixed point with 1.0 being 255 << 8, and
+in the order they are stored in the pixel, so the loops never need to know
+which of the formats they are writing.
+
+Each channel written this way is within one level (out of 255) of what the
+float path writes. The float path truncates, so the two only differ where
+the exact result sits close to a level boundary; fully transparent and
+fully opaque sources give identical results.
+*/
+
+#define FIX_ONE (255 << 8)
+
+static bool fix_format(int format)
+{
+   switch (format) {
+      case ALLEGRO_PIXEL_FORMAT_ARGB_8888:
+      case ALLEGRO_PIXEL_FORMAT_ABGR_8888:
+#ifdef ALLEGRO_LITTLE_ENDIAN
+      case ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE:
+#endif
+         return true;
+      default:
+         return false;
+   }
+}
+
+/* Convert one channel, scaled so 1.0 maps to one. Values the float path
+ * would write as 0 or 255 are clamped to those, anything further out is
+ * rejected since the float path overflows into the neighbouring channel
+ * for them and we don't try to reproduce that.
+ */
+static bool fix_channel(float c, double one, int32_t *out)
+{
+   double x = c * 255.0;
+   if (!(x > -1.0 && x < 256.0))
+      return false;
+   x = _ALLEGRO_CLAMP(0.0, x / 255.0, 1.0);
+   *out = (int32_t)(x * one + 0.5);
+   return true;
+}
+
+static bool fix_color_scaled(ALLEGRO_COLOR c, int format, double one,
+   int32_t out[4])
+{
+   float c0 = c.b, c2 = c.r;
+   if (!fix_format(format))
+      return false;
+   if (format != ALLEGRO_PIXEL_FORMAT_ARGB_8888) {
+      c0 = c.r;
+      c2 = c.b;
+   }
+   return fix_channel(c0, one, &out[0]) && fix_channel(c.g, one, &out[1]) &&
+      fix_channel(c2, one, &out[2]) && fix_channel(c.a, one, &out[3]);
+}
+
+/* A solid colour, in 8.8. */
+static bool fix_color(ALLEGRO_COLOR c, int format, uint32_t out[4])
+{
+   return fix_color_scaled(c, format, FIX_ONE, (int32_t *)out);
+}
+
+/* A tint to multiply texels with, in 0.16 so 1.0 is 65536. */
+static bool fix_tint(ALLEGRO_COLOR c, int format, uint32_t out[4])
+{
+   return fix_color_scaled(c, format, 65536, (int32_t *)out);
+}
+
+/* A gradient over n pixels, in 8.16. Both ends are clamped and the step
+ * derived from them, so stepping can never leave the valid range.
+ */
+static bool fix_gradient(ALLEGRO_COLOR c, ALLEGRO_COLOR dc, int n, int format,
+   int32_t out[4], int32_t out_dx[4])
+{
+   ALLEGRO_COLOR end;
+   int32_t out_end[4];
+   int i;
+
+   if (n < 2)
+      n = 2;
+   end.r = c.r + dc.r * (n - 1);
+   end.g = c.g + dc.g * (n - 1);
+   end.b = c.b + dc.b * (n - 1);
+   end.a = c.a + dc.a * (n - 1);
+   if (!fix_color_scaled(c, format, FIX_ONE << 8, out) ||
+         !fix_color_scaled(end, format, FIX_ONE << 8, out_end))
+      return false;
+   for (i = 0; i < 4; i++)
+      out_dx[i] = (out_end[i] - out[i]) / (n - 1);
+   return true;
+}
+
+static _AL_ALWAYS_INLINE void fix_grad_step(int32_t c[4], const int32_t dc[4])
+{
+   c[0] += dc[0];
+   c[1] += dc[1];
+   c[2] += dc[2];
+   c[3] += dc[3];
+}
+
+static _AL_ALWAYS_INLINE void fix_grad_color(uint32_t out[4],
+   const int32_t c[4])
+{
+   out[0] = c[0] >> 8;
+   out[1] = c[1] >> 8;
+   out[2] = c[2] >> 8;
+   out[3] = c[3] >> 8;
+}
+
+/* Turn an 8.16 gradient colour into a 0.16 tint, i.e. divide by 255. */
+static _AL_ALWAYS_INLINE void fix_grad_tint(uint32_t out[4],
+   const int32_t c[4])
+{
+   out[0] = (c[0] >> 8) + (c[0] >> 16) + 1;
+   out[1] = (c[1] >> 8) + (c[1] >> 16) + 1;
+   out[2] = (c[2] >> 8) + (c[2] >> 16) + 1;
+   out[3] = (c[3] >> 8) + (c[3] >> 16) + 1;
+}
+
+static _AL_ALWAYS_INLINE void fix_texel(uint32_t out[4], uint32_t texel,
+   const uint32_t tint[4])
+{
+   out[0] = ((texel & 0xff) * tint[0]) >> 8;
+   out[1] = (((texel >> 8) & 0xff) * tint[1]) >> 8;
+   out[2] = (((texel >> 16) & 0xff) * tint[2]) >> 8;
+   out[3] = ((texel >> 24) * tint[3]) >> 8;
+}
+
+static _AL_ALWAYS_INLINE void fix_texel_white(uint32_t out[4], uint32_t texel)
+{
+   out[0] = (texel & 0xff) << 8;
+   out[1] = texel & 0xff00;
+   out[2] = (texel >> 8) & 0xff00;
+   out[3] = (texel >> 16) & 0xff00;
+}
+
+static _AL_ALWAYS_INLINE uint32_t fix_pack_pixel(const uint32_t s[4])
+{
+   return (s[0] >> 8) | (s[1] & 0xff00) | ((s[2] & 0xff00) << 8) |
+      ((s[3] & 0xff00) << 16);
+}
+
+/* Only the source factors ALLEGRO_ONE and ALLEGRO_ALPHA and the destination
+ * factors ALLEGRO_ONE and ALLEGRO_INVERSE_ALPHA are handled, with
+ * ALLEGRO_ADD for both colour and alpha. The source alpha factor fa is in
+ * 0.16.
+ */
+static _AL_ALWAYS_INLINE uint32_t fix_blend_channel(uint32_t s, uint32_t d,
+   uint32_t fa, int src_mode, int dst_mode)
+{
+   uint32_t r;
+   if (src_mode == ALLEGRO_ALPHA)
+      s = (s * fa) >> 16;
+   if (dst_mode == ALLEGRO_INVERSE_ALPHA)
+      r = s + ((d * (65536 - fa)) >> 8);
+   else
+      r = s + (d << 8);
+   return r >= FIX_ONE ? 255 : r >> 8;
+}
+
+static _AL_ALWAYS_INLINE uint32_t fix_blend_pixel(const uint32_t s[4],
+   uint32_t dst, int src_mode, int dst_mode)
+{
+   /* Rescale the 8.8 alpha to 0.16, mapping 255 << 8 to exactly 65536. */
+   const uint32_t fa = s[3] + (s[3] >> 8) + (s[3] >> 15);
+   return fix_blend_channel(s[0], dst & 0xff, fa, src_mode, dst_mode) |
+      fix_blend_channel(s[1], (dst >> 8) & 0xff, fa, src_mode, dst_mode) << 8 |
+      fix_blend_channel(s[2], (dst >> 16) & 0xff, fa, src_mode, dst_mode) << 16 |
+      fix_blend_channel(s[3], dst >> 24, fa, src_mode, dst_mode) << 24;
+}
+
+
 /* Include generated routines. */
 #include "scanline_drawers.inc"
 
 
+/*
+Only the scanlines from min_y up to (but excluding) max_y are drawn, the
+ones above are still stepped over so that the shader state is the same as
+when drawing the whole triangle.
+*/
 static void triangle_stepper(uintptr_t state,
    shader_init init, shader_first first, shader_step step, shader_draw draw,
-   ALLEGRO_VERTEX* vtx1, ALLEGRO_VERTEX* vtx2, ALLEGRO_VERTEX* vtx3)
+   ALLEGRO_VERTEX* vtx1, ALLEGRO_VERTEX* vtx2, ALLEGRO_VERTEX* vtx3,
+   int min_y, int max_y)
 {
    float Coords[6] = {vtx1->x - 0.5f, vtx1->y + 0.5f, vtx2->x - 0.5f, vtx2->y + 0.5f, vtx3->x - 0.5f, vtx3->y + 0.5f};
    float *V1 = Coords, *V2 = &Coords[2], *V3 = &Coords[4], *s;
@@ -461,7 +649,12 @@ static void triangle_stepper(uintptr_t state,
    mid_y = ceilf(V2[1]);
    end_y = ceilf(V3[1]);
 
-   if (cur_y == end_y)
+   if (end_y > max_y)
+      end_y = max_y;
+   if (mid_y > end_y)
+      mid_y = end_y;
+
+   if (cur_y >= end_y)
       return;
 
    /*
@@ -554,7 +747,7 @@ static void triangle_stepper(uintptr_t state,
 
          first(state, left_x, cur_y, left_step, left_step - 1);
 
-         if (right_x >= left_x) {
+         if (right_x >= left_x && cur_y >= min_y) {
             draw(state, left_x, cur_y, right_x);
          }
 
@@ -590,7 +783,7 @@ static void triangle_stepper(uintptr_t state,
             right_x -= 1;
          }
 
-         if (right_x >= left_x) {
+         if (right_x >= left_x && cur_y >= min_y) {
             draw(state, left_x, cur_y, right_x);
          }
 
@@ -644,7 +837,7 @@ static void triangle_stepper(uintptr_t state,
 
          first(state, left_x, cur_y, left_step, left_step - 1);
 
-         if (right_x >= left_x) {
+         if (right_x >= left_x && cur_y >= min_y) {
             draw(state, left_x, cur_y, right_x);
          }
 
@@ -672,7 +865,7 @@ static void triangle_stepper(uintptr_t state,
             right_x -= 1;
          }
 
-         if (right_x >= left_x) {
+         if (right_x >= left_x && cur_y >= min_y) {
             draw(state, left_x, cur_y, right_x);
          }
 
@@ -683,11 +876,37 @@ static void triangle_stepper(uintptr_t state,
    }
 }
 
+typedef union {
+   state_solid_any_2d solid;
+   state_grad_any_2d grad;
+   state_texture_solid_any_2d texture_solid;
+   state_texture_grad_any_2d texture_grad;
+} state_any_2d;
+
+typedef struct {
+   shader_init init;
+   shader_first first;
+   shader_step step;
+   shader_draw draw;
+   /* The target field of the state, set by init. */
+   ALLEGRO_BITMAP **target;
+} triangle_shader;
+
+#define SET_SHADER(sh, name, variant)                 \
+   do {                                               \
+      (sh)->init = shader_##name##_init;              \
+      (sh)->first = shader_##name##_first;            \
+      (sh)->step = shader_##name##_step;              \
+      (sh)->draw = shader_##name##_draw_##variant;    \
+   } while (0)
+
 /*
 This one will check to see what exactly we need to draw...
-I.e. this will call all of the actual renderers and set the appropriate callbacks
+I.e. this will pick all of the actual renderers and prepare their state
 */
-void _al_triangle_2d(ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX* v2, ALLEGRO_VERTEX* v3)
+static void choose_triangle_shader(ALLEGRO_BITMAP* texture,
+   ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX* v2, ALLEGRO_VERTEX* v3,
+   state_any_2d* state, triangle_shader* shader)
 {
    int shade = 1;
    int grad = 1;
@@ -713,55 +932,68 @@ void _al_triangle_2d(ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX
 
    if (texture) {
       if (grad) {
-         state_texture_grad_any_2d state;
-         state.solid.texture = texture;
+         state->texture_grad.solid.texture = texture;
+         shader->target = &state->texture_grad.solid.target;
 
          if (shade) {
-            _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_texture_grad_any_init, shader_texture_grad_any_first, shader_texture_grad_any_step, shader_texture_grad_any_draw_shade);
+            SET_SHADER(shader, texture_grad_any, shade);
          } else {
-            _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_texture_grad_any_init, shader_texture_grad_any_first, shader_texture_grad_any_step, shader_texture_grad_any_draw_opaque);
+            SET_SHADER(shader, texture_grad_any, opaque);
          }
       } else {
          int white = 0;
-         state_texture_solid_any_2d state;
 
          if (v1c.r == 1 && v1c.g == 1 && v1c.b == 1 && v1c.a == 1) {
             white = 1;
          }
-         state.texture = texture;
+         state->texture_solid.texture = texture;
+         shader->target = &state->texture_solid.target;
+
          if (shade) {
             if (white) {
-               _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_texture_solid_any_init, shader_texture_solid_any_first, shader_texture_solid_any_step, shader_texture_solid_any_draw_shade_white);
+               SET_SHADER(shader, texture_solid_any, shade_white);
             } else {
-               _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_texture_solid_any_init, shader_texture_solid_any_first, shader_texture_solid_any_step, shader_texture_solid_any_draw_shade);
+               SET_SHADER(shader, texture_solid_any, shade);
             }
          } else {
             if (white) {
-               _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_texture_solid_any_init, shader_texture_solid_any_first, shader_texture_solid_any_step, shader_texture_solid_any_draw_opaque_white);
+               SET_SHADER(shader, texture_solid_any, opaque_white);
             } else {
-               _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_texture_solid_any_init, shader_texture_solid_any_first, shader_texture_solid_any_step, shader_texture_solid_any_draw_opaque);
+               SET_SHADER(shader, texture_solid_any, opaque);
             }
          }
       }
    } else {
       if (grad) {
-         state_grad_any_2d state;
+         shader->target = &state->grad.solid.target;
          if (shade) {
-            _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_grad_any_init, shader_grad_any_first, shader_grad_any_step, shader_grad_any_draw_shade);
+            SET_SHADER(shader, grad_any, shade);
          } else {
-            _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_grad_any_init, shader_grad_any_first, shader_grad_any_step, shader_grad_any_draw_opaque);
+            SET_SHADER(shader, grad_any, opaque);
          }
       } else {
-         state_solid_any_2d state;
+         shader->target = &state->solid.target;
          if (shade) {
-            _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_solid_any_init, shader_solid_any_first, shader_solid_any_step, shader_solid_any_draw_shade);
+            SET_SHADER(shader, solid_any, shade);
          } else {
-            _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_solid_any_init, shader_solid_any_first, shader_solid_any_step, shader_solid_any_draw_opaque);
+            SET_SHADER(shader, solid_any, opaque);
          }
       }
    }
 }
 
+#undef SET_SHADER
+
+void _al_triangle_2d(ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX* v2, ALLEGRO_VERTEX* v3)
+{
+   state_any_2d state;
+   triangle_shader shader;
+
+   choose_triangle_shader(texture, v1, v2, v3, &state, &shader);
+   _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state,
+      shader.init, shader.first, shader.step, shader.draw);
+}
+
 static int bitmap_region_is_locked(ALLEGRO_BITMAP* bmp, int x1, int y1, int w, int h)
 {
    ASSERT(bmp);
@@ -773,22 +1005,13 @@ static int bitmap_region_is_locked(ALLEGRO_BITMAP* bmp, int x1, int y1, int w, i
    return 0;
 }
 
-void _al_draw_soft_triangle(
-   ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX* v2, ALLEGRO_VERTEX* v3, uintptr_t state,
-   void (*init)(uintptr_t, ALLEGRO_VERTEX*, ALLEGRO_VERTEX*, ALLEGRO_VERTEX*),
-   void (*first)(uintptr_t, int, int, int, int),
-   void (*step)(uintptr_t, int),
-   void (*draw)(uintptr_t, int, int, int))
+/*
+Works out the region of the target a triangle may touch, clipped to the
+clipping rectangle. Returns false if there is nothing to draw.
+*/
+static bool triangle_region(ALLEGRO_VERTEX* vtx1, ALLEGRO_VERTEX* vtx2, ALLEGRO_VERTEX* vtx3,
+   int* x, int* y, int* w, int* h)
 {
-   /*
-   ALLEGRO_VERTEX copy_v1, copy_v2; <- may be needed for clipping later on
-   */
-   ALLEGRO_VERTEX* vtx1 = v1;
-   ALLEGRO_VERTEX* vtx2 = v2;
-   ALLEGRO_VERTEX* vtx3 = v3;
-   ALLEGRO_BITMAP *target = al_get_target_bitmap();
-   int need_unlock = 0;
-   ALLEGRO_LOCKED_REGION *lr;
    int min_x, max_x, min_y, max_y;
    int clip_min_x, clip_min_y, clip_max_x, clip_max_y;
 
@@ -816,33 +1039,405 @@ void _al_draw_soft_triangle(
    once clipping is implemented
    */
    if (min_x >= clip_max_x || min_y >= clip_max_y)
-      return;
+      return false;
    if (max_x >= clip_max_x)
       max_x = clip_max_x;
    if (max_y >= clip_max_y)
       max_y = clip_max_y;
 
    if (max_x < clip_min_x || max_y < clip_min_y)
-      return;
+      return false;
    if (min_x < clip_min_x)
       min_x = clip_min_x;
    if (min_y < clip_min_y)
       min_y = clip_min_y;
 
+   *x = min_x;
+   *y = min_y;
+   *w = max_x - min_x;
+   *h = max_y - min_y;
+   return true;
+}
+
+void _al_draw_soft_triangle(
+   ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX* v2, ALLEGRO_VERTEX* v3, uintptr_t state,
+   void (*init)(uintptr_t, ALLEGRO_VERTEX*, ALLEGRO_VERTEX*, ALLEGRO_VERTEX*),
+   void (*first)(uintptr_t, int, int, int, int),
+   void (*step)(uintptr_t, int),
+   void (*draw)(uintptr_t, int, int, int))
+{
+   ALLEGRO_BITMAP *target = al_get_target_bitmap();
+   int need_unlock = 0;
+   ALLEGRO_LOCKED_REGION *lr;
+   int x, y, w, h;
+
+   if (!triangle_region(v1, v2, v3, &x, &y, &w, &h))
+      return;
+
    if (al_is_bitmap_locked(target)) {
-      if (!bitmap_region_is_locked(target, min_x, min_y, max_x - min_x, max_y - min_y) ||
+      if (!bitmap_region_is_locked(target, x, y, w, h) ||
           _al_pixel_format_is_video_only(target->locked_region.format))
          return;
    } else {
-      if (!(lr = al_lock_bitmap_region(target, min_x, min_y, max_x - min_x, max_y - min_y, ALLEGRO_PIXEL_FORMAT_ANY, 0)))
+      if (!(lr = al_lock_bitmap_region(target, x, y, w, h, ALLEGRO_PIXEL_FORMAT_ANY, 0)))
          return;
       need_unlock = 1;
    }
 
-   triangle_stepper(state, init, first, step, draw, v1, v2, v3);
+   triangle_stepper(state, init, first, step, draw, v1, v2, v3, INT_MIN, INT_MAX);
 
    if (need_unlock)
       al_unlock_bitmap(target);
 }
 
+/*
+Batches of triangles drawn into a memory bitmap with the
+ALLEGRO_PARALLEL_DRAWING flag are split into bands of scanlines, which are
+rasterised by the worker threads. Every band goes through all of the
+triangles in order but only draws its own scanlines, so each pixel goes
+through exactly the same operations in the same order as when the
+triangles are drawn one after another.
+
+The scanline drawers clip against the locked region of the target, and
+the interpolants they skip over depend on where that region starts. When
+drawing serially every triangle locks just the region it touches, so each
+band gives the drawers a private copy of the target whose locked region
+is moved to that of the triangle being drawn.
+*/
+
+#define MIN_BAND_HEIGHT   16
+#define BANDS_PER_THREAD  4
+
+typedef struct {
+   ALLEGRO_BITMAP* texture;
+   ALLEGRO_VERTEX* vtx;
+   int num_triangles;
+   int (*regions)[4];
+   bool locked_here;
+   int y, h, bands;
+   ALLEGRO_STATE state;
+} triangle_batch;
+
+typedef struct {
+   state_any_2d state; /* must come first */
+   shader_init init;
+   ALLEGRO_BITMAP** target_field;
+   ALLEGRO_BITMAP* target;
+} band_state;
+
+static void band_init(uintptr_t state, ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX* v2, ALLEGRO_VERTEX* v3)
+{
+   band_state* s = (band_state*)state;
+
+   s->init(state, v1, v2, v3);
+   if (s->target)
+      *s->target_field = s->target;
+}
+
+static void draw_triangle_band(void* arg, int band)
+{
+   triangle_batch* batch = arg;
+   ALLEGRO_STATE old_state;
+   ALLEGRO_BITMAP *target, *root;
+   ALLEGRO_BITMAP fake_root, fake_sub;
+   ALLEGRO_BITMAP* fake = NULL;
+   int xofs = 0, yofs = 0;
+   int pixel_size = 0;
+   int min_y, max_y;
+   int i;
+
+   /* Scanline y is drawn into row y - 1, see the scanline drawers. */
+   min_y = (band == 0) ? INT_MIN :
+      batch->y + (int)((int64_t)batch->h * band / batch->bands);
+   max_y = (band == batch->bands - 1) ? INT_MAX :
+      batch->y + (int)((int64_t)batch->h * (band + 1) / batch->bands);
+
+   /* The drawers get the blender from the calling thread's state. */
+   al_store_state(&old_state, ALLEGRO_STATE_TARGET_BITMAP | ALLEGRO_STATE_BLENDER);
+   al_restore_state(&batch->state);
+
+   target = al_get_target_bitmap();
+   root = target->parent ? target->parent : target;
+
+   if (batch->locked_here) {
+      fake_root = *root;
+      fake = &fake_root;
+      if (target->parent) {
+         fake_sub = *target;
+         fake_sub.parent = &fake_root;
+         fake = &fake_sub;
+         xofs = target->xofs;
+         yofs = target->yofs;
+      }
+      pixel_size = al_get_pixel_size(root->locked_region.format);
+   }
+
+   for (i = 0; i < batch->num_triangles; i++) {
+      ALLEGRO_VERTEX* v = &batch->vtx[i * 3];
+      const int* r = batch->regions[i];
+      triangle_shader shader;
+      band_state bs;
+
+      if (r[3] <= 0)
+         continue;
+
+      if (fake) {
+         if (r[1] + r[3] + 1 <= min_y || r[1] + 1 >= max_y)
+            continue;
+
+         fake_root.lock_x = r[0] + xofs;
+         fake_root.lock_y = r[1] + yofs;
+         fake_root.lock_w = r[2];
+         fake_root.lock_h = r[3];
+         fake_root.lock_data = root->memory +
+            fake_root.lock_y * root->pitch + fake_root.lock_x * pixel_size;
+         fake_root.locked_region.data = fake_root.lock_data;
+      }
+
+      choose_triangle_shader(batch->texture, &v[0], &v[1], &v[2], &bs.state, &shader);
+      bs.init = shader.init;
+      bs.target_field = shader.target;
+      bs.target = fake;
+
+      triangle_stepper((uintptr_t)&bs, band_init, shader.first, shader.step, shader.draw,
+         &v[0], &v[1], &v[2], min_y, max_y);
+   }
+
+   al_restore_state(&old_state);
+}
+
+/*
+Returns true if the target bitmap wants triangles rasterised in parallel.
+*/
+bool _al_is_parallel_drawing_target(void)
+{
+   ALLEGRO_BITMAP *target = al_get_target_bitmap();
+   int flags;
+
+   if (!target)
+      return false;
+
+   flags = al_get_bitmap_flags(target);
+   return (flags & ALLEGRO_PARALLEL_DRAWING) && (flags & ALLEGRO_MEMORY_BITMAP) &&
+      _al_pixel_format_is_real(al_get_bitmap_format(target)) &&
+      !_al_pixel_format_is_compressed(al_get_bitmap_format(target));
+}
+
+/*
+Draws a batch of triangles, given as consecutive triples of vertices. The
+result is the same as calling _al_triangle_2d on each of them in turn.
+*/
+void _al_triangles_2d(ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX* vtx, int num_triangles)
+{
+   ALLEGRO_BITMAP *target = al_get_target_bitmap();
+   triangle_batch batch;
+   int min_x = INT_MAX, min_y = INT_MAX, max_x = INT_MIN, max_y = INT_MIN;
+   int threads, i;
+
+   if (_al_hold_triangles_memory(texture, vtx, num_triangles))
+      return;
+
+   if (!_al_is_parallel_drawing_target())
+      goto serial;
+   threads = _al_get_parallel_thread_count();
+   if (threads < 2)
+      goto serial;
+
+   batch.regions = al_malloc(num_triangles * sizeof(*batch.regions));
+   if (!batch.regions)
+      goto serial;
+
+   for (i = 0; i < num_triangles; i++) {
+      int* r = batch.regions[i];
+      ALLEGRO_VERTEX* v = &vtx[i * 3];
+
+      if (!triangle_region(&v[0], &v[1], &v[2], &r[0], &r[1], &r[2], &r[3]) ||
+            r[2] <= 0 || r[3] <= 0) {
+         r[3] = 0;
+         continue;
+      }
+      min_x = MIN(min_x, r[0]);
+      min_y = MIN(min_y, r[1]);
+      max_x = MAX(max_x, r[0] + r[2]);
+      max_y = MAX(max_y, r[1] + r[3]);
+   }
+
+   if (min_y == INT_MAX) {
+      al_free(batch.regions);
+      return;
+   }
+
+   if (al_is_bitmap_locked(target)) {
+      ALLEGRO_BITMAP *root = target->parent ? target->parent : target;
+
+      for (i = 0; i < num_triangles; i++) {
+         int* r = batch.regions[i];
+         if (r[3] > 0 && (!bitmap_region_is_locked(target, r[0], r[1], r[2], r[3]) ||
+               _al_pixel_format_is_video_only(target->locked_region.format)))
+            r[3] = 0;
+      }
+      batch.locked_here = false;
+      batch.y = root->lock_y - (target->parent ? target->yofs : 0) + 1;
+      batch.h = root->lock_h;
+   }
+   else {
+      batch.locked_here = true;
+      batch.y = min_y + 1;
+      batch.h = max_y - min_y;
+   }
+
+   batch.bands = MIN(threads * BANDS_PER_THREAD, batch.h / MIN_BAND_HEIGHT);
+   if (batch.bands < 2 || (batch.locked_here &&
+         !al_lock_bitmap_region(target, min_x, min_y, max_x - min_x, max_y - min_y,
+            ALLEGRO_PIXEL_FORMAT_ANY, 0))) {
+      al_free(batch.regions);
+      goto serial;
+   }
+
+   batch.texture = texture;
+   batch.vtx = vtx;
+   batch.num_triangles = num_triangles;
+   al_store_state(&batch.state, ALLEGRO_STATE_TARGET_BITMAP | ALLEGRO_STATE_BLENDER);
+
+   _al_run_parallel(batch.bands, draw_triangle_band, &batch);
+
+   if (batch.locked_here)
+      al_unlock_bitmap(target);
+   al_free(batch.regions);
+   return;
+
+serial:
+   for (i = 0; i < num_triangles; i++)
+      _al_triangle_2d(texture, &vtx[i * 3], &vtx[i * 3 + 1], &vtx[i * 3 + 2]);
+}
+
+/*
+A rectangle drawn as two triangles covers the pixels whose centres lie
+inside it. Which triangle, if any, gets the pixels whose centres lie
+exactly on one of the edges depends on rounding in the steppers, so only
+rectangles with no edge on a row or column of pixel centres are filled
+directly. Everything else is left to the triangles.
+
+Filling only pays off if every pixel gets the same value, i.e. the blender
+ignores what was in the target before. The value is found by running the
+solid scanline drawer on a single pixel, so it is exactly what the
+triangles would have written.
+*/
+
+static bool on_pixel_center(float c)
+{
+   /* Also true for NaN and infinities, which are left to the triangles. */
+   return !(c > floorf(c));
+}
+
+static bool factor_is_zero(int mode, float alpha)
+{
+   return mode == ALLEGRO_ZERO ||
+      (mode == ALLEGRO_ALPHA && alpha == 0) ||
+      (mode == ALLEGRO_INVERSE_ALPHA && alpha == 1);
+}
+
+static bool factor_reads_dest(int mode)
+{
+   return mode == ALLEGRO_DEST_COLOR || mode == ALLEGRO_INVERSE_DEST_COLOR;
+}
+
+static void draw_single_pixel(ALLEGRO_COLOR color, int format, uint32_t out[4])
+{
+   ALLEGRO_BITMAP fake;
+   ALLEGRO_VERTEX v;
+   state_any_2d state;
+   triangle_shader shader;
+   int pixel_size = al_get_pixel_size(format);
+
+   memset(&fake, 0, sizeof(fake));
+   memset(out, 0, 4 * sizeof(uint32_t));
+   fake.lock_w = 1;
+   fake.lock_h = 1;
+   fake.lock_data = out;
+   fake.locked_region.data = out;
+   fake.locked_region.format = format;
+   fake.locked_region.pitch = pixel_size;
+   fake.locked_region.pixel_size = pixel_size;
+
+   memset(&v, 0, sizeof(v));
+   v.color = color;
+   choose_triangle_shader(NULL, &v, &v, &v, &state, &shader);
+   shader.init((uintptr_t)&state, &v, &v, &v);
+   *shader.target = &fake;
+   /* Scanline y is drawn into row y - 1. */
+   shader.draw((uintptr_t)&state, 0, 1, 0);
+}
+
+/*
+Fills an axis aligned rectangle, given in target coordinates, with a
+solid colour. Returns false if the rectangle has to be drawn as triangles
+instead.
+*/
+bool _al_fill_rectangle_2d(float x1, float y1, float x2, float y2, ALLEGRO_COLOR color)
+{
+   ALLEGRO_BITMAP *target = al_get_target_bitmap();
+   ALLEGRO_LOCKED_REGION *lr;
+   int op, src_mode, dst_mode, op_alpha, src_alpha, dst_alpha;
+   uint32_t pixel[4];
+   float left, top, right, bottom;
+   int clip_x, clip_y, clip_w, clip_h;
+   int format;
+
+   if (!target || !(al_get_bitmap_flags(target) & ALLEGRO_MEMORY_BITMAP) ||
+         al_is_bitmap_locked(target))
+      return false;
+   format = al_get_bitmap_format(target);
+   if (_al_pixel_format_is_compressed(format) || al_get_pixel_size(format) > 16)
+      return false;
+
+   /* The same pixel centre offsets as in triangle_stepper. */
+   left = MIN(x1, x2) - 0.5f;
+   right = MAX(x1, x2) - 0.5f;
+   top = MIN(y1, y2) + 0.5f;
+   bottom = MAX(y1, y2) + 0.5f;
+   if (on_pixel_center(left) || on_pixel_center(right) ||
+         on_pixel_center(top) || on_pixel_center(bottom))
+      return false;
+
+   al_get_separate_bitmap_blender(&op,
+      &src_mode, &dst_mode, &op_alpha, &src_alpha, &dst_alpha);
+   if (!factor_is_zero(dst_mode, color.a) || !factor_is_zero(dst_alpha, color.a) ||
+         factor_reads_dest(src_mode) || factor_reads_dest(src_alpha))
+      return false;
+   /* Float pixels keep the sign of zero, which may still come from the
+    * target, unless the drawer doesn't look at the target at all.
+    */
+   if (format == ALLEGRO_PIXEL_FORMAT_ABGR_F32 &&
+         !(_AL_DEST_IS_ZERO && _AL_SRC_NOT_MODIFIED))
+      return false;
+
+   draw_single_pixel(color, format, pixel);
+
+   al_get_clipping_rectangle(&clip_x, &clip_y, &clip_w, &clip_h);
+   left = MAX(ceilf(left), (float)clip_x);
+   right = MIN(ceilf(right), (float)(clip_x + clip_w));
+   top = MAX(ceilf(top) - 1, (float)clip_y);
+   bottom = MIN(ceilf(bottom) - 1, (float)(clip_y + clip_h));
+   if (target->parent) {
+      /* Sub-bitmaps may reach outside their parent. */
+      left = MAX(left, (float)-target->xofs);
+      right = MIN(right, (float)(target->parent->w - target->xofs));
+      top = MAX(top, (float)-target->yofs);
+      bottom = MIN(bottom, (float)(target->parent->h - target->yofs));
+   }
+   if (left >= right || top >= bottom)
+      return true;
+
+   lr = al_lock_bitmap_region(target, (int)left, (int)top,
+      (int)(right - left), (int)(bottom - top), ALLEGRO_PIXEL_FORMAT_ANY,
+      ALLEGRO_LOCK_WRITEONLY);
+   if (!lr)
+      return true;
+   _al_fill_memory_region(lr->data, lr->pitch, lr->pixel_size, pixel,
+      (int)(right - left), (int)(bottom - top));
+   al_unlock_bitmap(target);
+   return true;
+}
+
 /* vim: set sts=3 sw=3 et: */
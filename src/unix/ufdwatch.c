@@ -17,13 +17,19 @@
  *      This module implements a background thread that waits for data
  *      to arrive in file descriptors, at which point it dispatches to
  *      functions which will process that data.
+ *
+ *      Where epoll and eventfd are available (Linux) the thread blocks
+ *      in epoll_wait until a watched fd is readable or it is told to
+ *      stop through the eventfd, so it never wakes up while idle.
+ *      Otherwise it polls the list with select.
  */
 
 
+#include <errno.h>
 #include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <sys/types.h>
-#include <sys/select.h>
 #include <unistd.h>
 
 #include "allegro5/allegro.h"
@@ -32,6 +38,16 @@
 #include "allegro5/internal/aintern_vector.h"
 #include "allegro5/platform/aintunix.h"
 
+#if defined(ALLEGRO_HAVE_SYS_EPOLL_H) && defined(ALLEGRO_HAVE_SYS_EVENTFD_H)
+   #define USE_EPOLL
+   #include <sys/epoll.h>
+   #include <sys/eventfd.h>
+#else
+   #include <sys/select.h>
+#endif
+
+ALLEGRO_DEBUG_CHANNEL("fdwatch")
+
 
 
 typedef struct WATCH_ITEM
@@ -48,6 +64,154 @@ static _AL_VECTOR fd_watch_list = _AL_VECTOR_INITIALIZER(WATCH_ITEM);
 
 
 
+#ifdef USE_EPOLL
+
+#define MAX_EPOLL_EVENTS   16
+
+static int epoll_fd = -1;
+static int wake_fd = -1;
+
+
+
+/* find_watch_item:
+ *  Returns the watch item for the fd, or NULL if it isn't watched any more.
+ *  The mutex must be held.
+ */
+static WATCH_ITEM *find_watch_item(int fd)
+{
+   unsigned int i;
+
+   for (i = 0; i < _al_vector_size(&fd_watch_list); i++) {
+      WATCH_ITEM *wi = _al_vector_ref(&fd_watch_list, i);
+      if (wi->fd == fd)
+         return wi;
+   }
+
+   return NULL;
+}
+
+
+
+/* fd_watch_thread_func: [fdwatch thread]
+ *  The thread loop function.
+ */
+static void fd_watch_thread_func(_AL_THREAD *self, void *unused)
+{
+   (void)unused;
+
+   while (!_al_get_thread_should_stop(self)) {
+      struct epoll_event events[MAX_EPOLL_EVENTS];
+      int n, i;
+
+      /* wait for something to happen on one of the fds */
+      n = epoll_wait(epoll_fd, events, MAX_EPOLL_EVENTS, -1);
+      if (n < 0) {
+         if (errno == EINTR)
+            continue;
+         ALLEGRO_ERROR("epoll_wait failed: %d\n", errno);
+         break;
+      }
+
+      /* one or more of the fds has activity */
+      _al_mutex_lock(&fd_watch_mutex);
+      {
+         for (i = 0; i < n; i++) {
+            WATCH_ITEM *wi;
+
+            if (events[i].data.fd == wake_fd) {
+               uint64_t count;
+               if (read(wake_fd, &count, sizeof(count)) < 0) {
+                  /* Nothing to do, it was only a wakeup. */
+               }
+               continue;
+            }
+
+            /* An earlier callback may have stopped watching the fd. */
+            wi = find_watch_item(events[i].data.fd);
+            if (wi) {
+               /* The callback is allowed to modify the watch list so the
+                * mutex must be recursive.
+                */
+               wi->callback(wi->cb_data);
+            }
+         }
+      }
+      _al_mutex_unlock(&fd_watch_mutex);
+   }
+}
+
+
+
+static bool start_watch_thread(void)
+{
+   struct epoll_event ev;
+
+   epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+   if (epoll_fd < 0) {
+      ALLEGRO_ERROR("epoll_create1 failed: %d\n", errno);
+      return false;
+   }
+
+   wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+   if (wake_fd < 0) {
+      ALLEGRO_ERROR("eventfd failed: %d\n", errno);
+      close(epoll_fd);
+      epoll_fd = -1;
+      return false;
+   }
+
+   ev.events = EPOLLIN;
+   ev.data.fd = wake_fd;
+   epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev);
+
+   _al_thread_create(&fd_watch_thread, fd_watch_thread_func, NULL);
+   return true;
+}
+
+
+
+static void stop_watch_thread(void)
+{
+   uint64_t one = 1;
+
+   /* The thread sleeps in epoll_wait without a timeout so it has to be
+    * woken up to notice that it should stop.
+    */
+   _al_thread_set_should_stop(&fd_watch_thread);
+   if (write(wake_fd, &one, sizeof(one)) < 0) {
+      ALLEGRO_ERROR("Failed to wake the fd watch thread: %d\n", errno);
+   }
+   _al_thread_join(&fd_watch_thread);
+
+   close(wake_fd);
+   close(epoll_fd);
+   wake_fd = -1;
+   epoll_fd = -1;
+}
+
+
+
+static void add_watch_fd(int fd)
+{
+   struct epoll_event ev;
+
+   ev.events = EPOLLIN;
+   ev.data.fd = fd;
+   if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+      ALLEGRO_ERROR("Failed to watch fd %d: %d\n", fd, errno);
+   }
+}
+
+
+
+static void remove_watch_fd(int fd)
+{
+   /* Fails harmlessly if the fd was already closed. */
+   epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+#else /* !USE_EPOLL */
+
 /* fd_watch_thread_func: [fdwatch thread]
  *  The thread loop function.
  */
@@ -113,6 +277,38 @@ static void fd_watch_thread_func(_AL_THREAD *self, void *unused)
 
 
 
+static bool start_watch_thread(void)
+{
+   _al_thread_create(&fd_watch_thread, fd_watch_thread_func, NULL);
+   return true;
+}
+
+
+
+static void stop_watch_thread(void)
+{
+   _al_thread_join(&fd_watch_thread);
+}
+
+
+
+static void add_watch_fd(int fd)
+{
+   /* Picked up by the thread after its current select times out. */
+   (void)fd;
+}
+
+
+
+static void remove_watch_fd(int fd)
+{
+   (void)fd;
+}
+
+#endif /* !USE_EPOLL */
+
+
+
 /* _al_unix_start_watching_fd: [primary thread]
  * 
  *  Start watching for data on file descriptor `fd'.  This is done in
@@ -135,7 +331,10 @@ void _al_unix_start_watching_fd(int fd, void (*callback)(void *), void *cb_data)
        * list.
        */
       _al_mutex_init_recursive(&fd_watch_mutex);
-      _al_thread_create(&fd_watch_thread, fd_watch_thread_func, NULL);
+      if (!start_watch_thread()) {
+         _al_mutex_destroy(&fd_watch_mutex);
+         return;
+      }
    }
 
    /* now add the watch item to the list */
@@ -146,6 +345,8 @@ void _al_unix_start_watching_fd(int fd, void (*callback)(void *), void *cb_data)
       wi->fd = fd;
       wi->callback = callback;
       wi->cb_data = cb_data;
+
+      add_watch_fd(fd);
    }
    _al_mutex_unlock(&fd_watch_mutex);
 }
@@ -172,6 +373,7 @@ void _al_unix_stop_watching_fd(int fd)
       for (i = 0; i < _al_vector_size(&fd_watch_list); i++) {
          wi = _al_vector_ref(&fd_watch_list, i);
          if (wi->fd == fd) {
+            remove_watch_fd(fd);
             _al_vector_delete_at(&fd_watch_list, i);
             list_empty = _al_vector_is_empty(&fd_watch_list);
             break;
@@ -182,7 +384,7 @@ void _al_unix_stop_watching_fd(int fd)
 
    /* if no more fd's are being watched, stop the background thread */
    if (list_empty) {
-      _al_thread_join(&fd_watch_thread);
+      stop_watch_thread();
       _al_mutex_destroy(&fd_watch_mutex);
       _al_vector_free(&fd_watch_list);
    }
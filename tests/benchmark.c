@@ -0,0 +1,693 @@
+/*
+ *    Benchmark driver for the software graphics routines.
+ *
+ *    Everything is drawn to memory bitmaps, so no display or GPU is
+ *    needed. Each benchmark is repeated for a minimum amount of time and
+ *    its throughput reported in megapixels per second, optionally as CSV
+ *    or JSON so results can be compared between builds.
+ */
+
+#define ALLEGRO_UNSTABLE
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_font.h>
+#include <allegro5/allegro_ttf.h>
+#include <allegro5/allegro_primitives.h>
+
+typedef enum {
+   OUTPUT_TEXT,
+   OUTPUT_CSV,
+   OUTPUT_JSON
+} OutputFormat;
+
+typedef void (*StepFunc)(void *data);
+
+typedef struct {
+   int format;
+   char const *name;
+} Format;
+
+typedef struct {
+   char const *name;
+   int op, src, dst;
+   bool tinted;
+} Blender;
+
+typedef struct {
+   ALLEGRO_BITMAP *src;
+   ALLEGRO_BITMAP *target;
+   ALLEGRO_COLOR tint;
+   int mode;
+} DrawData;
+
+typedef struct {
+   ALLEGRO_BITMAP *texture;
+   ALLEGRO_VERTEX vtx[4];
+} PrimData;
+
+typedef struct {
+   ALLEGRO_FONT *font;
+   int lines;
+} TextData;
+
+typedef struct {
+   ALLEGRO_BITMAP *bitmap;
+   int format;
+   int lock_flags;
+   bool blend;
+} LockData;
+
+static Format formats[] = {
+   { ALLEGRO_PIXEL_FORMAT_ARGB_8888, "ARGB_8888" },
+   { ALLEGRO_PIXEL_FORMAT_RGBA_8888, "RGBA_8888" },
+   { ALLEGRO_PIXEL_FORMAT_ARGB_4444, "ARGB_4444" },
+   { ALLEGRO_PIXEL_FORMAT_RGB_888, "RGB_888" },
+   { ALLEGRO_PIXEL_FORMAT_RGB_565, "RGB_565" },
+   { ALLEGRO_PIXEL_FORMAT_RGB_555, "RGB_555" },
+   { ALLEGRO_PIXEL_FORMAT_RGBA_5551, "RGBA_5551" },
+   { ALLEGRO_PIXEL_FORMAT_ARGB_1555, "ARGB_1555" },
+   { ALLEGRO_PIXEL_FORMAT_ABGR_8888, "ABGR_8888" },
+   { ALLEGRO_PIXEL_FORMAT_XBGR_8888, "XBGR_8888" },
+   { ALLEGRO_PIXEL_FORMAT_BGR_888, "BGR_888" },
+   { ALLEGRO_PIXEL_FORMAT_BGR_565, "BGR_565" },
+   { ALLEGRO_PIXEL_FORMAT_BGR_555, "BGR_555" },
+   { ALLEGRO_PIXEL_FORMAT_RGBX_8888, "RGBX_8888" },
+   { ALLEGRO_PIXEL_FORMAT_XRGB_8888, "XRGB_8888" },
+   { ALLEGRO_PIXEL_FORMAT_ABGR_F32, "ABGR_F32" },
+   { ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, "ABGR_8888_LE" },
+   { ALLEGRO_PIXEL_FORMAT_RGBA_4444, "RGBA_4444" },
+   { ALLEGRO_PIXEL_FORMAT_SINGLE_CHANNEL_8, "SINGLE_CHANNEL_8" }
+};
+
+#define NUM_FORMATS  (int)(sizeof(formats) / sizeof(formats[0]))
+
+static Blender blenders[] = {
+   { "copy", ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO, false },
+   { "premul", ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_INVERSE_ALPHA, false },
+   { "premul_tinted", ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_INVERSE_ALPHA, true },
+   { "alpha", ALLEGRO_ADD, ALLEGRO_ALPHA, ALLEGRO_INVERSE_ALPHA, false },
+   { "additive", ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ONE, false },
+   { "multiply", ALLEGRO_ADD, ALLEGRO_DEST_COLOR, ALLEGRO_ZERO, false },
+   { "subtract", ALLEGRO_DEST_MINUS_SRC, ALLEGRO_ONE, ALLEGRO_ONE, false },
+   { "const_color", ALLEGRO_ADD, ALLEGRO_CONST_COLOR,
+      ALLEGRO_INVERSE_CONST_COLOR, false }
+};
+
+#define NUM_BLENDERS  (int)(sizeof(blenders) / sizeof(blenders[0]))
+
+enum {
+   DRAW_PLAIN,
+   DRAW_TINTED,
+   DRAW_SCALED_UP,
+   DRAW_SCALED_DOWN,
+   DRAW_ROTATED,
+   DRAW_SCALED_ROTATED
+};
+
+static int argc;
+static char **argv;
+static OutputFormat output = OUTPUT_TEXT;
+static double min_time = 0.1;
+static int size = 256;
+static int extra_flags = 0;
+static bool list_only = false;
+static char const *font_filename = "../examples/data/DejaVuSans.ttf";
+static int num_results = 0;
+
+static void fatal_error(char const *msg, ...)
+{
+   va_list ap;
+
+   va_start(ap, msg);
+   fprintf(stderr, "benchmark: ");
+   vfprintf(stderr, msg, ap);
+   fprintf(stderr, "\n");
+   va_end(ap);
+   exit(EXIT_FAILURE);
+}
+
+static bool streq(char const *a, char const *b)
+{
+   return 0 == strcmp(a, b);
+}
+
+/* The remaining command line arguments select benchmarks by prefix. */
+static bool selected(char const *name)
+{
+   int i;
+
+   if (argc == 0)
+      return true;
+   for (i = 0; i < argc; i++) {
+      if (0 == strncmp(name, argv[i], strlen(argv[i])))
+         return true;
+   }
+   return false;
+}
+
+/* Whether any selected benchmark may have a name starting with prefix,
+ * to skip setting up for groups that won't run.
+ */
+static bool group_selected(char const *prefix)
+{
+   int i;
+
+   if (argc == 0 || list_only)
+      return true;
+   for (i = 0; i < argc; i++) {
+      size_t n = strlen(argv[i]);
+      if (n > strlen(prefix))
+         n = strlen(prefix);
+      if (0 == strncmp(prefix, argv[i], n))
+         return true;
+   }
+   return false;
+}
+
+static void report(char const *name, double mpixels, long iterations,
+   double seconds)
+{
+   switch (output) {
+      case OUTPUT_TEXT:
+         printf("%-40s %10.2f Mpix/s  (%ld in %.2fs)\n",
+            name, mpixels, iterations, seconds);
+         break;
+      case OUTPUT_CSV:
+         printf("%s,%.4f,%ld,%.4f\n", name, mpixels, iterations, seconds);
+         break;
+      case OUTPUT_JSON:
+         printf("%s\n    {\"name\": \"%s\", \"mpixels_per_sec\": %.4f, "
+            "\"iterations\": %ld, \"seconds\": %.4f}",
+            num_results > 0 ? "," : "", name, mpixels, iterations, seconds);
+         break;
+   }
+   fflush(stdout);
+   num_results++;
+}
+
+/* Run step until at least min_time has passed, after one untimed run to
+ * warm up caches. pixels is the number of pixels one step processes.
+ */
+static void measure(char const *name, double pixels, StepFunc step,
+   void *data)
+{
+   long iterations = 0;
+   long batch = 1;
+   double t0, elapsed;
+   long i;
+
+   if (!selected(name))
+      return;
+   if (list_only) {
+      printf("%s\n", name);
+      return;
+   }
+
+   step(data);
+
+   t0 = al_get_time();
+   do {
+      for (i = 0; i < batch; i++)
+         step(data);
+      iterations += batch;
+      batch *= 2;
+      elapsed = al_get_time() - t0;
+   } while (elapsed < min_time);
+
+   report(name, pixels * iterations / elapsed / 1e6, iterations, elapsed);
+}
+
+static ALLEGRO_BITMAP *create_bitmap(int w, int h, int format)
+{
+   ALLEGRO_BITMAP *bmp;
+
+   al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP | extra_flags);
+   al_set_new_bitmap_format(format);
+   bmp = al_create_bitmap(w, h);
+   if (!bmp)
+      fatal_error("failed to create %dx%d bitmap", w, h);
+   return bmp;
+}
+
+/* A bitmap with varying colour and (premultiplied) alpha, so blenders
+ * can't take any shortcuts.
+ */
+static ALLEGRO_BITMAP *create_pattern(int w, int h, int format)
+{
+   ALLEGRO_BITMAP *bmp = create_bitmap(w, h, format);
+   ALLEGRO_STATE state;
+   int x, y;
+
+   al_store_state(&state, ALLEGRO_STATE_TARGET_BITMAP | ALLEGRO_STATE_BLENDER);
+   al_set_target_bitmap(bmp);
+   al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO);
+   al_lock_bitmap(bmp, ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_WRITEONLY);
+   for (y = 0; y < h; y++) {
+      for (x = 0; x < w; x++) {
+         float a = ((x + y) % 17) / 16.0f;
+         al_put_pixel(x, y, al_map_rgba_f(a * x / w, a * y / h,
+            a * 0.5f, a));
+      }
+   }
+   al_unlock_bitmap(bmp);
+   al_restore_state(&state);
+   return bmp;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void step_draw(void *data)
+{
+   DrawData *d = data;
+   float w = al_get_bitmap_width(d->src);
+   float h = al_get_bitmap_height(d->src);
+
+   switch (d->mode) {
+      case DRAW_PLAIN:
+         al_draw_bitmap(d->src, 0, 0, 0);
+         break;
+      case DRAW_TINTED:
+         al_draw_tinted_bitmap(d->src, d->tint, 0, 0, 0);
+         break;
+      case DRAW_SCALED_UP:
+         al_draw_scaled_bitmap(d->src, 0, 0, w / 2, h / 2, 0, 0, w, h, 0);
+         break;
+      case DRAW_SCALED_DOWN:
+         al_draw_scaled_bitmap(d->src, 0, 0, w, h, 0, 0, w / 2, h / 2, 0);
+         break;
+      case DRAW_ROTATED:
+         al_draw_rotated_bitmap(d->src, w / 2, h / 2, w / 2, h / 2, 0.3, 0);
+         break;
+      case DRAW_SCALED_ROTATED:
+         al_draw_scaled_rotated_bitmap(d->src, w / 2, h / 2, w / 2, h / 2,
+            0.7, 0.7, 0.3, 0);
+         break;
+   }
+}
+
+static void bench_convert(void)
+{
+   DrawData d;
+   char name[80];
+   int i, j;
+
+   al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO);
+   d.mode = DRAW_PLAIN;
+
+   for (i = 0; i < NUM_FORMATS; i++) {
+      snprintf(name, sizeof name, "convert/%s/", formats[i].name);
+      if (!group_selected(name))
+         continue;
+      d.src = create_pattern(size, size, formats[i].format);
+      for (j = 0; j < NUM_FORMATS; j++) {
+         snprintf(name, sizeof name, "convert/%s/%s",
+            formats[i].name, formats[j].name);
+         if (!group_selected(name))
+            continue;
+         d.target = create_bitmap(size, size, formats[j].format);
+         al_set_target_bitmap(d.target);
+         measure(name, size * size, step_draw, &d);
+         al_destroy_bitmap(d.target);
+      }
+      al_destroy_bitmap(d.src);
+   }
+}
+
+static void bench_blit(void)
+{
+   DrawData d;
+   char name[80];
+   int i;
+
+   d.src = create_pattern(size, size, ALLEGRO_PIXEL_FORMAT_ARGB_8888);
+   d.target = create_pattern(size, size, ALLEGRO_PIXEL_FORMAT_ARGB_8888);
+   d.tint = al_map_rgba_f(0.5, 0.75, 1.0, 0.75);
+   al_set_target_bitmap(d.target);
+   al_set_blend_color(al_map_rgba_f(0.5, 0.5, 0.5, 0.5));
+
+   for (i = 0; i < NUM_BLENDERS; i++) {
+      snprintf(name, sizeof name, "blit/%s", blenders[i].name);
+      al_set_blender(blenders[i].op, blenders[i].src, blenders[i].dst);
+      d.mode = blenders[i].tinted ? DRAW_TINTED : DRAW_PLAIN;
+      measure(name, size * size, step_draw, &d);
+   }
+
+   al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_INVERSE_ALPHA);
+   d.mode = DRAW_SCALED_UP;
+   measure("draw/scaled_up", size * size, step_draw, &d);
+   d.mode = DRAW_SCALED_DOWN;
+   measure("draw/scaled_down", size * size / 4, step_draw, &d);
+   d.mode = DRAW_ROTATED;
+   measure("draw/rotated", size * size, step_draw, &d);
+   d.mode = DRAW_SCALED_ROTATED;
+   measure("draw/scaled_rotated", size * size * 0.49, step_draw, &d);
+   al_destroy_bitmap(d.src);
+
+   extra_flags |= ALLEGRO_MIN_LINEAR | ALLEGRO_MAG_LINEAR;
+   d.src = create_pattern(size, size, ALLEGRO_PIXEL_FORMAT_ARGB_8888);
+   extra_flags &= ~(ALLEGRO_MIN_LINEAR | ALLEGRO_MAG_LINEAR);
+   d.mode = DRAW_SCALED_UP;
+   measure("draw/scaled_up_linear", size * size, step_draw, &d);
+   d.mode = DRAW_SCALED_DOWN;
+   measure("draw/scaled_down_linear", size * size / 4, step_draw, &d);
+
+   al_destroy_bitmap(d.src);
+   al_destroy_bitmap(d.target);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void step_prim(void *data)
+{
+   PrimData *d = data;
+
+   al_draw_prim(d->vtx, NULL, d->texture, 0, 4, ALLEGRO_PRIM_TRIANGLE_FAN);
+}
+
+static void step_filled_rectangle(void *data)
+{
+   ALLEGRO_COLOR *c = data;
+
+   al_draw_filled_rectangle(0, 0, size, size, *c);
+}
+
+static void step_clear(void *data)
+{
+   ALLEGRO_COLOR *c = data;
+
+   al_clear_to_color(*c);
+}
+
+static void set_quad(PrimData *d, ALLEGRO_COLOR c1, ALLEGRO_COLOR c2)
+{
+   int i;
+
+   for (i = 0; i < 4; i++) {
+      d->vtx[i].x = (i == 1 || i == 2) ? size : 0;
+      d->vtx[i].y = (i >= 2) ? size : 0;
+      d->vtx[i].z = 0;
+      /* Repeat the texture a few times, to exercise wrapping. */
+      d->vtx[i].u = d->vtx[i].x * 2.5f;
+      d->vtx[i].v = d->vtx[i].y * 2.5f;
+      d->vtx[i].color = (i == 2) ? c2 : c1;
+   }
+}
+
+static void bench_prim(void)
+{
+   ALLEGRO_BITMAP *target;
+   ALLEGRO_COLOR white = al_map_rgba_f(1, 1, 1, 1);
+   ALLEGRO_COLOR half = al_map_rgba_f(0.25, 0.5, 0.25, 0.5);
+   ALLEGRO_COLOR other = al_map_rgba_f(0.5, 0.125, 0.75, 0.75);
+   PrimData d;
+
+   target = create_pattern(size, size, ALLEGRO_PIXEL_FORMAT_ARGB_8888);
+   d.texture = create_pattern(size / 4, size / 4,
+      ALLEGRO_PIXEL_FORMAT_ARGB_8888);
+   al_set_target_bitmap(target);
+   al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_INVERSE_ALPHA);
+
+   {
+      PrimData solid = d;
+      solid.texture = NULL;
+      set_quad(&solid, half, half);
+      measure("prim/solid", size * size, step_prim, &solid);
+      set_quad(&solid, half, other);
+      measure("prim/gradient", size * size, step_prim, &solid);
+   }
+   set_quad(&d, white, white);
+   measure("prim/textured", size * size, step_prim, &d);
+   set_quad(&d, half, half);
+   measure("prim/textured_tinted", size * size, step_prim, &d);
+   set_quad(&d, half, other);
+   measure("prim/textured_gradient", size * size, step_prim, &d);
+
+   al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO);
+   set_quad(&d, white, white);
+   measure("prim/textured_opaque", size * size, step_prim, &d);
+
+   al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_INVERSE_ALPHA);
+   measure("prim/filled_rectangle", size * size, step_filled_rectangle, &other);
+   measure("prim/filled_rectangle_opaque", size * size, step_filled_rectangle,
+      &white);
+   measure("clear", size * size, step_clear, &other);
+
+   al_destroy_bitmap(d.texture);
+   al_destroy_bitmap(target);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void step_text(void *data)
+{
+   TextData *d = data;
+   ALLEGRO_COLOR c = al_map_rgba_f(0.75, 0.5, 0.25, 1);
+   int h = al_get_font_line_height(d->font);
+   int i;
+
+   for (i = 0; i < d->lines; i++) {
+      al_draw_text(d->font, c, 0, i * h, 0,
+         "The quick brown fox jumps over the lazy dog");
+   }
+}
+
+static void bench_text_font(char const *name, ALLEGRO_FONT *font)
+{
+   TextData d;
+   int w, h;
+
+   d.font = font;
+   h = al_get_font_line_height(font);
+   w = al_get_text_width(font, "The quick brown fox jumps over the lazy dog");
+   d.lines = size / h;
+   if (d.lines < 1)
+      d.lines = 1;
+   measure(name, (double)w * h * d.lines, step_text, &d);
+}
+
+static void bench_text(void)
+{
+   ALLEGRO_BITMAP *target;
+   ALLEGRO_FONT *font;
+
+   target = create_pattern(size * 2, size, ALLEGRO_PIXEL_FORMAT_ARGB_8888);
+   al_set_target_bitmap(target);
+   al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_INVERSE_ALPHA);
+   al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP | extra_flags);
+   al_set_new_bitmap_format(ALLEGRO_PIXEL_FORMAT_ANY_WITH_ALPHA);
+
+   font = al_create_builtin_font();
+   if (font) {
+      bench_text_font("text/builtin", font);
+      al_destroy_font(font);
+   }
+
+   if (group_selected("text/ttf")) {
+      font = al_load_font(font_filename, 16, 0);
+      if (font) {
+         bench_text_font("text/ttf", font);
+         al_destroy_font(font);
+      }
+      else if (!list_only) {
+         fprintf(stderr, "benchmark: failed to load %s, skipping text/ttf\n",
+            font_filename);
+      }
+   }
+
+   al_destroy_bitmap(target);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void step_get_pixel(void *data)
+{
+   LockData *d = data;
+   int w = al_get_bitmap_width(d->bitmap);
+   int h = al_get_bitmap_height(d->bitmap);
+   float sum = 0;
+   int x, y;
+
+   for (y = 0; y < h; y++) {
+      for (x = 0; x < w; x++) {
+         ALLEGRO_COLOR c = al_get_pixel(d->bitmap, x, y);
+         sum += c.r;
+      }
+   }
+   /* Keep the loop from being optimised away. */
+   if (sum < 0)
+      printf("%f\n", sum);
+}
+
+static void step_put_pixel(void *data)
+{
+   LockData *d = data;
+   ALLEGRO_COLOR c = al_map_rgba_f(0.5, 0.25, 0.75, 1);
+   int w = al_get_bitmap_width(d->bitmap);
+   int h = al_get_bitmap_height(d->bitmap);
+   int x, y;
+
+   for (y = 0; y < h; y++) {
+      for (x = 0; x < w; x++) {
+         if (d->blend)
+            al_put_blended_pixel(x, y, c);
+         else
+            al_put_pixel(x, y, c);
+      }
+   }
+}
+
+static void step_lock(void *data)
+{
+   LockData *d = data;
+
+   al_lock_bitmap(d->bitmap, d->format, d->lock_flags);
+   al_unlock_bitmap(d->bitmap);
+}
+
+static void bench_pixel(void)
+{
+   ALLEGRO_BITMAP *small;
+   LockData d;
+
+   d.bitmap = create_pattern(size, size, ALLEGRO_PIXEL_FORMAT_ARGB_8888);
+   al_set_target_bitmap(d.bitmap);
+   al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_INVERSE_ALPHA);
+
+   al_lock_bitmap(d.bitmap, ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_READWRITE);
+   d.blend = false;
+   measure("pixel/get_locked", size * size, step_get_pixel, &d);
+   measure("pixel/put_locked", size * size, step_put_pixel, &d);
+   d.blend = true;
+   measure("pixel/put_blended_locked", size * size, step_put_pixel, &d);
+   al_unlock_bitmap(d.bitmap);
+   al_destroy_bitmap(d.bitmap);
+
+   /* Without a lock every pixel is locked on its own, so use fewer. */
+   small = create_pattern(size / 8, size / 8, ALLEGRO_PIXEL_FORMAT_ARGB_8888);
+   d.bitmap = small;
+   al_set_target_bitmap(small);
+   d.blend = false;
+   measure("pixel/get", (size / 8) * (size / 8), step_get_pixel, &d);
+   measure("pixel/put", (size / 8) * (size / 8), step_put_pixel, &d);
+   al_destroy_bitmap(small);
+
+   d.bitmap = create_pattern(size, size, ALLEGRO_PIXEL_FORMAT_ARGB_8888);
+   d.format = ALLEGRO_PIXEL_FORMAT_ANY;
+   d.lock_flags = ALLEGRO_LOCK_READWRITE;
+   measure("lock/native", size * size, step_lock, &d);
+   d.format = ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE;
+   d.lock_flags = ALLEGRO_LOCK_READONLY;
+   measure("lock/convert_readonly", size * size, step_lock, &d);
+   d.lock_flags = ALLEGRO_LOCK_WRITEONLY;
+   measure("lock/convert_writeonly", size * size, step_lock, &d);
+   d.lock_flags = ALLEGRO_LOCK_READWRITE;
+   measure("lock/convert_readwrite", size * size, step_lock, &d);
+   al_destroy_bitmap(d.bitmap);
+}
+
+/*---------------------------------------------------------------------------*/
+
+const char* help_str =
+" [OPTION]... [BENCHMARK]...\n"
+"\n"
+"Runs the software graphics benchmarks whose names start with any of the\n"
+"given prefixes (e.g. blit/ or convert/ARGB_8888/), or all of them.\n"
+"\n"
+" --csv                 output comma separated values\n"
+" --json                output JSON\n"
+" -l, --list            list the benchmarks instead of running them\n"
+" -t, --time SECONDS    minimum time to run each benchmark (default 0.1)\n"
+" -s, --size PIXELS     width and height of the bitmaps (default 256)\n"
+" --parallel            draw to bitmaps with ALLEGRO_PARALLEL_DRAWING\n"
+" --font FILE           TrueType font for the text benchmark\n";
+
+int main(int _argc, char *_argv[])
+{
+   unsigned int version;
+
+   argc = _argc - 1;
+   argv = _argv + 1;
+
+   for (; argc > 0; argc--, argv++) {
+      char const *opt = argv[0];
+      if (streq(opt, "--csv")) {
+         output = OUTPUT_CSV;
+      }
+      else if (streq(opt, "--json")) {
+         output = OUTPUT_JSON;
+      }
+      else if (streq(opt, "-l") || streq(opt, "--list")) {
+         list_only = true;
+      }
+      else if ((streq(opt, "-t") || streq(opt, "--time")) && argc > 1) {
+         min_time = atof(argv[1]);
+         argc--, argv++;
+      }
+      else if ((streq(opt, "-s") || streq(opt, "--size")) && argc > 1) {
+         size = atoi(argv[1]);
+         if (size < 16)
+            fatal_error("size must be at least 16");
+         argc--, argv++;
+      }
+      else if (streq(opt, "--parallel")) {
+         extra_flags |= ALLEGRO_PARALLEL_DRAWING;
+      }
+      else if (streq(opt, "--font") && argc > 1) {
+         font_filename = argv[1];
+         argc--, argv++;
+      }
+      else if (streq(opt, "-h") || streq(opt, "--help")) {
+         printf("Usage:\n%s%s", _argv[0], help_str);
+         return 0;
+      }
+      else if (opt[0] == '-') {
+         fatal_error("unknown option: %s\nSee --help for usage", opt);
+      }
+      else {
+         break;
+      }
+   }
+
+   if (!al_init()) {
+      fatal_error("failed to initialise Allegro");
+   }
+   al_init_font_addon();
+   al_init_ttf_addon();
+   al_init_primitives_addon();
+
+   version = al_get_allegro_version();
+   if (!list_only) {
+      switch (output) {
+         case OUTPUT_TEXT:
+            printf("# Allegro %d.%d.%d, %dx%d bitmaps\n",
+               version >> 24, (version >> 16) & 255, (version >> 8) & 255,
+               size, size);
+            break;
+         case OUTPUT_CSV:
+            printf("name,mpixels_per_sec,iterations,seconds\n");
+            break;
+         case OUTPUT_JSON:
+            printf("{\n  \"version\": \"%d.%d.%d\",\n  \"size\": %d,\n"
+               "  \"results\": [",
+               version >> 24, (version >> 16) & 255, (version >> 8) & 255,
+               size);
+            break;
+      }
+   }
+
+   bench_convert();
+   bench_blit();
+   bench_prim();
+   bench_text();
+   bench_pixel();
+
+   if (output == OUTPUT_JSON && !list_only)
+      printf("\n  ]\n}\n");
+
+   return 0;
+}
+
+/* vim: set sts=3 sw=3 et: */
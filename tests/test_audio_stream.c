@@ -0,0 +1,157 @@
+/*
+ *    Checks that stream fragments reach the mixer complete and in order.
+ *
+ *    A thread feeds consecutive numbers into streams of 2 to 64 fragments
+ *    while the main thread renders a voice of the null audio driver in
+ *    blocks of varying length.  Every number must come out exactly once,
+ *    in order.  Exits with a non-zero status on failure.
+ */
+
+#define ALLEGRO_UNSTABLE
+#include <stdio.h>
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_audio.h>
+
+#define FREQUENCY       44100
+#define FRAGMENT_LEN    7
+#define MAX_BLOCK       13
+#define WANT_SAMPLES    20000
+#define TIME_LIMIT      5.0
+
+static ALLEGRO_AUDIO_STREAM *stream;
+static volatile bool stop;
+
+static void *feed(ALLEGRO_THREAD *thread, void *arg)
+{
+   float next = 1;
+   int i;
+   (void)thread;
+   (void)arg;
+
+   while (!stop) {
+      float *fragment = al_get_audio_stream_fragment(stream);
+      if (!fragment) {
+         al_rest(0.001);
+         continue;
+      }
+      for (i = 0; i < FRAGMENT_LEN; i++)
+         fragment[i] = next++;
+      if (!al_set_audio_stream_fragment(stream, fragment)) {
+         printf("al_set_audio_stream_fragment failed\n");
+         stop = true;
+      }
+   }
+   return NULL;
+}
+
+/* Returns the number of errors found with a stream of n fragments. */
+static int test_fragments(ALLEGRO_VOICE *voice, unsigned int n)
+{
+   ALLEGRO_MIXER *mixer;
+   ALLEGRO_THREAD *thread;
+   float last = 0;
+   long got = 0;
+   int errors = 0;
+   int block;
+   double t0;
+
+   mixer = al_create_mixer(FREQUENCY, ALLEGRO_AUDIO_DEPTH_FLOAT32,
+      ALLEGRO_CHANNEL_CONF_1);
+   al_set_mixer_quality(mixer, ALLEGRO_MIXER_QUALITY_POINT);
+   al_attach_mixer_to_voice(mixer, voice);
+
+   stream = al_create_audio_stream(n, FRAGMENT_LEN, FREQUENCY,
+      ALLEGRO_AUDIO_DEPTH_FLOAT32, ALLEGRO_CHANNEL_CONF_1);
+   al_set_audio_stream_pan(stream, ALLEGRO_AUDIO_PAN_NONE);
+   al_attach_audio_stream_to_mixer(stream, mixer);
+
+   stop = false;
+   thread = al_create_thread(feed, NULL);
+   al_start_thread(thread);
+
+   t0 = al_get_time();
+   for (block = 0; got < WANT_SAMPLES && al_get_time() - t0 < TIME_LIMIT;
+         block++) {
+      float buf[MAX_BLOCK];
+      unsigned int len = 1 + block % MAX_BLOCK;
+      unsigned int i;
+
+      al_render_voice(voice, buf, len);
+      /* Silence means the feeder fell behind, which is allowed. */
+      for (i = 0; i < len; i++) {
+         if (buf[i] == 0)
+            continue;
+         if (buf[i] != last + 1) {
+            printf("  %u fragments: got %.0f after %.0f\n", n, buf[i], last);
+            errors++;
+         }
+         last = buf[i];
+         got++;
+      }
+   }
+
+   stop = true;
+   al_join_thread(thread, NULL);
+   al_destroy_thread(thread);
+
+   if (got < WANT_SAMPLES) {
+      printf("  %u fragments: only %ld samples played\n", n, got);
+      errors++;
+   }
+   /* A stream of two fragments is never counted as late. */
+   if (n == 2) {
+      ALLEGRO_AUDIO_STATS stats;
+      al_get_audio_stream_stats(stream, &stats);
+      if (stats.late_fragments != 0) {
+         printf("  %u fragments: %u late\n", n, stats.late_fragments);
+         errors++;
+      }
+   }
+   if (al_get_available_audio_stream_fragments(stream) > n) {
+      printf("  %u fragments: %u available\n", n,
+         al_get_available_audio_stream_fragments(stream));
+      errors++;
+   }
+
+   al_destroy_audio_stream(stream);
+   al_detach_mixer(mixer);
+   al_destroy_mixer(mixer);
+   return errors;
+}
+
+int main(void)
+{
+   ALLEGRO_CONFIG *config;
+   ALLEGRO_VOICE *voice;
+   unsigned int n;
+   int errors = 0;
+
+   if (!al_init()) {
+      printf("failed to initialise Allegro\n");
+      return 1;
+   }
+
+   config = al_get_system_config();
+   al_set_config_value(config, "audio", "driver", "null");
+   al_set_config_value(config, "null", "manual", "true");
+   if (!al_install_audio()) {
+      printf("failed to install the null audio driver\n");
+      return 1;
+   }
+
+   voice = al_create_voice(FREQUENCY, ALLEGRO_AUDIO_DEPTH_FLOAT32,
+      ALLEGRO_CHANNEL_CONF_1);
+   if (!voice) {
+      printf("failed to create a voice\n");
+      return 1;
+   }
+
+   for (n = 2; n <= 64; n++)
+      errors += test_fragments(voice, n);
+
+   al_destroy_voice(voice);
+   printf("%s: %d errors\n", errors ? "FAIL" : "OK", errors);
+   return errors ? 1 : 0;
+}
+
+/* vim: set sts=3 sw=3 et: */
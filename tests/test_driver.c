@@ -9,6 +9,7 @@
 #include <math.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <allegro5/allegro.h>
 #include <allegro5/allegro_color.h>
 #include <allegro5/allegro_image.h>
@@ -390,6 +391,7 @@ static int get_pixel_format(char const *v)
       : streq(v, "ALLEGRO_PIXEL_FORMAT_ABGR_F32") ? ALLEGRO_PIXEL_FORMAT_ABGR_F32
       : streq(v, "ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE") ? ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE
       : streq(v, "ALLEGRO_PIXEL_FORMAT_RGBA_4444") ? ALLEGRO_PIXEL_FORMAT_RGBA_4444
+      : streq(v, "ALLEGRO_PIXEL_FORMAT_SINGLE_CHANNEL_8") ? ALLEGRO_PIXEL_FORMAT_SINGLE_CHANNEL_8
       : streq(v, "ALLEGRO_PIXEL_FORMAT_COMPRESSED_RGBA_DXT1") ? ALLEGRO_PIXEL_FORMAT_COMPRESSED_RGBA_DXT1
       : streq(v, "ALLEGRO_PIXEL_FORMAT_COMPRESSED_RGBA_DXT3") ? ALLEGRO_PIXEL_FORMAT_COMPRESSED_RGBA_DXT3
       : streq(v, "ALLEGRO_PIXEL_FORMAT_COMPRESSED_RGBA_DXT5") ? ALLEGRO_PIXEL_FORMAT_COMPRESSED_RGBA_DXT5
@@ -407,13 +409,29 @@ static int get_lock_bitmap_flags(char const *v)
       : atoi(v);
 }
 
-static int get_bitmap_flags(char const *v)
+static int get_bitmap_flag(char const *v)
 {
    return streq(v, "ALLEGRO_MEMORY_BITMAP") ? ALLEGRO_MEMORY_BITMAP
       : streq(v, "ALLEGRO_VIDEO_BITMAP") ? ALLEGRO_VIDEO_BITMAP
+      : streq(v, "ALLEGRO_PARALLEL_DRAWING") ? ALLEGRO_PARALLEL_DRAWING
+      : streq(v, "ALLEGRO_MIN_LINEAR") ? ALLEGRO_MIN_LINEAR
+      : streq(v, "ALLEGRO_MAG_LINEAR") ? ALLEGRO_MAG_LINEAR
       : atoi(v);
 }
 
+static int get_bitmap_flags(char const *v)
+{
+   char buf[81];
+   char *tok;
+   int flags = 0;
+
+   snprintf(buf, sizeof(buf), "%s", v);
+   for (tok = strtok(buf, "|"); tok; tok = strtok(NULL, "|")) {
+      flags |= get_bitmap_flag(tok);
+   }
+   return flags;
+}
+
 static void fill_lock_region(LockRegion *lr, float alphafactor, bool blended)
 {
    int x, y;
@@ -871,6 +889,60 @@ static double bitmap_dissimilarity(ALLEGRO_BITMAP *bmp1, ALLEGRO_BITMAP *bmp2)
    return sqrt(sqerr / (w*h*4.0));
 }
 
+static int bitmap_max_difference(ALLEGRO_BITMAP *bmp1, ALLEGRO_BITMAP *bmp2)
+{
+   ALLEGRO_LOCKED_REGION *lr1;
+   ALLEGRO_LOCKED_REGION *lr2;
+   int x, y, w, h;
+   int maxerr = 0;
+
+   lr1 = al_lock_bitmap(bmp1, ALLEGRO_PIXEL_FORMAT_RGBA_8888,
+      ALLEGRO_LOCK_READONLY);
+   lr2 = al_lock_bitmap(bmp2, ALLEGRO_PIXEL_FORMAT_RGBA_8888,
+      ALLEGRO_LOCK_READONLY);
+
+   w = al_get_bitmap_width(bmp1);
+   h = al_get_bitmap_height(bmp1);
+
+   for (y = 0; y < h; y++) {
+      unsigned char const *data1 =
+         ((unsigned char const *)lr1->data) + y*lr1->pitch;
+      unsigned char const *data2 =
+         ((unsigned char const *)lr2->data) + y*lr2->pitch;
+
+      for (x = 0; x < w*4; x++) {
+         int err = abs((int)data1[x] - (int)data2[x]);
+         if (err > maxerr)
+            maxerr = err;
+      }
+   }
+
+   al_unlock_bitmap(bmp1);
+   al_unlock_bitmap(bmp2);
+
+   return maxerr;
+}
+
+static int bitmap_count_unlike(ALLEGRO_BITMAP *bmp, ALLEGRO_COLOR color)
+{
+   unsigned char r, g, b, a;
+   unsigned char pr, pg, pb, pa;
+   int x, y;
+   int count = 0;
+
+   al_unmap_rgba(color, &r, &g, &b, &a);
+
+   for (y = 0; y < al_get_bitmap_height(bmp); y++) {
+      for (x = 0; x < al_get_bitmap_width(bmp); x++) {
+         al_unmap_rgba(al_get_pixel(bmp, x, y), &pr, &pg, &pb, &pa);
+         if (pr != r || pg != g || pb != b || pa != a)
+            count++;
+      }
+   }
+
+   return count;
+}
+
 static bool check_similarity(ALLEGRO_CONFIG const *cfg,
    char const *testname,
    ALLEGRO_BITMAP *bmp1, ALLEGRO_BITMAP *bmp2, BmpType bmp_type, bool reliable)
@@ -1512,6 +1584,16 @@ static bool do_test(ALLEGRO_CONFIG *cfg, char const *testname,
          set_config_float(cfg, testname, lval, d);
          continue;
       }
+      if (SCANLVAL("max_difference", 2)) {
+         int d = bitmap_max_difference(B(0), B(1));
+         set_config_int(cfg, testname, lval, d);
+         continue;
+      }
+      if (SCANLVAL("count_unlike", 2)) {
+         int n = bitmap_count_unlike(B(0), C(1));
+         set_config_int(cfg, testname, lval, n);
+         continue;
+      }
       if (SCANLVAL("al_color_lab", 3)) {
          ALLEGRO_COLOR rgb = al_color_lab(F(0), F(1), F(2));
          char hex[100];
@@ -1790,6 +1872,16 @@ int main(int _argc, char *_argv[])
    argc--;
    argv++;
 
+   /* Split every conversion of more than a few rows into bands, so that
+    * the tests which convert, clone or lock bitmaps also check that the
+    * banded path gives the same result. This must be set before al_init
+    * reads it, and only takes effect with several CPUs.
+    */
+   al_set_config_value(al_get_system_config(), "graphics",
+      "parallel_conversion", "true");
+   al_set_config_value(al_get_system_config(), "graphics",
+      "parallel_conversion_threshold", "0");
+
    if (!al_init()) {
       fatal_error("failed to initialise Allegro");
    }